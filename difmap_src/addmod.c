@@ -2,6 +2,7 @@
 #include <stdlib.h>
 
 #include "modvis.h"
+#include "modgrid.h"
 #include "obs.h"
 #include "vlbutil.h"
 #include "mapwin.h"
@@ -31,6 +32,33 @@
  */
 
 static int fixmod(Observation *ob, Model *mod, Modcmp *cmp, int doadd);
+
+/*
+ * fixmod() collects the visibilities of each sub-array into blocks of
+ * up to FIX_NVIS visibilities, whose model visibilities are computed
+ * together by modvis_add(). Visibilities whose gridded components have
+ * already been interpolated from a Modgrid are placed at the start of
+ * the block, and the rest at the end.
+ */
+#define FIX_NVIS 8192
+
+typedef struct {
+  Visibility *vis[FIX_NVIS]; /* The visibilities of the block */
+  int base[FIX_NVIS];        /* The baseline indexes of the visibilities */
+  double uu[FIX_NVIS];       /* The U coordinates (wavelengths) */
+  double vv[FIX_NVIS];       /* The V coordinates (wavelengths) */
+  double re[FIX_NVIS];       /* The real parts of the model visibilities */
+  double im[FIX_NVIS];       /* The imaginary parts of the model */
+                             /*  visibilities */
+  int ngrid;                 /* The number of visibilities at the start */
+                             /*  of the block */
+  int ndir;                  /* The number of visibilities at the end of */
+                             /*  the block */
+} Fixblock;
+
+static int fixmod_block(Fixblock *fb, Modvis *mv, Subarray *sub, float freq,
+			int doadd);
+static int fixmod_end(Modgrid *mg, Modvis *mv, Fixblock *fb, int iret);
 static int uvaddmod(Observation *ob, Model *mod);
 static int uvsubmod(Observation *ob, Model *mod);
 
@@ -342,6 +370,9 @@ static int fixmod(Observation *ob, Model *mod, Modcmp *cmp, int doadd)
   int base;      /* The index of baseline visibility being processed */
   int domod;     /* If true use mod argument, otherwise use cmp argument */
   int old_if;    /* State of current IF to be restored on exit */
+  Modgrid *mg;   /* The UV grid of the delta components of mod, or NULL */
+  Modvis *mv;    /* The components in the form used by modvis_add() */
+  Fixblock *fb;  /* The block of visibilities being computed */
 /*
  * Quietly ignore this call if there is no selection to compute model
  * visibilities for.
@@ -375,6 +406,31 @@ static int fixmod(Observation *ob, Model *mod, Modcmp *cmp, int doadd)
  * Record the fact that model visibilities now exist in 'ob'.
  */
   ob->hasmod=1;
+/*
+ * The model visibilities are about to change. Their Cartesian copies
+ * are updated along with them, but the structure-of-arrays view of the
+ * residuals isn't.
+ */
+  ob_cart_stale(ob, CART_VIEW);
+/*
+ * When a large model of delta components is being added, such as a
+ * CLEAN model, interpolating the visibilities of these components from
+ * the FFT of a gridded version of the model is much faster than
+ * computing them directly. new_Modgrid() returns NULL if this would
+ * not be the case.
+ */
+  mg = domod ? new_Modgrid(ob, mod) : NULL;
+/*
+ * Prepare the components for modvis_add(), and allocate the block of
+ * visibilities to pass to it.
+ */
+  mv = new_Modvis(ob, mod, cmp, mg);
+  fb = (Fixblock *) malloc(sizeof(Fixblock));
+  if(!mv || !fb) {
+    if(!fb)
+      lprintf(stderr, "fixmod: Insufficient memory.\n");
+    return fixmod_end(mg, mv, fb, 1);
+  };
 /*
  * Fix all sampled IFs.
  * Note that the model visibilities are particular to this stream and
@@ -391,7 +447,7 @@ static int fixmod(Observation *ob, Model *mod, Modcmp *cmp, int doadd)
  * Get the model of the next IF.
  */
     if(getIF(ob, cif))
-      return 1;
+      return fixmod_end(mg, mv, fb, 1);
 /*
  * Get the factor required to convert the UVW coordinates
  * from light seconds to wavelengths.
@@ -402,6 +458,10 @@ static int fixmod(Observation *ob, Model *mod, Modcmp *cmp, int doadd)
  */
     for(isub=0; isub<ob->nsub; isub++, sub++) {
       Integration *integ = sub->integ;
+/*
+ * Start a new block of visibilities.
+ */
+      fb->ngrid = fb->ndir = 0;
 /*
  * Loop through the integrations of the current sub-array.
  */
@@ -422,36 +482,42 @@ static int fixmod(Observation *ob, Model *mod, Modcmp *cmp, int doadd)
  */
 	  if(!(vis->bad & FLAG_DEL)) {
 /*
- * Accumulate the real and imaginary parts of the model visibility.
- */
-	    float re=0.0, im=0.0;
-	    if(domod) {
-	      for(cmp=mod->head; cmp; cmp=cmp->next)
-		add_cmp_to_modvis(cmp, sub, base, freq, u, v, &re, &im);
-	    } else {
-	      add_cmp_to_modvis(cmp, sub, base, freq, u, v, &re, &im);
-	    };
-/*
- * If subtracting the model, negate the visibility.
- */
-	    if(!doadd) {
-	      re = -re;
-	      im = -im;
-	    };
-/*
- * Add the new model visibilty to the existing one.
- */
-	    add_cart_to_polar(&vis->modamp, &vis->modphs, re, im);
+ * If the gridded components can be interpolated at this UV coordinate,
+ * do so now, and place the visibility at the start of the block.
+ * Otherwise place it at the end of the block, for all of the
+ * components to be computed directly.
+ */
+	    float re=0.0f, im=0.0f;
+	    int slot = mg && modgrid_vis(mg, u, v, &re, &im)==0 ?
+	      fb->ngrid++ : FIX_NVIS - ++fb->ndir;
+	    fb->vis[slot] = vis;
+	    fb->base[slot] = base;
+	    fb->uu[slot] = u;
+	    fb->vv[slot] = v;
+	    fb->re[slot] = re;
+	    fb->im[slot] = im;
+/*
+ * Compute the model visibilities of the block when it is full.
+ */
+	    if(fb->ngrid + fb->ndir >= FIX_NVIS &&
+	       fixmod_block(fb, mv, sub, freq, doadd))
+	      return fixmod_end(mg, mv, fb, 1);
 	  };
 	};
       };
+/*
+ * Compute the model visibilities of the final block of the sub-array.
+ */
+      if(fixmod_block(fb, mv, sub, freq, doadd))
+	return fixmod_end(mg, mv, fb, 1);
     };
 /*
  * Store the modified model in the uvmodel.scr scratch file.
  */
     if(putmodel(ob, cif))
-      return 1;
+      return fixmod_end(mg, mv, fb, 1);
   };
+  fixmod_end(mg, mv, fb, 0);
 /*
  * Reinstate the original IF.
  */
@@ -474,6 +540,82 @@ static int fixmod(Observation *ob, Model *mod, Modcmp *cmp, int doadd)
   return 0;
 }
 
+/*.......................................................................
+ * Compute the model visibilities of a block of visibilities, add or
+ * subtract them from the model visibilities of the block's Visibility
+ * objects, then empty the block. This is a private function of
+ * fixmod().
+ *
+ * Input:
+ *  fb       Fixblock *  The block of visibilities.
+ *  mv         Modvis *  The model components.
+ *  sub      Subarray *  The sub-array of the visibilities.
+ *  freq        float    The frequency of the visibilities (Hz).
+ *  doadd         int    If true add the model.
+ *                       If false subtract the model.
+ * Output:
+ *  return        int    0 - OK.
+ *                       1 - Error.
+ */
+static int fixmod_block(Fixblock *fb, Modvis *mv, Subarray *sub, float freq,
+			int doadd)
+{
+  int first = FIX_NVIS - fb->ndir; /* The first directly computed slot */
+  float sign = doadd ? 1.0f : -1.0f; /* The sign of the new visibilities */
+  int i;
+/*
+ * Compute the components that weren't interpolated from the Modgrid
+ * for the visibilities at the start of the block, then compute all of
+ * the components for those at the end of the block.
+ */
+  if(modvis_add(mv, sub, freq, 0, fb->ngrid, fb->base, fb->uu, fb->vv,
+		fb->re, fb->im) ||
+     modvis_add(mv, sub, freq, 1, fb->ndir, fb->base + first,
+		fb->uu + first, fb->vv + first, fb->re + first,
+		fb->im + first))
+    return 1;
+/*
+ * Add the new model visibilities to the existing ones, negating them
+ * if the model is being subtracted. The Cartesian copies of the model
+ * visibilities are updated in the same way, so that if they were up to
+ * date beforehand, they remain so.
+ */
+  for(i=0; i<FIX_NVIS; i++) {
+    if(i < fb->ngrid || i >= first) {
+      Visibility *vis = fb->vis[i];
+      add_cart_to_polar(&vis->modamp, &vis->modphs, sign * fb->re[i],
+			sign * fb->im[i]);
+      vis->modre += sign * fb->re[i];
+      vis->modim += sign * fb->im[i];
+    } else {
+      i = first - 1;   /* Skip the unused slots */
+    };
+  };
+  fb->ngrid = fb->ndir = 0;
+  return 0;
+}
+
+/*.......................................................................
+ * Delete the resources of fixmod(). This is a private function of
+ * fixmod().
+ *
+ * Input:
+ *  mg    Modgrid *  The UV grid of the model, or NULL.
+ *  mv     Modvis *  The components of the model, or NULL.
+ *  fb   Fixblock *  The block of visibilities, or NULL.
+ *  iret      int    The value to return.
+ * Output:
+ *  return    int    iret.
+ */
+static int fixmod_end(Modgrid *mg, Modvis *mv, Fixblock *fb, int iret)
+{
+  del_Modgrid(mg);
+  del_Modvis(mv);
+  if(fb)
+    free(fb);
+  return iret;
+}
+
 /*.......................................................................
  * Re-arrange the established model and tentative models such
  * that the fixed components of both models become the new established
@@ -785,10 +927,14 @@ int clrmod(Observation *ob, int doold, int donew, int docont)
       Subarray *sub = &ob->sub[isub];
       for(ut=0; ut<sub->ntime; ut++) {
 	Visibility *vis = sub->integ[ut].vis;
-	for(base=0; base<sub->nbase; base++,vis++)
+	for(base=0; base<sub->nbase; base++,vis++) {
 	  vis->modamp = vis->modphs = 0.0f;
+	  vis->modre = vis->modim = 0.0f;
+	};
       };
     };
+    ob_cart_stale(ob, CART_VIEW);
+    ob->cart |= CART_MODEL;
 /*
  * If there is a UV model paging file, have the model cleared there as
  * well.
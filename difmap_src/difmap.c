@@ -43,6 +43,8 @@
 #include "planet.h"
 #include "pb.h"
 #include "mapcor.h"
+#include "partask.h"
+#include "ifcache.h"
 
 extern char *date_str(void);
 
@@ -79,7 +81,8 @@ static struct {
   int p_mintel;   /* Minimum number of telescopes for phase solution */
   int a_mintel;   /* Minimum number of telescopes for amplitude solution */
   int doflag;     /* If true, flag un-correctable baslines */
-} slfpar, slfdef={0.0f,0.0f,0.0f,0.0f,3,4,1};
+  int dostef;     /* If true, solve for gains with the StEFCal schedule */
+} slfpar, slfdef={0.0f,0.0f,0.0f,0.0f,3,4,1,0};
 
 /* Struct to contain parameters for maplot */
 
@@ -116,8 +119,11 @@ static struct {
   int niter;     /* Default max number of iterations */
   float gain;    /* Default CLEAN gain */
   float cutoff;  /* Default residual cut off */
+  int patch;     /* The half-width of the beam patch, or 0 for the */
+                 /*  whole CLEAN area */
+  int clark;     /* True to use Clark/Cotton-Schwab CLEAN */
 } clnpar = {
-  100, 0.05f, 0.0f
+  100, 0.05f, 0.0f, 0, 0
 };
 
 /* The following variable is set by the multi_model command */
@@ -309,6 +315,12 @@ static Template(map_to_rad_fn);
 static Template(rad_to_map_fn);
 static Template(uv_to_wav_fn);
 static Template(wav_to_uv_fn);
+static Template(threads_fn);
+static Template(clnpatch_fn);
+static Template(clnmode_fn);
+static Template(ifcache_fn);
+static Template(selfmode_fn);
+static Template(readmode_fn);
 
 /*
  * Declare the function types below.
@@ -423,6 +435,12 @@ static Functype dmapf_type[] = {
    {rad_to_map_fn,   NORM, 1,1,  "ff",   "00",     "vv",    0 },
    {uv_to_wav_fn,    NORM, 1,1,  "ff",   "00",     "vv",    0 },
    {wav_to_uv_fn,    NORM, 1,1,  "ff",   "00",     "vv",    0 },
+   {threads_fn,      NORM, 0,1,  " i",   " 0",     " v",    1 },
+   {clnpatch_fn,     NORM, 0,1,  " i",   " 0",     " v",    1 },
+   {clnmode_fn,      NORM, 0,1,  " C",   " 0",     " v",    1 },
+   {ifcache_fn,      NORM, 0,1,  " f",   " 0",     " v",    1 },
+   {selfmode_fn,     NORM, 0,1,  " C",   " 0",     " v",    1 },
+   {readmode_fn,     NORM, 0,1,  " C",   " 0",     " v",    1 },
 };
 
 /*
@@ -539,6 +557,12 @@ static char *dmapf_name[] = {
    "rad_to_map",
    "uv_to_wav",
    "wav_to_uv",
+   "threads",
+   "clnpatch",
+   "clnmode",
+   "ifcache",
+   "selfmode",
+   "readmode",
 };
 
 /*
@@ -607,6 +631,8 @@ static int write_marker_commands(FILE *fp);
 
 static int nodata(const char *fname, Obstate state);
 static int nomap(const char *fname);
+static int add_clean_model(Model *clnmod);
+static int clark_clean(Descriptor *invals[], Descriptor *outvals);
 
 /*
  * Enumerate the values of vlbmap->domap.
@@ -851,9 +877,11 @@ static void obs_end()
  * Create a new MapBeam instance for a given mapsize and cellsize.
  *
  * Input:
- *  nx     int  Number of pixels along X-axis of map/beam grid (power of 2).
+ *  nx     int  Number of pixels along X-axis of map/beam grid (see
+ *              mapsize_ok()).
  *  xinc float  The X-axis cellsize of the grid in map xy units.
- *  ny     int  Number of pixels along X-axis of map/beam grid (power of 2).
+ *  ny     int  Number of pixels along Y-axis of map/beam grid (see
+ *              mapsize_ok()).
  *  yinc float  The Y-axis cellsize of the grid in map xy units.
  */
 static Template(mapsize_fn)
@@ -1267,13 +1295,106 @@ static Template(clean_fn)
  */
   lprintf(stdout, "clean: niter=%d  gain=%g  cutoff=%g\n",
 	  clnpar.niter, clnpar.gain, clnpar.cutoff);
+/*
+ * Use Clark/Cotton-Schwab CLEAN?
+ */
+  if(clnpar.clark)
+    return clark_clean(invals, outvals);
 /*
  * CLEAN the map.
  */
   clnmod = mapclean(vlbob, vlbmap, vlbwins, clnpar.niter, clnpar.cutoff,
-		    clnpar.gain, 1);
+		    clnpar.gain, clnpar.patch, 1);
   if(!clnmod)
     return -1;
+/*
+ * If the beam was only subtracted within a patch around each component,
+ * the residual map is only approximate outside the patches, so arrange
+ * for it to be recomputed from the residual visibilities before it is
+ * next used.
+ */
+  if(clnpar.patch > 0)
+    vlbmap->domap = MAP_IS_STALE;
+/*
+ * Add the new components to the tentative model.
+ */
+  return add_clean_model(clnmod);
+}
+
+/*.......................................................................
+ * Perform Clark/Cotton-Schwab CLEAN, on behalf of clean_fn(). Each
+ * major cycle inverts the residual visibilities to a new residual map,
+ * then calls clarkclean() to perform minor cycles on a list of its
+ * brightest pixels. The components of the minor cycles are added to the
+ * tentative model, which the next call to uvinvert() establishes,
+ * thereby subtracting them from the visibilities.
+ *
+ * Input:
+ *  invals    Descriptor ** The arguments of clean_fn().
+ *  outvals   Descriptor *  The return value descriptor of clean_fn().
+ * Output:
+ *  return           int    no_error, or -1 on error.
+ */
+static int clark_clean(Descriptor *invals[], Descriptor *outvals)
+{
+  Model *clnmod;      /* The components of the latest minor cycles */
+  int nleft;          /* The number of components still allowed */
+  int niter;          /* The number of components of the minor cycles */
+  int more;           /* True if another major cycle is needed */
+  int ncycle;         /* The number of major cycles completed */
+/*
+ * Get the max number of components.
+ */
+  nleft = clnpar.niter < 0 ? -clnpar.niter : clnpar.niter;
+/*
+ * Perform major cycles until no more are needed, or the component
+ * limit is reached.
+ */
+  for(ncycle=1; nleft > 0; ncycle++) {
+/*
+ * Recompute the residual map and beam, if needed.
+ */
+    if((vlbmap->domap || vlbmap->dobeam) && invert_fn(invals,0,outvals))
+      return -1;
+    lprintf(stdout, "Major cycle %d: peak residual = %g Jy/beam\n", ncycle,
+	    fabs(vlbmap->maxpix.value) > fabs(vlbmap->minpix.value) ?
+	    vlbmap->maxpix.value : vlbmap->minpix.value);
+/*
+ * Perform the minor cycles.
+ */
+    clnmod = clarkclean(vlbob, vlbmap, vlbwins,
+			clnpar.niter < 0 ? -nleft : nleft, clnpar.cutoff,
+			clnpar.gain, clnpar.patch, 1, &niter, &more);
+    if(!clnmod)
+      return -1;
+/*
+ * The residual map no longer accounts for the model.
+ */
+    if(niter > 0)
+      vlbmap->domap = MAP_IS_STALE;
+/*
+ * Add the new components to the tentative model.
+ */
+    if(add_clean_model(clnmod))
+      return -1;
+    nleft -= niter;
+    if(!more)
+      break;
+  };
+  return no_error;
+}
+
+/*.......................................................................
+ * Add the components of a clean model to the tentative model, after
+ * correcting them for the effects of the primary beams.
+ *
+ * Input:
+ *  clnmod    Model *  The new clean model. This is deleted.
+ * Output:
+ *  return      int    no_error.
+ */
+static int add_clean_model(Model *clnmod)
+{
 /*
  * Correct for the effects of the combined primary beams?
  */
@@ -1758,7 +1879,7 @@ static Template(gscal_fn)
   iret = slfcal(vlbob, -1, 1, slfpar.gauval, slfpar.gaurad,
 		0.0, doamp, dophs, dofloat,
 		(doamp ? slfpar.a_mintel : slfpar.p_mintel),
-		slfpar.doflag, 1, slfpar.maxamp, slfpar.maxphs,
+		slfpar.doflag, 1, slfpar.dostef, slfpar.maxamp, slfpar.maxphs,
 		invpar.uvmin, invpar.uvmax, &flagged);
 /*
  * If data were flagged then mark the beam as invalid.
@@ -2717,7 +2838,7 @@ static Template(self_fn)
   iret = slfcal(vlbob, -1, 1, slfpar.gauval, slfpar.gaurad,
 		solint, doamp, dophs, dofloat,
 		(doamp ? slfpar.a_mintel : slfpar.p_mintel),
-		slfpar.doflag, 0, slfpar.maxamp, slfpar.maxphs,
+		slfpar.doflag, 0, slfpar.dostef, slfpar.maxamp, slfpar.maxphs,
 		invpar.uvmin, invpar.uvmax, &flagged);
 /*
  * If data were flagged then mark the beam as invalid.
@@ -3796,6 +3917,8 @@ static int wrtpars(char *parname, char *basename)
 			     slfpar.gauval, wavtouv(slfpar.gaurad)) < 0;
   waserr = waserr || lprintf(fp, "selflims %g, %g\n",
 			     slfpar.maxamp, slfpar.maxphs * rtod) < 0;
+  waserr = waserr || lprintf(fp, "selfmode %s\n",
+			     slfpar.dostef ? "stefcal" : "relax") < 0;
   waserr = waserr || lprintf(fp, "xyrange %g, %g, %g, %g\n",
 			     radtoxy(mappar.box[0]), radtoxy(mappar.box[1]),
 			     radtoxy(mappar.box[2]), radtoxy(mappar.box[3]))<0;
@@ -3809,6 +3932,9 @@ static int wrtpars(char *parname, char *basename)
   waserr = waserr || lprintf(fp, "integer niter; niter=%d\n", clnpar.niter)<0;
   waserr = waserr || lprintf(fp, "float gain; gain=%g\n", clnpar.gain)<0;
   waserr = waserr || lprintf(fp, "float cutoff; cutoff=%g\n", clnpar.cutoff)<0;
+  waserr = waserr || lprintf(fp, "clnpatch %d\n", clnpar.patch)<0;
+  waserr = waserr || lprintf(fp, "clnmode %s\n",
+			     clnpar.clark ? "clark" : "hogbom")<0;
   waserr = waserr || lprintf(fp, "float cmul; cmul=%g\n", mappar.cmul)<0;
   waserr = waserr || lprintf(fp, "logical docont; docont=%s\n",
 			     mappar.docont ? "true" : "false") < 0;
@@ -5915,7 +6041,10 @@ static Template(shiftto_fn)
  * Create polarization intensity and angle maps above and below the
  * map of the current selection. Note that the beam array is used as
  * a work area during this operation, so vlbmap->dobeam will be 1 after
- * this function has been called.
+ * this function has been called. The streams of Q, U and the current
+ * polarization are composed in a single pass through the UV data, and
+ * the map of the current polarization is made before those of Q and U,
+ * so that it doesn't have to be remade afterwards.
  *
  * Input:
  *  docln    int    If true attempt to restore each map.
@@ -5935,7 +6064,10 @@ static int make_polmap(int docln)
   float *qptr;   /* A pointer into the Q map */
   float *magptr; /* A pointer into the polarization magnitude map */
   float *angptr; /* A pointer into the polarization angle map */
+  float *sptr;   /* A pointer into the saved rows of the current map */
+  long nsave;    /* The number of saved elements of the current map */
   Stokes pol;    /* The currently selected polarization */
+  long j;
   int i;
 /*
  * Check that a map and beam have been allocated and that an observation
@@ -6022,6 +6154,38 @@ static int make_polmap(int docln)
  * want 'uvinvert' to overwrite it with an update of the beam.
  */
   vlbmap->dobeam = 0;
+/*
+ * Compose the streams of Q, U and the current polarization in one pass
+ * through the UV data, so that the following selections don't each
+ * have to re-read it.
+ */
+  {
+    Stokes pols[3];
+    pols[0] = SQ;
+    pols[1] = SU;
+    pols[2] = pol;
+    if(ob_stash_pols(vlbob, pols, 3))
+      return polmap_error(pol);
+  };
+/*
+ * Unless the current polarization is U, whose map will be the last to
+ * be made, make the map of the current polarization now, and save the
+ * central half of its rows, which are the only ones that are displayed,
+ * in the unused second half of the beam array.
+ */
+  nsave = (long) vlbmap->ny/2 * vlbmap->nx;
+  if(pol != SU) {
+    if(vlbmap->domap && !(docln && vlbmap->domap==MAP_IS_CLEAN) &&
+       invert_fn(NULL, 0, NULL))
+      return polmap_error(pol);
+    if(docln && (!vlbmap->ncmp || vlbmap->domap!=MAP_IS_CLEAN) &&
+       restore_fn(NULL,0,NULL) == -1)
+      return polmap_error(pol);
+    sptr = vlbmap->beam + nsave;
+    mptr = vlbmap->map + vlbmap->ny/4 * vlbmap->nx;
+    for(j=0; j<nsave; j++)
+      *sptr++ = *mptr++;
+  };
 /*
  * Make a Q map.
  */
@@ -6079,23 +6243,16 @@ static int make_polmap(int docln)
       *uptr++ = *mptr++;
   };
 /*
- * Create a map of the stokes parameter that was selected on entry to
- * this command.
+ * Reselect the stokes parameter that was selected on entry to this
+ * command, and reinstate the saved rows of its map.
  */
   if(pol != vlbob->stream.pol.type) {
     if(ob_select(vlbob, 0, vlbob->stream.cl, pol))
       return polmap_error(pol);
-/*
- * Create the residual map.
- */
-    vlbmap->domap = MAP_IS_STALE;
-    if(invert_fn(NULL, 0, NULL))
-      return polmap_error(pol);
-/*
- * Create the restored map if possible.
- */
-    if(docln && restore_fn(NULL,0,NULL) == -1)
-      return polmap_error(pol);
+    sptr = vlbmap->beam + nsave;
+    mptr = vlbmap->map + vlbmap->ny/4 * vlbmap->nx;
+    for(j=0; j<nsave; j++)
+      *mptr++ = *sptr++;
   };
 /*
  * Convert the Q and U maps into polarized intensity and polarized
@@ -6293,6 +6450,218 @@ static Template(multi_model_fn)
   return no_error;
 }
 
+/*.......................................................................
+ * Set or report the number of threads that multi-threaded operations,
+ * such as gridding, are allowed to use.
+ *
+ * Input:
+ *  nthread  int   The new number of threads, or 0 to use one thread
+ *                 per online processor.
+ */
+static Template(threads_fn)
+{
+/*
+ * Has the user requested a change?
+ */
+  if(npar > 0) {
+    int nthread = *INTPTR(invals[0]);
+    if(nthread==0)
+      nthread = count_cpus();
+    if(set_nthread(nthread))
+      return -1;
+  };
+/*
+ * Report the current setting.
+ */
+  lprintf(stdout, "Multi-threaded operations will use up to %d thread%s.\n",
+	  get_nthread(), get_nthread()==1 ? "" : "s");
+  return no_error;
+}
+
+/*.......................................................................
+ * Set or report the half-width of the patch of the dirty beam that
+ * 'clean' subtracts around each component.
+ *
+ * Input:
+ *  patch    int   The half-width of the patch (pixels), or 0 to
+ *                 subtract the beam from the whole CLEAN area.
+ */
+static Template(clnpatch_fn)
+{
+/*
+ * Has the user requested a change?
+ */
+  if(npar > 0) {
+    int patch = *INTPTR(invals[0]);
+    if(patch < 0) {
+      lprintf(stderr, "clnpatch: The patch half-width can't be negative.\n");
+      return -1;
+    };
+    clnpar.patch = patch;
+  };
+/*
+ * Report the current setting.
+ */
+  if(clnpar.patch > 0) {
+    lprintf(stdout,
+	    "clean will subtract the beam within %d pixels of each component.\n",
+	    clnpar.patch);
+  } else {
+    lprintf(stdout,
+	    "clean will subtract the beam from the whole CLEAN area.\n");
+  };
+  return no_error;
+}
+
+/*.......................................................................
+ * Set or report the CLEAN algorithm that 'clean' uses.
+ *
+ * Input:
+ *  mode    char *  The name of the algorithm, "hogbom" or "clark".
+ */
+static Template(clnmode_fn)
+{
+  enum {CLN_HOGBOM, CLN_CLARK};
+  static Enumpar modes[] = {{"hogbom", CLN_HOGBOM}, {"clark", CLN_CLARK}};
+  static Enumtab *modetab=NULL; /* Symbol table of mode enumerators */
+/*
+ * Construct the enumerator symbol table if not already done.
+ */
+  if(!modetab &&
+     !(modetab=new_Enumtab(modes, sizeof(modes)/sizeof(Enumpar),
+			   "clnmode: mode")))
+    return -1;
+/*
+ * Has the user requested a change?
+ */
+  if(npar > 0) {
+    Enumpar *mode = find_enum(modetab, *STRPTR(invals[0]));
+    if(!mode)
+      return -1;
+    clnpar.clark = mode->id == CLN_CLARK;
+  };
+/*
+ * Report the current setting.
+ */
+  lprintf(stdout, "clean will use the %s algorithm.\n",
+	  clnpar.clark ? "Clark/Cotton-Schwab" : "Hogbom");
+  return no_error;
+}
+
+/*.......................................................................
+ * Set or report the amount of memory that may be used to keep copies of
+ * corrected IFs in memory, so that they don't have to be re-read from
+ * the IF paging file each time that they are needed.
+ *
+ * Input:
+ *  size   float   The memory budget (megabytes), or 0 to disable the
+ *                 IF cache.
+ */
+static Template(ifcache_fn)
+{
+/*
+ * Has the user requested a change?
+ */
+  if(npar > 0) {
+    float size = *FLTPTR(invals[0]);
+    if(size < 0.0f) {
+      lprintf(stderr, "ifcache: The memory budget can't be negative.\n");
+      return -1;
+    };
+    set_ifcache_budget((size_t) (size * 1048576.0));
+/*
+ * Release any memory that the current observation uses beyond the
+ * new budget.
+ */
+    ifc_trim(vlbob);
+  };
+/*
+ * Report the current setting.
+ */
+  if(get_ifcache_budget() > 0) {
+    lprintf(stdout, "Up to %.0f Mbytes will be used to cache corrected IFs.\n",
+	    get_ifcache_budget() / 1048576.0);
+  } else {
+    lprintf(stdout, "Corrected IFs will not be cached.\n");
+  };
+  return no_error;
+}
+
+/*.......................................................................
+ * Set or report the iteration scheme that 'selfcal' and 'gscale' use to
+ * solve for telescope gains.
+ *
+ * Input:
+ *  mode    char *  The name of the scheme, "relax" or "stefcal".
+ */
+static Template(selfmode_fn)
+{
+  enum {SLF_RELAX, SLF_STEFCAL};
+  static Enumpar modes[] = {{"relax", SLF_RELAX}, {"stefcal", SLF_STEFCAL}};
+  static Enumtab *modetab=NULL; /* Symbol table of mode enumerators */
+/*
+ * Construct the enumerator symbol table if not already done.
+ */
+  if(!modetab &&
+     !(modetab=new_Enumtab(modes, sizeof(modes)/sizeof(Enumpar),
+			   "selfmode: mode")))
+    return -1;
+/*
+ * Has the user requested a change?
+ */
+  if(npar > 0) {
+    Enumpar *mode = find_enum(modetab, *STRPTR(invals[0]));
+    if(!mode)
+      return -1;
+    slfpar.dostef = mode->id == SLF_STEFCAL;
+  };
+/*
+ * Report the current setting.
+ */
+  lprintf(stdout, "selfcal will solve for gains with the %s scheme.\n",
+	  slfpar.dostef ? "StEFCal" : "fixed loop-gain");
+  return no_error;
+}
+
+/*.......................................................................
+ * Set or report how 'observe' reads UV FITS files.
+ *
+ * Input:
+ *  mode    char *  The name of the mode, "twopass" or "spool".
+ */
+static Template(readmode_fn)
+{
+  enum {RD_TWOPASS, RD_SPOOL};
+  static Enumpar modes[] = {{"twopass", RD_TWOPASS}, {"spool", RD_SPOOL}};
+  static Enumtab *modetab=NULL; /* Symbol table of mode enumerators */
+/*
+ * Construct the enumerator symbol table if not already done.
+ */
+  if(!modetab &&
+     !(modetab=new_Enumtab(modes, sizeof(modes)/sizeof(Enumpar),
+			   "readmode: mode")))
+    return -1;
+/*
+ * Has the user requested a change?
+ */
+  if(npar > 0) {
+    Enumpar *mode = find_enum(modetab, *STRPTR(invals[0]));
+    if(!mode)
+      return -1;
+    set_uvf_spool(mode->id == RD_SPOOL);
+  };
+/*
+ * Report the current setting.
+ */
+  if(get_uvf_spool()) {
+    lprintf(stdout,
+	    "observe will read UV FITS files once, spooling their data.\n");
+  } else {
+    lprintf(stdout, "observe will read UV FITS files twice.\n");
+  };
+  return no_error;
+}
+
 /*.......................................................................
  * Add a marker to the list of markers that are to be drawn on subsequent
  * maps, specifying its position by its Right Ascension and Declination.
@@ -90,6 +90,13 @@ Dpage *new_Dpage(int ntime, int nbase, int nchan, int nif, int npol)
   dp->rio = new_Recio("uvdata.scr", IS_SCR, 0, dp->nvis * sizeof(Cvis));
   if(dp->rio==NULL)
     return del_Dpage(dp);
+/*
+ * Where possible, access the file via a memory map, to avoid a system
+ * call per integration. Integrations are mostly read and written in
+ * time order.
+ */
+  if(rec_mmap(dp->rio, REC_SEQUENTIAL))
+    return del_Dpage(dp);
 /*
  * Allocate a visibility buffer of this size.
  */
@@ -0,0 +1,370 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "logio.h"
+#include "obs.h"
+#include "ifcache.h"
+
+/*
+ * The maximum number of bytes that the cached IFs of an observation
+ * may occupy. The default of zero disables the cache.
+ */
+static size_t ifc_budget = 0;
+
+static IFcache *ifcmemerr(IFcache *ifc);
+static int ifc_evict(IFcache *ifc, size_t need, int keep);
+static void ifc_discard(IFcache *ifc, int cif);
+
+/*.......................................................................
+ * Allocate and initialize an empty IF cache.
+ *
+ * Input:
+ *  nif       int   The number of IFs per integration.
+ *  nbase     int   The max number of baselines per integration.
+ *  ntime     int   The number of integrations per IF.
+ * Output:
+ *  return IFcache * The allocated and initialized descriptor, or NULL
+ *                  on error.
+ */
+IFcache *new_IFcache(int nif, int nbase, int ntime)
+{
+  IFcache *ifc;   /* Pointer to the new descriptor */
+  int cif;        /* The index of an IF */
+/*
+ * Attempt to allocate the new descriptor.
+ */
+  ifc = malloc(sizeof(*ifc));
+  if(ifc==NULL)
+    return ifcmemerr(ifc);
+/*
+ * Intialize ifc at least up to the point at which it can safely be passed
+ * to del_IFcache().
+ */
+  ifc->nif = nif;
+  ifc->nbase = nbase;
+  ifc->ntime = ntime;
+  ifc->vis = NULL;
+  ifc->valid = NULL;
+  ifc->used = NULL;
+  ifc->clock = 0;
+  ifc->nbytes = 0;
+/*
+ * Allocate the per-IF arrays.
+ */
+  ifc->vis = malloc(sizeof(Ifvis *) * nif);
+  ifc->valid = malloc(sizeof(char) * nif);
+  ifc->used = malloc(sizeof(unsigned long) * nif);
+  if(ifc->vis==NULL || ifc->valid==NULL || ifc->used==NULL)
+    return ifcmemerr(ifc);
+/*
+ * Start with nothing cached.
+ */
+  for(cif=0; cif<nif; cif++) {
+    ifc->vis[cif] = NULL;
+    ifc->valid[cif] = 0;
+    ifc->used[cif] = 0;
+  };
+  return ifc;
+}
+
+/*.......................................................................
+ * Private cleanup function of new_IFcache() for memory allocation failures.
+ *
+ * Input:
+ *  ifc    IFcache *   The partially initialized IFcache descriptor.
+ * Output:
+ *  return IFcache *   Allways NULL.
+ */
+static IFcache *ifcmemerr(IFcache *ifc)
+{
+  lprintf(stderr, "new_IFcache: Insufficient memory.\n");
+  return del_IFcache(ifc);
+}
+
+/*.......................................................................
+ * Delete an IF cache and the visibilities that it contains.
+ *
+ * Input:
+ *  ifc    IFcache *   A descriptor originally returned by new_IFcache().
+ * Output:
+ *  return IFcache *   Always NULL. Use like ifc=del_IFcache(ifc);
+ */
+IFcache *del_IFcache(IFcache *ifc)
+{
+  if(ifc) {
+    if(ifc->vis) {
+      int cif;
+      for(cif=0; cif<ifc->nif; cif++)
+	ifc_discard(ifc, cif);
+      free(ifc->vis);
+    };
+    if(ifc->valid)
+      free(ifc->valid);
+    if(ifc->used)
+      free(ifc->used);
+    free(ifc);
+  };
+  return NULL;
+}
+
+/*.......................................................................
+ * Copy the corrected visibilities of the IF that is currently in the
+ * Observation structure into the IF cache, discarding the least recently
+ * used IFs if necessary to stay within the memory budget. This should be
+ * called by getIF() just before the current IF is replaced.
+ *
+ * Input:
+ *  ob     Observation *  The observation whose current IF is to be saved.
+ * Output:
+ *  return         int    0 - The IF was cached.
+ *                        1 - The IF wasn't cached, either because there
+ *                            was no fully corrected IF in memory, or
+ *                            because it didn't fit within the budget.
+ *                            This is not an error.
+ */
+int ifc_save(Observation *ob)
+{
+  IFcache *ifc = ob->ifc;   /* The cache of the observation */
+  size_t size;              /* The size of the copy of one IF */
+  Intrec *rec;              /* Pointer into ob->rec[] */
+  Ifvis *cvis;              /* The cache array of the IF */
+  int cif;                  /* The index of the current IF */
+  int ut;                   /* The index of an integration */
+/*
+ * Only fully corrected IFs that have selected channels are cached.
+ */
+  if(!ifc || !ob_ready(ob, OB_GETIF, NULL))
+    return 1;
+  cif = ob->stream.cif;
+  if(ob->ifs[cif].cl == NULL)
+    return 1;
+/*
+ * Work out the memory needed to cache the IF.
+ */
+  size = sizeof(Ifvis) * ifc->nbase * ifc->ntime;
+/*
+ * Discard the least recently used IFs, other than this one, until
+ * there is room for it.
+ */
+  if(ifc_evict(ifc, ifc->vis[cif] ? 0 : size, cif)) {
+    ifc_discard(ifc, cif);
+    return 1;
+  };
+/*
+ * Allocate the cache array of the IF if it doesn't already have one.
+ * Failure to do so simply means that the IF isn't cached.
+ */
+  if(!ifc->vis[cif]) {
+    ifc->vis[cif] = malloc(size);
+    if(!ifc->vis[cif])
+      return 1;
+    ifc->nbytes += size;
+  };
+/*
+ * Copy the visibilities of each integration.
+ */
+  rec = ob->rec;
+  for(ut=0; ut<ob->nrec; ut++,rec++) {
+    Integration *integ = rec->integ;
+    Visibility *vis = integ->vis;
+    int nbase = integ->sub->nbase;
+    int base;
+    cvis = ifc->vis[cif] + (long) ut * ifc->nbase;
+    for(base=0; base<nbase; base++,vis++,cvis++) {
+      cvis->amp = vis->amp;
+      cvis->phs = vis->phs;
+      cvis->wt = vis->wt;
+      cvis->bad = vis->bad;
+    };
+  };
+/*
+ * Mark the copy as valid and most recently used.
+ */
+  ifc->valid[cif] = 1;
+  ifc->used[cif] = ++ifc->clock;
+  return 0;
+}
+
+/*.......................................................................
+ * Copy the cached visibilities of a given IF into the Observation
+ * structure. The caller must then read the UV model of the IF and record
+ * it as the current IF, as done by getIF().
+ *
+ * Since the Observation's copy of the IF may subsequently be changed,
+ * the cached copy is marked as out of date. It is replaced by
+ * ifc_save() when the IF is next swapped out.
+ *
+ * Input:
+ *  ob     Observation *  The observation to restore the IF into.
+ *  cif            int    The index of the IF to restore.
+ * Output:
+ *  return         int    0 - The IF was restored.
+ *                        1 - The IF isn't cached.
+ */
+int ifc_load(Observation *ob, int cif)
+{
+  IFcache *ifc = ob->ifc;   /* The cache of the observation */
+  Intrec *rec;              /* Pointer into ob->rec[] */
+  Ifvis *cvis;              /* The cache array of the IF */
+  int ut;                   /* The index of an integration */
+/*
+ * Is there an up to date copy of the IF?
+ */
+  if(!ifc || cif < 0 || cif >= ifc->nif || !ifc->valid[cif])
+    return 1;
+/*
+ * Copy the visibilities of each integration.
+ */
+  ob_cart_stale(ob, CART_DATA);
+  rec = ob->rec;
+  for(ut=0; ut<ob->nrec; ut++,rec++) {
+    Integration *integ = rec->integ;
+    Visibility *vis = integ->vis;
+    int nbase = integ->sub->nbase;
+    int base;
+    cvis = ifc->vis[cif] + (long) ut * ifc->nbase;
+    for(base=0; base<nbase; base++,vis++,cvis++) {
+      vis->amp = cvis->amp;
+      vis->phs = cvis->phs;
+      vis->wt = cvis->wt;
+      vis->bad = cvis->bad;
+    };
+  };
+/*
+ * Keep the array for the next ifc_save() of this IF, but mark it as
+ * out of date.
+ */
+  ifc->valid[cif] = 0;
+  ifc->used[cif] = ++ifc->clock;
+  return 0;
+}
+
+/*.......................................................................
+ * Mark the cached copy of a given IF, or of all IFs, as out of date.
+ * This must be called whenever the corrections of an IF that isn't
+ * currently in the Observation structure are changed.
+ *
+ * Input:
+ *  ob     Observation *  The observation whose cache is to be updated.
+ *  cif            int    The index of the IF, or -1 for all IFs.
+ */
+void ifc_forget(Observation *ob, int cif)
+{
+  IFcache *ifc = ob ? ob->ifc : NULL;
+  if(ifc) {
+    if(cif < 0) {
+      for(cif=0; cif<ifc->nif; cif++)
+	ifc->valid[cif] = 0;
+    } else if(cif < ifc->nif) {
+      ifc->valid[cif] = 0;
+    };
+  };
+}
+
+/*.......................................................................
+ * Return the cached visibilities of one integration of a given IF. This
+ * is used to apply edits to cached IFs in the same way as to the current
+ * IF.
+ *
+ * Input:
+ *  ob     Observation *  The observation that contains the cache.
+ *  cif            int    The index of the IF.
+ *  irec          long    The record index of the integration (see
+ *                        Integration::irec).
+ * Output:
+ *  return        Ifvis *  The array of visibilities of the integration,
+ *                        ordered like Integration::vis[], or NULL if
+ *                        the IF isn't cached.
+ */
+Ifvis *ifc_integ(Observation *ob, int cif, long irec)
+{
+  IFcache *ifc = ob->ifc;
+  if(!ifc || cif < 0 || cif >= ifc->nif || !ifc->valid[cif] ||
+     irec < 0 || irec >= ifc->ntime)
+    return NULL;
+  return ifc->vis[cif] + irec * ifc->nbase;
+}
+
+/*.......................................................................
+ * Discard cached IFs until the cache of an observation no longer exceeds
+ * the current budget. This should be called after the budget is reduced.
+ *
+ * Input:
+ *  ob     Observation *  The observation whose cache is to be trimmed.
+ */
+void ifc_trim(Observation *ob)
+{
+  if(ob && ob->ifc)
+    (void) ifc_evict(ob->ifc, 0, -1);
+}
+
+/*.......................................................................
+ * Discard the least recently used cached IFs until a given number of
+ * extra bytes can be allocated without exceeding the budget.
+ *
+ * Input:
+ *  ifc    IFcache *  The cache to make room in.
+ *  need    size_t    The number of bytes that are needed.
+ *  keep       int    The index of an IF that mustn't be discarded,
+ *                    or -1.
+ * Output:
+ *  return     int    0 - OK.
+ *                    1 - There isn't enough room.
+ */
+static int ifc_evict(IFcache *ifc, size_t need, int keep)
+{
+  while(ifc->nbytes + need > ifc_budget) {
+    int oldest = -1;  /* The least recently used IF */
+    int cif;
+    for(cif=0; cif<ifc->nif; cif++) {
+      if(ifc->vis[cif] && cif != keep &&
+	 (oldest < 0 || ifc->used[cif] < ifc->used[oldest]))
+	oldest = cif;
+    };
+    if(oldest < 0)
+      return 1;
+    ifc_discard(ifc, oldest);
+  };
+  return 0;
+}
+
+/*.......................................................................
+ * Release the cache array of a given IF.
+ *
+ * Input:
+ *  ifc    IFcache *  The cache that contains the IF.
+ *  cif        int    The index of the IF.
+ */
+static void ifc_discard(IFcache *ifc, int cif)
+{
+  if(ifc->vis[cif]) {
+    free(ifc->vis[cif]);
+    ifc->vis[cif] = NULL;
+    ifc->nbytes -= sizeof(Ifvis) * ifc->nbase * ifc->ntime;
+  };
+  ifc->valid[cif] = 0;
+}
+
+/*.......................................................................
+ * Return the memory budget of the IF cache of each observation.
+ *
+ * Output:
+ *  return  size_t  The budget in bytes (0 means that IFs aren't cached).
+ */
+size_t get_ifcache_budget(void)
+{
+  return ifc_budget;
+}
+
+/*.......................................................................
+ * Set the memory budget of the IF cache of each observation. Existing
+ * caches that exceed a reduced budget are trimmed when ifc_save() or
+ * ifc_trim() is next called for them.
+ *
+ * Input:
+ *  nbytes  size_t  The budget in bytes, or 0 to disable caching.
+ */
+void set_ifcache_budget(size_t nbytes)
+{
+  ifc_budget = nbytes;
+}
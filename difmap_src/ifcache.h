@@ -0,0 +1,70 @@
+#ifndef ifcache_h
+#define ifcache_h
+
+/*
+ * The IF cache keeps memory-resident copies of the corrected
+ * visibilities of IFs that are not currently in the Observation
+ * structure, so that getIF() can reinstate them without re-reading
+ * the ifdata.scr paging file and re-applying corrections. The memory
+ * used by the copies of each observation is limited by a global
+ * budget. When a new copy would exceed this budget, the least recently
+ * used copies are discarded. Discarded IFs are simply re-read from the
+ * paging file the next time that they are needed.
+ */
+
+/* Declare a struct to hold one corrected visibility of a cached IF */
+
+typedef struct {
+  float amp;      /* Amplitude of visibility */
+  float phs;      /* Phase of visibility */
+  float wt;       /* Visibility weight (1/variance) */
+  int bad;        /* The Flagtype flags of the visibility */
+} Ifvis;
+
+/* Declare the container of the cached IFs of an observation */
+
+typedef struct IFcache {
+  int nif;        /* The number of IFs in the observation */
+  int nbase;      /* The max number of baselines per integration */
+  int ntime;      /* The number of integrations per IF */
+  Ifvis **vis;     /* vis[cif] is NULL, or the ntime x nbase cached */
+                  /*  visibilities of IF cif */
+  char *valid;    /* valid[cif] is true if vis[cif] holds an up to */
+                  /*  date copy of IF cif */
+  unsigned long *used; /* used[cif] is the value of 'clock' when IF cif */
+                       /*  was last saved or restored */
+  unsigned long clock; /* A counter incremented on each save or restore */
+  size_t nbytes;  /* The total size of the cached visibility arrays */
+} IFcache;
+
+/* Create and delete the IF cache of an observation */
+
+IFcache *new_IFcache(int nif, int nbase, int ntime);
+IFcache *del_IFcache(IFcache *ifc);
+
+/* Copy the corrected visibilities of the current IF into the cache */
+
+int ifc_save(Observation *ob);
+
+/* Reinstate the visibilities of IF cif from the cache */
+
+int ifc_load(Observation *ob, int cif);
+
+/* Discard the copy of IF cif, or of all IFs if cif is -1 */
+
+void ifc_forget(Observation *ob, int cif);
+
+/* Return the cached visibilities of integration irec of IF cif */
+
+Ifvis *ifc_integ(Observation *ob, int cif, long irec);
+
+/* Discard copies until the cache no longer exceeds the budget */
+
+void ifc_trim(Observation *ob);
+
+/* Get and set the memory budget of all IF caches (bytes) */
+
+size_t get_ifcache_budget(void);
+void set_ifcache_budget(size_t nbytes);
+
+#endif
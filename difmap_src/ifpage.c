@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "logio.h"
 #include "recio.h"
@@ -12,7 +14,25 @@
  */
 static Dvis zero_vis = {0.0f,0.0f,0.0f};
 
+/*
+ * Define the state of the background reader that ip_prefetch() uses to
+ * read the whole of one IF into memory, while the caller gets on with
+ * processing the IF that is currently in the Observation structure.
+ * While the reader thread is running it has exclusive use of ip->rio,
+ * so every other function that uses ip->rio must first call
+ * ip_fetch_wait().
+ */
+typedef struct IPfetch {
+  pthread_t tid;  /* The identifier of the reader thread */
+  int busy;       /* True while the reader thread is running */
+  int cif;        /* The IF whose visibilities are in vis[], or -1 */
+  int ioerr;      /* True if the reader thread failed */
+  Dvis *vis;      /* The ntime x nbase visibilities of IF cif */
+} IPfetch;
+
 static IFpage *ipmemerr(IFpage *ip);
+static void ip_fetch_wait(IFpage *ip);
+static void *ip_fetch_thread(void *arg);
 
 /*.......................................................................
  * Allocate and intialize a IF-paging file descriptor. This is used
@@ -45,6 +65,7 @@ IFpage *new_IFpage(int nif, int nbase, int ntime)
   ip->first = 0;
   ip->nread = 0;
   ip->ioerr = 0;
+  ip->fetch = NULL;
 /*
  * Install input parameters.
  */
@@ -59,6 +80,12 @@ IFpage *new_IFpage(int nif, int nbase, int ntime)
 		      ip->nbase * ip->ntime * sizeof(Dvis));
   if(ip->rio==NULL)
     return del_IFpage(ip);
+/*
+ * Where possible, access the file via a memory map. The integrations
+ * of each IF are mostly read and written in time order.
+ */
+  if(rec_mmap(ip->rio, REC_SEQUENTIAL))
+    return del_IFpage(ip);
 /*
  * Allocate a visibility buffer sufficient to contain one integration of
  * a single IF.
@@ -102,6 +129,16 @@ static IFpage *ipmemerr(IFpage *ip)
 IFpage *del_IFpage(IFpage *ip)
 {
   if(ip) {
+/*
+ * Wait for any background read to complete before discarding its
+ * buffer.
+ */
+    if(ip->fetch) {
+      ip_fetch_wait(ip);
+      if(ip->fetch->vis)
+	free(ip->fetch->vis);
+      free(ip->fetch);
+    };
 /*
  * Close and delete the scratch file.
  */
@@ -143,6 +180,14 @@ int ip_write(IFpage *ip, long ut)
     lprintf(stderr, "ip_write: Integration index out of range.\n");
     return 1;
   };
+/*
+ * Any prefetched copy of the IF is about to become out of date.
+ */
+  if(ip->fetch) {
+    ip_fetch_wait(ip);
+    if(ip->fetch->cif == ip->cif)
+      ip->fetch->cif = -1;
+  };
 /*
  * Position the file if necessary.
  */
@@ -188,6 +233,18 @@ int ip_read(IFpage *ip, long ut)
     lprintf(stderr, "ip_read: Integration index out of range.\n");
     return 1;
   };
+/*
+ * If the IF has been read into memory by ip_prefetch(), copy the
+ * requested visibilities from there.
+ */
+  if(ip->fetch) {
+    ip_fetch_wait(ip);
+    if(ip->fetch->cif == ip->cif) {
+      memcpy(&ip->dvis[ip->first], ip->fetch->vis + ut * ip->nbase + ip->first,
+	     ip->nread * sizeof(Dvis));
+      return 0;
+    };
+  };
 /*
  * Position the file if necessary.
  */
@@ -330,5 +387,112 @@ int ip_clear(IFpage *ip)
  */
 int ip_flush(IFpage *ip)
 {
+  if(ip && ip->fetch)
+    ip_fetch_wait(ip);
   return ip ? rec_flush(ip->rio) : 0;
 }
+
+/*.......................................................................
+ * Start a thread that reads all of the visibilities of a given IF into
+ * memory, so that subsequent ip_read() calls for that IF can be
+ * satisfied without waiting for the paging file. The caller doesn't
+ * need to wait for the read to complete. Other IFpage functions do
+ * that when they next need the paging file.
+ *
+ * Input:
+ *  ip    IFpage *  The IF paging file descriptor.
+ *  cif      int    The index of the IF to be read.
+ * Output:
+ *  return   int    0 - The read was started, or the IF is already
+ *                      in memory.
+ *                  1 - The IF won't be prefetched, either because
+ *                      of an earlier error, or because memory or a
+ *                      thread wasn't available. This is not an error,
+ *                      since ip_read() then simply reads the paging
+ *                      file as usual.
+ */
+int ip_prefetch(IFpage *ip, int cif)
+{
+  IPfetch *fetch;  /* The background reader */
+  if(ip==NULL || ip->ioerr || cif < 0 || cif >= ip->nif)
+    return 1;
+/*
+ * Allocate the background reader on first use.
+ */
+  if(!ip->fetch) {
+    fetch = malloc(sizeof(IPfetch));
+    if(!fetch)
+      return 1;
+    fetch->busy = 0;
+    fetch->cif = -1;
+    fetch->ioerr = 0;
+    fetch->vis = malloc(sizeof(Dvis) * ip->nbase * ip->ntime);
+    if(!fetch->vis) {
+      free(fetch);
+      return 1;
+    };
+    ip->fetch = fetch;
+  };
+  fetch = ip->fetch;
+/*
+ * Wait for any earlier read to finish, and don't re-read an IF that is
+ * already in memory.
+ */
+  ip_fetch_wait(ip);
+  if(fetch->cif == cif)
+    return 0;
+/*
+ * Start the read.
+ */
+  fetch->cif = cif;
+  fetch->ioerr = 0;
+  fetch->busy = 1;
+  if(pthread_create(&fetch->tid, NULL, ip_fetch_thread, ip)) {
+    fetch->busy = 0;
+    fetch->cif = -1;
+    return 1;
+  };
+  return 0;
+}
+
+/*.......................................................................
+ * The start function of the reader thread of ip_prefetch(). This must
+ * not call lprintf(), since that isn't thread-safe. Errors are instead
+ * recorded in ip->fetch->ioerr, and the failed read is then quietly
+ * discarded by ip_fetch_wait().
+ *
+ * Input:
+ *  arg      void *  The IFpage descriptor.
+ * Output:
+ *  return   void *  Always NULL.
+ */
+static void *ip_fetch_thread(void *arg)
+{
+  IFpage *ip = (IFpage *) arg;
+  IPfetch *fetch = ip->fetch;
+  size_t nvis = (size_t) ip->nbase * ip->ntime;
+  if(rec_seek(ip->rio, fetch->cif, 0L) ||
+     (size_t) rec_read(ip->rio, nvis, sizeof(Dvis), fetch->vis) < nvis)
+    fetch->ioerr = 1;
+  return NULL;
+}
+
+/*.......................................................................
+ * Wait for the reader thread of ip_prefetch() to finish, if it is
+ * running. If it failed, its IF is marked as not being in memory, so
+ * that the error is reported when ip_read() next reads the paging file
+ * itself.
+ *
+ * Input:
+ *  ip    IFpage *  The IF paging file descriptor (ip->fetch!=NULL).
+ */
+static void ip_fetch_wait(IFpage *ip)
+{
+  IPfetch *fetch = ip->fetch;
+  if(fetch->busy) {
+    pthread_join(fetch->tid, NULL);
+    fetch->busy = 0;
+    if(fetch->ioerr)
+      fetch->cif = -1;
+  };
+}
@@ -25,6 +25,7 @@ typedef struct {
   int ntime;     /* The number of integrations in the file */
   int nif;       /* The number  of IF's in the file */
   int cif;       /* Index of currently selected IF */
+  struct IPfetch *fetch; /* The background reader of ip_prefetch(), or NULL */
 } IFpage;
 
 /* Open a new binary ifdata.scr scratch file */
@@ -64,4 +65,8 @@ int ip_clear(IFpage *ip);
 
 int ip_flush(IFpage *ip);
 
+/* Start reading IF cif into memory in the background */
+
+int ip_prefetch(IFpage *ip, int cif);
+
 #endif
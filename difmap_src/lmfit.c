@@ -120,6 +120,7 @@ Lmfit *new_Lmfit(void *obj, int nfree, GETFREE(*getfree), SETFREE(*setfree),
   lm->getfree = getfree;
   lm->setfree = setfree;
   lm->getnext = getnext;
+  lm->getsums = 0;
 /*
  * Allocate the contents of the fit containers.
  */
@@ -314,6 +315,74 @@ Lmfit *del_Lmfit(Lmfit *lm)
   return NULL;
 }
 
+/*.......................................................................
+ * Provide an alternative to the getnext() function that was passed to
+ * new_Lmfit(), for accumulating the sums of each iteration. This allows
+ * the caller to divide the data between threads, have each thread
+ * accumulate partial sums with lm_addpoint(), and then add these
+ * together. The getnext() function is not called while a getsums()
+ * function is installed.
+ *
+ * Input:
+ *  lm       Lmfit *  The fit descriptor.
+ *  getsums         A function (declared as GETSUMS(getsums)), or 0 to
+ *                  revert to using getnext(). It will be called once
+ *                  per iteration with zeroed sums, and should add the
+ *                  contributions of all of the data points to them.
+ *                    Input arguments:
+ *                      obj     void * The obj argument of new_Lmfit().
+ *                      nfree    int   The number of free parameters.
+ *                    Input/Output arguments:
+ *                      hessian double **  The nfree x nfree Hessian
+ *                                     matrix. Only the elements of
+ *                                     the lower triangle, including
+ *                                     the diagonal, need be added to.
+ *                      cgrad  double * The nfree elements of the
+ *                                     chi-squared gradient.
+ *                      chisq  double * The chi-squared sum.
+ *                      ndata    long * The number of measurements that
+ *                                     were added.
+ *                    Output arguments:
+ *                      return   int   0 - OK.
+ *                                     1 - Error.
+ */
+void lm_set_getsums(Lmfit *lm, GETSUMS(*getsums))
+{
+  if(lm)
+    lm->getsums = getsums;
+}
+
+/*.......................................................................
+ * Add the contribution of a single measurement to the Hessian matrix,
+ * chi-squared gradient and chi-squared sums of a fit.
+ *
+ * Input:
+ *  nfree       int    The number of free parameters.
+ *  dy       double    The (data - model) residual of the measurement.
+ *  wt       double    The weight of the measurement (1/sigma^2).
+ *  mgrad    double *  The nfree partial derivatives of the model wrt
+ *                     each of the free parameters.
+ * Input/Output:
+ *  hessian  double ** The lower triangle of the Hessian matrix sum.
+ *  cgrad    double *  The nfree elements of the chi-squared gradient sum.
+ *  chisq    double *  The chi-squared sum.
+ */
+void lm_addpoint(int nfree, double dy, double wt, const double *mgrad,
+		 double **hessian, double *cgrad, double *chisq)
+{
+  int row;      /* A row index */
+  int col;      /* A column index */
+  for(row=0; row<nfree; row++) {
+    double tmp = wt * mgrad[row];
+    double *hessian_row = hessian[row];
+    for(col=0; col<=row; col++) {
+      hessian_row[col] += tmp * mgrad[col];
+    };
+    cgrad[row] += dy * tmp;
+  };
+  *chisq += wt * dy * dy;
+}
+
 /*.......................................................................
  * Perform a single iteration of the Levenberg-Marquardt minimization
  * non-linear least-squares technique.
@@ -456,28 +525,31 @@ static int lm_getfit(Lmfit *lm)
  * Initialize the chi-squared sum.
  */
   lm->new.chisq = 0.0;
+/*
+ * Have the user's getsums() function accumulate the sums, if one was
+ * provided.
+ */
+  if(lm->getsums) {
+    long ndata = 0;
+    iret = lm->getsums(lm->obj, lm->nfree, lm->new.hessian, lm->new.cgrad,
+		       &lm->new.chisq, &ndata) ? -1 : 0;
+    lm->new.ndfree += ndata;
+  } else {
 /*
  * Sum over data and model.
  */
-  while((iret=lm->getnext(lm->obj, lm->nfree, &dy, &wt, lm->work))==1) {
-    double *mgrad = lm->work; /* Model gradient */
+    while((iret=lm->getnext(lm->obj, lm->nfree, &dy, &wt, lm->work))==1) {
 /*
  * Record the receipt of a new measurement.
  */
-    lm->new.ndfree++;
+      lm->new.ndfree++;
 /*
  * Add in the contribution to the Hessian matrix, Chi-squared gradient
  * and chi-squared, of the latest measurement.
  */
-    for(row=0; row<lm->nfree; row++) {
-      double tmp = wt * mgrad[row];
-      double *hessian_row = lm->new.hessian[row];
-      for(col=0; col<=row; col++) {
-	hessian_row[col] += tmp * mgrad[col];
-      };
-      lm->new.cgrad[row] += dy * tmp;
+      lm_addpoint(lm->nfree, dy, wt, lm->work, lm->new.hessian, lm->new.cgrad,
+		  &lm->new.chisq);
     };
-    lm->new.chisq += wt * dy * dy;
   };
 /*
  * Fill in the symmetric upper half of the Hessian matrix.
@@ -4,6 +4,7 @@
 #define GETFREE(fn) int (fn)(void *obj, int nfree, double *pars)
 #define SETFREE(fn) int (fn)(void *obj, int nfree, double *pars)
 #define GETNEXT(fn) int (fn)(void *obj, int nfree, double *dy, double *wt, double *mgrad)
+#define GETSUMS(fn) int (fn)(void *obj, int nfree, double **hessian, double *cgrad, double *chisq, long *ndata)
 
 typedef struct {
   double **hessian; /* Linearized hessian matrix: (*hessian[nfree])[nfree] */
@@ -29,6 +30,7 @@ typedef struct {
   GETFREE(*getfree);/* Function to get a copy of the current free parameters */
   SETFREE(*setfree);/* Function to set the current model free parameters */
   GETNEXT(*getnext);/* Get the next data - model,derivatives from iterator */
+  GETSUMS(*getsums);/* Optional replacement for the getnext() loop, or NULL */
 } Lmfit;
 
 /* Construct and intialize a new Levenberg-Marquardt fit object */
@@ -36,6 +38,15 @@ typedef struct {
 Lmfit *new_Lmfit(void *obj, int nfree, GETFREE(*getfree), SETFREE(*setfree),
 		 GETNEXT(*getnext));
 
+/* Have lm_fit() accumulate its sums via getsums() instead of getnext() */
+
+void lm_set_getsums(Lmfit *lm, GETSUMS(*getsums));
+
+/* Add the contribution of one measurement to the sums of a fit */
+
+void lm_addpoint(int nfree, double dy, double wt, const double *mgrad,
+		 double **hessian, double *cgrad, double *chisq);
+
 /* Delete a Levenberg-Marquardt fit object */
 
 Lmfit *del_Lmfit(Lmfit *lm);
@@ -9,11 +9,148 @@
 #include "mapwin.h"
 #include "model.h"
 #include "mapcln.h"
+#include "partask.h"
 
-static float *absmax(float *map, int nx, int ny, Winran *wins, int nwin);
+/*
+ * In order to avoid searching every windowed pixel of the residual map
+ * for the peak residual on each iteration, the CLEAN area is divided
+ * into square blocks of PEAK_BLOCK x PEAK_BLOCK pixels, and the peak of
+ * the windowed pixels of each block is recorded. Whenever pixels of the
+ * map are changed, only the peaks of the blocks that contain those
+ * pixels need to be recomputed, and the peak of the whole map is then
+ * found by searching the much smaller list of block peaks.
+ */
+#define PEAK_BLOCK 32
+
+/*
+ * Record the peak of one block.
+ */
+typedef struct {
+  float maxabs;   /* The max absolute value of the windowed pixels of the */
+                  /*  block, or 0 if none are non-zero */
+  long pix;       /* The index in the map of the pixel that has this */
+                  /*  value, or -1 if maxabs is 0 */
+  int pwin;       /* The index of the first window that contains pix */
+  int uwin;       /* If all of the pixels of the block are first */
+                  /*  encountered in the same window, the index of that */
+                  /*  window, otherwise -1 */
+} Peakblk;
+
+/*
+ * The following object contains the block peaks of a residual map.
+ */
+typedef struct {
+  float *map;     /* The residual map */
+  int nx;         /* The number of pixels along the X-axis of the map */
+  int ixmin;      /* The first X-axis pixel of the CLEAN area */
+  int iymin;      /* The first Y-axis pixel of the CLEAN area */
+  int xwid;       /* The number of pixels along X in the CLEAN area */
+  int ywid;       /* The number of pixels along Y in the CLEAN area */
+  int nbx, nby;   /* The number of blocks along the X and Y axes */
+  int *win;       /* For each pixel of the CLEAN area, the index of the */
+                  /*  first window that contains it, or -1 */
+  Peakblk *blk;   /* The nbx*nby block peaks */
+} Peakidx;
+
+static Peakidx *new_Peakidx(MapBeam *mb, int ixmin, int ixmax, int iymin,
+			    int iymax, Winran *wins, int nwin);
+static Peakidx *del_Peakidx(Peakidx *pk);
+static void peak_update(Peakidx *pk, int iya, int iyb);
+static void peak_reset(Peakidx *pk, int by, int bxa, int bxb);
+static void peak_row(Peakidx *pk, int iy, int bxa, int bxb);
+static float *peak_find(Peakidx *pk);
+
+/*
+ * The beam is subtracted from each row of the residual map, and the
+ * peak absolute value of each block of a row is found, by the
+ * following kernels.
+ */
+#define ROW_SUBTRACT_FN(fn) void (fn)(float *map, const float *beam, \
+				      float cmpval, int n)
+#define ROW_ABSMAX_FN(fn) float (fn)(const float *map, int n)
+
+static ROW_SUBTRACT_FN(sub_row);
+static ROW_ABSMAX_FN(absmax_row);
+
+/*
+ * Where the compiler supports it, versions of the kernels that use the
+ * SSE2 and AVX instructions of x86 processors are also compiled, and
+ * the fastest version that the host processor supports is selected at
+ * run time, by select_kernels().
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || \
+     __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define X86_SIMD 1
+#include <immintrin.h>
+static ROW_SUBTRACT_FN(sub_row_sse2) __attribute__((target("sse2")));
+static ROW_ABSMAX_FN(absmax_row_sse2) __attribute__((target("sse2")));
+static ROW_SUBTRACT_FN(sub_row_avx) __attribute__((target("avx")));
+static ROW_ABSMAX_FN(absmax_row_avx) __attribute__((target("avx")));
+#else
+#define X86_SIMD 0
+#endif
+
+static ROW_SUBTRACT_FN(*row_subtract) = sub_row;
+static ROW_ABSMAX_FN(*row_absmax) = absmax_row;
+static void select_kernels(void);
+
+/*
+ * When more than one thread is allowed, the rows of the area of the
+ * map from which the beam is subtracted are divided between the
+ * threads, in whole rows of peak blocks, provided that each thread is
+ * left with at least SUBCC_THREAD_PIX pixels. Below this, the cost of
+ * starting the threads exceeds the time saved.
+ */
+#define SUBCC_THREAD_PIX 131072L
+
+/*
+ * The following object describes the subtraction of one component.
+ */
+typedef struct {
+  Peakidx *pk;    /* The block peaks of the residual map */
+  float *beam;    /* The beam array */
+  long cntr;      /* The index of the center of the beam */
+  long cmppix;    /* The map index of the pixel of the component */
+  float cmpval;   /* The component value (Jy/Beam) */
+  int xa, xb;     /* The range of columns, xa <= ix < xb, of the CLEAN */
+                  /*  area from which the beam is subtracted */
+  int ya, yb;     /* The range of rows, ya <= iy < yb, of the CLEAN */
+                  /*  area from which the beam is subtracted */
+  int bxa, bxb;   /* The range of columns of blocks, bxa..bxb, and */
+  int bya, byb;   /*  rows of blocks, bya..byb, that contain the above */
+                  /*  pixels */
+} Subcmp;
+
+static void subcc(MapBeam *mb, float *cmpptr, float cmpval, int patch,
+		  Peakidx *pk);
+static PARTASK_FN(subcc_task);
+
+static Winran *clean_wins(MapBeam *mb, Mapwin *mw, int ixmin, int ixmax,
+			  int iymin, int iymax, int *nwin);
+
+/*
+ * The Clark minor cycles only operate on a list of the brightest pixels
+ * of the residual map. If more than CLARK_MAXPIX pixels exceed the
+ * initial flux limit of a minor cycle, the limit is raised until the
+ * list is no longer than this. The raised limit starts from at least
+ * CLARK_MINFRAC times the peak residual, and is raised by a factor of
+ * 1.25 at most CLARK_MAXITER times, after which only the first
+ * CLARK_MAXPIX matching pixels are listed.
+ */
+#define CLARK_MAXPIX 65536L
+#define CLARK_MINFRAC 1.0e-4f
+#define CLARK_MAXITER 64
 
-static void subcc(MapBeam *mb, float *cmpptr, float cmpval,
-		  int ixmin, int ixmax, int iymin, int iymax);
+/*
+ * Record a pixel of the list of the brightest pixels.
+ */
+typedef struct {
+  float value;    /* The latest residual value of the pixel */
+  int ix, iy;     /* The map pixel coordinates of the pixel */
+} Clarkpix;
+
+static long clark_list(Peakidx *pk, float limit, Clarkpix *list);
+static float beam_sidelobe(MapBeam *mb, int xwid, int ywid, int patch);
 
 /*.......................................................................
  * Clean a map using the beam and windows given and with optional
@@ -40,6 +177,13 @@ static void subcc(MapBeam *mb, float *cmpptr, float cmpval,
  *                     be subtracted.
  *  cutoff    float    The residual flux to stop cleaning at. (Jy/Beam).
  *  gain      float    The CLEAN loop gain < 1.0 .
+ *  patch       int    If > 0, the beam of each component is only
+ *                     subtracted from the pixels that lie within
+ *                     'patch' pixels of the component along each
+ *                     axis, rather than from the whole CLEAN area.
+ *                     The rest of the residual map is then only an
+ *                     approximation, and should be recomputed from
+ *                     the visibilities before further use.
  *  docomp      int    If true then compress the model components.
  * Output:
 
@@ -53,11 +197,10 @@ static void subcc(MapBeam *mb, float *cmpptr, float cmpval,
  *                     del_Model() when no longer required.
  */
 Model *mapclean(Observation *ob, MapBeam *mb, Mapwin *mw, int maxcmp,
-		float cutoff, float gain, int docomp)
+		float cutoff, float gain, int patch, int docomp)
 {
-  Subwin *win;          /* A window in the list contained in 'mw' */
   Winran *wins;         /* Array of window indexes */
-  Winran *swin;         /* A window in 'wins' */
+  Peakidx *pk;          /* The block peaks of the residual map */
   Model *mod;           /* The new clean model */
   float *absptr;        /* Contains pointer to the pixel in map with the */
                         /* max absolute value in the map */
@@ -105,47 +248,11 @@ Model *mapclean(Observation *ob, MapBeam *mb, Mapwin *mw, int maxcmp,
   xcent = mb->nx/2;
   ycent = mb->ny/2;
 /*
- * Allocate as many Winran structures as windows in 'mw' or if 'mw'
- * is empty 1 Winran structure to delimit the whole clean area
- * as a window.
+ * Get the pixel ranges of the CLEAN windows.
  */
-  nwin = (mw == NULL || mw->nwin == 0) ? 1:mw->nwin;
-  wins = (Winran *) malloc(nwin * sizeof(Winran));
-  if(wins == NULL) {
-    lprintf(stderr, "Insufficient memory to CLEAN map\n");
+  wins = clean_wins(mb, mw, ixmin, ixmax, iymin, iymax, &nwin);
+  if(!wins)
     return del_Model(mod);
-  };
-/*
- * If no windows were specified set one up to select the whole CLEAN
- * area.
- */
-  if(mw == NULL || mw->nwin == 0) {
-    wins->xa = ixmin;
-    wins->xb = ixmax;
-    wins->ya = iymin;
-    wins->yb = iymax;
-  } else {
-/*
- * Convert the window limits to element ranges and enforce bounds.
- */
-    swin = wins;
-    for(win=mw->head; win != NULL; win=win->next) {
-      if(win_pix(win, mb, ixmin, ixmax, iymin, iymax, swin) == 0)
-	swin++;
-      else
-	nwin--;
-    };
-/*
- * Were there any windows in the clean area?
- */
-    if(nwin==0) {
-      lprintf(stderr,
-	      "clean: All your CLEAN windows lie outside the CLEAN area\n");
-      lprintf(stderr, "clean: No CLEANing performed.\n");
-      free(wins);
-      return del_Model(mod);
-    };
-  };
 /*
  * The cutoff is for comparison to absolute values so enforce positivity.
  */
@@ -169,6 +276,18 @@ Model *mapclean(Observation *ob, MapBeam *mb, Mapwin *mw, int maxcmp,
     free(wins);
     return del_Model(mod);
   };
+/*
+ * Select the fastest row kernels that this processor supports.
+ */
+  select_kernels();
+/*
+ * Index the peaks of the residual map.
+ */
+  pk = new_Peakidx(mb, ixmin, ixmax, iymin, iymax, wins, nwin);
+  if(!pk) {
+    free(wins);
+    return del_Model(mod);
+  };
 /*
  * CLEAN loop.
  */
@@ -177,7 +296,7 @@ Model *mapclean(Observation *ob, MapBeam *mb, Mapwin *mw, int maxcmp,
  * Search the CLEAN windows for the next largest absolute pixel value
  * in the residual map.
  */
-    absptr = absmax(mb->map, mb->nx, mb->ny, wins, nwin);
+    absptr = peak_find(pk);
     if(absptr == NULL) {
       lprintf(stderr, "clean: No flux left in map - finishing early\n");
       break;
@@ -209,7 +328,7 @@ Model *mapclean(Observation *ob, MapBeam *mb, Mapwin *mw, int maxcmp,
 /*
  * Subtract the component from the map.
  */
-    subcc(mb, absptr, maxval, ixmin, ixmax, iymin, iymax);
+    subcc(mb, absptr, maxval, patch, pk);
 /*
  * Keep a record of the flux subtracted so far and report it every 50
  * components.
@@ -248,66 +367,292 @@ Model *mapclean(Observation *ob, MapBeam *mb, Mapwin *mw, int maxcmp,
  */
   mb->ncmp = 0;
   free(wins);
+  del_Peakidx(pk);
   return mod;
 }
 
 /*.......................................................................
- * Find and return a pointer to the pixel containing the max absolute
- * value within windowed areas of a 2D array.
+ * Create the block-peak index of the windowed pixels of a residual map.
+ *
+ * The peak that is returned by peak_find() is the same pixel that a
+ * search of each window in turn, row by row, keeping the first pixel
+ * that exceeds the absolute value of all preceding pixels, would find.
+ * To this end, each pixel of the CLEAN area is labelled with the index
+ * of the first window that contains it, and ties in absolute value are
+ * broken in favor of pixels of earlier windows, then of earlier rows,
+ * then of earlier columns.
+ *
+ * Input:
+ *  mb       MapBeam *  The map and beam container.
+ *  ixmin,ixmax  int    The X-axis pixel range of the CLEAN area.
+ *  iymin,iymax  int    The Y-axis pixel range of the CLEAN area.
+ *  wins      Winran *  The array of nwin CLEAN windows. These must lie
+ *                      within the CLEAN area.
+ *  nwin         int    The number of windows in wins[].
+ * Output:
+ *  return   Peakidx *  The new index, or NULL on error.
+ */
+static Peakidx *new_Peakidx(MapBeam *mb, int ixmin, int ixmax, int iymin,
+			    int iymax, Winran *wins, int nwin)
+{
+  Peakidx *pk;    /* The new index */
+  long npix;      /* The number of pixels in the CLEAN area */
+  long i;
+  int iwin;       /* The index of a window */
+  int ix, iy;     /* The pixel coordinates of a pixel */
+  int bx, by;     /* The block coordinates of a block */
+/*
+ * Allocate the container.
+ */
+  pk = (Peakidx *) malloc(sizeof(Peakidx));
+  if(!pk) {
+    lprintf(stderr, "Insufficient memory to CLEAN map\n");
+    return NULL;
+  };
+/*
+ * Record the geometry of the CLEAN area and its blocks.
+ */
+  pk->map = mb->map;
+  pk->nx = mb->nx;
+  pk->ixmin = ixmin;
+  pk->iymin = iymin;
+  pk->xwid = ixmax - ixmin + 1;
+  pk->ywid = iymax - iymin + 1;
+  pk->nbx = (pk->xwid + PEAK_BLOCK - 1) / PEAK_BLOCK;
+  pk->nby = (pk->ywid + PEAK_BLOCK - 1) / PEAK_BLOCK;
+  pk->win = NULL;
+  pk->blk = NULL;
+/*
+ * Allocate the window labels and the block peaks.
+ */
+  npix = (long) pk->xwid * pk->ywid;
+  pk->win = (int *) malloc(sizeof(int) * npix);
+  pk->blk = (Peakblk *) malloc(sizeof(Peakblk) * pk->nbx * pk->nby);
+  if(!pk->win || !pk->blk) {
+    lprintf(stderr, "Insufficient memory to CLEAN map\n");
+    return del_Peakidx(pk);
+  };
+/*
+ * Label each pixel with the index of the first window that contains it.
+ */
+  for(i=0; i<npix; i++)
+    pk->win[i] = -1;
+  for(iwin=nwin-1; iwin>=0; iwin--) {
+    Winran *wr = wins + iwin;
+    for(iy=wr->ya; iy<=wr->yb; iy++) {
+      int *wptr = pk->win + (long)(iy - iymin) * pk->xwid + (wr->xa - ixmin);
+      for(ix=wr->xa; ix<=wr->xb; ix++)
+	*wptr++ = iwin;
+    };
+  };
+/*
+ * Record which blocks lie entirely within a single window. The peaks of
+ * these blocks can be found without consulting the window labels.
+ */
+  for(by=0; by<pk->nby; by++) {
+    int iya = by * PEAK_BLOCK;
+    int iyb = iya + PEAK_BLOCK < pk->ywid ? iya + PEAK_BLOCK : pk->ywid;
+    for(bx=0; bx<pk->nbx; bx++) {
+      Peakblk *blk = pk->blk + by * pk->nbx + bx;
+      int ixa = bx * PEAK_BLOCK;
+      int ixb = ixa + PEAK_BLOCK < pk->xwid ? ixa + PEAK_BLOCK : pk->xwid;
+      int uwin = pk->win[(long) iya * pk->xwid + ixa];
+      for(iy=iya; iy<iyb && uwin >= 0; iy++) {
+	int *wptr = pk->win + (long) iy * pk->xwid;
+	for(ix=ixa; ix<ixb; ix++) {
+	  if(wptr[ix] != uwin) {
+	    uwin = -1;
+	    break;
+	  };
+	};
+      };
+      blk->uwin = uwin;
+    };
+  };
+/*
+ * Compute the initial peaks of all blocks.
+ */
+  peak_update(pk, iymin, iymax);
+  return pk;
+}
+
+/*.......................................................................
+ * Delete an index that was returned by new_Peakidx().
  *
  * Input:
- *   map  float *   A pointer to the 1st element of the 2D array.
- *   nx   int       Number of elements along the X-axis.
- *   ny   int       Number of elements along the Y-axis.
- *   wins Winran *  Pointer to first element of an array of window
- *                  ranges.
- *   nwin int       The number of elements in Winran.
+ *  pk       Peakidx *  The index to be deleted.
  * Output:
- *   return float * The pointer to the max absolute value in the windowed
- *                  region. If this is NULL then no
- *                  non-zero points were found within the windows.
+ *  return   Peakidx *  The deleted index (always NULL).
+ */
+static Peakidx *del_Peakidx(Peakidx *pk)
+{
+  if(pk) {
+    if(pk->win)
+      free(pk->win);
+    if(pk->blk)
+      free(pk->blk);
+    free(pk);
+  };
+  return NULL;
+}
+
+/*.......................................................................
+ * Recompute the peaks of all blocks that contain any of a given range
+ * of rows of the CLEAN area. This must be called whenever the
+ * pixels in these rows are modified.
+ *
+ * Input:
+ *  pk     Peakidx *  The index to be updated.
+ *  iya        int    The first map row that has been modified.
+ *  iyb        int    The last map row that has been modified.
+ */
+static void peak_update(Peakidx *pk, int iya, int iyb)
+{
+  int by;         /* The index of a row of blocks */
+  int iy;         /* The index of a row of the CLEAN area */
+/*
+ * Get the range of rows of blocks that contain the specified rows.
+ */
+  int bya = (iya - pk->iymin) / PEAK_BLOCK;
+  int byb = (iyb - pk->iymin) / PEAK_BLOCK;
+/*
+ * Rescan all of the rows of each affected row of blocks.
+ */
+  for(by=bya; by<=byb; by++) {
+    int ya = by * PEAK_BLOCK;
+    int yb = ya + PEAK_BLOCK < pk->ywid ? ya + PEAK_BLOCK : pk->ywid;
+    peak_reset(pk, by, 0, pk->nbx - 1);
+    for(iy=ya; iy<yb; iy++)
+      peak_row(pk, iy, 0, pk->nbx - 1);
+  };
+}
+
+/*.......................................................................
+ * Discard the peaks of a given range of blocks within a row of blocks,
+ * in preparation for presenting each of the rows of pixels of these
+ * blocks to peak_row().
+ *
+ * Input:
+ *  pk     Peakidx *  The index to be updated.
+ *  by         int    The index of the row of blocks.
+ *  bxa        int    The index of the first block to be reset.
+ *  bxb        int    The index of the last block to be reset.
+ */
+static void peak_reset(Peakidx *pk, int by, int bxa, int bxb)
+{
+  Peakblk *blk = pk->blk + by * pk->nbx + bxa;
+  int bx;
+  for(bx=bxa; bx<=bxb; bx++, blk++) {
+    blk->maxabs = 0.0f;
+    blk->pix = -1;
+    blk->pwin = blk->uwin;
+  };
+}
+
+/*.......................................................................
+ * Update the peaks of a given range of the blocks that contain a given
+ * row of the CLEAN area, with the pixel values of that row. The rows of
+ * each block must be presented in increasing order, after a call to
+ * peak_reset().
+ *
+ * Input:
+ *  pk     Peakidx *  The index to be updated.
+ *  iy         int    The index of the row wrt the start of the CLEAN
+ *                    area.
+ *  bxa        int    The index of the first block to be updated.
+ *  bxb        int    The index of the last block to be updated.
  */
-static float *absmax(float *map, int nx, int ny, Winran *wins, int nwin)
+static void peak_row(Peakidx *pk, int iy, int bxa, int bxb)
 {
-  float maxabs; /* Max absolute value yet found */
-  float *maxptr;/* Pointer to */
-  int ix,iy;   /* Pixel being examined */
-  float *fptr; /* Pointer into map array */
-  int xwid;    /* Number of pixels along X in current window */
-  int ywid;    /* Number of pixels along Y in current window */
-  int xskip;   /* The number of floats between a right and next left edge */
-  int iwin;    /* Number of current CLEAN window */
-/*
- * Loop through windows and find and record the max absolute value and its
- * pointer. 
- */
-  maxabs = 0.0f;
-  maxptr = NULL;
-  for(iwin=0; iwin < nwin; iwin++, wins++) {
-    xwid = wins->xb - wins->xa + 1;
-    ywid = wins->yb - wins->ya + 1;
-/*
- * Determine the number of pixels between the right edge of the current
- * window and the left edge of the same window on the next row.
- */
-    xskip = nx - xwid;
-/*
- * Pointer to corner of current window with lowest address.
- */
-    fptr = map + wins->xa + wins->ya * nx;
-    for(iy=0; iy < ywid; iy++,fptr += xskip) {
-      for(ix=0; ix < xwid; ix++,fptr++) {
-	if(*fptr < -maxabs || *fptr > maxabs) {
-	  maxabs = (*fptr < 0.0f) ? -(*fptr):*fptr;
-	  maxptr = fptr;
+  long row = (long)(iy + pk->iymin) * pk->nx + pk->ixmin; /* Map index */
+                                                          /*  of the row */
+  float *fptr = pk->map + row;          /* The pixels of the row */
+  int *wptr = pk->win + (long) iy * pk->xwid; /* The window labels */
+  Peakblk *blk = pk->blk + (iy / PEAK_BLOCK) * pk->nbx + bxa;
+  int bx;         /* The index of a block along the row */
+  int ix;         /* The index of a pixel along the row */
+  for(bx=bxa; bx<=bxb; bx++, blk++) {
+    int xa = bx * PEAK_BLOCK;
+    int xb = xa + PEAK_BLOCK < pk->xwid ? xa + PEAK_BLOCK : pk->xwid;
+    float maxabs = blk->maxabs;  /* The max absolute value found so far */
+    long maxpix = blk->pix;      /* The map index of the pixel of maxabs */
+/*
+ * If all of the pixels of the block belong to the same window, then
+ * the first pixel in row-major order that has the largest absolute
+ * value is the peak.
+ */
+    if(blk->uwin >= 0) {
+/*
+ * Find the max absolute value in the row segment, then, if it exceeds
+ * the peak of the preceding rows, locate its first occurrence.
+ */
+      float segmax = row_absmax(fptr + xa, xb - xa);
+      if(segmax > maxabs) {
+	for(ix=xa; fabs(fptr[ix]) != segmax; ix++)
+	  ;
+	maxabs = segmax;
+	maxpix = row + ix;
+      };
+/*
+ * Otherwise ignore pixels that aren't in any window, and break ties
+ * in favor of pixels of earlier windows.
+ */
+    } else {
+      int maxwin = blk->pwin;    /* The window label of maxpix */
+      for(ix=xa; ix<xb; ix++) {
+	int iwin = wptr[ix];
+	if(iwin >= 0) {
+	  float value = fptr[ix];
+	  float absval = value < 0.0f ? -value : value;
+	  if(absval > maxabs ||
+	     (absval == maxabs && maxpix >= 0 && iwin < maxwin)) {
+	    maxabs = absval;
+	    maxpix = row + ix;
+	    maxwin = iwin;
+	  };
 	};
       };
+      blk->pwin = maxwin;
     };
+    blk->maxabs = maxabs;
+    blk->pix = maxpix;
   };
+}
+
+/*.......................................................................
+ * Return a pointer to the windowed pixel of the residual map that has
+ * the largest absolute value.
+ *
+ * Input:
+ *  pk      Peakidx *  The index of the residual map.
+ * Output:
+ *  return    float *  The pointer to the max absolute value in the
+ *                     windowed region. If this is NULL then no non-zero
+ *                     points were found within the windows.
+ */
+static float *peak_find(Peakidx *pk)
+{
+  float maxabs = 0.0f;  /* The max absolute value found so far */
+  long maxpix = -1;     /* The map index of the pixel of maxabs */
+  int maxwin = -1;      /* The window label of maxpix */
+  int nblk = pk->nbx * pk->nby;  /* The number of blocks */
+  int i;
 /*
- * Return the pointer to the pixel of the max absolute value.
+ * Find the block with the largest peak, breaking ties in favor of
+ * pixels of earlier windows, then of earlier pixels.
  */
-  return maxptr;
+  for(i=0; i<nblk; i++) {
+    Peakblk *blk = pk->blk + i;
+    if(blk->pix >= 0 && blk->maxabs >= maxabs) {
+      if(blk->maxabs > maxabs || blk->pwin < maxwin ||
+	 (blk->pwin == maxwin && blk->pix < maxpix)) {
+	maxabs = blk->maxabs;
+	maxpix = blk->pix;
+	maxwin = blk->pwin;
+      };
+    };
+  };
+  return maxpix >= 0 ? pk->map + maxpix : NULL;
 }
 
 /*.......................................................................
@@ -318,52 +663,673 @@ static float *absmax(float *map, int nx, int ny, Winran *wins, int nwin)
  * Input:
  *  cmpptr float * The address of the component pixel in the map.
  *  cmpval float   The component value (Jy/Beam).
- *  ixmin  int     The X pixel at the left edge of the CLEAN area.
- *  ixmax  int     The X pixel at the right edge of the CLEAN area.
- *  iymin  int     The Y pixel at the lower edge of the CLEAN area.
- *  iymax  int     The Y pixel at the upper edge of the CLEAN area.
+ *  patch    int   If > 0, only subtract the beam from pixels that are
+ *                 within this many pixels of the component along both
+ *                 axes. Otherwise subtract it from the whole CLEAN
+ *                 area.
+ * Input/Output:
+ *  pk   Peakidx * The block peaks of the residual map. These are
+ *                 updated to account for the subtracted component.
  */
-static void subcc(MapBeam *mb, float *cmpptr, float cmpval,
-		  int ixmin, int ixmax, int iymin, int iymax)
+static void subcc(MapBeam *mb, float *cmpptr, float cmpval, int patch,
+		  Peakidx *pk)
 {
-  int xwid;    /* Width of CLEAN area in pixels along X axis */
-  int ywid;    /* Width of CLEAN area in pixels along Y axis */
-  int xskip;   /* No. of pixels between left and right edges of CLEAN area */
-  int ix,iy;   /* Used to record position within xwid and ywid */
-  int cntr;    /* Offset in floats to centre of map and beam arrays */
-  float *mptr; /* Pointer into the map */
-  float *bptr; /* Pointer into the beam array */
+  Subcmp sc;   /* The description of the subtraction */
+  long npix;   /* The number of pixels from which the beam is subtracted */
+  int nthread; /* The number of threads to use */
+  int cx, cy;  /* The position of the component wrt the CLEAN area */
+/*
+ * Locate the component within the CLEAN area.
+ */
+  sc.pk = pk;
+  sc.beam = mb->beam;
+  sc.cntr = mb->nx/2 + (long) mb->nx * (mb->ny/2);
+  sc.cmppix = cmpptr - mb->map;
+  sc.cmpval = cmpval;
+  cx = sc.cmppix % mb->nx - pk->ixmin;
+  cy = sc.cmppix / mb->nx - pk->iymin;
 /*
- * Determine the size of the clean area in pixels.
+ * Determine the area of the CLEAN area from which the beam is to be
+ * subtracted.
  */
+  if(patch > 0) {
+    sc.xa = cx - patch > 0 ? cx - patch : 0;
+    sc.xb = cx + patch < pk->xwid ? cx + patch + 1 : pk->xwid;
+    sc.ya = cy - patch > 0 ? cy - patch : 0;
+    sc.yb = cy + patch < pk->ywid ? cy + patch + 1 : pk->ywid;
+  } else {
+    sc.xa = sc.ya = 0;
+    sc.xb = pk->xwid;
+    sc.yb = pk->ywid;
+  };
+/*
+ * Get the ranges of blocks whose peaks have to be updated.
+ */
+  sc.bxa = sc.xa / PEAK_BLOCK;
+  sc.bxb = (sc.xb - 1) / PEAK_BLOCK;
+  sc.bya = sc.ya / PEAK_BLOCK;
+  sc.byb = (sc.yb - 1) / PEAK_BLOCK;
+/*
+ * Decide how many threads to use.
+ */
+  npix = (long) (sc.xb - sc.xa) * (sc.yb - sc.ya);
+  nthread = get_nthread();
+  if(nthread > npix / SUBCC_THREAD_PIX)
+    nthread = npix / SUBCC_THREAD_PIX;
+  if(nthread > sc.byb - sc.bya + 1)
+    nthread = sc.byb - sc.bya + 1;
+/*
+ * Subtract the component.
+ */
+  run_partask(nthread, subcc_task, &sc);
+  return;
+}
+
+/*.......................................................................
+ * This is the task function that subcc() runs in each thread. It
+ * subtracts the beam from its share of the rows of blocks that the
+ * subtraction touches, updating the block peaks of each row while its
+ * pixels are still in the cache.
+ */
+static PARTASK_FN(subcc_task)
+{
+  Subcmp *sc = (Subcmp *) data;
+  Peakidx *pk = sc->pk;
+  long ia, ib;   /* The range of rows of blocks to be processed */
+  long by;       /* The index of a row of blocks */
+  int iy;        /* The index of a row of the CLEAN area */
+  partask_range(sc->byb - sc->bya + 1, ithread, nthread, &ia, &ib);
+  for(by=sc->bya + ia; by<sc->bya + ib; by++) {
+    int ya = by * PEAK_BLOCK;
+    int yb = ya + PEAK_BLOCK < pk->ywid ? ya + PEAK_BLOCK : pk->ywid;
+    peak_reset(pk, by, sc->bxa, sc->bxb);
+    for(iy=ya; iy<yb; iy++) {
+/*
+ * Subtract the beam from the part of this row that is within the
+ * subtraction area.
+ */
+      if(iy >= sc->ya && iy < sc->yb) {
+	long pix = (long) (iy + pk->iymin) * pk->nx + pk->ixmin + sc->xa;
+	row_subtract(pk->map + pix, sc->beam + sc->cntr + (pix - sc->cmppix),
+		     sc->cmpval, sc->xb - sc->xa);
+      };
+/*
+ * Rows of the affected blocks that lie outside the subtraction area
+ * are unchanged, but must still be rescanned, because the peak of a
+ * block is recomputed from all of its rows.
+ */
+      peak_row(pk, iy, sc->bxa, sc->bxb);
+    };
+  };
+}
+
+/*.......................................................................
+ * Select the fastest versions of the row kernels that the host
+ * processor supports.
+ */
+static void select_kernels(void)
+{
+#if X86_SIMD
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx")) {
+    row_subtract = sub_row_avx;
+    row_absmax = absmax_row_avx;
+  } else if(__builtin_cpu_supports("sse2")) {
+    row_subtract = sub_row_sse2;
+    row_absmax = absmax_row_sse2;
+  };
+#endif
+}
+
+/*.......................................................................
+ * Subtract a scaled copy of a row of the beam from a row of the map.
+ *
+ * Input/Output:
+ *  map     float *  The n pixels of the map row.
+ * Input:
+ *  beam    float *  The n corresponding pixels of the beam.
+ *  cmpval  float    The scale factor of the beam.
+ *  n         int    The number of pixels in the row.
+ */
+static ROW_SUBTRACT_FN(sub_row)
+{
+  int i;
+  for(i=0; i<n; i++)
+    map[i] -= beam[i] * cmpval;
+}
+
+/*.......................................................................
+ * Return the max absolute value of the pixels of a row of the map.
+ *
+ * Input:
+ *  map     float *  The n pixels of the map row.
+ *  n         int    The number of pixels in the row.
+ * Output:
+ *  return  float    The max absolute value, or 0 if n is 0.
+ */
+static ROW_ABSMAX_FN(absmax_row)
+{
+  float maxabs = 0.0f;
+  int i;
+  for(i=0; i<n; i++) {
+    float absval = fabs(map[i]);
+    maxabs = absval > maxabs ? absval : maxabs;
+  };
+  return maxabs;
+}
+
+#if X86_SIMD
+/*
+ * The SIMD versions of the above kernels. Note that the multiplications
+ * and subtractions are performed separately, as in the scalar versions,
+ * so that the results are identical.
+ */
+static ROW_SUBTRACT_FN(sub_row_sse2)
+{
+  __m128 scale = _mm_set1_ps(cmpval);
+  int i;
+  for(i=0; i+4 <= n; i += 4) {
+    __m128 m = _mm_loadu_ps(map + i);
+    __m128 b = _mm_loadu_ps(beam + i);
+    _mm_storeu_ps(map + i, _mm_sub_ps(m, _mm_mul_ps(b, scale)));
+  };
+  for(; i<n; i++)
+    map[i] -= beam[i] * cmpval;
+}
+
+static ROW_ABSMAX_FN(absmax_row_sse2)
+{
+  __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 vmax = _mm_setzero_ps();
+  float part[4];
+  float maxabs;
+  int i;
+  for(i=0; i+4 <= n; i += 4)
+    vmax = _mm_max_ps(vmax, _mm_and_ps(_mm_loadu_ps(map + i), mask));
+  _mm_storeu_ps(part, vmax);
+  maxabs = part[0];
+  if(part[1] > maxabs) maxabs = part[1];
+  if(part[2] > maxabs) maxabs = part[2];
+  if(part[3] > maxabs) maxabs = part[3];
+  for(; i<n; i++) {
+    float absval = fabs(map[i]);
+    maxabs = absval > maxabs ? absval : maxabs;
+  };
+  return maxabs;
+}
+
+static ROW_SUBTRACT_FN(sub_row_avx)
+{
+  __m256 scale = _mm256_set1_ps(cmpval);
+  int i;
+  for(i=0; i+8 <= n; i += 8) {
+    __m256 m = _mm256_loadu_ps(map + i);
+    __m256 b = _mm256_loadu_ps(beam + i);
+    _mm256_storeu_ps(map + i, _mm256_sub_ps(m, _mm256_mul_ps(b, scale)));
+  };
+  for(; i<n; i++)
+    map[i] -= beam[i] * cmpval;
+}
+
+static ROW_ABSMAX_FN(absmax_row_avx)
+{
+  __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 vmax = _mm256_setzero_ps();
+  float part[8];
+  float maxabs = 0.0f;
+  int i;
+  for(i=0; i+8 <= n; i += 8)
+    vmax = _mm256_max_ps(vmax, _mm256_and_ps(_mm256_loadu_ps(map + i), mask));
+  _mm256_storeu_ps(part, vmax);
+  for(i=0; i<8; i++)
+    maxabs = part[i] > maxabs ? part[i] : maxabs;
+  for(i=n - n % 8; i<n; i++) {
+    float absval = fabs(map[i]);
+    maxabs = absval > maxabs ? absval : maxabs;
+  };
+  return maxabs;
+}
+#endif
+
+/*.......................................................................
+ * Convert the list of CLEAN windows of a map to an array of pixel
+ * ranges within the CLEAN area.
+ *
+ * Input:
+ *  mb       MapBeam *  The map and beam container.
+ *  mw        Mapwin *  The list of CLEAN windows. If this is NULL, or
+ *                      contains no windows, a single window that
+ *                      covers the whole CLEAN area is returned.
+ *  ixmin,ixmax  int    The X-axis pixel range of the CLEAN area.
+ *  iymin,iymax  int    The Y-axis pixel range of the CLEAN area.
+ * Output:
+ *  nwin         int *  The number of windows in the returned array.
+ *  return    Winran *  The malloc'd array of windows, or NULL on
+ *                      error, or if none of the windows overlap the
+ *                      CLEAN area.
+ */
+static Winran *clean_wins(MapBeam *mb, Mapwin *mw, int ixmin, int ixmax,
+			  int iymin, int iymax, int *nwin)
+{
+  Subwin *win;          /* A window in the list contained in 'mw' */
+  Winran *wins;         /* Array of window indexes */
+  Winran *swin;         /* A window in 'wins' */
+/*
+ * Allocate as many Winran structures as windows in 'mw' or if 'mw'
+ * is empty 1 Winran structure to delimit the whole clean area
+ * as a window.
+ */
+  *nwin = (mw == NULL || mw->nwin == 0) ? 1:mw->nwin;
+  wins = (Winran *) malloc(*nwin * sizeof(Winran));
+  if(wins == NULL) {
+    lprintf(stderr, "Insufficient memory to CLEAN map\n");
+    return NULL;
+  };
+/*
+ * If no windows were specified set one up to select the whole CLEAN
+ * area.
+ */
+  if(mw == NULL || mw->nwin == 0) {
+    wins->xa = ixmin;
+    wins->xb = ixmax;
+    wins->ya = iymin;
+    wins->yb = iymax;
+  } else {
+/*
+ * Convert the window limits to element ranges and enforce bounds.
+ */
+    swin = wins;
+    for(win=mw->head; win != NULL; win=win->next) {
+      if(win_pix(win, mb, ixmin, ixmax, iymin, iymax, swin) == 0)
+	swin++;
+      else
+	(*nwin)--;
+    };
+/*
+ * Were there any windows in the clean area?
+ */
+    if(*nwin==0) {
+      lprintf(stderr,
+	      "clean: All your CLEAN windows lie outside the CLEAN area\n");
+      lprintf(stderr, "clean: No CLEANing performed.\n");
+      free(wins);
+      return NULL;
+    };
+  };
+  return wins;
+}
+
+/*.......................................................................
+ * Perform one set of Clark CLEAN minor cycles on a residual map.
+ *
+ * The minor cycles don't modify the residual map. Instead, a list is
+ * made of the windowed pixels whose absolute values exceed the product
+ * of the peak residual and the largest sidelobe of the dirty beam that
+ * lies outside the beam patch. CLEAN components are then found in this
+ * list alone, subtracting only the beam patch of each component from
+ * the other pixels of the list, until the peak of the list falls to
+ * this flux limit. Beyond this point, the approximation of the
+ * truncated beam would start to make the list misleading, so a major
+ * cycle is then needed, in which the caller subtracts the components
+ * from the visibilities and computes a new residual map.
+ *
+ * Input:
+ *  ob  Observation *  The observation responsible for the map.
+ * Input/Ouput:
+ *  mb      MapBeam *  The residual map and beam. The residual map is
+ *                     not modified, but it no longer accounts for
+ *                     the returned model, so it should be recomputed
+ *                     before further use.
+ * Input:
+ *  mw       Mapwin *  The container of a list of clean windows. If this
+ *                     is NULL or contains no windows then the whole area
+ *                     defined in 'mb' will be searched for components.
+ *  maxcmp      int    The absolute value 'maxcmp' specifies the max number
+ *                     of components to be found. If this is negative then
+ *                     cleaning will stop before the given limit as soon
+ *                     as a -ve component is seen.
+ *  cutoff    float    The residual flux to stop cleaning at. (Jy/Beam).
+ *  gain      float    The CLEAN loop gain < 1.0 .
+ *  patch       int    The half-width of the square beam patch
+ *                     (pixels). If this is <= 0, a quarter of the
+ *                     width of the CLEAN area is substituted.
+ *  docomp      int    If true then compress the model components.
+ * Output:
+ *  niter       int *  The number of components subtracted.
+ *  more        int *  On return, *more is 1 if the minor cycles ended
+ *                     because they reached their flux limit, such that
+ *                     more components can be found after a major cycle.
+ *                     It is 0 if the cutoff, a negative component, or
+ *                     the limit on the number of components was reached.
+ *  return    Model *  The new model components, or NULL on error. This
+ *                     should be deleted using del_Model() when no
+ *                     longer required.
+ */
+Model *clarkclean(Observation *ob, MapBeam *mb, Mapwin *mw, int maxcmp,
+		  float cutoff, float gain, int patch, int docomp,
+		  int *niter, int *more)
+{
+  Winran *wins;         /* Array of window indexes */
+  Peakidx *pk;          /* The block peaks of the residual map */
+  Model *mod;           /* The new clean model */
+  Clarkpix *list;       /* The list of the brightest pixels */
+  long npix;            /* The number of pixels in list[] */
+  long i;
+  float *absptr;        /* The pixel of the peak residual */
+  float peak;           /* The absolute value of the peak residual */
+  float limit;          /* The flux limit of the minor cycles */
+  float climit;         /* The cutoff in the units of the map */
+  float sidelobe;       /* The largest sidelobe outside the patch wrt bmax */
+  float ccsum=0.0f;     /* Sum of clean-component fluxes */
+  int nwin;             /* Number of clean windows */
+  int ixmin, ixmax;     /* First and last X-pixel of CLEAN area */
+  int iymin, iymax;     /* First and last Y-pixel of CLEAN area */
+  int xwid, ywid;       /* The dimensions of the CLEAN area */
+  int xcent,ycent;      /* Pixel coordinate of centre of map grid */
+  long cntr;            /* Offset to centre of the beam array */
+  float bmax;           /* Value of beam at beam centre */
+  int noneg;            /* If true then stop at the first negative component */
+/*
+ * Nothing has been done yet.
+ */
+  *niter = 0;
+  *more = 0;
+/*
+ * Trap bad clean gain.
+ */
+  if(gain<=0.0 || gain > 1.0) {
+    lprintf(stderr, "clarkclean: Ridiculous clean gain: %g\n", gain);
+    return NULL;
+  };
+/*
+ * Set up the Model container to receive CLEAN components.
+ */
+  mod = new_Model();
+  if(!mod)
+    return NULL;
+/*
+ * Determine the area of the map that can be cleaned, as in mapclean().
+ */
+  ixmin = mb->nx/4;
+  iymin = mb->ny/4;
+  ixmax = mb->nx - ixmin-1;
+  iymax = mb->ny - iymin-1;
   xwid = ixmax - ixmin + 1;
   ywid = iymax - iymin + 1;
+  xcent = mb->nx/2;
+  ycent = mb->ny/2;
 /*
- * Determine the number of pixels between the right edge of the CLEAN area
- * and the left edge of the same window on the next row.
+ * Substitute the default beam patch?
  */
-  xskip = mb->nx - xwid;
+  if(patch <= 0)
+    patch = (xwid < ywid ? xwid : ywid) / 4;
+  if(patch < 1)
+    patch = 1;
 /*
- * Determine the offset in floats to the centre of the beam and map arrays.
+ * Get the pixel ranges of the CLEAN windows.
  */
-  cntr = mb->nx/2 + mb->nx * mb->ny/2;
+  wins = clean_wins(mb, mw, ixmin, ixmax, iymin, iymax, &nwin);
+  if(!wins)
+    return del_Model(mod);
 /*
- * Pointer to corner of CLEAN area with lowest address.
+ * Process maxcmp to see if to stop at the first negative.
  */
-  mptr = mb->map + ixmin + iymin * mb->nx;
+  noneg = maxcmp < 0;
+  if(noneg) maxcmp = -maxcmp;
 /*
- * Get the pointer to the pixel in the beam array that should correspond
- * to this point.
+ * Get the value at the centre of the beam.
  */
-  bptr = mb->beam + cntr + (mptr - cmpptr);
+  cntr = mb->nx/2 + (long) mb->nx * (mb->ny/2);
+  bmax = mb->beam[cntr];
+  if(bmax == 0.0f) {
+    lprintf(stderr, "clean: invalid dirty beam supplied - try using invert\n");
+    free(wins);
+    return del_Model(mod);
+  };
 /*
- * Subtract the component.
+ * Index the peaks of the residual map, and allocate the list of
+ * brightest pixels.
  */
-  for(iy=0; iy < ywid; iy++) {
-    for(ix=0; ix < xwid; ix++)
-      *(mptr++) -= *(bptr++) * cmpval;
-    mptr += xskip;
-    bptr += xskip;
+  pk = new_Peakidx(mb, ixmin, ixmax, iymin, iymax, wins, nwin);
+  free(wins);
+  if(!pk)
+    return del_Model(mod);
+  list = (Clarkpix *) malloc(sizeof(Clarkpix) * CLARK_MAXPIX);
+  if(!list) {
+    lprintf(stderr, "Insufficient memory to CLEAN map\n");
+    del_Peakidx(pk);
+    return del_Model(mod);
   };
-  return;
+/*
+ * Find the peak residual.
+ */
+  absptr = peak_find(pk);
+  if(absptr == NULL) {
+    lprintf(stderr, "clean: No flux left in map - finishing early\n");
+    free(list);
+    del_Peakidx(pk);
+    return mod;
+  };
+  peak = fabs(*absptr);
+/*
+ * See if the CLEAN has already converged.
+ */
+  climit = fabs(cutoff) * fabs(bmax);
+  if(peak <= climit) {
+    lprintf(stdout, "Clean target residual flux of %g Jy/beam attained\n",
+	    fabs(cutoff));
+    free(list);
+    del_Peakidx(pk);
+    return mod;
+  };
+/*
+ * Determine the flux limit of the minor cycles.
+ */
+  sidelobe = beam_sidelobe(mb, xwid, ywid, patch);
+  limit = sidelobe * peak;
+  if(limit < climit)
+    limit = climit;
+/*
+ * If the beam has sidelobes outside the patch that are as large as its
+ * center, the above limit would exclude the peak itself, so fall back
+ * to the cutoff.
+ */
+  if(limit >= peak)
+    limit = climit;
+/*
+ * Get the list of the pixels that exceed the limit, raising the limit
+ * if there are too many of them. Note that the limit may be zero.
+ */
+  npix = clark_list(pk, limit, NULL);
+  if(npix > CLARK_MAXPIX) {
+    if(limit < CLARK_MINFRAC * peak)
+      limit = CLARK_MINFRAC * peak;
+    for(i=0; i<CLARK_MAXITER &&
+	(npix = clark_list(pk, limit, NULL)) > CLARK_MAXPIX; i++)
+      limit *= 1.25f;
+  };
+  npix = clark_list(pk, limit, list);
+  del_Peakidx(pk);
+/*
+ * Perform the minor cycles.
+ */
+  for(;;) {
+    Clarkpix *cp;      /* The pixel of the new component */
+    float cmpval;      /* The new component (Jy/beam) */
+    float absval;      /* The absolute value of a pixel */
+    float maxabs;      /* The max absolute value in the list */
+    long first;        /* The index of the first pixel of list[] that */
+                       /*  is within the patch of the component */
+/*
+ * Find the brightest pixel of the list.
+ */
+    cp = NULL;
+    maxabs = 0.0f;
+    for(i=0; i<npix; i++) {
+      absval = fabs(list[i].value);
+      if(absval > maxabs) {
+	maxabs = absval;
+	cp = list + i;
+      };
+    };
+/*
+ * Stop when the list has been cleaned down to the flux limit.
+ */
+    if(!cp || maxabs <= limit) {
+      if(limit > climit)
+	*more = 1;
+      else
+	lprintf(stdout, "Clean target residual flux of %g Jy/beam attained\n",
+		fabs(cutoff));
+      break;
+    };
+/*
+ * Stop if the iteration limit has been reached.
+ */
+    if(*niter >= maxcmp)
+      break;
+/*
+ * Stop if a negative component is detected and negative components
+ * were prohibited by the user.
+ */
+    cmpval = cp->value / bmax;
+    if(noneg && cmpval < 0.0f) {
+      lprintf(stdout, "Clean halted at first negative component\n");
+      break;
+    };
+/*
+ * Apply the CLEAN gain and record the new component.
+ */
+    cmpval *= gain;
+    if(add_xycmp(mod, docomp, 0, cmpval, (cp->ix - xcent) * mb->xinc,
+		 (cp->iy - ycent) * mb->yinc, 0.0, 0.0, 0.0, M_DELT,
+		 0.0, 0.0) == NULL) {
+      lprintf(stderr, "Leaving CLEAN early due to memory problems\n");
+      break;
+    };
+    (*niter)++;
+    ccsum += cmpval;
+/*
+ * The list is sorted in order of increasing row, so locate the
+ * first pixel whose row is within the patch, then subtract the beam
+ * patch from the pixels of the list up to the last row of the patch.
+ */
+    {
+      long lo = 0, hi = npix;
+      int iya = cp->iy - patch;
+      int iyb = cp->iy + patch;
+      int ixa = cp->ix - patch;
+      int ixb = cp->ix + patch;
+      int cx = cp->ix, cy = cp->iy;
+      while(lo < hi) {
+	long mid = (lo + hi) / 2;
+	if(list[mid].iy < iya)
+	  lo = mid + 1;
+	else
+	  hi = mid;
+      };
+      first = lo;
+      for(i=first; i<npix && list[i].iy <= iyb; i++) {
+	Clarkpix *lp = list + i;
+	if(lp->ix >= ixa && lp->ix <= ixb) {
+	  lp->value -= mb->beam[cntr + (long)(lp->iy - cy) * mb->nx +
+				(lp->ix - cx)] * cmpval;
+	};
+      };
+    };
+  };
+/*
+ * Report the results of the minor cycles.
+ */
+  lprintf(stdout,
+   "Minor cycles: %d components, %g Jy, from %ld pixels above %g Jy/beam\n",
+	  *niter, ccsum, npix, limit / bmax);
+  free(list);
+  return mod;
+}
+
+/*.......................................................................
+ * Count, and optionally list, the windowed pixels of the CLEAN area
+ * whose absolute values exceed a given limit. The pixels are listed in
+ * order of increasing row, then increasing column.
+ *
+ * Input:
+ *  pk      Peakidx *  The block peaks of the residual map.
+ *  limit     float    The limit to be exceeded.
+ * Input/Output:
+ *  list   Clarkpix *  If not NULL, the first CLARK_MAXPIX matching
+ *                     pixels are recorded in list[], which must have
+ *                     room for CLARK_MAXPIX elements.
+ * Output:
+ *  return     long    If list is NULL, the number of matching pixels.
+ *                     Otherwise the number of pixels recorded in list[].
+ */
+static long clark_list(Peakidx *pk, float limit, Clarkpix *list)
+{
+  long npix = 0;   /* The number of pixels found */
+  int by, bx;      /* The indexes of a block */
+  int ix, iy;      /* The indexes of a pixel wrt the CLEAN area */
+  for(by=0; by<pk->nby; by++) {
+    int ya = by * PEAK_BLOCK;
+    int yb = ya + PEAK_BLOCK < pk->ywid ? ya + PEAK_BLOCK : pk->ywid;
+    Peakblk *brow = pk->blk + by * pk->nbx;
+    for(iy=ya; iy<yb; iy++) {
+      float *fptr = pk->map + (long)(iy + pk->iymin) * pk->nx + pk->ixmin;
+      int *wptr = pk->win + (long) iy * pk->xwid;
+/*
+ * Only search blocks whose peaks exceed the limit.
+ */
+      for(bx=0; bx<pk->nbx; bx++) {
+	if(brow[bx].pix >= 0 && brow[bx].maxabs > limit) {
+	  int xa = bx * PEAK_BLOCK;
+	  int xb = xa + PEAK_BLOCK < pk->xwid ? xa + PEAK_BLOCK : pk->xwid;
+	  for(ix=xa; ix<xb; ix++) {
+	    if(wptr[ix] >= 0 && fabs(fptr[ix]) > limit) {
+	      if(list) {
+		Clarkpix *cp = list + npix;
+		if(npix >= CLARK_MAXPIX)
+		  return npix;
+		cp->value = fptr[ix];
+		cp->ix = ix + pk->ixmin;
+		cp->iy = iy + pk->iymin;
+	      };
+	      npix++;
+	    };
+	  };
+	};
+      };
+    };
+  };
+  return npix;
+}
+
+/*.......................................................................
+ * Return the largest absolute value of the dirty beam, relative to its
+ * central value, outside a square patch about its center, out to the
+ * largest offset that separates two pixels of the CLEAN area.
+ *
+ * Input:
+ *  mb      MapBeam *  The map and beam container.
+ *  xwid,ywid   int    The dimensions of the CLEAN area.
+ *  patch       int    The half-width of the patch.
+ * Output:
+ *  return    float    The largest sidelobe outside the patch.
+ */
+static float beam_sidelobe(MapBeam *mb, int xwid, int ywid, int patch)
+{
+  long cntr = mb->nx/2 + (long) mb->nx * (mb->ny/2);
+  float maxabs = 0.0f;  /* The largest absolute value found so far */
+  int dx, dy;           /* The offset of a pixel from the beam center */
+  for(dy = -(ywid-1); dy <= ywid-1; dy++) {
+    float *bptr = mb->beam + cntr + (long) dy * mb->nx;
+    int inpatch = dy >= -patch && dy <= patch;
+    for(dx = -(xwid-1); dx <= xwid-1; dx++) {
+      if(!inpatch || dx < -patch || dx > patch) {
+	float absval = fabs(bptr[dx]);
+	if(absval > maxabs)
+	  maxabs = absval;
+      };
+    };
+  };
+  return maxabs / fabs(mb->beam[cntr]);
 }
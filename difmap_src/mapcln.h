@@ -1,2 +1,6 @@
 Model *mapclean(Observation *ob, MapBeam *mb, Mapwin *mw, int maxcmp,
-		float cutoff, float gain, int docomp);
+		float cutoff, float gain, int patch, int docomp);
+
+Model *clarkclean(Observation *ob, MapBeam *mb, Mapwin *mw, int maxcmp,
+		  float cutoff, float gain, int patch, int docomp,
+		  int *niter, int *more);
@@ -4,8 +4,8 @@
 
 #include "logio.h"
 #include "mapmem.h"
+#include "vlbfft.h"
 
-static int ispow2(int n);
 static UVbin *new_UVbin(MapBeam *mb, int nu, int nv);
 static UVbin *del_UVbin(MapBeam *mb);
 
@@ -41,8 +41,11 @@ MapBeam *new_MapBeam(MapBeam *oldmap, int nx, float xinc, int ny, float yinc)
 /*
  * Check arguments.
  */
-  if(nx<=32 || !ispow2(nx) || ny<=32 || !ispow2(ny)) {
-    lprintf(stderr, "new_MapBeam: map grid size must be a power of 2 > 32.\n");
+  if(!mapsize_ok(nx) || !mapsize_ok(ny)) {
+    lprintf(stderr,
+	    "new_MapBeam: The map grid size must be a multiple of 4 > 32,\n");
+    lprintf(stderr,
+	    " with no prime factors other than 2, 3 and 5 (eg. 512, 1536).\n");
     return del_MapBeam(oldmap);
   };
   if(xinc <= 0.0f || yinc <= 0.0f) {
@@ -259,30 +262,23 @@ static UVbin *del_UVbin(MapBeam *mb)
 }
 
 /*.......................................................................
- * Private function of new_MapBeam() used to determine whether a given
- * grid-size is a power of 2. This method is a lot faster and more
- * robust than using logs etc..
+ * Determine whether a given number of pixels is supported along
+ * either axis of the map and beam grids. The grid must be larger than
+ * 32 pixels, and a multiple of 4 pixels, so that the inner quarter of
+ * the map is centered on an exact pixel, and so that the gridded UV
+ * plane can be phase shifted by alternately negating its elements.
+ * The number must also be a size that newfft() can transform, which
+ * means that it can have no prime factors other than 2, 3 and 5.
  *
  * Input:
  *  n        int   The grid size.
  * Output:
- *  return   int   0 - n is not a power of 2.
- *                 1 - n is a power of 2.
+ *  return   int   0 - n is not a supported grid size.
+ *                 1 - n is a supported grid size.
  */
-static int ispow2(int n)
+int mapsize_ok(int n)
 {
-/*
- * Negative numbers are not powers of 2.
- */
-  if(n<=0)
-    return 0;
-/*
- * Divide by 2 until the remainder of dividing by two is non-zero, or
- * 1 is reached. 1 is only reached if the number is a power of two.
- */
-  while(n>1 && n%2==0)
-    n >>= 1;
-  return n==1;
+  return n > 32 && n%4 == 0 && fft_size_ok(n);
 }
 
 /*.......................................................................
@@ -70,6 +70,13 @@ typedef struct {
 MapBeam *new_MapBeam(MapBeam *oldmap, int nx, float xinc, int ny, float yinc);
 MapBeam *del_MapBeam(MapBeam *mb);
 
+/*
+ * Return true if n is a supported number of pixels along an axis of
+ * the map and beam grids.
+ */
+
+int mapsize_ok(int n);
+
 /*
  * Record map statistics in mb->maxpix and mb->minpix,
  * and mb->maprms, mb->mapmean.
@@ -3,6 +3,7 @@
 #include <math.h>
 
 #include "obs.h"
+#include "visview.h"
 #include "logio.h"
 
 /*.......................................................................
@@ -27,6 +28,7 @@ int moddif(Observation *ob, Moddif *md, float uvmin, float uvmax)
   int isub;        /* The index of the sub-array being processed */
   int cif;         /* The index of the IF being processed */
   int old_if;      /* State of current IF to be restored on exit */
+  Visview *view;   /* The structure-of-arrays view of the current IF */
   long nvis=0;     /* The number of visibilities used. */
   float msd=0.0f;  /* Mean square diff between model and observed data */
   float chi=0.0f;  /* Mean square number of sigma deviation */
@@ -68,50 +70,46 @@ int moddif(Observation *ob, Moddif *md, float uvmin, float uvmax)
  */
     if(getIF(ob, cif))
       return 1;
+/*
+ * Get the structure-of-arrays view of the residuals of the new IF.
+ */
+    view = ob_visview(ob);
+    if(!view)
+      return 1;
 /*
  * Visit each subarray in turn.
  */
-    for(isub=0; isub<ob->nsub; isub++) {
-      Subarray *sub = &ob->sub[isub];
-      int ut;
-      for(ut=0; ut<sub->ntime; ut++) {
-	Visibility *vis = sub->integ[ut].vis;
-	int base;
-	for(base=0; base<sub->nbase; base++,vis++) {
+    for(isub=0; isub<view->nsub; isub++) {
+      Subview *sv = view->sub + isub;
+      long i;
+      for(i=0; i<sv->nvis; i++) {
 /*
  * Get the square of the UV radius.
  */
-	  float uu = vis->u * ob->stream.uvscale;
-	  float vv = vis->v * ob->stream.uvscale;
-	  float uvrad = sqrt(uu*uu+vv*vv);
+	float uu = sv->u[i] * ob->stream.uvscale;
+	float vv = sv->v[i] * ob->stream.uvscale;
+	float uvrad = sqrt(uu*uu+vv*vv);
 /*
  * Only look at unflagged visibilities within the requested UV range.
  */
-	  if(!vis->bad && uvrad >= uvmin && uvrad <= uvmax) {
+	if(!sv->bad[i] && uvrad >= uvmin && uvrad <= uvmax) {
 /*
- * Calculate the square modulus of the complex difference vector using the
- * cosine rule.
+ * Calculate the square modulus of the complex difference vector.
  */
-	    float ampvis = vis->amp;
-	    float phsvis = vis->phs;
-	    float ampmod = vis->modamp;
-	    float phsmod = vis->modphs;
-	    float sqrmod = ampvis*ampvis + ampmod*ampmod -
-	      2.0f * ampvis*ampmod * cos(phsvis-phsmod);
+	  float sqrmod = sv->re[i]*sv->re[i] + sv->im[i]*sv->im[i];
 /*
  * Count the number of visibilities used.
  */
-	    nvis++;
+	  nvis++;
 /*
  * Accumulate chi-squared.
- * vis->wt is the reciprocal of the ampitude variance.
+ * wt is the reciprocal of the ampitude variance.
  */
-	    chi += vis->wt * sqrmod;
+	  chi += sv->wt[i] * sqrmod;
 /*
  * Accumulate the mean-square-difference between model and data.
  */
-	    msd += (sqrmod - msd) / nvis;
-	  };
+	  msd += (sqrmod - msd) / nvis;
 	};
       };
     };
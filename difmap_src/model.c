@@ -29,6 +29,39 @@ static FreeList *modcmp_memory = NULL;  /* A (Modcmp *) freelist */
 
 static FreeList *model_memory = NULL;   /* A (Model *) freelist */
 
+/*
+ * When delta components are merged with existing delta components at
+ * the same position, the existing component is found via a hash index
+ * of the delta components of the model, instead of by searching the
+ * component list. The index is an open-addressed hash table, keyed on
+ * the position and spectral index of each component. It is created on
+ * first use, kept up to date as components are added and removed, and
+ * rebuilt when marked as stale.
+ */
+typedef struct Modindex {
+  Modcmp **slot;         /* The array of nslot hash-table entries */
+  unsigned long nslot;   /* The size of slot[] (a power of two) */
+  unsigned long nused;   /* The number of non-NULL entries in slot[] */
+  unsigned long ndup;    /* The number of delta components that aren't */
+                         /*  indexed because an earlier component of */
+                         /*  the list has the same position */
+  int stale;             /* True if the index must be rebuilt before use */
+} Modindex;
+
+/*
+ * The initial number of slots in a new index.
+ */
+#define MODINDEX_MIN 64
+
+static Modindex *mi_ready(Model *mod);
+static Modindex *mi_reset(Model *mod);
+static void mi_forget(Model *mod);
+static Modcmp *mi_lookup(Modindex *mi, float x, float y, float spcind);
+static void mi_insert(Model *mod, Modcmp *cmp);
+static void mi_remove(Model *mod, Modcmp *cmp);
+static Modcmp *find_delta(Model *mod, Modcmp *end, float x, float y,
+			  float spcind);
+
 /*.......................................................................
  * Get a new model component structure from the free-list. Also
  * initialise it so that all members are zero, including the 'next' link.
@@ -120,6 +153,7 @@ Model *new_Model(void)
   mod->ncmp = 0;
   mod->head  = 0;
   mod->tail = 0;
+  mod->index = NULL;
 /*
  * Until proved otherwise assume that the model is squashed and formed
  * from delta components only.
@@ -153,6 +187,10 @@ Model *del_Model(Model *mod)
  * Return all model components to the free-list.
  */
   clr_Model(mod);
+/*
+ * Delete the component index.
+ */
+  mi_forget(mod);
 /*
  * Return the model container to the freelist.
  */
@@ -185,6 +223,11 @@ Model *clr_Model(Model *mod)
     next = cmp->next;
     del_cmp(cmp);
   };
+/*
+ * Empty the component index.
+ */
+  if(mod->index)
+    (void) mi_reset(mod);
 /*
  * Reset the model parameters to represent its new empty state.
  */
@@ -257,21 +300,19 @@ Modcmp *add_xycmp(Model *mod, int docomp, int freepar, float flux, float x,
  * required and simply add the new flux to the matching component.
  */
   if(docomp && type == M_DELT) {
-    for(cmp=mod->head; cmp != NULL; cmp=cmp->next) {
-      if(x == cmp->x && y == cmp->y && cmp->type == M_DELT &&
-	 spcind == cmp->spcind) {
+    cmp = find_delta(mod, NULL, x, y, spcind);
+    if(cmp) {
 /*
  * If the equal spectral index of the two components is non-zero,
  * get the flux to be added at the reference frequency of the target
  * component.
  */
-	if(spcind != 0.0 && freq0 != cmp->freq0)
-	  flux *= pow(cmp->freq0 / freq0, spcind);
-	cmp->freepar |= freepar;
-	cmp->flux += flux;
-	mod->flux += flux;
-	return cmp;
-      };
+      if(spcind != 0.0 && freq0 != cmp->freq0)
+	flux *= pow(cmp->freq0 / freq0, spcind);
+      cmp->freepar |= freepar;
+      cmp->flux += flux;
+      mod->flux += flux;
+      return cmp;
     };
   };
 /*
@@ -703,9 +744,13 @@ Model *cut_mod(Model *mod, float cut)
   for(cmp=mod->head; cmp != NULL && cmp->flux >= cut; cmp = cmp->next)
     last = cmp;
 /*
- * Delete the residual list.
+ * Delete the residual list. Rather than removing the deleted components
+ * from the component index one at a time, arrange for it to be rebuilt
+ * when next needed.
  */
   if(last) {
+    if(mod->index)
+      mod->index->stale = 1;
     while(last->next != NULL)
       del_cmp(rem_cmp(mod,last,last->next));
   };
@@ -726,6 +771,8 @@ Model *squash(Model *mod)
                      /* components */
   Modcmp *cmp;       /* The component being checked against 'target' */
   Modcmp *prev;      /* The component preceding 'cmp' */
+  Modcmp *next;      /* The component following 'cmp' */
+  Modindex *index;   /* The index of the components that precede 'cmp' */
 /*
  * No-op if no model to be squashed or the model is already squashed.
  */
@@ -733,53 +780,50 @@ Model *squash(Model *mod)
     return mod;
   mod->issqd = 1;  /* Mark the model as squashed */
 /*
- * For each delta-function model component (target) search for any others
- * of the same type with identical positions, add their flux to the target
- * component, unlink them from the component list and delete them.
- * The outer loop gets the next component in the list, then the inner loop
- * searches all components up to that point for matchng positions. If found
- * the outer loop component is unlinked and deleted while the inner loop
- * component has its flux incremented.
- */
-  prev = mod->head;
-  if(prev!=NULL) {
-    for(cmp=prev->next; cmp != NULL; cmp=prev->next) {
-      if(cmp->type != M_DELT) {
-	prev=prev->next;
-	continue;
-      };
-      for(target=mod->head; target != cmp; target=target->next) {
-	if(cmp->x == target->x && cmp->y == target->y && target->type==M_DELT &&
-	   cmp->spcind == target->spcind) {
+ * For each delta-function model component (cmp) search the preceding
+ * components for one of the same type with an identical position. If
+ * found, add the flux of cmp to that component (target), then unlink
+ * and delete cmp. The preceding delta components are looked up in the
+ * component index, which is rebuilt as the list is traversed, so
+ * that it only contains components that precede cmp.
+ */
+  index = mi_reset(mod);
+  prev = NULL;
+  for(cmp=mod->head; cmp != NULL; cmp=next) {
+    next = cmp->next;
+    target = cmp->type != M_DELT ? NULL : (index ?
+	     mi_lookup(index, cmp->x, cmp->y, cmp->spcind) :
+	     find_delta(mod, cmp, cmp->x, cmp->y, cmp->spcind));
+    if(target) {
 /*
  * Get the reference flux of the component that is to be added.
  */
-	  float flux = cmp->flux;
+      float flux = cmp->flux;
 /*
  * If the spectral indeces of the two components (verified as being equal
  * above) are non-zero, get the flux of the component that is being added,
  * at the reference frequency of the target component.
  */
-	  if(cmp->spcind != 0.0 && cmp->freq0 != target->freq0)
-	    flux *= pow(target->freq0 / cmp->freq0, cmp->spcind);
+      if(cmp->spcind != 0.0 && cmp->freq0 != target->freq0)
+	flux *= pow(target->freq0 / cmp->freq0, cmp->spcind);
 /*
  * Add the flux of the new component to the target.
  */
-	  target->flux += flux;
-	  mod->flux += flux;       /* NB. rem_cmp() subtracts removed flux */
+      target->flux += flux;
+      mod->flux += flux;       /* NB. rem_cmp() subtracts removed flux */
 /*
  * Unlink and delete the redundant component (cmp).
  */
-	  cmp = del_cmp(rem_cmp(mod,prev,cmp));
-	  break;
-	};
-      };
+      cmp = del_cmp(rem_cmp(mod,prev,cmp));
+    } else {
 /*
- * If the outer-loop component was not deleted and unlinked then the
- * preceding component in the next iteration is the current component.
+ * Index the retained component, and make it the predecessor of the
+ * next component.
  */
-      if(target==cmp)
-	prev=cmp;
+      if(index && cmp->type == M_DELT)
+	mi_insert(mod, cmp);
+      index = mod->index;
+      prev = cmp;
     };
   };
 /*
@@ -868,6 +912,8 @@ Model *add_mod(Model *mod, Model *old, int docomp, int append)
   old->flux = 0.0;
   old->head=0;
   old->tail=0;
+  if(old->index)
+    (void) mi_reset(old);
 /*
  * Return the combined model.
  */
@@ -892,6 +938,7 @@ void shiftmod(Model *mod, float east, float north)
     cmp->x += east;
     cmp->y += north;
   };
+  reindex_mod(mod);
   return;
 }
 
@@ -924,29 +971,27 @@ Modcmp *add_cmp(Modcmp *cmp, Model *mod, int docomp)
  * to add merge the component with.
  */
   if(docomp && cmp->type==M_DELT) {
-    for(oldcmp=mod->head; oldcmp != NULL; oldcmp=oldcmp->next) {
-      if(cmp->x == oldcmp->x && cmp->y == oldcmp->y && oldcmp->type==M_DELT &&
-	 cmp->spcind == oldcmp->spcind) {
+    oldcmp = find_delta(mod, NULL, cmp->x, cmp->y, cmp->spcind);
+    if(oldcmp) {
 /*
  * Get the reference frequency of the component to be added.
  */
-	float flux = cmp->flux;
+      float flux = cmp->flux;
 /*
  * If the equal spectral index of the two components is non-zero,
  * get the flux to be added at the reference frequency of the target
  * component.
  */
-	if(cmp->spcind != 0.0 && cmp->freq0 != oldcmp->freq0)
-	  flux *= pow(oldcmp->freq0 / cmp->freq0, cmp->spcind);
+      if(cmp->spcind != 0.0 && cmp->freq0 != oldcmp->freq0)
+	flux *= pow(oldcmp->freq0 / cmp->freq0, cmp->spcind);
 /*
  * Add the flux to that of the existing component.
  */
-	oldcmp->freepar |= cmp->freepar;
-	oldcmp->flux += flux;
-	mod->flux += flux;
-	cmp = del_cmp(cmp);
-	return oldcmp;
-      };
+      oldcmp->freepar |= cmp->freepar;
+      oldcmp->flux += flux;
+      mod->flux += flux;
+      cmp = del_cmp(cmp);
+      return oldcmp;
     };
   };
 /*
@@ -964,6 +1009,11 @@ Modcmp *add_cmp(Modcmp *cmp, Model *mod, int docomp)
   mod->flux += cmp->flux;
   cmp->next = NULL;
   mod->issqd = mod->issqd && docomp;
+/*
+ * Add delta components to the component index, if there is one.
+ */
+  if(mod->index && cmp->type==M_DELT)
+    mi_insert(mod, cmp);
 /*
  * The first time that a model component is encountered that isn't a
  * continuum delta function, mark the model as containing more than
@@ -1010,6 +1060,11 @@ Modcmp *rem_cmp(Model *mod, Modcmp *prev, Modcmp *cmp)
       return cmp;
     };
   };
+/*
+ * Remove delta components from the component index, if there is one.
+ */
+  if(mod->index && cmp->type==M_DELT)
+    mi_remove(mod, cmp);
 /*
  * If 'prev' is still NULL then 'cmp' is the first component of the model.
  */
@@ -1217,8 +1272,10 @@ Model *cpy_Model(Model *mod)
 /*
  * Initialize the parts that should be assigned anew.
  */
+  newmod->ncmp = 0;
   newmod->head = NULL;
   newmod->tail = NULL;
+  newmod->index = NULL;
 /*
  * Add copies of the original components to the new model.
  */
@@ -1246,3 +1303,335 @@ Model *cpy_Model(Model *mod)
   };
   return newmod;
 }
+
+/*.......................................................................
+ * Mark the component index of a model as stale, so that it gets rebuilt
+ * the next time that it is needed. This must be called after the
+ * positions or spectral indexes of the components of a model have been
+ * changed in place.
+ *
+ * Input:
+ *  mod    Model *  The model whose components have been changed
+ *                  (can be NULL).
+ */
+void reindex_mod(Model *mod)
+{
+  if(mod && mod->index)
+    mod->index->stale = 1;
+}
+
+/*.......................................................................
+ * Compute the hash-table key of a delta component from its position and
+ * spectral index.
+ *
+ * Input:
+ *  x,y       float   The position of the component (radians).
+ *  spcind    float   The spectral index of the component.
+ * Output:
+ *  return    unsigned long  The hash key.
+ */
+static unsigned long mi_hash(float x, float y, float spcind)
+{
+  float key[3];          /* The values to be hashed */
+  unsigned char *bytes;  /* The bytes of key[] */
+  unsigned long h;       /* The hash value */
+  size_t i;
+/*
+ * Since -0.0 == 0.0, convert negative zeros to positive zeros so that
+ * both have the same bit pattern.
+ */
+  key[0] = x + 0.0f;
+  key[1] = y + 0.0f;
+  key[2] = spcind + 0.0f;
+/*
+ * Compute a 32-bit FNV-1a hash of the bytes of the key.
+ */
+  bytes = (unsigned char *) key;
+  h = 2166136261UL;
+  for(i=0; i<sizeof(key); i++)
+    h = ((h ^ bytes[i]) * 16777619UL) & 0xffffffffUL;
+  return h;
+}
+
+/*.......................................................................
+ * Return the component index of a model, creating or rebuilding it
+ * first if necessary.
+ *
+ * Input:
+ *  mod       Model *  The model to be indexed.
+ * Output:
+ *  return Modindex *  The up to date index, or NULL if there was
+ *                     insufficient memory to create it.
+ */
+static Modindex *mi_ready(Model *mod)
+{
+  Modcmp *cmp;   /* A component of the model */
+/*
+ * Is there an up to date index?
+ */
+  if(mod->index && !mod->index->stale)
+    return mod->index;
+/*
+ * Create or empty the index.
+ */
+  if(!mi_reset(mod))
+    return NULL;
+/*
+ * Index all of the delta components of the model.
+ */
+  for(cmp=mod->head; cmp && mod->index; cmp=cmp->next) {
+    if(cmp->type == M_DELT)
+      mi_insert(mod, cmp);
+  };
+  return mod->index;
+}
+
+/*.......................................................................
+ * Create or empty the component index of a model, leaving it with no
+ * entries. Note that, unlike mi_ready(), this doesn't index the existing
+ * components of the model.
+ *
+ * Input:
+ *  mod       Model *  The model whose index is to be reset.
+ * Output:
+ *  return Modindex *  The empty index, or NULL if there was insufficient
+ *                     memory to create it.
+ */
+static Modindex *mi_reset(Model *mod)
+{
+  Modindex *mi = mod->index;
+  unsigned long i;
+/*
+ * Create a new index?
+ */
+  if(!mi) {
+    mi = malloc(sizeof(Modindex));
+    if(!mi)
+      return NULL;
+    mi->nslot = MODINDEX_MIN;
+    mi->slot = malloc(sizeof(Modcmp *) * mi->nslot);
+    if(!mi->slot) {
+      free(mi);
+      return NULL;
+    };
+    mod->index = mi;
+  };
+/*
+ * Empty the index.
+ */
+  for(i=0; i<mi->nslot; i++)
+    mi->slot[i] = NULL;
+  mi->nused = 0;
+  mi->ndup = 0;
+  mi->stale = 0;
+  return mi;
+}
+
+/*.......................................................................
+ * Delete the component index of a model.
+ *
+ * Input:
+ *  mod     Model *  The model whose index is to be deleted.
+ */
+static void mi_forget(Model *mod)
+{
+  if(mod->index) {
+    if(mod->index->slot)
+      free(mod->index->slot);
+    free(mod->index);
+    mod->index = NULL;
+  };
+}
+
+/*.......................................................................
+ * Look up the indexed delta component that has a given position and
+ * spectral index.
+ *
+ * Input:
+ *  mi    Modindex *  The index to search.
+ *  x,y      float    The position of the component (radians).
+ *  spcind   float    The spectral index of the component.
+ * Output:
+ *  return  Modcmp *  The matching component, or NULL if not found.
+ */
+static Modcmp *mi_lookup(Modindex *mi, float x, float y, float spcind)
+{
+  unsigned long mask = mi->nslot - 1;
+  unsigned long i;
+  Modcmp *cmp;
+  for(i=mi_hash(x, y, spcind) & mask; (cmp=mi->slot[i]) != NULL;
+      i=(i+1) & mask) {
+    if(cmp->x == x && cmp->y == y && cmp->spcind == spcind)
+      return cmp;
+  };
+  return NULL;
+}
+
+/*.......................................................................
+ * Add a delta component to the component index of a model. If an
+ * earlier component has the same position, only that component remains
+ * indexed. If there is insufficient memory to enlarge the index, the
+ * index is deleted.
+ *
+ * Input:
+ *  mod     Model *  The model that contains the component.
+ *  cmp    Modcmp *  The delta component to be indexed.
+ */
+static void mi_insert(Model *mod, Modcmp *cmp)
+{
+  Modindex *mi = mod->index;
+  unsigned long mask;
+  unsigned long i;
+/*
+ * Stale indexes are rebuilt from scratch when next needed.
+ */
+  if(mi->stale)
+    return;
+/*
+ * Components whose positions are NaN can't be matched, so there is
+ * no point in indexing them.
+ */
+  if(cmp->x != cmp->x || cmp->y != cmp->y || cmp->spcind != cmp->spcind)
+    return;
+/*
+ * Double the size of the table when it becomes half full.
+ */
+  if(2 * (mi->nused + 1) > mi->nslot) {
+    unsigned long nslot = 2 * mi->nslot;
+    Modcmp **slot = malloc(sizeof(Modcmp *) * nslot);
+    Modcmp **old = mi->slot;
+    unsigned long nold = mi->nslot;
+    if(!slot) {
+      mi_forget(mod);
+      return;
+    };
+    for(i=0; i<nslot; i++)
+      slot[i] = NULL;
+    mask = nslot - 1;
+    for(i=0; i<nold; i++) {
+      Modcmp *c = old[i];
+      if(c) {
+	unsigned long j = mi_hash(c->x, c->y, c->spcind) & mask;
+	while(slot[j])
+	  j = (j+1) & mask;
+	slot[j] = c;
+      };
+    };
+    free(old);
+    mi->slot = slot;
+    mi->nslot = nslot;
+  };
+/*
+ * Find either an existing component with the same position, or the
+ * empty slot in which to place the new component.
+ */
+  mask = mi->nslot - 1;
+  for(i=mi_hash(cmp->x, cmp->y, cmp->spcind) & mask; mi->slot[i];
+      i=(i+1) & mask) {
+    Modcmp *c = mi->slot[i];
+    if(c->x == cmp->x && c->y == cmp->y && c->spcind == cmp->spcind) {
+      if(c != cmp)
+	mi->ndup++;
+      return;
+    };
+  };
+  mi->slot[i] = cmp;
+  mi->nused++;
+}
+
+/*.......................................................................
+ * Remove a delta component from the component index of a model.
+ *
+ * Input:
+ *  mod     Model *  The model that contains the component.
+ *  cmp    Modcmp *  The delta component to be removed.
+ */
+static void mi_remove(Model *mod, Modcmp *cmp)
+{
+  Modindex *mi = mod->index;
+  unsigned long mask = mi->nslot - 1;
+  unsigned long i, j;
+/*
+ * Stale indexes are rebuilt from scratch when next needed.
+ */
+  if(mi->stale)
+    return;
+/*
+ * Find the slot of the component, or of the indexed component that
+ * has the same position.
+ */
+  for(i=mi_hash(cmp->x, cmp->y, cmp->spcind) & mask; mi->slot[i];
+      i=(i+1) & mask) {
+    Modcmp *c = mi->slot[i];
+    if(c->x == cmp->x && c->y == cmp->y && c->spcind == cmp->spcind)
+      break;
+  };
+/*
+ * If the component isn't in the index, then it is either one of the
+ * unindexed duplicates of an indexed component, or has an unindexable
+ * position (ie. NaN).
+ */
+  if(mi->slot[i] != cmp) {
+    if(mi->slot[i] && mi->ndup > 0)
+      mi->ndup--;
+    return;
+  };
+/*
+ * If a later component at the same position isn't indexed, it must
+ * replace this one, so have the index rebuilt when next needed.
+ */
+  if(mi->ndup > 0) {
+    mi->stale = 1;
+    return;
+  };
+/*
+ * Remove the entry, then move later entries of the same probe sequence
+ * back into the gap, so that they can still be found.
+ */
+  mi->slot[i] = NULL;
+  mi->nused--;
+  for(j=(i+1) & mask; mi->slot[j]; j=(j+1) & mask) {
+    Modcmp *c = mi->slot[j];
+    unsigned long k = mi_hash(c->x, c->y, c->spcind) & mask;
+    if(i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+      mi->slot[i] = c;
+      mi->slot[j] = NULL;
+      i = j;
+    };
+  };
+}
+
+/*.......................................................................
+ * Find the first delta component of a model that has a given position
+ * and spectral index.
+ *
+ * Input:
+ *  mod     Model *  The model to search.
+ *  end    Modcmp *  If not NULL, only search the components that
+ *                   precede this one in the component list. This
+ *                   bypasses the component index.
+ *  x,y     float    The position of the component (radians).
+ *  spcind  float    The spectral index of the component.
+ * Output:
+ *  return Modcmp *  The matching component, or NULL if not found.
+ */
+static Modcmp *find_delta(Model *mod, Modcmp *end, float x, float y,
+			  float spcind)
+{
+  Modindex *mi;  /* The component index of the model */
+  Modcmp *cmp;   /* A component of the model */
+/*
+ * Use the index where possible.
+ */
+  if(!end && (mi=mi_ready(mod)) != NULL)
+    return mi_lookup(mi, x, y, spcind);
+/*
+ * Search the component list.
+ */
+  for(cmp=mod->head; cmp != end; cmp=cmp->next) {
+    if(x == cmp->x && y == cmp->y && cmp->type == M_DELT &&
+       spcind == cmp->spcind)
+      return cmp;
+  };
+  return NULL;
+}
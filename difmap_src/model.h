@@ -44,6 +44,8 @@ typedef struct Model {
   float flux;      /* Total flux in model */
   Modcmp *head;    /* Head of cmp list */
   Modcmp *tail;    /* Tail of cmp list */
+  struct Modindex *index; /* A hash index of the delta components, by */
+                          /*  position, or NULL if not created yet */
 } Model;
 
 
@@ -88,6 +90,10 @@ Model *squash(Model *mod);
 
 void shiftmod(Model *mod, float east, float north);
 
+/* Call after changing the positions of model components in place */
+
+void reindex_mod(Model *mod);
+
 /* Plot the fixed and/or variable components of a model */
 
 int modplot(Model *mod, int dofix, int dovar, float xa, float xb, float ya, float yb);
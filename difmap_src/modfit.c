@@ -7,12 +7,59 @@
 #include "logio.h"
 #include "lmfit.h"
 #include "besj.h"
+#include "partask.h"
+#include "pb.h"
 
 typedef struct { /* The partial derivative of the model vs one free parameter */
   double re;     /* Real part of partial derivative */
   double im;     /* Imaginary part of partial derivative */
 } Vispar;
 
+/*
+ * Describe the model vs. data residual of one visibility.
+ */
+typedef struct {
+  Vispar *vp;      /* Array of nfree visibility complex partial derivatives */
+  double re;       /* Real part of (data - model) */
+  double im;       /* Imaginary part of (data - model) */
+  double wt;       /* Weight of visibility */
+} Fitvis;
+
+/*
+ * The partial sums of one thread of the parallel accumulation mode.
+ */
+typedef struct {
+  Fitvis fv;       /* The residual of the latest visibility of the thread */
+  double *mgrad;   /* Work array of nfree model gradients */
+  double **hessian;/* The lower triangle of the partial Hessian matrix */
+  double *cgrad;   /* The partial chi-squared gradient */
+  double chisq;    /* The partial chi-squared */
+  long ndata;      /* The number of measurements summed by the thread */
+  int err;         /* True if the thread encountered an error */
+  PARTASK_PAD;     /* Separates the sums of neighbouring threads */
+} Fitpart;
+
+/*
+ * Record the values of a component of the variable model that only
+ * change when its parameters, or the IF being processed, change.
+ */
+typedef struct {
+  Modcmp *cmp;     /* The component */
+  double sinphi;   /* sin(cmp->phi) */
+  double cosphi;   /* cos(cmp->phi) */
+  double flux;     /* The flux of the component at the frequency of the */
+                   /*  IF, excluding primary beam attenuation */
+  double lnfreq;   /* log(freq/cmp->freq0) if the spectral index is free */
+} Fitcmp;
+
+/*
+ * The cost of accumulating the sums of one visibility is roughly
+ * proportional to the number of free parameters. The visibilities of a
+ * sub-array are only divided between threads when each thread will get
+ * at least MF_THREAD_WORK such visibility parameters.
+ */
+#define MF_THREAD_WORK 32768L
+
 /*
  * Define an object to contain state info during fitting.
  */
@@ -27,24 +74,51 @@ typedef struct {
   int ibase;       /* Index of the baseline from itime to be processed next */
   int done;        /* Start new visibility next? */
   int eod;         /* True when no more data require processing */
-  Vispar *vp;      /* Array of nfree visibility complex partial derivatives */
-  double re;       /* Real part of (data - model) */
-  double im;       /* Imaginary part of (data - model) */
-  double wt;       /* Weight of visibility */
+  Fitvis fv;       /* The residual of the latest visibility */
+  int nthread;     /* The number of threads of the parallel accumulation */
+                   /*  mode, or 0 if getnext() is used instead */
+  Fitpart *part;   /* The partial sums of each of the nthread threads */
+  Fitcmp *cmps;    /* The cached values of the components of 'mod' */
+  int ncmp;        /* The number of elements in cmps[] */
+  int cache_cif;   /* The IF for which cmps[] and pbtab[] were computed, */
+                   /*  or -1 if they need to be recomputed */
+  int dopb;        /* True if primary beams are in use */
+  int *suboff;     /* The index of the first baseline of each sub-array */
+                   /*  within each row of pbtab[] */
+  int nbtot;       /* The total number of baselines of all sub-arrays */
+  float *pbtab;    /* If dopb is true, the ncmp x nbtot primary beam */
+                   /*  factors of each component on each baseline */
   double uvrmin;   /* The minimum UV radius */
   double uvrmax;   /* The maximum UV radius - used to renormalize U and V */
 } Modfit;
 
+/*
+ * Describe the visibilities of one sub-array to the threads of the
+ * parallel accumulation mode.
+ */
+typedef struct {
+  Modfit *mf;      /* The resource container of the fit */
+  int isub;        /* The index of the sub-array */
+  long nvis;       /* The number of visibilities in the sub-array */
+} Fittask;
+
 static Modfit *new_Modfit(Observation *ob, Model *mod,
 			  float uvmin, float uvmax);
 static Modfit *del_Modfit(Modfit *mf);
 static int mod_nfree(Model *mod);
 static int endfit(Observation *ob, Modfit *mf, int retcode);
-static int getmodvis(Modfit *mf, Visibility *vis);
+static int getmodvis(Modfit *mf, int isub, int ibase, Visibility *vis,
+		     Fitvis *fv);
+static void fit_cache(Modfit *mf, int cif);
+static int skipvis(Modfit *mf, Visibility *vis);
+static Fitpart *new_Fitparts(int nthread, int nfree);
+static Fitpart *del_Fitparts(Fitpart *part, int nthread);
 
 static GETFREE(getfree);
 static SETFREE(setfree);
 static GETNEXT(getnext);
+static GETSUMS(getsums);
+static PARTASK_FN(fit_task);
 
 /*.......................................................................
  * Fit the variable components of the established and tentative models to
@@ -381,6 +455,14 @@ static SETFREE(setfree)
 	cmp->spcind = *pars++;
     };
   };
+/*
+ * The positions of the components may have changed.
+ */
+  reindex_mod(mf->mod);
+/*
+ * The cached values of the components are now out of date.
+ */
+  mf->cache_cif = -1;
   return 0;
 }
 
@@ -415,8 +497,6 @@ static GETNEXT(getnext)
   if(mf->done) {
     Observation *ob = mf->ob;
     Visibility *vis;
-    float uu,vv;       /* The UV coordinates of the visibility */
-    float uvrad;       /* The UV radius of the visibility */
     int skip;          /* True if the current visibility isn't usable */
 /*
  * Did the previous call to this function process the last visibility
@@ -446,12 +526,6 @@ static GETNEXT(getnext)
  * Get the latest visibility.
  */
       vis = &ob->sub[mf->isub].integ[mf->itime].vis[mf->ibase];
-/*
- * Is the visibility within the specified UV range?
- */
-      uu = vis->u * ob->stream.uvscale;
-      vv = vis->v * ob->stream.uvscale;
-      uvrad = sqrt(uu*uu+vv*vv);
 /*
  * Note that in the following loop if we move on to the next IF,
  * then 'vis' will refer to a different visibility, so extract
@@ -459,13 +533,20 @@ static GETNEXT(getnext)
  *
  * Should we skip this visibility?
  */
-      skip = vis->bad || uvrad < mf->uvrmin || uvrad > mf->uvrmax;
+      skip = skipvis(mf, vis);
 /*
  * Compute the UV representation of the model and its derivatives at
- * the UV coordinates of the latest visibility.
- */
-      if(!skip && getmodvis(mf, vis))
-	return -1;
+ * the UV coordinates of the latest visibility. The Cartesian forms of
+ * the visibilities of an IF are only recomputed when the IF, or its
+ * visibilities, change, so that they are computed once per IF rather
+ * than once per iteration of the fit.
+ */
+      if(!skip) {
+	ob_cartesian(ob, CART_DATA | CART_MODEL);
+	fit_cache(mf, mf->cif);
+	if(getmodvis(mf, mf->isub, mf->ibase, vis, &mf->fv))
+	  return -1;
+      };
 /*
  * Increment indexes for the next visibility.
  */
@@ -497,27 +578,27 @@ static GETNEXT(getnext)
  * Return the real part of the latest visibility parameterization?
  */
   if(mf->done) {
-    *dy = mf->re;  /* Real (data - model) residual */
-    *wt = mf->wt;  /* Weight given to real part of data */
+    *dy = mf->fv.re;  /* Real (data - model) residual */
+    *wt = mf->fv.wt;  /* Weight given to real part of data */
 /*
  * Copy the real parts of the model gradient wrt chi-squared into the
  * return array.
  */
     for(i=0; i<mf->nfree; i++)
-      mgrad[i] = mf->vp[i].re;
+      mgrad[i] = mf->fv.vp[i].re;
   }
 /*
  * Return the imaginary part of the latest visibility parameterization.
  */
   else {
-    *dy = mf->im;  /* Imaginary (data - model) residual */
-    *wt = mf->wt;  /* Weight given to imaginary part of data */
+    *dy = mf->fv.im;  /* Imaginary (data - model) residual */
+    *wt = mf->fv.wt;  /* Weight given to imaginary part of data */
 /*
  * Copy the imaginary parts of the model gradient wrt chi-squared into the
  * return array.
  */
     for(i=0; i<mf->nfree; i++)
-      mgrad[i] = mf->vp[i].im;
+      mgrad[i] = mf->fv.vp[i].im;
   };
 /*
  * Toggle the visibility status.
@@ -529,6 +610,189 @@ static GETNEXT(getnext)
   return 1;
 }
 
+/*.......................................................................
+ * Accumulate the Hessian matrix, chi-squared gradient and chi-squared
+ * sums of all of the usable visibilities, by dividing the visibilities
+ * of each sub-array of each IF between mf->nthread threads. This is
+ * used by lm_fit() in place of getnext() when more than one thread
+ * is available.
+ *
+ * Input:
+ *  obj        void *   The Modfit descriptor.
+ *  nfree       int     The number of free parameters in the model.
+ * Input/Output:
+ *  hessian  double **  The lower triangle of the Hessian matrix sum.
+ *  cgrad    double *   The chi-squared gradient sum.
+ *  chisq    double *   The chi-squared sum.
+ *  ndata      long *   The number of measurements that were summed.
+ * Output:
+ *  return      int     0 - OK.
+ *                      1 - Error.
+ */
+static GETSUMS(getsums)
+{
+  Modfit *mf = (Modfit *) obj; /* The modelfit resource container */
+  Observation *ob = mf->ob;    /* The observation being fitted */
+  Modcmp *cmp;                 /* A component of the variable model */
+  Fittask ft;                  /* The description of a parallel task */
+  int cif;                     /* The index of the IF being processed */
+  int ithread;                 /* The index of a thread */
+  int row, col;                /* Hessian matrix indexes */
+/*
+ * getmodvis() rejects unsupported component types, but since it is
+ * called by the threads, check for them here, so that the error can
+ * be reported.
+ */
+  for(cmp=mf->mod->head; cmp; cmp=cmp->next) {
+    switch(cmp->type) {
+    case M_DELT: case M_GAUS: case M_DISK: case M_ELLI: case M_RING: case M_SZ:
+      break;
+    case M_RECT:
+      lprintf(stderr, "modfit: Rectangular components are not supported.\n");
+      return 1;
+      break;
+    default:
+      lprintf(stderr, "modfit: Unknown model component type: %d\n",cmp->type);
+      return 1;
+      break;
+    };
+  };
+/*
+ * Clear the partial sums of each thread.
+ */
+  for(ithread=0; ithread<mf->nthread; ithread++) {
+    Fitpart *part = mf->part + ithread;
+    for(row=0; row<nfree; row++) {
+      part->cgrad[row] = 0.0;
+      for(col=0; col<=row; col++)
+	part->hessian[row][col] = 0.0;
+    };
+    part->chisq = 0.0;
+    part->ndata = 0;
+    part->err = 0;
+  };
+/*
+ * Get the first IF to be processed.
+ */
+  cif = nextIF(ob, 0, 1, 1);
+  if(cif < 0) {
+    lprintf(stderr,
+	    "modfit: Unable to find any IFs that contain selected channels.\n");
+    return 1;
+  };
+/*
+ * Process each sub-array of each IF in turn.
+ */
+  ft.mf = mf;
+  for( ; cif >= 0; cif = nextIF(ob, cif+1, 1, 1)) {
+    if(getIF(ob, cif))
+      return 1;
+/*
+ * The threads read the Cartesian forms of the visibilities, so make sure
+ * that they are up to date before starting them.
+ */
+    ob_cartesian(ob, CART_DATA | CART_MODEL);
+    fit_cache(mf, cif);
+    for(ft.isub=0; ft.isub<ob->nsub; ft.isub++) {
+      Subarray *sub = ob->sub + ft.isub;
+      int nthread = mf->nthread;
+      ft.nvis = (long) sub->nbase * sub->ntime;
+/*
+ * Work out how many threads it is worth using.
+ */
+      if(nthread > (double) ft.nvis * nfree / MF_THREAD_WORK)
+	nthread = (double) ft.nvis * nfree / MF_THREAD_WORK;
+      if(nthread < 1)
+	nthread = 1;
+      run_partask(nthread, fit_task, &ft);
+    };
+/*
+ * Did any of the threads encounter an error?
+ */
+    for(ithread=0; ithread<mf->nthread; ithread++) {
+      if(mf->part[ithread].err)
+	return 1;
+    };
+  };
+/*
+ * Add the partial sums of the threads, in order of thread index, so
+ * that the result only depends on the number of threads.
+ */
+  for(ithread=0; ithread<mf->nthread; ithread++) {
+    Fitpart *part = mf->part + ithread;
+    for(row=0; row<nfree; row++) {
+      cgrad[row] += part->cgrad[row];
+      for(col=0; col<=row; col++)
+	hessian[row][col] += part->hessian[row][col];
+    };
+    *chisq += part->chisq;
+    *ndata += part->ndata;
+  };
+  return 0;
+}
+
+/*.......................................................................
+ * The task function of getsums(). This adds the contributions of a
+ * contiguous share of the visibilities of one sub-array to the partial
+ * sums of the calling thread.
+ */
+static PARTASK_FN(fit_task)
+{
+  Fittask *ft = (Fittask *) data;
+  Modfit *mf = ft->mf;
+  Fitpart *part = mf->part + ithread;
+  Subarray *sub = mf->ob->sub + ft->isub;
+  long ia, ib;    /* The range of visibilities of this thread */
+  long ivis;      /* The index of a visibility within the sub-array */
+  int i;
+/*
+ * Get the range of visibilities to be processed by this thread.
+ */
+  partask_range(ft->nvis, ithread, nthread, &ia, &ib);
+  for(ivis=ia; ivis<ib && !part->err; ivis++) {
+    int ibase = ivis % sub->nbase;
+    Visibility *vis = &sub->integ[ivis / sub->nbase].vis[ibase];
+    if(!skipvis(mf, vis)) {
+      if(getmodvis(mf, ft->isub, ibase, vis, &part->fv)) {
+	part->err = 1;
+      } else {
+/*
+ * Add the real and imaginary parts of the visibility as two measurements.
+ */
+	for(i=0; i<mf->nfree; i++)
+	  part->mgrad[i] = part->fv.vp[i].re;
+	lm_addpoint(mf->nfree, part->fv.re, part->fv.wt, part->mgrad,
+		    part->hessian, part->cgrad, &part->chisq);
+	for(i=0; i<mf->nfree; i++)
+	  part->mgrad[i] = part->fv.vp[i].im;
+	lm_addpoint(mf->nfree, part->fv.im, part->fv.wt, part->mgrad,
+		    part->hessian, part->cgrad, &part->chisq);
+	part->ndata += 2;
+      };
+    };
+  };
+}
+
+/*.......................................................................
+ * Return true if a given visibility should be excluded from the fit,
+ * either because it is flagged, or because it lies outside the
+ * selected range of UV radii.
+ *
+ * Input:
+ *  mf      Modfit *  The model-fit descriptor.
+ *  vis Visibility *  The visibility to be checked.
+ * Output:
+ *  return     int    0 - The visibility is usable.
+ *                    1 - The visibility should be skipped.
+ */
+static int skipvis(Modfit *mf, Visibility *vis)
+{
+  float uu = vis->u * mf->ob->stream.uvscale;
+  float vv = vis->v * mf->ob->stream.uvscale;
+  float uvrad = sqrt(uu*uu+vv*vv);
+  return vis->bad || uvrad < mf->uvrmin || uvrad > mf->uvrmax;
+}
+
 /*.......................................................................
  * Construct a UV modelfit object.
  *
@@ -574,20 +838,80 @@ static Modfit *new_Modfit(Observation *ob, Model *mod,
   mf->ibase = 0;
   mf->done = 1;
   mf->eod = 0;
-  mf->vp = NULL;
-  mf->re = 0.0;
-  mf->im = 0.0;
-  mf->wt = 0.0;
+  mf->fv.vp = NULL;
+  mf->fv.re = 0.0;
+  mf->fv.im = 0.0;
+  mf->fv.wt = 0.0;
+  mf->nthread = 0;
+  mf->part = NULL;
+  mf->cmps = NULL;
+  mf->ncmp = 0;
+  mf->cache_cif = -1;
+  mf->dopb = count_antenna_beams(ob->ab) > 0;
+  mf->suboff = NULL;
+  mf->nbtot = 0;
+  mf->pbtab = NULL;
   mf->uvrmin = 1.0;
   mf->uvrmax = 1.0;
 /*
  * Allocate the array for recording complex partial derivatives.
  */
-  mf->vp = (Vispar *) malloc(sizeof(Vispar) * nfree);
-  if(mf->vp==NULL) {
+  mf->fv.vp = (Vispar *) malloc(sizeof(Vispar) * nfree);
+  if(mf->fv.vp==NULL) {
     lprintf(stderr, "Insufficient memory to model fit.\n");
     return del_Modfit(mf);
   };
+/*
+ * Allocate the cache of component values.
+ */
+  {
+    Modcmp *cmp;
+    Fitcmp *fc;
+    mf->cmps = (Fitcmp *) malloc(sizeof(Fitcmp) * mod->ncmp);
+    if(mf->cmps==NULL) {
+      lprintf(stderr, "Insufficient memory to model fit.\n");
+      return del_Modfit(mf);
+    };
+    for(cmp=mod->head,fc=mf->cmps; cmp && mf->ncmp<mod->ncmp;
+	cmp=cmp->next,fc++,mf->ncmp++) {
+      fc->cmp = cmp;
+      fc->sinphi = 0.0;
+      fc->cosphi = 1.0;
+      fc->flux = 0.0;
+      fc->lnfreq = 0.0;
+    };
+  };
+/*
+ * If primary beams are in use, allocate the table of the primary
+ * beam factors of each component on each baseline.
+ */
+  if(mf->dopb) {
+    int isub;
+    mf->suboff = (int *) malloc(sizeof(int) * ob->nsub);
+    if(mf->suboff==NULL) {
+      lprintf(stderr, "Insufficient memory to model fit.\n");
+      return del_Modfit(mf);
+    };
+    for(isub=0; isub<ob->nsub; isub++) {
+      mf->suboff[isub] = mf->nbtot;
+      mf->nbtot += ob->sub[isub].nbase;
+    };
+    mf->pbtab = (float *) malloc(sizeof(float) * mf->ncmp * mf->nbtot);
+    if(mf->pbtab==NULL) {
+      lprintf(stderr, "Insufficient memory to model fit.\n");
+      return del_Modfit(mf);
+    };
+  };
+/*
+ * If more than one thread is available, allocate the partial sums
+ * of the threads of the parallel accumulation mode.
+ */
+  if(get_nthread() > 1) {
+    mf->part = new_Fitparts(get_nthread(), nfree);
+    if(mf->part==NULL)
+      return del_Modfit(mf);
+    mf->nthread = get_nthread();
+  };
 /*
  * Determine the maximum UV radius in the observation. This will
  * be used to scale down U and V, and scale up the major and minor
@@ -612,6 +936,11 @@ static Modfit *new_Modfit(Observation *ob, Model *mod,
   mf->lm = new_Lmfit((void *)mf, nfree, getfree, setfree, getnext);
   if(mf->lm==NULL)
     return del_Modfit(mf);
+/*
+ * Have the sums of each iteration accumulated by multiple threads?
+ */
+  if(mf->nthread > 1)
+    lm_set_getsums(mf->lm, getsums);
 /*
  * Return the new descriptor.
  */
@@ -629,61 +958,224 @@ static Modfit *new_Modfit(Observation *ob, Model *mod,
 static Modfit *del_Modfit(Modfit *mf)
 {
   if(mf) {
-    if(mf->vp)
-      free(mf->vp);
+    if(mf->fv.vp)
+      free(mf->fv.vp);
+    del_Fitparts(mf->part, mf->nthread);
+    if(mf->cmps)
+      free(mf->cmps);
+    if(mf->suboff)
+      free(mf->suboff);
+    if(mf->pbtab)
+      free(mf->pbtab);
     if(mf->lm)
       del_Lmfit(mf->lm);
   };
   return NULL;
 }
 
+/*.......................................................................
+ * Allocate the per-thread partial sums of the parallel accumulation
+ * mode.
+ *
+ * Input:
+ *  nthread     int    The number of threads.
+ *  nfree       int    The number of free parameters.
+ * Output:
+ *  return  Fitpart *  The array of nthread partial sums, or NULL on
+ *                     error.
+ */
+static Fitpart *new_Fitparts(int nthread, int nfree)
+{
+  Fitpart *part;  /* The array to be returned */
+  int ithread;    /* The index of a thread */
+  int row;        /* A row of a Hessian matrix */
+/*
+ * Allocate the array and initialize its elements at least to the point
+ * at which they can safely be passed to del_Fitparts().
+ */
+  part = (Fitpart *) malloc(sizeof(Fitpart) * nthread);
+  if(part==NULL) {
+    lprintf(stderr, "Insufficient memory to model fit.\n");
+    return NULL;
+  };
+  for(ithread=0; ithread<nthread; ithread++) {
+    Fitpart *p = part + ithread;
+    p->fv.vp = NULL;
+    p->fv.re = p->fv.im = p->fv.wt = 0.0;
+    p->mgrad = NULL;
+    p->hessian = NULL;
+    p->cgrad = NULL;
+    p->chisq = 0.0;
+    p->ndata = 0;
+    p->err = 0;
+  };
+/*
+ * Allocate the arrays of each thread. The rows of each Hessian matrix
+ * are allocated as a single block, pointed to by its first row.
+ */
+  for(ithread=0; ithread<nthread; ithread++) {
+    Fitpart *p = part + ithread;
+    p->fv.vp = (Vispar *) malloc(sizeof(Vispar) * nfree);
+    p->mgrad = (double *) malloc(sizeof(double) * nfree);
+    p->cgrad = (double *) malloc(sizeof(double) * nfree);
+    p->hessian = (double **) malloc(sizeof(double *) * nfree);
+    if(p->fv.vp==NULL || p->mgrad==NULL || p->cgrad==NULL ||
+       p->hessian==NULL || (p->hessian[0] = (double *)
+			    malloc(sizeof(double) * nfree * nfree))==NULL) {
+      if(p->hessian) {
+	free(p->hessian);
+	p->hessian = NULL;
+      };
+      lprintf(stderr, "Insufficient memory to model fit.\n");
+      return del_Fitparts(part, nthread);
+    };
+    for(row=1; row<nfree; row++)
+      p->hessian[row] = p->hessian[0] + row * nfree;
+  };
+  return part;
+}
+
+/*.......................................................................
+ * Delete an array of partial sums returned by new_Fitparts().
+ *
+ * Input:
+ *  part    Fitpart *  The array to be deleted (can be NULL).
+ *  nthread     int    The dimension of part[].
+ * Output:
+ *  return  Fitpart *  Always NULL.
+ */
+static Fitpart *del_Fitparts(Fitpart *part, int nthread)
+{
+  if(part) {
+    int ithread;
+    for(ithread=0; ithread<nthread; ithread++) {
+      Fitpart *p = part + ithread;
+      if(p->fv.vp)
+	free(p->fv.vp);
+      if(p->mgrad)
+	free(p->mgrad);
+      if(p->cgrad)
+	free(p->cgrad);
+      if(p->hessian) {
+	free(p->hessian[0]);
+	free(p->hessian);
+      };
+    };
+    free(part);
+  };
+  return NULL;
+}
+
+/*.......................................................................
+ * Compute the values of the components of the variable model that
+ * getmodvis() needs, but which only change when the model parameters
+ * are changed by setfree(), or when a different IF is processed.
+ * Nothing is done if the cache is already up to date.
+ *
+ * Input:
+ *  mf      Modfit *  The model-fit descriptor.
+ *  cif        int    The index of the IF that is about to be processed.
+ */
+static void fit_cache(Modfit *mf, int cif)
+{
+  Observation *ob = mf->ob;  /* The observation being fitted */
+  double freq;               /* The frequency of the IF */
+  int icmp;                  /* The index of a component */
+/*
+ * Is the cache already up to date?
+ */
+  if(mf->cache_cif == cif)
+    return;
+  freq = getfreq(ob, cif);
+  for(icmp=0; icmp<mf->ncmp; icmp++) {
+    Fitcmp *fc = mf->cmps + icmp;
+    Modcmp *cmp = fc->cmp;
+/*
+ * Get the spectral-index scale factor.
+ */
+    double si = cmp->spcind==0.0 ? 1.0 : pow(freq/cmp->freq0, cmp->spcind);
+    fc->sinphi = sin(cmp->phi);
+    fc->cosphi = cos(cmp->phi);
+    fc->flux = cmp->flux * si;
+    fc->lnfreq = cmp->freepar & M_SPCIND ? log(freq/cmp->freq0) : 0.0;
+/*
+ * Tabulate the primary beam factor of the component on each baseline.
+ */
+    if(mf->dopb) {
+      float radius = calc_pointing_offset(ob, cmp->x, cmp->y);
+      float *pb = mf->pbtab + (long) icmp * mf->nbtot;
+      int isub;
+      for(isub=0; isub<ob->nsub; isub++) {
+	Subarray *sub = ob->sub + isub;
+	int base;
+	for(base=0; base<sub->nbase; base++)
+	  *pb++ = pb_bl_factor(sub, base, freq, radius);
+      };
+    };
+  };
+  mf->cache_cif = cif;
+}
+
 /*.......................................................................
  * Calculate the UV plane complex representation of the current variable
  * model and its derivatives wrt each of the free parameters.
  *
+ * Since this function may be called concurrently by multiple threads, it
+ * doesn't modify mf, and the caller must ensure that the Cartesian
+ * forms of the visibilities of the current IF are up to date, by
+ * calling ob_cartesian(ob, CART_DATA | CART_MODEL), and that the
+ * cached component values are up to date, by calling fit_cache().
+ *
  * Input:
  *  mf      Modfit *  The model-fit descriptor.
+ *  isub       int    The index of the sub-array of the visibility.
+ *  ibase      int    The index of the baseline of the visibility.
  *  vis Visibility *  The descriptor of the visibility.
+ * Input/Output:
+ *  fv      Fitvis *  On output:
+ *                     fv->vp[0..nfree-1] The complex partial derivatives
+ *                       of the model wrt each of the model free
+ *                       parameters.
+ *                     fv->re The real part of the (data - model) residual
+ *                       where the model includes both the variable model
+ *                       mf->mod and the established model.
+ *                     fv->im The imaginary part of the (data - model)
+ *                       residual where the model includes both the
+ *                       variable model mf->mod and the established model.
+ *                     fv->wt The weight of the real and imaginary parts
+ *                       of the visibility.
  * Output:
- *  mf->vp[0..nfree-1] The complex partial derivatives of the model wrt
- *                     each of the model free parameters.
- *  mf->re             The real part of the (data - model) residual
- *                     where the model includes both the variable model
- *                     mf->mod and the established model.
- *  mf->im             The imaginary part of the (data - model) residual
- *                     where the model includes both the variable model
- *                     mf->mod and the established model.
- *  mf->wt             The weight of the real and imaginary parts of the
- *                     visibility.
  *  return     int     0 - OK.
  *                     1 - Error.
  */
-static int getmodvis(Modfit *mf, Visibility *vis)
+static int getmodvis(Modfit *mf, int isub, int ibase, Visibility *vis,
+		     Fitvis *fv)
 {
-  Vispar *vp = mf->vp;   /* The model vs. free-parameter partial derivatives */
+  Vispar *vp = fv->vp;   /* The model vs. free-parameter partial derivatives */
   UVstream *uvs = &mf->ob->stream;   /* Stream-specific parameters */
   double uu = vis->u * uvs->uvscale; /* Visibility U in wavelengths */
   double vv = vis->v * uvs->uvscale; /* Visibility V in wavelengths */
   double uun = uu / mf->uvrmax;      /* Re-normalized version of uu */
   double vvn = vv / mf->uvrmax;      /* Re-normalized version of vv */
-  double freq = getfreq(mf->ob, mf->cif); /* The frequency of the current IF */
-  Modcmp *cmp;                       /* The model component being processed */
+  Fitcmp *fc;                        /* The cached values of a component */
+  int icmp;                          /* The index of a component */
   int i;
 /*
  * Get the current (data - established_model) data residual and weight.
  */
-  mf->re = vis->amp * cos(vis->phs) - vis->modamp * cos(vis->modphs);
-  mf->im = vis->amp * sin(vis->phs) - vis->modamp * sin(vis->modphs);
-  mf->wt = vis->wt;
+  fv->re = vis->re - vis->modre;
+  fv->im = vis->im - vis->modim;
+  fv->wt = vis->wt;
 /*
  * Clear the partial-derivative output array.
  */
   for(i=0; i<mf->nfree; i++)
-    mf->vp[i].re = mf->vp[i].im = 0.0;
+    fv->vp[i].re = fv->vp[i].im = 0.0;
 /*
  * Loop through the components of the variable model.
  */
-  for(cmp=mf->mod->head; cmp; cmp=cmp->next) {
+  for(icmp=0,fc=mf->cmps; icmp<mf->ncmp; icmp++,fc++) {
+    Modcmp *cmp = fc->cmp;
 /*
  * Since all model component types are even functions, the only
  * contribution to the model visibility phase is from the centroid
@@ -694,10 +1186,10 @@ static int getmodvis(Modfit *mf, Visibility *vis)
     double cmpre;   /* Real part of model-component visibility */
     double cmpim;   /* Imaginary part of model-component visibility */
 /*
- * Pre-compute useful constants.
+ * Get the cached sin and cos of the position angle.
  */
-    double sinphi = sin(cmp->phi);
-    double cosphi = cos(cmp->phi);
+    double sinphi = fc->sinphi;
+    double cosphi = fc->cosphi;
 /*
  * Compute the elliptically stretched UV radius (also scaled by pi * major
  * axis for convenience).
@@ -705,19 +1197,15 @@ static int getmodvis(Modfit *mf, Visibility *vis)
     double tmpa = (uu * cosphi - vv * sinphi) * cmp->ratio;
     double tmpb = (uu * sinphi + vv * cosphi);
     double uvrad = pi * cmp->major * sqrt(tmpa*tmpa + tmpb*tmpb);
-/*
- * Get the spectral-index scale factor.
- */
-    double si = cmp->spcind==0.0 ? 1.0 : pow(freq/cmp->freq0, cmp->spcind);
 /*
  * Get the primary beam scale factor.
  */
-    double pb = pb_bl_factor(mf->ob->sub + mf->isub, mf->ibase, freq,
-			     calc_pointing_offset(mf->ob, cmp->x, cmp->y));
+    double pb = mf->dopb ?
+      mf->pbtab[(long) icmp * mf->nbtot + mf->suboff[isub] + ibase] : 1.0;
 /*
  * Get the potentially frequency dependent flux of the component.
  */
-    double flux = cmp->flux * si * pb;
+    double flux = fc->flux * pb;
 /*
  * Get the bitmap of free-parameter designations.
  */
@@ -867,7 +1355,7 @@ static int getmodvis(Modfit *mf, Visibility *vis)
  * index.
  */
     if(freepar & M_SPCIND) {
-      double factor = log(freq/cmp->freq0);
+      double factor = fc->lnfreq;
       vp->re = cmpre * factor;
       vp->im = cmpim * factor;
       vp++;
@@ -875,8 +1363,8 @@ static int getmodvis(Modfit *mf, Visibility *vis)
 /*
  * Accumulate the residual visibility.
  */
-    mf->re -= cmpre;
-    mf->im -= cmpim;
+    fv->re -= cmpre;
+    fv->im -= cmpim;
   };
 /*
  * Job completed succesfully.
@@ -0,0 +1,571 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "modgrid.h"
+#include "model.h"
+#include "obs.h"
+#include "pb.h"
+#include "vlbconst.h"
+#include "vlbfft.h"
+#include "logio.h"
+
+/*
+ * When a model contains many delta components, as CLEAN models do,
+ * computing the visibility of every component at every UV coordinate
+ * is very slow. Instead, the components can be placed on a regular
+ * grid in the image plane, this can be Fourier transformed to a regular
+ * UV grid, and the model visibilities can then be interpolated from the
+ * UV grid at the coordinates of the visibilities. This is the inverse
+ * of the gridding that uvinvert() uses to compute dirty maps.
+ *
+ * For interpolation to reproduce the direct transform accurately, the
+ * image grid is made twice as wide as the area occupied by the
+ * components, and a Kaiser-Bessel interpolation function is used. The
+ * effect of the interpolation function is cancelled by dividing the
+ * flux of each component by the Fourier transform of the interpolation
+ * function at its position. With the parameters below, the
+ * interpolated visibilities of a few hundred to a few thousand
+ * components match a double precision direct sum to within 3 parts in
+ * 10^6 of the total absolute flux of the components, with RMS errors
+ * below 1 part in 10^6. This is no worse than the single precision
+ * direct calculation. The remaining errors come from the single
+ * precision UV coordinates and UV grid, not from the interpolation, so
+ * widening the interpolation function doesn't reduce them.
+ */
+#define MG_NMASK 3     /* The number of UV grid cells on either side of */
+                       /*  the nearest cell to a U,V coordinate, from */
+                       /*  which visibilities are interpolated. */
+#define MG_WIDTH (2*MG_NMASK+1) /* The width of the interpolation */
+                                /*  function (UV grid cells) */
+#define MG_NKERN 4096  /* The number of samples of the interpolation */
+                       /*  function between its center and its edge */
+
+/*
+ * Model components can only be gridded if they lie on a regular
+ * lattice of positions, such as the pixels of a CLEAN map. Components
+ * are deemed to lie on such a lattice if their positions are within
+ * MG_TOL lattice spacings of the lattice points. The spacing of the
+ * lattice is taken to be the smallest separation between components,
+ * divided by an integer up to MG_MAXDIV.
+ */
+#define MG_TOL 1.0e-3
+#define MG_MAXDIV 8
+
+/*
+ * The maximum number of pixels in the UV grid.
+ */
+#define MG_MAXPIX (1L<<24)
+
+/*
+ * The following estimates of the relative costs of interpolating a
+ * visibility, and of each pixel of the FFT, in units of the cost of
+ * computing one component at one visibility directly, are used to
+ * decide whether gridding the model would be faster.
+ */
+#define MG_VISCOST 24.0
+#define MG_FFTCOST 0.5
+
+struct Modgrid {
+  float *grid;          /* The (nx/2+1) x ny complex half conjugate */
+                        /*  symmetric UV grid, with U=0,V=0 at element 0 */
+  int nx, ny;           /* The dimensions of the equivalent image grid */
+  double uinc, vinc;    /* The U and V widths of the UV grid cells */
+                        /*  (wavelengths) */
+  double xc, yc;        /* The position that corresponds to the center */
+                        /*  of the image grid (radians) */
+  float kscale;         /* The conversion factor from a distance in UV */
+                        /*  grid cells to an index in kern[] */
+  float kern[MG_NKERN+2]; /* The normalized interpolation function */
+};
+
+/*
+ * Describe the lattice of the components along one axis.
+ */
+typedef struct {
+  double inc;           /* The lattice spacing (radians) */
+  double cent;          /* The lattice point used as the grid center */
+  long hwid;            /* The max distance of any component from cent, */
+                        /*  in multiples of inc */
+} Mglat;
+
+static int mg_gridable(Modcmp *cmp);
+static int mg_lattice(Model *mod, int isx, Mglat *lat);
+static int mg_dim(Mglat *lat, float umax, double *pixsize);
+static double mg_kbft(double x);
+static double mg_bessi0(double x);
+
+/*
+ * The shape parameter of the Kaiser-Bessel function for an image grid
+ * that is twice as wide as the area occupied by the components.
+ */
+#define MG_BETA (pi * sqrt(0.5625 * MG_WIDTH * MG_WIDTH - 0.8))
+
+/*.......................................................................
+ * Create the UV grid of the gridable components of a model, if doing
+ * so would be faster than computing their visibilities directly.
+ *
+ * Input:
+ *  ob   Observation *  The observation whose visibilities are to be
+ *                      computed. This must be in the OB_SELECT state.
+ *  mod        Model *  The model to be gridded. Only delta components
+ *                      that don't have spectral indexes can be gridded.
+ * Output:
+ *  return   Modgrid *  The new UV grid, or NULL if the model can't be
+ *                      gridded, if gridding wouldn't be faster, or on
+ *                      error. In all of these cases, the visibilities of
+ *                      the model should be computed directly.
+ */
+Modgrid *new_Modgrid(Observation *ob, Model *mod)
+{
+  Modgrid *mg;          /* The object to be returned */
+  Modcmp *cmp;          /* A component of the model */
+  UVrange *uvr;         /* The range of UV coordinates of the data */
+  Mglat xlat, ylat;     /* The lattices of the component positions */
+  double xpix, ypix;    /* The dimensions of the image grid pixels */
+  double ncmp;          /* The number of gridable components */
+  double nvis;          /* The number of visibilities to be computed */
+  double npix;          /* The number of pixels in the grid */
+  int nif;              /* The number of sampled IFs */
+  int cif;              /* The index of an IF */
+  int i;
+/*
+ * Primary beams make the visibilities of each component depend on the
+ * baseline, so they can't be gridded.
+ */
+  if(!mod || count_antenna_beams(ob->ab) > 0)
+    return NULL;
+/*
+ * Count the gridable components.
+ */
+  ncmp = 0.0;
+  for(cmp=mod->head; cmp; cmp=cmp->next) {
+    if(mg_gridable(cmp))
+      ncmp++;
+  };
+/*
+ * Get an upper limit on the number of visibilities to be computed.
+ */
+  nif = 0;
+  for(cif=0; (cif=nextIF(ob, cif, 1, 1)) >= 0; cif++)
+    nif++;
+  nvis = (double) ob->nrec * ob->nbmax * nif;
+/*
+ * Don't bother gridding the model if the cost of interpolating the
+ * visibilities alone would exceed that of computing them directly.
+ */
+  if(ncmp < 2.0 * MG_VISCOST)
+    return NULL;
+/*
+ * Find the lattices of positions on which the components lie.
+ */
+  if(mg_lattice(mod, 1, &xlat) || mg_lattice(mod, 0, &ylat))
+    return NULL;
+/*
+ * Get the range of UV coordinates to be interpolated.
+ */
+  uvr = uvrange(ob, 1, 0, 0.0f, 0.0f);
+  if(!uvr || uvr->umax <= 0.0f || uvr->vmax <= 0.0f)
+    return NULL;
+/*
+ * Allocate the container.
+ */
+  mg = (Modgrid *) malloc(sizeof(Modgrid));
+  if(!mg)
+    return NULL;
+  mg->grid = NULL;
+/*
+ * Choose the dimensions of the grid.
+ */
+  mg->nx = mg_dim(&xlat, uvr->umax, &xpix);
+  mg->ny = mg_dim(&ylat, uvr->vmax, &ypix);
+  npix = (double) mg->nx * mg->ny;
+  if(mg->nx == 0 || mg->ny == 0 || npix > MG_MAXPIX ||
+     ncmp * nvis < 2.0 * (nvis * MG_VISCOST +
+			  npix * log(npix) / log(2.0) * MG_FFTCOST))
+    return del_Modgrid(mg);
+  mg->uinc = 1.0 / (mg->nx * xpix);
+  mg->vinc = 1.0 / (mg->ny * ypix);
+  mg->xc = xlat.cent;
+  mg->yc = ylat.cent;
+/*
+ * Allocate the grid.
+ */
+  mg->grid = (float *) calloc((size_t) (mg->nx + 2) * mg->ny, sizeof(float));
+  if(!mg->grid)
+    return del_Modgrid(mg);
+/*
+ * Tabulate the Kaiser-Bessel interpolation function, normalized by its
+ * integral.
+ */
+  mg->kscale = MG_NKERN / (MG_WIDTH / 2.0);
+  for(i=0; i<MG_NKERN+2; i++) {
+    double t = 2.0 * i / (MG_WIDTH * mg->kscale);
+    mg->kern[i] = t < 1.0 ?
+      mg_bessi0(MG_BETA * sqrt(1.0 - t * t)) / (MG_WIDTH * mg_kbft(0.0)) :
+      0.0;
+  };
+/*
+ * Place the components on the image grid, dividing their fluxes by the
+ * transform of the interpolation function at their positions.
+ */
+  for(cmp=mod->head; cmp; cmp=cmp->next) {
+    if(mg_gridable(cmp)) {
+      long ix = floor((cmp->x - mg->xc) / xpix + 0.5);
+      long iy = floor((cmp->y - mg->yc) / ypix + 0.5);
+      mg->grid[(iy + mg->ny/2) * mg->nx + ix + mg->nx/2] += cmp->flux *
+	mg_kbft(0.0) / mg_kbft((double) ix / mg->nx) *
+	mg_kbft(0.0) / mg_kbft((double) iy / mg->ny);
+    };
+  };
+/*
+ * Transform the image grid to the UV grid, then move the phase center
+ * to the center of the image grid.
+ */
+  if(newfft(mg->grid, mg->nx/2, mg->ny, 1, 1, 0))
+    return del_Modgrid(mg);
+  cnj_shift(mg->grid, mg->nx, mg->ny);
+  lprintf(stdout, "Interpolating the visibilities of %d components from a"
+	  " %dx%d UV grid.\n", (int) ncmp, mg->nx, mg->ny);
+  return mg;
+}
+
+/*.......................................................................
+ * Delete a Modgrid object.
+ *
+ * Input:
+ *  mg      Modgrid *  The object to be deleted.
+ * Output:
+ *  return  Modgrid *  The deleted object (always NULL).
+ */
+Modgrid *del_Modgrid(Modgrid *mg)
+{
+  if(mg) {
+    if(mg->grid)
+      free(mg->grid);
+    free(mg);
+  };
+  return NULL;
+}
+
+/*.......................................................................
+ * Return true if a given model component is represented by a Modgrid.
+ *
+ * Input:
+ *  mg     Modgrid *  The UV grid of the model, or NULL.
+ *  cmp     Modcmp *  A component of the model.
+ * Output:
+ *  return     int    1 - The component is in the grid.
+ *                    0 - The component must be computed directly.
+ */
+int modgrid_cmp(Modgrid *mg, Modcmp *cmp)
+{
+  return mg && mg_gridable(cmp);
+}
+
+/*.......................................................................
+ * Add the visibility of the gridded components at a given UV
+ * coordinate to a model visibility.
+ *
+ * Input:
+ *  mg     Modgrid *  The UV grid of the model.
+ *  uu       float    The U coordinate (wavelengths).
+ *  vv       float    The V coordinate (wavelengths).
+ * Input/Output:
+ *  re, im   float *  The real and imaginary parts of the visibility
+ *                    of the gridded components will be added to *re
+ *                    and *im.
+ * Output:
+ *  return     int    0 - OK.
+ *                    1 - The UV coordinate lies outside the grid, so
+ *                        the visibility must be computed directly.
+ */
+int modgrid_vis(Modgrid *mg, float uu, float vv, float *re, float *im)
+{
+  float wu[MG_WIDTH];   /* The interpolation weights along U */
+  float wv[MG_WIDTH];   /* The interpolation weights along V */
+  double fu, fv;        /* The UV coordinate in units of grid cells */
+  double sre, sim;      /* The interpolated real and imaginary parts */
+  int nrow = mg->nx/2 + 1; /* The number of complex elements per row */
+  int conj;             /* True if fu,fv were negated */
+  int iu0, iv0;         /* The UV grid cell that is closest to fu,fv */
+  int i, j;
+/*
+ * The grid only records half of the conjugate-symmetric UV plane, so
+ * interpolate negative U coordinates from the conjugate point.
+ */
+  fu = uu / mg->uinc;
+  fv = vv / mg->vinc;
+  conj = fu < 0.0;
+  if(conj) {
+    fu = -fu;
+    fv = -fv;
+  };
+/*
+ * Does the interpolation area lie within the grid?
+ */
+  if(fu > mg->nx/2 - MG_NMASK - 1 || fabs(fv) > mg->ny/2 - MG_NMASK - 1)
+    return 1;
+/*
+ * Compute the interpolation weights.
+ */
+  iu0 = (int) floor(fu + 0.5);
+  iv0 = (int) floor(fv + 0.5);
+  for(i=0; i<MG_WIDTH; i++) {
+    double du = fabs(iu0 + i - MG_NMASK - fu) * mg->kscale;
+    double dv = fabs(iv0 + i - MG_NMASK - fv) * mg->kscale;
+    int ku = (int) du;
+    int kv = (int) dv;
+    wu[i] = mg->kern[ku] + (du - ku) * (mg->kern[ku+1] - mg->kern[ku]);
+    wv[i] = mg->kern[kv] + (dv - kv) * (mg->kern[kv+1] - mg->kern[kv]);
+  };
+/*
+ * Interpolate the visibility.
+ */
+  sre = sim = 0.0;
+  for(j=0; j<MG_WIDTH; j++) {
+    int iv = iv0 + j - MG_NMASK;
+    float *row = mg->grid + 2L * nrow * (iv < 0 ? iv + mg->ny : iv);
+    float *crow = mg->grid + 2L * nrow * (iv > 0 ? mg->ny - iv : -iv);
+    double rsum = 0.0, isum = 0.0;
+    for(i=0; i<MG_WIDTH; i++) {
+      int iu = iu0 + i - MG_NMASK;
+/*
+ * Cells at negative U are the conjugates of the cells at -U,-V.
+ */
+      if(iu >= 0) {
+	rsum += wu[i] * row[2*iu];
+	isum += wu[i] * row[2*iu+1];
+      } else {
+	rsum += wu[i] * crow[-2*iu];
+	isum -= wu[i] * crow[-2*iu+1];
+      };
+    };
+    sre += wv[j] * rsum;
+    sim += wv[j] * isum;
+  };
+  if(conj)
+    sim = -sim;
+/*
+ * Shift the phase center from the center of the image grid to the
+ * origin of the coordinates of the components.
+ */
+  if(mg->xc != 0.0 || mg->yc != 0.0) {
+    double phs = twopi * (uu * mg->xc + vv * mg->yc);
+    double cosphs = cos(phs);
+    double sinphs = sin(phs);
+    double tmp = sre * cosphs - sim * sinphs;
+    sim = sre * sinphs + sim * cosphs;
+    sre = tmp;
+  };
+  *re += sre;
+  *im += sim;
+  return 0;
+}
+
+/*.......................................................................
+ * Return true if a given component can be gridded.
+ */
+static int mg_gridable(Modcmp *cmp)
+{
+  return cmp->type == M_DELT && cmp->spcind == 0.0f;
+}
+
+/*.......................................................................
+ * Find a regular lattice that contains the X or Y coordinates of all of
+ * the gridable components of a model.
+ *
+ * Input:
+ *  mod     Model *  The model.
+ *  isx       int    True for the X axis, false for the Y axis.
+ * Output:
+ *  lat     Mglat *  The lattice.
+ *  return    int    0 - OK.
+ *                   1 - The components don't lie on a lattice.
+ */
+static int mg_lattice(Model *mod, int isx, Mglat *lat)
+{
+  Modcmp *cmp;          /* A component of the model */
+  double org = 0.0;     /* The coordinate of the first component */
+  double wmin, wmax;    /* The range of coordinates wrt org */
+  double dmin;          /* The smallest non-zero separation from org */
+  double wfar;          /* The coordinate furthest from org, wrt org */
+  int first = 1;        /* True until the first component is seen */
+  int div;              /* The divisor of dmin being tried */
+/*
+ * Get the range of coordinates with respect to the coordinate of the
+ * first component.
+ */
+  wmin = wmax = wfar = 0.0;
+  for(cmp=mod->head; cmp; cmp=cmp->next) {
+    if(mg_gridable(cmp)) {
+      double w = isx ? cmp->x : cmp->y;
+      if(first) {
+	org = w;
+	first = 0;
+      };
+      w -= org;
+      if(w < wmin)
+	wmin = w;
+      if(w > wmax)
+	wmax = w;
+      if(fabs(w) > fabs(wfar))
+	wfar = w;
+    };
+  };
+/*
+ * If all of the components have the same coordinate, any spacing will
+ * do, so leave it to mg_dim() to choose one.
+ */
+  if(wmax - wmin <= 0.0) {
+    lat->inc = 0.0;
+    lat->cent = org;
+    lat->hwid = 0;
+    return 0;
+  };
+/*
+ * Find the smallest separation from the first component, ignoring
+ * differences that are due to rounding errors.
+ */
+  dmin = wmax - wmin;
+  for(cmp=mod->head; cmp; cmp=cmp->next) {
+    if(mg_gridable(cmp)) {
+      double d = fabs((isx ? cmp->x : cmp->y) - org);
+      if(d > (wmax - wmin) * 1.0e-6 && d < dmin)
+	dmin = d;
+    };
+  };
+/*
+ * Try dividing the above separation by successive integers, until a
+ * spacing is found for which all of the components lie on the lattice.
+ * The component coordinates are single precision, so the separation
+ * of two nearby components is only known to a few parts in 10^5.
+ * Refine each trial spacing by dividing the separation of the most
+ * distant component by the number of spacings that it spans.
+ */
+  for(div=1; div<=MG_MAXDIV; div++) {
+    double inc = dmin / div;
+    inc = wfar / floor(fabs(wfar) / inc + 0.5);
+    if(inc < 0.0)
+      inc = -inc;
+    for(cmp=mod->head; cmp; cmp=cmp->next) {
+      if(mg_gridable(cmp)) {
+	double w = ((isx ? cmp->x : cmp->y) - org) / inc;
+	if(fabs(w - floor(w + 0.5)) > MG_TOL)
+	  break;
+      };
+    };
+/*
+ * Did all of the components lie on the lattice? If so, use the
+ * lattice point closest to the middle of the components as the center
+ * of the grid.
+ */
+    if(!cmp) {
+      lat->inc = inc;
+      lat->cent = org + floor((wmin + wmax) / 2.0 / inc + 0.5) * inc;
+      lat->hwid = (long) floor((wmax - wmin) / 2.0 / inc + 0.5) + 1;
+      return 0;
+    };
+  };
+  return 1;
+}
+
+/*.......................................................................
+ * Choose the number of pixels and the pixel size of one axis of the
+ * image grid.
+ *
+ * Input:
+ *  lat      Mglat *  The lattice of the components along this axis.
+ *  umax     float    The largest UV coordinate along the conjugate
+ *                    axis, which must be interpolated (wavelengths).
+ * Output:
+ *  pixsize double *  The size of each pixel (radians).
+ *  return     int    The number of pixels, or 0 if the grid would be
+ *                    too large.
+ */
+static int mg_dim(Mglat *lat, float umax, double *pixsize)
+{
+  double pmax = 0.4 / umax; /* The largest usable pixel size */
+  double nsub;              /* The number of pixels per lattice spacing */
+  double n;                 /* The number of pixels */
+/*
+ * The pixels must be small enough to make the UV grid wide enough to
+ * contain all of the UV coordinates, plus the width of the
+ * interpolation function. Subdivide the lattice spacing if needed.
+ */
+  if(lat->inc <= 0.0) {
+    *pixsize = pmax;
+    nsub = 1.0;
+  } else {
+    nsub = ceil(lat->inc / pmax);
+    *pixsize = lat->inc / nsub;
+  };
+/*
+ * Make the grid twice as wide as the area occupied by the components.
+ */
+  n = 4.0 * (lat->hwid * nsub + 1);
+/*
+ * Leave room in the UV grid for the interpolation function beyond umax.
+ */
+  if(n < 2.0 * (MG_NMASK + 2) / (0.5 - umax * *pixsize))
+    n = 2.0 * (MG_NMASK + 2) / (0.5 - umax * *pixsize);
+  if(n < 32.0)
+    n = 32.0;
+  if(n > MG_MAXPIX)
+    return 0;
+/*
+ * Round up to a size that newfft() can transform as a real array.
+ */
+  {
+    int size = 4 * (int) ceil(n / 4.0);
+    while(!fft_size_ok(size/2))
+      size += 4;
+    return size;
+  };
+}
+
+/*.......................................................................
+ * Return the Fourier transform of the Kaiser-Bessel interpolation
+ * function, divided by its width, at a given position in the image
+ * grid.
+ *
+ * Input:
+ *  x      double   The position, as a fraction of the width of the
+ *                  image grid (-0.5 to 0.5).
+ * Output:
+ *  return double   The transform.
+ */
+static double mg_kbft(double x)
+{
+  double a = pi * MG_WIDTH * x;
+  double s = MG_BETA * MG_BETA - a * a;
+  if(s > 0.0) {
+    s = sqrt(s);
+    return sinh(s) / s;
+  } else if(s < 0.0) {
+    s = sqrt(-s);
+    return sin(s) / s;
+  };
+  return 1.0;
+}
+
+/*.......................................................................
+ * Return the modified Bessel function of the first kind, of order 0.
+ *
+ * Input:
+ *  x      double   The argument (0 <= x <= 20 or so).
+ * Output:
+ *  return double   I0(x).
+ */
+static double mg_bessi0(double x)
+{
+  double term = 1.0;    /* The latest term of the series */
+  double sum = 1.0;     /* The sum of the series */
+  double q = x * x / 4.0;
+  int k;
+  for(k=1; term > sum * 1.0e-16; k++) {
+    term *= q / ((double) k * k);
+    sum += term;
+  };
+  return sum;
+}
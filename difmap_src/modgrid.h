@@ -0,0 +1,40 @@
+#ifndef modgrid_h
+#define modgrid_h
+
+#include "model.h"
+#include "obs.h"
+
+/*
+ * A Modgrid object records the Fourier transform of the delta
+ * components of a model, sampled on a regular UV grid, from which the
+ * model visibilities of these components can be interpolated much
+ * more quickly than they can be computed directly, when the model
+ * contains many components.
+ */
+typedef struct Modgrid Modgrid;
+
+/*
+ * Create the UV grid of the gridable components of a model, if doing
+ * so would be faster than computing their visibilities directly.
+ * NULL is returned if not, or on error.
+ */
+Modgrid *new_Modgrid(Observation *ob, Model *mod);
+
+/*
+ * Delete a Modgrid object.
+ */
+Modgrid *del_Modgrid(Modgrid *mg);
+
+/*
+ * Return true if a given model component is represented by a Modgrid.
+ */
+int modgrid_cmp(Modgrid *mg, Modcmp *cmp);
+
+/*
+ * Add the interpolated visibility of the gridded components at a given
+ * UV coordinate (wavelengths) to *re and *im. If the UV coordinate
+ * lies outside the grid, 1 is returned, and nothing is added.
+ */
+int modgrid_vis(Modgrid *mg, float uu, float vv, float *re, float *im);
+
+#endif
@@ -7,6 +7,8 @@
 #include "besj.h"
 #include "vlbconst.h"
 #include "obs.h"
+#include "pb.h"
+#include "partask.h"
 #include "logio.h"
 
 /*
@@ -20,6 +22,89 @@ static int ready=0;                /* True after table is initialized */
 static const int soffset=CTSIZ+(CTSIZ/4); /* Index to cos(360+90 degrees) */
 
 static void add_cmpvis_to_modvis(float amp, float phs, float *re, float *im);
+static double cmp_shape(Modcmp *cmp, double sinphi, double cosphi,
+			double uu, double vv);
+
+/*
+ * The batched model-visibility kernel, modvis_add(), computes the
+ * visibilities of a list of components at an array of U,V coordinates,
+ * one component at a time. The phase term of each component is
+ * accumulated by one of the following row kernels, which add
+ * amp[i]*exp(2.pi.i.(uu[i]*x + vv[i]*y)) to re[i],im[i] for i=0..n-1.
+ */
+#define MV_ROW_FN(fn) void (fn)(const double *uu, const double *vv, \
+				const double *amp, double x, double y, \
+				int n, double *re, double *im)
+
+static MV_ROW_FN(mv_row);
+
+/*
+ * Where the compiler supports it, versions of the row kernel that use
+ * the SSE2 and AVX instructions of x86 processors are also compiled,
+ * and the fastest version that the host processor supports is selected
+ * at run time, by mv_select_kernel().
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || \
+     __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define X86_SIMD 1
+#include <immintrin.h>
+static MV_ROW_FN(mv_row_sse2) __attribute__((target("sse2")));
+static MV_ROW_FN(mv_row_avx) __attribute__((target("avx")));
+#else
+#define X86_SIMD 0
+#endif
+
+static MV_ROW_FN(*mv_row_kernel) = NULL;
+static void mv_select_kernel(void);
+
+/*
+ * The cost of a call to modvis_add() is roughly proportional to the
+ * number of components times the number of visibilities. The
+ * visibilities are only divided between threads when each thread will
+ * get at least MV_THREAD_WORK such component visibilities.
+ */
+#define MV_THREAD_WORK 262144L
+
+/*
+ * Describe a component in the form used by modvis_add().
+ */
+typedef struct {
+  Modcmp *cmp;          /* The original component */
+  double x, y;          /* The position of the component (radians) */
+  double sinphi, cosphi;/* The sin and cos of the position angle */
+  float radius;         /* The distance of the component from the */
+                        /*  pointing center (radians) */
+  double flux;          /* The flux of the component at the frequency */
+                        /*  of the latest call to modvis_add() */
+} Mvcmp;
+
+struct Modvis {
+  Mvcmp *cmps;          /* The array of ncmp components */
+  int ncmp;             /* The number of components in cmps[] */
+  int ngrid;            /* The components that are represented by a */
+                        /*  Modgrid are in cmps[0..ngrid-1] */
+  int dopb;             /* True if primary beams are in use */
+  double *amp;          /* Work array for the amplitudes of a */
+                        /*  component at each visibility */
+  int namp;             /* The allocated dimension of amp[] */
+};
+
+/*
+ * Describe a call to modvis_add() to the threads that execute it.
+ */
+typedef struct {
+  Modvis *mv;           /* The component list */
+  Subarray *sub;        /* The sub-array of the visibilities */
+  float freq;           /* The frequency of the visibilities (Hz) */
+  int ca;               /* The index of the first component in mv->cmps[] */
+  int nvis;             /* The number of visibilities */
+  const int *base;      /* The baseline indexes of the visibilities */
+  const double *uu;     /* The U coordinates of the visibilities */
+  const double *vv;     /* The V coordinates of the visibilities */
+  double *re, *im;      /* The model visibilities */
+} Mvtask;
+
+static PARTASK_FN(modvis_task);
 
 /*.......................................................................
  * Compute the visibility amplitude and phase at a given U,V coordinate
@@ -69,49 +154,7 @@ void cmpvis(Modcmp *cmp, Subarray *sub, int base, float freq, float uu,
  * The other types are a little more complicated!
  */
   else {
-/*
- * Pre-compute parameters.
- */
-    double sinphi = sin(cmp->phi);
-    double cosphi = cos(cmp->phi);
-    double tmpa = (vv*cosphi+uu*sinphi);
-    double tmpb = (cmp->ratio*(uu*cosphi-vv*sinphi));
-    double tmpc = pi * cmp->major * sqrt(tmpa*tmpa + tmpb*tmpb);
-/*
- * Limit tmpc to sensible values to prevent underflow,overflow and
- * divide-by-zero errors.
- */
-    if(tmpc < 1.0e-9)
-      tmpc = 1.0e-9;
-/*
- * See the "Introduction to Caltech VLBI programs" for details of
- * the type-specific calculations below.
- */
-    switch(cmp->type) {
-    case M_GAUS:
-      cmpamp = flux * (tmpc<12.0 ? exp(-0.3606737602 * tmpc*tmpc):0.0);
-      break;
-    case M_DISK:
-      cmpamp = 2.0f * flux * c_besj1(tmpc)/tmpc;
-      break;
-    case M_ELLI:
-      cmpamp = 3.0f * flux * (sin(tmpc)-tmpc*cos(tmpc))/(tmpc*tmpc*tmpc);
-      break;
-    case M_RING:
-      cmpamp = flux * c_besj0(tmpc);
-      break;
-    case M_RECT:
-      tmpa = pi * cmp->major * (uu*sinphi+vv*cosphi);
-      cmpamp = flux * (fabs(tmpa) > 0.001 ? sin(tmpa)/tmpa : 1.0);
-      break;
-    case M_SZ:
-      cmpamp = flux * (tmpc < 50.0 ? exp(-tmpc) : 0.0) / tmpc;
-      break;
-    default:
-      lprintf(stderr, "Ignoring unknown model component type: %d\n", cmp->type);
-      cmpamp = 0.0f;
-      cmpphs = 0.0f;
-    };
+    cmpamp = flux * cmp_shape(cmp, sin(cmp->phi), cos(cmp->phi), uu, vv);
   };
 /*
  * Assign the return values.
@@ -223,3 +266,482 @@ static void add_cmpvis_to_modvis(float amp, float phs, float *re, float *im)
   *im += amp * (*cos_ptr + err_indx*(cos_ptr[-isign] - *cos_ptr));
   return;
 }
+
+/*.......................................................................
+ * Return the factor by which the visibility amplitude of a non-delta
+ * component, at a given U,V coordinate, differs from its flux.
+ *
+ * Input:
+ *  cmp        Modcmp *  The descriptor of the model component.
+ *  sinphi     double    sin(cmp->phi).
+ *  cosphi     double    cos(cmp->phi).
+ *  uu         double    The U coordinate in the UV plane (wavelengths).
+ *  vv         double    The V coordinate in the UV plane (wavelengths).
+ * Output:
+ *  return     double    The amplitude factor.
+ */
+static double cmp_shape(Modcmp *cmp, double sinphi, double cosphi,
+			double uu, double vv)
+{
+/*
+ * Pre-compute parameters.
+ */
+  double tmpa = (vv*cosphi+uu*sinphi);
+  double tmpb = (cmp->ratio*(uu*cosphi-vv*sinphi));
+  double tmpc = pi * cmp->major * sqrt(tmpa*tmpa + tmpb*tmpb);
+/*
+ * Limit tmpc to sensible values to prevent underflow,overflow and
+ * divide-by-zero errors.
+ */
+  if(tmpc < 1.0e-9)
+    tmpc = 1.0e-9;
+/*
+ * See the "Introduction to Caltech VLBI programs" for details of
+ * the type-specific calculations below.
+ */
+  switch(cmp->type) {
+  case M_DELT:
+    return 1.0;
+  case M_GAUS:
+    return tmpc<12.0 ? exp(-0.3606737602 * tmpc*tmpc) : 0.0;
+  case M_DISK:
+    return 2.0 * c_besj1(tmpc)/tmpc;
+  case M_ELLI:
+    return 3.0 * (sin(tmpc)-tmpc*cos(tmpc))/(tmpc*tmpc*tmpc);
+  case M_RING:
+    return c_besj0(tmpc);
+  case M_RECT:
+    tmpa = pi * cmp->major * (uu*sinphi+vv*cosphi);
+    return fabs(tmpa) > 0.001 ? sin(tmpa)/tmpa : 1.0;
+  case M_SZ:
+    return (tmpc < 50.0 ? exp(-tmpc) : 0.0) / tmpc;
+  default:
+    lprintf(stderr, "Ignoring unknown model component type: %d\n", cmp->type);
+    break;
+  };
+  return 0.0;
+}
+
+/*.......................................................................
+ * Prepare a list of model components for the computation of their
+ * visibilities by modvis_add(). Per-component quantities, such as the
+ * position angle terms and the distances from the pointing center, are
+ * computed here once, instead of at each visibility.
+ *
+ * Input:
+ *  ob   Observation *  The observation whose visibilities are to be
+ *                      computed.
+ *  mod        Model *  The model whose components are to be computed.
+ *  cmp       Modcmp *  If mod==NULL, component cmp will be used instead.
+ *  mg       Modgrid *  If not NULL, the UV grid from which the
+ *                      visibilities of some of the components of mod
+ *                      are to be interpolated where possible (see
+ *                      the dogrid argument of modvis_add()).
+ * Output:
+ *  return   Modvis *   The new component list, or NULL on error.
+ */
+Modvis *new_Modvis(Observation *ob, Model *mod, Modcmp *cmp, Modgrid *mg)
+{
+  Modvis *mv;     /* The object to be returned */
+  Modcmp *head;   /* The first of the components to be computed */
+  Modcmp *c;      /* A component being processed */
+  int ingrid;     /* True while collecting the components of mg */
+/*
+ * Get the start of the list of components.
+ */
+  head = mod ? mod->head : cmp;
+/*
+ * Allocate the container.
+ */
+  mv = (Modvis *) malloc(sizeof(Modvis));
+  if(!mv) {
+    lprintf(stderr, "new_Modvis: Insufficient memory.\n");
+    return NULL;
+  };
+  mv->cmps = NULL;
+  mv->ncmp = 0;
+  mv->ngrid = 0;
+  mv->dopb = count_antenna_beams(ob->ab) > 0;
+  mv->amp = NULL;
+  mv->namp = 0;
+/*
+ * Allocate the array of components.
+ */
+  mv->cmps = (Mvcmp *) malloc(sizeof(Mvcmp) * (mod ? (mod->ncmp+1) : 1));
+  if(!mv->cmps) {
+    lprintf(stderr, "new_Modvis: Insufficient memory.\n");
+    return del_Modvis(mv);
+  };
+/*
+ * Copy the components, placing those that are represented by mg before
+ * the rest.
+ */
+  for(ingrid=1; ingrid>=0; ingrid--) {
+    for(c=head; c; c = mod ? c->next : NULL) {
+      if(!modgrid_cmp(mg, c) == !ingrid) {
+	Mvcmp *mc = mv->cmps + mv->ncmp++;
+	mc->cmp = c;
+	mc->x = c->x;
+	mc->y = c->y;
+	mc->sinphi = sin(c->phi);
+	mc->cosphi = cos(c->phi);
+	mc->radius = mv->dopb ? calc_pointing_offset(ob, c->x, c->y) : 0.0f;
+	mc->flux = c->flux;
+      };
+    };
+    if(ingrid)
+      mv->ngrid = mv->ncmp;
+  };
+  return mv;
+}
+
+/*.......................................................................
+ * Delete a Modvis object.
+ *
+ * Input:
+ *  mv      Modvis *  The object to be deleted.
+ * Output:
+ *  return  Modvis *  The deleted object (always NULL).
+ */
+Modvis *del_Modvis(Modvis *mv)
+{
+  if(mv) {
+    if(mv->cmps)
+      free(mv->cmps);
+    if(mv->amp)
+      free(mv->amp);
+    free(mv);
+  };
+  return NULL;
+}
+
+/*.......................................................................
+ * Add the visibilities of a list of model components to the model
+ * visibilities of an array of visibilities of one sub-array and IF.
+ * This is equivalent to calling add_cmp_to_modvis() for each
+ * component at each visibility, but the phase terms are computed with
+ * a vectorised kernel that is more accurate than the cosine table of
+ * add_cmp_to_modvis(), and the visibilities are divided between
+ * threads.
+ *
+ * Input:
+ *  mv       Modvis *  The components, from new_Modvis().
+ *  sub    Subarray *  The parent sub-array of the visibilities.
+ *  freq      float    The frequency of the visibilities (Hz).
+ *  dogrid      int    If false, skip the components that are
+ *                     represented by the Modgrid that was passed to
+ *                     new_Modvis(), because their contributions have
+ *                     already been interpolated from it.
+ *  nvis        int    The number of visibilities.
+ *  base        int *  The baseline indexes of the nvis visibilities.
+ *  uu       double *  The U coordinates of the nvis visibilities
+ *                     (wavelengths).
+ *  vv       double *  The V coordinates of the nvis visibilities
+ *                     (wavelengths).
+ * Input/Output:
+ *  re, im   double *  The real and imaginary parts of the components
+ *                     will be added to re[i],im[i], for i=0..nvis-1.
+ * Output:
+ *  return      int    0 - OK.
+ *                     1 - Error.
+ */
+int modvis_add(Modvis *mv, Subarray *sub, float freq, int dogrid, int nvis,
+	       const int *base, const double *uu, const double *vv,
+	       double *re, double *im)
+{
+  Mvtask mt;    /* The description of the task */
+  int nthread;  /* The number of threads to use */
+  int i;
+/*
+ * Nothing to compute?
+ */
+  if(nvis < 1)
+    return 0;
+/*
+ * Select the row kernel on the first call.
+ */
+  if(!mv_row_kernel)
+    mv_select_kernel();
+/*
+ * Make sure that the work array can hold the amplitudes of nvis
+ * visibilities.
+ */
+  if(mv->namp < nvis) {
+    double *amp = (double *) realloc(mv->amp, sizeof(double) * nvis);
+    if(!amp) {
+      lprintf(stderr, "modvis_add: Insufficient memory.\n");
+      return 1;
+    };
+    mv->amp = amp;
+    mv->namp = nvis;
+  };
+/*
+ * Compute the fluxes of the components at the specified frequency.
+ */
+  for(i=0; i<mv->ncmp; i++) {
+    Mvcmp *mc = mv->cmps + i;
+    Modcmp *cmp = mc->cmp;
+    mc->flux = cmp->spcind==0.0 ? cmp->flux :
+      cmp->flux * pow(freq/cmp->freq0, cmp->spcind);
+  };
+/*
+ * Describe the task.
+ */
+  mt.mv = mv;
+  mt.sub = sub;
+  mt.freq = freq;
+  mt.ca = dogrid ? 0 : mv->ngrid;
+  mt.nvis = nvis;
+  mt.base = base;
+  mt.uu = uu;
+  mt.vv = vv;
+  mt.re = re;
+  mt.im = im;
+/*
+ * Work out how many threads it is worth using.
+ */
+  nthread = get_nthread();
+  if(nthread > (double) (mv->ncmp - mt.ca) * nvis / MV_THREAD_WORK)
+    nthread = (double) (mv->ncmp - mt.ca) * nvis / MV_THREAD_WORK;
+  if(nthread > nvis)
+    nthread = nvis;
+  run_partask(nthread, modvis_task, &mt);
+  return 0;
+}
+
+/*.......................................................................
+ * The task function of modvis_add(). This computes the visibilities of
+ * all of the components for a contiguous share of the visibilities.
+ */
+static PARTASK_FN(modvis_task)
+{
+  Mvtask *mt = (Mvtask *) data;
+  Modvis *mv = mt->mv;
+  long ia, ib;      /* The range of visibilities of this thread */
+  const double *uu; /* The U coordinates of this thread */
+  const double *vv; /* The V coordinates of this thread */
+  double *amp;      /* The amplitude work array of this thread */
+  int n;            /* The number of visibilities of this thread */
+  int icmp;         /* The index of a component */
+  int i;
+/*
+ * Get the range of visibilities to be processed by this thread.
+ */
+  partask_range(mt->nvis, ithread, nthread, &ia, &ib);
+  n = ib - ia;
+  uu = mt->uu + ia;
+  vv = mt->vv + ia;
+  amp = mv->amp + ia;
+/*
+ * Add the contributions of each component in turn.
+ */
+  for(icmp=mt->ca; icmp<mv->ncmp; icmp++) {
+    Mvcmp *mc = mv->cmps + icmp;
+    Modcmp *cmp = mc->cmp;
+/*
+ * Compute the amplitude of the component at each visibility.
+ */
+    switch(cmp->type) {
+    case M_DELT:
+      for(i=0; i<n; i++)
+	amp[i] = mc->flux;
+      break;
+    case M_GAUS:  /* The common case of cmp_shape() */
+      {
+	double ca = pi * cmp->major * mc->sinphi;
+	double cb = pi * cmp->major * mc->cosphi;
+	double ratio = cmp->ratio;
+	for(i=0; i<n; i++) {
+	  double tmpa = vv[i]*cb + uu[i]*ca;
+	  double tmpb = ratio * (uu[i]*cb - vv[i]*ca);
+	  double tsq = tmpa*tmpa + tmpb*tmpb;
+	  amp[i] = tsq < 144.0 ? mc->flux * exp(-0.3606737602 * tsq) : 0.0;
+	};
+      };
+      break;
+    default:
+      for(i=0; i<n; i++) {
+	amp[i] = mc->flux * cmp_shape(cmp, mc->sinphi, mc->cosphi,
+				      uu[i], vv[i]);
+      };
+      break;
+    };
+/*
+ * Apply the primary beam factors of the baselines.
+ */
+    if(mv->dopb) {
+      for(i=0; i<n; i++) {
+	amp[i] *= pb_bl_factor(mt->sub, mt->base[ia+i], mt->freq,
+			       mc->radius);
+      };
+    };
+/*
+ * Add the phase terms.
+ */
+    mv_row_kernel(uu, vv, amp, mc->x, mc->y, n, mt->re + ia, mt->im + ia);
+  };
+}
+
+/*.......................................................................
+ * Select the fastest version of the row kernel that the host processor
+ * supports.
+ */
+static void mv_select_kernel(void)
+{
+  mv_row_kernel = mv_row;
+#if X86_SIMD
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx"))
+    mv_row_kernel = mv_row_avx;
+  else if(__builtin_cpu_supports("sse2"))
+    mv_row_kernel = mv_row_sse2;
+#endif
+}
+
+/*
+ * The row kernels compute sin(2.pi.t) and cos(2.pi.t) by reducing the
+ * phase t to the range -0.5..0.5 turns, evaluating the Taylor series
+ * of the sine and cosine of half of the reduced angle (-pi/2..pi/2),
+ * then applying the double-angle formulae. The truncation errors of
+ * the series are below 1e-9.
+ */
+#define MV_S3  (-1.0/6.0)
+#define MV_S5  (1.0/120.0)
+#define MV_S7  (-1.0/5040.0)
+#define MV_S9  (1.0/362880.0)
+#define MV_S11 (-1.0/39916800.0)
+#define MV_S13 (1.0/6227020800.0)
+#define MV_C2  (-1.0/2.0)
+#define MV_C4  (1.0/24.0)
+#define MV_C6  (-1.0/720.0)
+#define MV_C8  (1.0/40320.0)
+#define MV_C10 (-1.0/3628800.0)
+#define MV_C12 (1.0/479001600.0)
+#define MV_C14 (-1.0/87178291200.0)
+
+/*
+ * Adding and then subtracting 1.5 x 2^52 rounds a double of magnitude
+ * less than 2^51 to the nearest integer, without leaving the SIMD
+ * registers.
+ */
+#define MV_ROUND 6755399441055744.0
+
+/*.......................................................................
+ * Add amp[i]*exp(2.pi.i.(uu[i]*x + vv[i]*y)) to re[i],im[i], for
+ * i=0..n-1.
+ *
+ * Input:
+ *  uu,vv     double *  The U,V coordinates of the n visibilities
+ *                      (wavelengths).
+ *  amp       double *  The n amplitudes of the component.
+ *  x,y       double    The position of the component (radians).
+ *  n            int    The number of visibilities.
+ * Input/Output:
+ *  re,im     double *  The n model visibilities to add to.
+ */
+static MV_ROW_FN(mv_row)
+{
+  int i;
+  for(i=0; i<n; i++) {
+    double t = uu[i]*x + vv[i]*y;
+    double h = pi * (t - floor(t + 0.5));
+    double h2 = h*h;
+    double s = h * (1.0 + h2*(MV_S3 + h2*(MV_S5 + h2*(MV_S7 + h2*(MV_S9 +
+		    h2*(MV_S11 + h2*MV_S13))))));
+    double c = 1.0 + h2*(MV_C2 + h2*(MV_C4 + h2*(MV_C6 + h2*(MV_C8 +
+		    h2*(MV_C10 + h2*(MV_C12 + h2*MV_C14))))));
+    re[i] += amp[i] * (c*c - s*s);
+    im[i] += amp[i] * (2.0*s*c);
+  };
+}
+
+#if X86_SIMD
+/*
+ * The SIMD versions of the above kernel.
+ */
+#define MV_SSE2_POLY(h2, a, b) _mm_add_pd(_mm_set1_pd(a), _mm_mul_pd(h2, b))
+
+static MV_ROW_FN(mv_row_sse2)
+{
+  __m128d vx = _mm_set1_pd(x);
+  __m128d vy = _mm_set1_pd(y);
+  __m128d vround = _mm_set1_pd(MV_ROUND);
+  __m128d vpi = _mm_set1_pd(pi);
+  __m128d one = _mm_set1_pd(1.0);
+  __m128d two = _mm_set1_pd(2.0);
+  int i;
+  for(i=0; i+2 <= n; i += 2) {
+    __m128d t = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(uu + i), vx),
+			   _mm_mul_pd(_mm_loadu_pd(vv + i), vy));
+    __m128d h = _mm_mul_pd(vpi, _mm_sub_pd(t, _mm_sub_pd(_mm_add_pd(t, vround),
+							 vround)));
+    __m128d h2 = _mm_mul_pd(h, h);
+    __m128d s = _mm_set1_pd(MV_S13);
+    __m128d c = _mm_set1_pd(MV_C14);
+    __m128d a = _mm_loadu_pd(amp + i);
+    s = MV_SSE2_POLY(h2, MV_S11, s);
+    s = MV_SSE2_POLY(h2, MV_S9, s);
+    s = MV_SSE2_POLY(h2, MV_S7, s);
+    s = MV_SSE2_POLY(h2, MV_S5, s);
+    s = MV_SSE2_POLY(h2, MV_S3, s);
+    s = _mm_mul_pd(h, _mm_add_pd(one, _mm_mul_pd(h2, s)));
+    c = MV_SSE2_POLY(h2, MV_C12, c);
+    c = MV_SSE2_POLY(h2, MV_C10, c);
+    c = MV_SSE2_POLY(h2, MV_C8, c);
+    c = MV_SSE2_POLY(h2, MV_C6, c);
+    c = MV_SSE2_POLY(h2, MV_C4, c);
+    c = MV_SSE2_POLY(h2, MV_C2, c);
+    c = _mm_add_pd(one, _mm_mul_pd(h2, c));
+    _mm_storeu_pd(re + i, _mm_add_pd(_mm_loadu_pd(re + i),
+	    _mm_mul_pd(a, _mm_sub_pd(_mm_mul_pd(c, c), _mm_mul_pd(s, s)))));
+    _mm_storeu_pd(im + i, _mm_add_pd(_mm_loadu_pd(im + i),
+	    _mm_mul_pd(a, _mm_mul_pd(_mm_mul_pd(two, s), c))));
+  };
+  if(i < n)
+    mv_row(uu + i, vv + i, amp + i, x, y, n - i, re + i, im + i);
+}
+
+#define MV_AVX_POLY(h2, a, b) _mm256_add_pd(_mm256_set1_pd(a), \
+					    _mm256_mul_pd(h2, b))
+
+static MV_ROW_FN(mv_row_avx)
+{
+  __m256d vx = _mm256_set1_pd(x);
+  __m256d vy = _mm256_set1_pd(y);
+  __m256d vround = _mm256_set1_pd(MV_ROUND);
+  __m256d vpi = _mm256_set1_pd(pi);
+  __m256d one = _mm256_set1_pd(1.0);
+  __m256d two = _mm256_set1_pd(2.0);
+  int i;
+  for(i=0; i+4 <= n; i += 4) {
+    __m256d t = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(uu + i), vx),
+			      _mm256_mul_pd(_mm256_loadu_pd(vv + i), vy));
+    __m256d h = _mm256_mul_pd(vpi, _mm256_sub_pd(t,
+			_mm256_sub_pd(_mm256_add_pd(t, vround), vround)));
+    __m256d h2 = _mm256_mul_pd(h, h);
+    __m256d s = _mm256_set1_pd(MV_S13);
+    __m256d c = _mm256_set1_pd(MV_C14);
+    __m256d a = _mm256_loadu_pd(amp + i);
+    s = MV_AVX_POLY(h2, MV_S11, s);
+    s = MV_AVX_POLY(h2, MV_S9, s);
+    s = MV_AVX_POLY(h2, MV_S7, s);
+    s = MV_AVX_POLY(h2, MV_S5, s);
+    s = MV_AVX_POLY(h2, MV_S3, s);
+    s = _mm256_mul_pd(h, _mm256_add_pd(one, _mm256_mul_pd(h2, s)));
+    c = MV_AVX_POLY(h2, MV_C12, c);
+    c = MV_AVX_POLY(h2, MV_C10, c);
+    c = MV_AVX_POLY(h2, MV_C8, c);
+    c = MV_AVX_POLY(h2, MV_C6, c);
+    c = MV_AVX_POLY(h2, MV_C4, c);
+    c = MV_AVX_POLY(h2, MV_C2, c);
+    c = _mm256_add_pd(one, _mm256_mul_pd(h2, c));
+    _mm256_storeu_pd(re + i, _mm256_add_pd(_mm256_loadu_pd(re + i),
+	  _mm256_mul_pd(a, _mm256_sub_pd(_mm256_mul_pd(c, c),
+					 _mm256_mul_pd(s, s)))));
+    _mm256_storeu_pd(im + i, _mm256_add_pd(_mm256_loadu_pd(im + i),
+	  _mm256_mul_pd(a, _mm256_mul_pd(_mm256_mul_pd(two, s), c))));
+  };
+  if(i < n)
+    mv_row(uu + i, vv + i, amp + i, x, y, n - i, re + i, im + i);
+}
+#endif
@@ -3,6 +3,7 @@
 
 #include "model.h"
 #include "obs.h"
+#include "modgrid.h"
 
 void cmpvis(Modcmp *cmp, Subarray *sub, int base, float freq, float uu,
 	    float vv, float *amp, float *phs);
@@ -10,4 +11,18 @@ void cmpvis(Modcmp *cmp, Subarray *sub, int base, float freq, float uu,
 void add_cmp_to_modvis(Modcmp *cmp, Subarray *sub, int base, float freq,
 		       float uu, float vv, float *re, float *im);
 
+/*
+ * A Modvis object records a list of model components in a form that
+ * allows their visibilities to be computed efficiently for large
+ * numbers of visibilities, by modvis_add().
+ */
+typedef struct Modvis Modvis;
+
+Modvis *new_Modvis(Observation *ob, Model *mod, Modcmp *cmp, Modgrid *mg);
+Modvis *del_Modvis(Modvis *mv);
+
+int modvis_add(Modvis *mv, Subarray *sub, float freq, int dogrid, int nvis,
+	       const int *base, const double *uu, const double *vv,
+	       double *re, double *im);
+
 #endif
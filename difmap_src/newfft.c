@@ -13,13 +13,119 @@
  * notice to say that the file has been modified by them.
  */
 
+#include <stdlib.h>
 #include <math.h>
 #include <stdio.h>
+
+#if USE_FFTW == 1
+#include <fftw3.h>
+#endif
+
 #include "vlbconst.h"
 #include "vlbfft.h"
+#include "partask.h"
+#include "logio.h"
+
+/*
+ * newfft() performs 2D transforms as a sequence of 1D complex
+ * transforms along each axis of the image. These 1D transforms are
+ * delegated to a backend, which is selected when difmap is compiled.
+ * The default backend is the mixed-radix FFT that is implemented in
+ * this file. If the configure script found the single-precision FFTW3
+ * library, that is used instead.
+ *
+ * The following is the declaration of a backend function that
+ * performs nvec 1D complex transforms, each of n elements.
+ *
+ * Input/Output:
+ *  image   float *  The array that contains the vectors to be
+ *                   transformed in place.
+ * Input:
+ *  n         int    The number of complex elements per vector.
+ *  ninc      int    The number of floats between consecutive complex
+ *                   elements of a vector.
+ *  nvec      int    The number of vectors to be transformed.
+ *  vinc      int    The number of floats between the first elements
+ *                   of consecutive vectors.
+ *  isign     int    +1 - forward transform.
+ *                   -1 - inverse transform.
+ * Output:
+ *  return    int    0 - OK.
+ *                   1 - Error.
+ */
+#define FFT_AXIS_FN(fn) int (fn)(float *image, int n, int ninc, int nvec, \
+				 int vinc, int isign)
+
+static FFT_AXIS_FN(mr_axis);
+#if USE_FFTW == 1
+static FFT_AXIS_FN(fftw_axis);
+static FFT_AXIS_FN(*fft_axis) = fftw_axis;
+#else
+static FFT_AXIS_FN(*fft_axis) = mr_axis;
+#endif
+
+/*
+ * The mixed-radix FFT breaks each transform into a sequence of
+ * passes of radix 4, 2, 3 or 5. The following object records the
+ * factors of a given transform length and the twiddle factors of each
+ * pass.
+ */
+#define FFT_MAXFAC 32   /* The max number of factors of a transform length */
+
+typedef struct {
+  int n;                /* The length of the transform */
+  int nfac;             /* The number of factors in fac[] */
+  int fac[FFT_MAXFAC];  /* The radix of each pass */
+  float *twid;          /* The twiddle factors of all of the passes */
+} MRPlan;
+
+/*
+ * Keep plans for the most recently used transform lengths. newfft()
+ * needs one plan per axis, so two suffice.
+ */
+#define FFT_NPLAN 2
+static MRPlan *mr_plans[FFT_NPLAN] = {NULL, NULL};
+
+static MRPlan *get_MRPlan(int n);
+static MRPlan *new_MRPlan(int n);
+static MRPlan *del_MRPlan(MRPlan *plan);
+
+/*
+ * To make effective use of the cache when transforming along the
+ * slowly varying axis of an image, and to present long runs of
+ * contiguous data to the innermost loops of each pass, the vectors
+ * of each axis are transformed in blocks of up to FFT_BLOCK vectors.
+ * The vectors of a block are first copied into a work array, in
+ * which element t of vector b is stored at complex index t*nb+b.
+ */
+#define FFT_BLOCK 8
+
+/*
+ * Describe the transforms along an axis, to the threads that share
+ * the work.
+ */
+typedef struct {
+  MRPlan *plan;     /* The plan of the transform */
+  float *image;     /* The array to be transformed */
+  int ninc;         /* The increment between elements of a vector */
+  int nvec;         /* The number of vectors to be transformed */
+  int vinc;         /* The increment between vectors */
+  int isign;        /* The direction of the transform */
+  float *work;      /* 2 work arrays of 2*n*FFT_BLOCK floats per thread */
+} MRAxis;
+
+static PARTASK_FN(mr_axis_task);
+static float *mr_transform(MRPlan *plan, int nb, int isign, float *x,
+			   float *y);
+static void mr_pass2(int l, long m, const float *tw, float sgn,
+		     const float *x, float *y);
+static void mr_pass3(int l, long m, const float *tw, float sgn,
+		     const float *x, float *y);
+static void mr_pass4(int l, long m, const float *tw, float sgn,
+		     const float *x, float *y);
+static void mr_pass5(int l, long m, const float *tw, float sgn,
+		     const float *x, float *y);
 
-static void bitswap(float *image, int curdim, int curinc, int othdim,
-		    int othinc);
 static void fixreal(float *image, int adim, int bdim, int isign);
 static void opn_fft(float *image, int adim, int bdim);
 static void cls_fft(float *image, int adim, int bdim);
@@ -46,9 +152,12 @@ static void cls_fft(float *image, int adim, int bdim);
  *                      (adim+1)*bdim complex numbers.
  *                      
  *  adim     int        The number of complex points in a row of
- *                      'image'. This must be a power of 2.
- *  bdim     int        The number of rows 'image'. This must be a power
- *                      of 2. (bdim may be 1).
+ *                      'image'. This must have no prime factors other
+ *                      than 2, 3 and 5 (see fft_size_ok()). For real
+ *                      transforms it must also be even.
+ *  bdim     int        The number of rows 'image'. This must have no
+ *                      prime factors other than 2, 3 and 5. (bdim may
+ *                      be 1).
  *  
  *  isign    int        +1 => do the forward transform.
  *                      -1 => do the inverse transform. The inverse
@@ -60,204 +169,621 @@ static void cls_fft(float *image, int adim, int bdim);
  *                      or on the inverse transforms, but not both.
  *                      Which one you choose is largely a matter of
  *                      convention and the nature of your data.
+ * Output:
+ *  return   int        0 - OK.
+ *                      1 - Error.
  */
-void newfft(float *image, int adim, int bdim, int isign, int isreal,
-	    int rescale)
+int newfft(float *image, int adim, int bdim, int isign, int isreal,
+	   int rescale)
 {
-  int ini_dim; /* Number of first dimension to be transformed */
-  int end_dim; /* Number of last dimension to be transformed */
-  int inc_dim; /* Increment between ini_dim and end_dim */
-  int curdim=0;/* Number of complex elements on current axis */
-  int othdim=0;/* Number of elements on the other of the two axes */
-  int curinc=0;/* Number of floats between complex elements on current axis */
-  int othinc=0;/* Number of floats between complex elements on other axis */
-  int slot;    /* An element number on current axis */
-  int ipos;    /* Index into row or column on the "other" axis */
-  float *vecptr;/* Pointer to first element of a row or column vector */
-  float *kptr;  /* Pointer to k'th element within a sub-transform */
-  float *erptr; /* Pointer to the real part of an element in even tranform */
-  float *eiptr; /* Pointer to the imag part of an element in even transform */
-  float *orptr; /* Pointer to the real part of an element in odd tranform */
-  float *oiptr; /* Pointer to the imag part of an element in odd transform */
-  double wr;    /* Real part of W(k) = exp(2.pi.i.k/N) */
-  double wi;    /* Imag part of W(k) = exp(2.pi.i.k/N) */
-  double omega; /* +/-2.pi/N - the increment angle to get W(k+1) from W(k) */
-  double sininc;/* sin(omega) for use in recurrence relations */
-  double cosinc;/* cos(omega) for use in recurrence relations */
-  double wtmp;  /* Intermediary for double precision calculations */
-  float fwr,fwi;/* Float versions of wr and wi. */
-  float wreal;  /* Real part of W(k)*F(k_odd) */
-  float wimag;  /* Imaginary part of W(k)*F(k_odd) */
-  int ntrans;   /* Number of points in transform being built */
-  int nprev;    /* Width of even/odd transforms to be combined to ntrans */
-  int traninc;  /* Increment from one 'ntrans' transform to next */
-  int previnc;  /* Increment from one half-transform to next */
-  int k;        /* k'th element in a transform */
+  int ncol;    /* The number of complex columns to be transformed */
   int i;
 /*
- * Loop over dimensions for the bit-reversal phase. When the input array
- * is a real-array being forward transformed then the first dimension
- * (rows) must be tranformed first, whereas where the input array is
- * a half-conjugate-symmetric array being inverse transformed, the
- * first dimension must be tranformed last. For normal tranforms the
- * order is irrelavant.
+ * Check the dimensions.
+ */
+  if(!fft_size_ok(adim) || !fft_size_ok(bdim) || (isreal && adim%2)) {
+    lprintf(stderr, "newfft: Unsupported transform dimensions: %dx%d.\n",
+	    adim, bdim);
+    return 1;
+  };
+/*
+ * Real transforms have an extra complex column to be transformed.
+ */
+  ncol = isreal ? adim+1 : adim;
+/*
+ * When the input array is a real-array being forward transformed then
+ * the first dimension (rows) must be tranformed first, whereas where the
+ * input array is a half-conjugate-symmetric array being inverse
+ * transformed, the first dimension must be tranformed last. For normal
+ * tranforms the order is irrelavant. The conversion between the rows of
+ * real/conjugate-symmetric transform pairs is done by fixreal(), between
+ * the transforms of the two axes.
  */
   if(isign == 1) {
-    ini_dim=0;
-    end_dim=2;
-    inc_dim=1;
+    if(fft_axis(image, adim, 2, bdim, 2*adim, isign))
+      return 1;
+    if(isreal)
+      fixreal(image, adim, bdim, isign);
+    if(bdim > 1 && fft_axis(image, bdim, 2*ncol, ncol, 2, isign))
+      return 1;
   } else {
-    ini_dim=1;
-    end_dim=-1;
-    inc_dim=-1;
+    if(bdim > 1 && fft_axis(image, bdim, 2*ncol, ncol, 2, isign))
+      return 1;
+    if(isreal)
+      fixreal(image, adim, bdim, isign);
+    if(fft_axis(image, adim, 2, bdim, 2*adim, isign))
+      return 1;
   };
-  for(i=ini_dim; i!=end_dim; i += inc_dim) {
-/*
- * Set up element increments and dimensions for the current axis.
- * Also handle conversion of the rows of real/conjugate-symmetric
- * transform pairs - this must be done after all other dimensions
- * have been transformed and for this reason the 1st dimension of
- * the image will be transformed last.
- */
-    switch(i) {
-    case 0:
-      curdim = adim;   /* Number of elements on current axis (ncol) */
-      othdim = bdim;   /* Number of elements on other axis (nrow) */
-      curinc = 2;      /* Two floats between elements on current axis */
-      othinc = 2*adim; /* Number of floats between elements on other axis */
-      if(isreal && isign == -1)
-	fixreal(image,adim,bdim,isign);
-      break;
-    case 1:
-      curdim = bdim;
-      othdim = adim;
-      curinc = 2*adim;
-      othinc = 2;
-/*
- * Real tranforms actually have an extra complex column to be
- * transformed.
- */
-      if(isreal) {
-	if(isign == 1)
-	  fixreal(image,adim,bdim,isign);
-	othdim = adim+1;
-	curinc = 2*(adim+1);
-      };
-      break;
-    };
 /*
- * Swap columns/rows in which the integer array indexes are mirrored
- * in their bit representation.
+ * On the reverse transform divide throughout by the number of complex data
+ * points.
+ */
+  if(rescale) {
+    int nfloat=(isreal ? (adim+1):adim)*bdim*2;
+    float ncomplex = (isreal ? adim*2 : adim) * bdim;
+    for(i=0; i<nfloat; i++)
+      image[i] /= ncomplex;
+  };
+  return 0;
+}
+
+/*.......................................................................
+ * Return true if a given transform length can be handled by newfft().
+ *
+ * Input:
+ *  n        int   The number of complex elements along an axis.
+ * Output:
+ *  return   int   0 - n has prime factors other than 2, 3 and 5.
+ *                 1 - n is a supported transform length.
  */
-    bitswap(image, curdim, curinc, othdim, othinc);
+int fft_size_ok(int n)
+{
+  if(n < 1)
+    return 0;
+  while(n%2==0)
+    n /= 2;
+  while(n%3==0)
+    n /= 3;
+  while(n%5==0)
+    n /= 5;
+  return n==1;
+}
+
+/*.......................................................................
+ * The mixed-radix backend of newfft(). See the documentation of
+ * FFT_AXIS_FN() for details.
+ */
+static FFT_AXIS_FN(mr_axis)
+{
+  MRAxis mra;      /* The description of the work to be shared */
+  int nblock;      /* The number of blocks of vectors */
+  int nthread;     /* The number of threads to use */
 /*
- * Now combine all the one-point transformed that resulted from the
- * above swapping, first into 2-point transforms, then 4-point transforms
- * etc... 'ntrans' is the number of complex points per transform at
- * each step.
+ * Transforms of a single element are no-ops.
  */
-    vecptr = image;
-    for(ipos=0; ipos < othdim; ipos++) {
-      for(ntrans=2; ntrans <= curdim; ntrans<<=1) {
-	nprev = ntrans/2;  /* Length of odd and even parts being combined */
+  if(n < 2 || nvec < 1)
+    return 0;
 /*
- * Determine the increment required to step over one completed transform
- * of 'ntrans' points. Also the increment over one of the sub-transforms.
+ * Get the plan of the transform.
  */
-	traninc = ntrans * curinc;
-	previnc = nprev * curinc;
+  mra.plan = get_MRPlan(n);
+  if(!mra.plan)
+    return 1;
 /*
- * Pre-calculate part of the argument of exp(2.pi.i/ntrans) as
- * required in the Danielson and Lanczos formula. The 'isign'
- * term decides if the transform is forward or reverse.
+ * Work out how many threads to use. There is no point in using more
+ * threads than there are blocks of vectors.
  */
-	omega = isign*twopi/ntrans;
+  nblock = (nvec + FFT_BLOCK - 1) / FFT_BLOCK;
+  nthread = get_nthread();
+  if(nthread > nblock)
+    nthread = nblock;
 /*
- * wr and wi are the real and imaginary parts of exp(i.omega.k).
- * Where 'k' is the element of the transform being calculated.
- * For k=0 they are 1 and 0 respectively.
+ * Allocate two work arrays per thread.
  */
-	fwr = (float) (wr = 1.0);
-	fwi = (float) (wi = 0.0);
+  mra.work = (float *) malloc(sizeof(float) * 4 * (size_t) n * FFT_BLOCK *
+			      nthread);
+  if(!mra.work) {
+    lprintf(stderr, "newfft: Insufficient memory.\n");
+    return 1;
+  };
 /*
- * As k increments by 1 within each iteration of the following loop,
- * we can simply calculate wr and wi by simple trig angle addition
- * equations. For these we will require cos() and sin() of omega.
+ * Divide the blocks of vectors between the threads.
+ */
+  mra.image = image;
+  mra.ninc = ninc;
+  mra.nvec = nvec;
+  mra.vinc = vinc;
+  mra.isign = isign;
+  run_partask(nthread, mr_axis_task, &mra);
+  free(mra.work);
+  return 0;
+}
+
+/*.......................................................................
+ * This is the parallel task function that mr_axis() uses to divide
+ * the blocks of vectors of an axis between threads.
+ *
+ * Input:
+ *  data      void *  The MRAxis description of the axis, cast to
+ *                    (void *).
+ *  ithread    int    The index of the calling thread.
+ *  nthread    int    The number of threads.
  */
-	cosinc = cos(omega);
-	sininc = sin(omega);
+static PARTASK_FN(mr_axis_task)
+{
+  MRAxis *mra = (MRAxis *) data;
+  int n = mra->plan->n;      /* The length of each transform */
+  long nblock;               /* The total number of blocks of vectors */
+  long ia, ib;               /* The range of blocks of this thread */
+  long iblock;               /* The index of a block */
+  float *x, *y;              /* The work arrays of this thread */
 /*
-* Combine the adjacent even and odd transforms. NB. Both transforms
-* are period in 1/ntrans which is why we can store each in just
-* 1/ntrans elements. Since we need each element of the two transforms
-* twice, once for k=n (n=0->ntrans/2-1) and then again for k=n+ntrans/2,
-* The calculation for these two elements will be performed in one go.
-* In order to do this, note that if W(k)=exp(2.pi.i.k/ntrans) then
-* W(k+ntrans/2) = -W(k).
-*/
-	kptr=vecptr;  /* Start of current row or column in image */
-	for(k=0; k<nprev; k++) {
+ * Get the work arrays of this thread.
+ */
+  x = mra->work + 4 * (size_t) n * FFT_BLOCK * ithread;
+  y = x + 2 * (size_t) n * FFT_BLOCK;
 /*
- * Loop for each tranform.
+ * Get the range of blocks to be processed by this thread.
  */
-	  erptr = kptr;         /* Pointer to element k of even transform */
-	  orptr = kptr+previnc; /* Pointer to element k of odd transform */
-	  for(slot=0; slot<curdim; slot += ntrans) {
-	    eiptr = erptr+1;
-	    oiptr = orptr+1;
-	    wreal = *orptr*fwr - *oiptr*fwi; /* W(k)*F(k_odd) - real */
-	    wimag = *orptr*fwi + *oiptr*fwr; /* W(k)*F(k_odd) - imaginary */
+  nblock = (mra->nvec + FFT_BLOCK - 1) / FFT_BLOCK;
+  partask_range(nblock, ithread, nthread, &ia, &ib);
+  for(iblock=ia; iblock<ib; iblock++) {
+    int va = iblock * FFT_BLOCK;   /* The first vector of the block */
+    int nb = mra->nvec - va;       /* The number of vectors in the block */
+    float *res;                    /* The work array that holds the result */
+    int t, b;
+    if(nb > FFT_BLOCK)
+      nb = FFT_BLOCK;
 /*
- * First evaluate F(kp) where kp=k+nprev and W(kp) is -W(k).
- * Thus F(kp)=F(k_even)-W(k)*F(k_odd).
+ * Copy the vectors of the block into the work array.
  */
-	    *orptr = *erptr - wreal;
-	    *oiptr = *eiptr - wimag;
+    for(b=0; b<nb; b++) {
+      const float *vptr = mra->image + (va + b) * (long) mra->vinc;
+      float *xptr = x + 2*b;
+      for(t=0; t<n; t++, vptr += mra->ninc, xptr += 2*nb) {
+	xptr[0] = vptr[0];
+	xptr[1] = vptr[1];
+      };
+    };
 /*
- * Now evaluate F(k)=F(k_even)+W(k)*F(k_odd).
+ * Transform the block.
  */
-	    *erptr += wreal;
-	    *eiptr += wimag;
+    res = mr_transform(mra->plan, nb, mra->isign, x, y);
 /*
- * Move to element k of the next even and odd transforms.
+ * Copy the transformed vectors back into the image.
  */
-	    erptr += traninc;
-	    orptr += traninc;
-	  };
+    for(b=0; b<nb; b++) {
+      float *vptr = mra->image + (va + b) * (long) mra->vinc;
+      const float *rptr = res + 2*b;
+      for(t=0; t<n; t++, vptr += mra->ninc, rptr += 2*nb) {
+	vptr[0] = rptr[0];
+	vptr[1] = rptr[1];
+      };
+    };
+  };
+}
+
+/*.......................................................................
+ * Perform nb interleaved 1D transforms, using the self-sorting
+ * (Stockham) formulation of the mixed-radix FFT. Each pass reads from
+ * one work array and writes to the other, so no bit-reversal
+ * permutation is needed.
+ *
+ * Consider a pass of radix p that follows passes whose radices
+ * multiply to l. On entry to the pass, the transform is made up of
+ * n/l interleaved l-point transforms. The pass combines each group of
+ * p of these into one l*p-point transform. Within a pass, the same
+ * twiddle factor applies to runs of m=nb*n/(l*p) contiguous complex
+ * elements, which keeps the innermost loops simple.
+ *
+ * Input:
+ *  plan    MRPlan *  The plan of the transform.
+ *  nb         int    The number of interleaved transforms.
+ *  isign      int    +1 - forward transform.
+ *                    -1 - inverse transform.
+ * Input/Output:
+ *  x        float *  On input, the nb*n complex elements to be
+ *                    transformed, with element t of transform b at
+ *                    complex index t*nb+b. This array is used as
+ *                    workspace.
+ *  y        float *  A work array of the same size as x[].
+ * Output:
+ *  return   float *  The array, x or y, that contains the result.
+ */
+static float *mr_transform(MRPlan *plan, int nb, int isign, float *x,
+			   float *y)
+{
+  const float *tw = plan->twid;  /* The twiddle factors of the next pass */
+  float sgn = isign > 0 ? 1.0f : -1.0f;
+  long l = 1;    /* The product of the radices of the previous passes */
+  int i;
+  for(i=0; i<plan->nfac; i++) {
+    int p = plan->fac[i];                 /* The radix of the pass */
+    long m = (long) nb * (plan->n / (l * p));
+    float *tmp;
+    switch(p) {
+    case 2:
+      mr_pass2(l, m, tw, sgn, x, y);
+      break;
+    case 3:
+      mr_pass3(l, m, tw, sgn, x, y);
+      break;
+    case 4:
+      mr_pass4(l, m, tw, sgn, x, y);
+      break;
+    case 5:
+      mr_pass5(l, m, tw, sgn, x, y);
+      break;
+    };
 /*
- * Since in the next iteration k goes up by one, compute sin() and
- * cos() of omega plus the current angle.
+ * Advance to the twiddle factors of the next pass.
  */
-	  wtmp = wr;
-	  wr = wtmp*cosinc - wi*sininc;
-	  wi = wtmp*sininc + wi*cosinc;
-	  fwr = (float) wr;  /* Single precision is sufficient */
-	  fwi = (float) wi;  /* outside the recurrence */
+    tw += 2 * l * (p-1);
+    l *= p;
 /*
- * Next element of target 'ntrans' transform.
+ * The output of this pass is the input of the next.
  */
-	  kptr += curinc;
-	};
-      };
+    tmp = x;
+    x = y;
+    y = tmp;
+  };
+  return x;
+}
+
+/*.......................................................................
+ * Perform a radix-2 pass of mr_transform().
+ *
+ * Input:
+ *  l        int    The product of the radices of the previous passes.
+ *  m       long    The number of contiguous complex elements that
+ *                  share each twiddle factor.
+ *  tw     float *  The l*(p-1) complex twiddle factors of the pass.
+ *  sgn    float    1 for forward transforms, -1 for inverse.
+ *  x      float *  The input array.
+ * Output:
+ *  y      float *  The output array.
+ */
+static void mr_pass2(int l, long m, const float *tw, float sgn,
+		     const float *x, float *y)
+{
+  int j;
+  long i;
+  for(j=0; j<l; j++, tw+=2) {
+    float w1r = tw[0], w1i = sgn * tw[1];
+    const float *x0 = x + 2*(2*j)*m;
+    const float *x1 = x0 + 2*m;
+    float *y0 = y + 2*j*m;
+    float *y1 = y0 + 2*l*m;
+    for(i=0; i<2*m; i+=2) {
+      float a1r = x1[i]*w1r - x1[i+1]*w1i;
+      float a1i = x1[i]*w1i + x1[i+1]*w1r;
+      y0[i]   = x0[i] + a1r;
+      y0[i+1] = x0[i+1] + a1i;
+      y1[i]   = x0[i] - a1r;
+      y1[i+1] = x0[i+1] - a1i;
+    };
+  };
+}
+
+/*.......................................................................
+ * Perform a radix-3 pass of mr_transform(). The arguments are the
+ * same as those of mr_pass2().
+ */
+static void mr_pass3(int l, long m, const float *tw, float sgn,
+		     const float *x, float *y)
+{
+  const float s60 = sgn * 0.86602540378443864676f; /* sgn.sin(2.pi/3) */
+  int j;
+  long i;
+  for(j=0; j<l; j++, tw+=4) {
+    float w1r = tw[0], w1i = sgn * tw[1];
+    float w2r = tw[2], w2i = sgn * tw[3];
+    const float *x0 = x + 2*(3*j)*m;
+    const float *x1 = x0 + 2*m;
+    const float *x2 = x1 + 2*m;
+    float *y0 = y + 2*j*m;
+    float *y1 = y0 + 2*l*m;
+    float *y2 = y1 + 2*l*m;
+    for(i=0; i<2*m; i+=2) {
+      float a1r = x1[i]*w1r - x1[i+1]*w1i;
+      float a1i = x1[i]*w1i + x1[i+1]*w1r;
+      float a2r = x2[i]*w2r - x2[i+1]*w2i;
+      float a2i = x2[i]*w2i + x2[i+1]*w2r;
+      float tr = a1r + a2r, ti = a1i + a2i;
+      float mr = x0[i] - 0.5f * tr, mi = x0[i+1] - 0.5f * ti;
+      float dr = s60 * (a1r - a2r), di = s60 * (a1i - a2i);
+      y0[i]   = x0[i] + tr;
+      y0[i+1] = x0[i+1] + ti;
+      y1[i]   = mr - di;
+      y1[i+1] = mi + dr;
+      y2[i]   = mr + di;
+      y2[i+1] = mi - dr;
+    };
+  };
+}
+
+/*.......................................................................
+ * Perform a radix-4 pass of mr_transform(). The arguments are the
+ * same as those of mr_pass2().
+ */
+static void mr_pass4(int l, long m, const float *tw, float sgn,
+		     const float *x, float *y)
+{
+  int j;
+  long i;
+  for(j=0; j<l; j++, tw+=6) {
+    float w1r = tw[0], w1i = sgn * tw[1];
+    float w2r = tw[2], w2i = sgn * tw[3];
+    float w3r = tw[4], w3i = sgn * tw[5];
+    const float *x0 = x + 2*(4*j)*m;
+    const float *x1 = x0 + 2*m;
+    const float *x2 = x1 + 2*m;
+    const float *x3 = x2 + 2*m;
+    float *y0 = y + 2*j*m;
+    float *y1 = y0 + 2*l*m;
+    float *y2 = y1 + 2*l*m;
+    float *y3 = y2 + 2*l*m;
+    for(i=0; i<2*m; i+=2) {
+      float a1r = x1[i]*w1r - x1[i+1]*w1i;
+      float a1i = x1[i]*w1i + x1[i+1]*w1r;
+      float a2r = x2[i]*w2r - x2[i+1]*w2i;
+      float a2i = x2[i]*w2i + x2[i+1]*w2r;
+      float a3r = x3[i]*w3r - x3[i+1]*w3i;
+      float a3i = x3[i]*w3i + x3[i+1]*w3r;
+      float s02r = x0[i] + a2r, s02i = x0[i+1] + a2i;
+      float d02r = x0[i] - a2r, d02i = x0[i+1] - a2i;
+      float s13r = a1r + a3r, s13i = a1i + a3i;
+      float d13r = sgn * (a1r - a3r), d13i = sgn * (a1i - a3i);
+      y0[i]   = s02r + s13r;
+      y0[i+1] = s02i + s13i;
+      y1[i]   = d02r - d13i;
+      y1[i+1] = d02i + d13r;
+      y2[i]   = s02r - s13r;
+      y2[i+1] = s02i - s13i;
+      y3[i]   = d02r + d13i;
+      y3[i+1] = d02i - d13r;
+    };
+  };
+}
+
+/*.......................................................................
+ * Perform a radix-5 pass of mr_transform(). The arguments are the
+ * same as those of mr_pass2().
+ */
+static void mr_pass5(int l, long m, const float *tw, float sgn,
+		     const float *x, float *y)
+{
+  const float c1 = 0.30901699437494742410f;        /* cos(2.pi/5) */
+  const float c2 = -0.80901699437494742410f;       /* cos(4.pi/5) */
+  const float s1 = sgn * 0.95105651629515357212f;  /* sgn.sin(2.pi/5) */
+  const float s2 = sgn * 0.58778525229247312917f;  /* sgn.sin(4.pi/5) */
+  int j;
+  long i;
+  for(j=0; j<l; j++, tw+=8) {
+    float w1r = tw[0], w1i = sgn * tw[1];
+    float w2r = tw[2], w2i = sgn * tw[3];
+    float w3r = tw[4], w3i = sgn * tw[5];
+    float w4r = tw[6], w4i = sgn * tw[7];
+    const float *x0 = x + 2*(5*j)*m;
+    const float *x1 = x0 + 2*m;
+    const float *x2 = x1 + 2*m;
+    const float *x3 = x2 + 2*m;
+    const float *x4 = x3 + 2*m;
+    float *y0 = y + 2*j*m;
+    float *y1 = y0 + 2*l*m;
+    float *y2 = y1 + 2*l*m;
+    float *y3 = y2 + 2*l*m;
+    float *y4 = y3 + 2*l*m;
+    for(i=0; i<2*m; i+=2) {
+      float a1r = x1[i]*w1r - x1[i+1]*w1i;
+      float a1i = x1[i]*w1i + x1[i+1]*w1r;
+      float a2r = x2[i]*w2r - x2[i+1]*w2i;
+      float a2i = x2[i]*w2i + x2[i+1]*w2r;
+      float a3r = x3[i]*w3r - x3[i+1]*w3i;
+      float a3i = x3[i]*w3i + x3[i+1]*w3r;
+      float a4r = x4[i]*w4r - x4[i+1]*w4i;
+      float a4i = x4[i]*w4i + x4[i+1]*w4r;
+      float s14r = a1r + a4r, s14i = a1i + a4i;
+      float d14r = a1r - a4r, d14i = a1i - a4i;
+      float s23r = a2r + a3r, s23i = a2i + a3i;
+      float d23r = a2r - a3r, d23i = a2i - a3i;
 /*
- * Next row or column of image to be transformed.
+ * The real-coefficient and imaginary-coefficient parts of outputs 1
+ * and 4, and of outputs 2 and 3.
  */
-      vecptr += othinc;
+      float p1r = x0[i] + c1 * s14r + c2 * s23r;
+      float p1i = x0[i+1] + c1 * s14i + c2 * s23i;
+      float q1r = s1 * d14r + s2 * d23r;
+      float q1i = s1 * d14i + s2 * d23i;
+      float p2r = x0[i] + c2 * s14r + c1 * s23r;
+      float p2i = x0[i+1] + c2 * s14i + c1 * s23i;
+      float q2r = s2 * d14r - s1 * d23r;
+      float q2i = s2 * d14i - s1 * d23i;
+      y0[i]   = x0[i] + s14r + s23r;
+      y0[i+1] = x0[i+1] + s14i + s23i;
+      y1[i]   = p1r - q1i;
+      y1[i+1] = p1i + q1r;
+      y4[i]   = p1r + q1i;
+      y4[i+1] = p1i - q1r;
+      y2[i]   = p2r - q2i;
+      y2[i+1] = p2i + q2r;
+      y3[i]   = p2r + q2i;
+      y3[i+1] = p2i - q2r;
     };
   };
+}
+
+/*.......................................................................
+ * Return a plan for mixed-radix transforms of a given length. Plans
+ * of the most recently requested lengths are cached, so this function
+ * must only be called by one thread at a time.
+ *
+ * Input:
+ *  n          int    The length of the transform.
+ * Output:
+ *  return  MRPlan *  The plan, or NULL on error.
+ */
+static MRPlan *get_MRPlan(int n)
+{
+  MRPlan *plan;
+  int i;
 /*
- * On the reverse transform divide throughout by the number of complex data
- * points.
+ * Is there already a plan for this length?
  */
-  if(rescale) {
-    int nfloat=(isreal ? (adim+1):adim)*bdim*2;
-    float ncomplex = (isreal ? adim*2 : adim) * bdim;
-    for(i=0; i<nfloat; i++)
-      image[i] /= ncomplex;
+  for(i=0; i<FFT_NPLAN; i++) {
+    plan = mr_plans[i];
+    if(plan && plan->n == n) {
+/*
+ * Move the plan to the front of the cache.
+ */
+      for( ; i>0; i--)
+	mr_plans[i] = mr_plans[i-1];
+      mr_plans[0] = plan;
+      return plan;
+    };
   };
-  return;
+/*
+ * Create a new plan and replace the least recently used plan with it.
+ */
+  plan = new_MRPlan(n);
+  if(!plan)
+    return NULL;
+  del_MRPlan(mr_plans[FFT_NPLAN-1]);
+  for(i=FFT_NPLAN-1; i>0; i--)
+    mr_plans[i] = mr_plans[i-1];
+  mr_plans[0] = plan;
+  return plan;
 }
 
+/*.......................................................................
+ * Create the plan of a mixed-radix transform of a given length.
+ *
+ * Input:
+ *  n          int    The length of the transform. This must be
+ *                    accepted by fft_size_ok().
+ * Output:
+ *  return  MRPlan *  The new plan, or NULL on error.
+ */
+static MRPlan *new_MRPlan(int n)
+{
+  static const int radices[] = {4, 2, 3, 5};  /* Radices in order of use */
+  MRPlan *plan;   /* The new plan */
+  float *tw;      /* A pointer into plan->twid[] */
+  long l;         /* The product of the radices of the previous passes */
+  int nleft;      /* The part of n that remains to be factored */
+  int i, j, q;
+/*
+ * Check the transform length.
+ */
+  if(!fft_size_ok(n)) {
+    lprintf(stderr, "new_MRPlan: Unsupported transform length: %d.\n", n);
+    return NULL;
+  };
+/*
+ * Allocate the container.
+ */
+  plan = (MRPlan *) malloc(sizeof(MRPlan));
+  if(!plan) {
+    lprintf(stderr, "new_MRPlan: Insufficient memory.\n");
+    return NULL;
+  };
+  plan->n = n;
+  plan->nfac = 0;
+  plan->twid = NULL;
+/*
+ * Factorize the transform length, preferring radix-4 passes.
+ */
+  nleft = n;
+  for(i=0; i<(int)(sizeof(radices)/sizeof(radices[0])); i++) {
+    while(nleft % radices[i] == 0 && plan->nfac < FFT_MAXFAC) {
+      plan->fac[plan->nfac++] = radices[i];
+      nleft /= radices[i];
+    };
+  };
+/*
+ * Each pass of radix p needs l*(p-1) complex twiddle factors, where l
+ * is the product of the radices of the previous passes. This sums to
+ * n-1 twiddle factors.
+ */
+  plan->twid = (float *) malloc(sizeof(float) * 2 * (n > 1 ? n-1 : 1));
+  if(!plan->twid) {
+    lprintf(stderr, "new_MRPlan: Insufficient memory.\n");
+    return del_MRPlan(plan);
+  };
+/*
+ * Compute the twiddle factors, exp(2.pi.i.q.j/(l.p)), of each pass,
+ * for the forward transform. The twiddle factor of element q of
+ * the j'th group of a pass is recorded at index j*(p-1)+q-1.
+ */
+  tw = plan->twid;
+  l = 1;
+  for(i=0; i<plan->nfac; i++) {
+    int p = plan->fac[i];
+    for(j=0; j<l; j++) {
+      for(q=1; q<p; q++) {
+	double theta = twopi * q * j / (l * p);
+	*tw++ = cos(theta);
+	*tw++ = sin(theta);
+      };
+    };
+    l *= p;
+  };
+  return plan;
+}
+
+/*.......................................................................
+ * Delete a mixed-radix plan.
+ *
+ * Input:
+ *  plan    MRPlan *  The plan to be deleted (can be NULL).
+ * Output:
+ *  return  MRPlan *  The deleted plan (always NULL).
+ */
+static MRPlan *del_MRPlan(MRPlan *plan)
+{
+  if(plan) {
+    if(plan->twid)
+      free(plan->twid);
+    free(plan);
+  };
+  return NULL;
+}
+
+#if USE_FFTW == 1
+/*.......................................................................
+ * The FFTW3 backend of newfft(). See the documentation of
+ * FFT_AXIS_FN() for details.
+ */
+static FFT_AXIS_FN(fftw_axis)
+{
+  fftwf_plan plan;   /* The FFTW plan of the transforms */
+  fftwf_complex *data = (fftwf_complex *) image;
+/*
+ * Transforms of a single element are no-ops.
+ */
+  if(n < 2 || nvec < 1)
+    return 0;
+/*
+ * Plan the transforms. Note that FFTW_ESTIMATE plans don't modify
+ * the array. Also note that the sign of the exponent of the
+ * forward transform of newfft() is the opposite of that of FFTW.
+ */
+  plan = fftwf_plan_many_dft(1, &n, nvec, data, NULL, ninc/2, vinc/2,
+			     data, NULL, ninc/2, vinc/2,
+			     isign > 0 ? FFTW_BACKWARD : FFTW_FORWARD,
+			     FFTW_ESTIMATE);
+/*
+ * If FFTW can't handle the transform, fall back to the mixed-radix
+ * backend.
+ */
+  if(!plan)
+    return mr_axis(image, n, ninc, nvec, vinc, isign);
+  fftwf_execute(plan);
+  fftwf_destroy_plan(plan);
+  return 0;
+}
+#endif
+
 /*.......................................................................
  * Given an input image of dimensions (adim,bdim) apply the phase shift
  * specified in the shift theorem, necessary to move the centre of the
@@ -270,7 +796,7 @@ void newfft(float *image, int adim, int bdim, int isign, int isreal,
  * Input/Output:
  *  image  float *   A 1D array with adim*bdim*2 elements, where adim
  *                   and bdim denote the dimensions of the equivalent
- *                   2D array and must be integral powers of two and
+ *                   2D array and must both be even, and
  *                   the factor of 2 indicates that each element of this
  *                   array is made up of two consecutive floats, the
  *                   first is the real part and the second, the imaginary
@@ -310,69 +836,6 @@ void fft_shift(float *image, int adim, int bdim)
   return;
 }
 
-/*.......................................................................
- * Swap rows or columns etc of an FFT array where the index of each
- * swapped row or column is the bit-reversed value of the other.
- *
- * Input:
- *   float *image;    Pointer to image being FFT'd.
- *   int curdim;      The number of elements along the current axis.
- *   int curinc;      The increment (in floats) between elements on the
- *                    current axis.
- *   int othdim;      The number of elements on the perpendicular 'other'
- *                    axis.
- *   int othinc;      The increment (in floats) between elements of the other
- *                    axis.
- *
- */
-static void bitswap(float *image, int curdim, int curinc, int othdim,
-		    int othinc)
-{
-  static int slot;    /* An element number on current axis */
-  static int ipos;    /* An element number on other axis axis */
-  static int idim;    /* Temporary copy of curdim */
-  static int swapd;   /* The index of one of two rows/columns to be swapped */
-  static int orig;    /* The index of one of two rows/columns to be swapped */
-  static float ftmp;  /* Intermediary for swapping element */
-  static float *aptr; /* Pointer to be stepped along a column or row */
-  static float *bptr; /* Pointer to be stepped along a column or row */
-/*
- * Swap each vector that is perpendicular to the current dimension at the
- * current element (slot) on the current dimension.
- */
-  for(slot=0; slot<curdim; slot++) {
-/*
- * Find the bit-reversed value of 'slot'. Build it in 'swapd'.
- */
-      idim = curdim;
-      orig = slot; swapd = 0;
-      while(idim>>=1) {
-	swapd <<= 1;        /* Make room for the new bit */
-	swapd |= orig & 01; /* Add the new bit to the vacated slot */
-	orig  >>= 1;        /* Demote the next msb of 'slot' to be its lsb */
-      };
-/*
- * Clause to prevent columns/rows being swapped twice or to themselves.
- * If it is met then swap column/row 'slot' for 'swapd'.
- */
-      if(swapd < slot) {
-	aptr = image+slot*curinc;   /* Pointer to start of 1st column/row */
-	bptr = image+swapd*curinc;  /* Pointer to start of 2nd column/row */
-	for(ipos=0; ipos < othdim; ipos++) {
-	  ftmp  = *aptr;          /* Swap the real part */
-	  *aptr = *bptr;
-	  *bptr = ftmp;
-	  ftmp    = aptr[1];      /* Swap the imaginary part */
-	  aptr[1] = bptr[1];
-	  bptr[1] = ftmp;
-	  aptr += othinc;         /* Go to next element in each column/row */
-	  bptr += othinc;
-	};
-      };
-    };
-    return;
-}
-
 /*.......................................................................
  * This routine is provided for:
  * 1) forward transforming real 2D images of
@@ -386,8 +849,8 @@ static void bitswap(float *image, int curdim, int curinc, int othdim,
  *                    And half of the conjugate symmetric tranform in
  *                    (adim+1)*bdim complex float pairs.
  * Input:
- *  adim    int       See under image. adim must be a power of 2.
- *  bdim    int       See under image. bdim must be a power of 2.
+ *  adim    int       See under image. adim must be even.
+ *  bdim    int       See under image.
  *  isign   int        1 - forward transform real image to complex.
  *                    -1 - inverse tranform complex to real image.
  */
@@ -638,8 +1101,8 @@ static void cls_fft(float *image, int adim, int bdim)
  *                   2D array.  The factor of 2 indicates that each
  *                   element of this array is made up of two
  *                   consecutive floats, the first is the real part
- *                   and the second, the imaginary part.  adim and
- *                   bdim must be integral powers of two
+ *                   and the second, the imaginary part.  adim must
+ *                   be a multiple of 4, and bdim must be even.
  * Input:
  *  adim   int       There should be adim+2 floats along the first
  *                   dimension (fastest changing index) of the
@@ -5,6 +5,8 @@
 #include "logio.h"
 #include "obs.h"
 #include "obedit.h"
+#include "ifcache.h"
+#include "polstash.h"
 #include "telspec.h"
 #include "vlbconst.h"
 
@@ -372,6 +374,7 @@ int ed_integ(Observation *ob, Subarray *sub, int ut, int cif, int doflag,
     Baseline *bptr = sub->base;
     Visibility *vis = integ->vis;
     int base;
+    ob_cart_stale(ob, CART_VIEW);
     for(base=0; base<sub->nbase; base++,bptr++,vis++) {
 /*
  * Edit the visibility only if selected.
@@ -389,6 +392,32 @@ int ed_integ(Observation *ob, Subarray *sub, int ut, int cif, int doflag,
       };
     };
   };
+/*
+ * Apply the edit in the same way to the copies of affected IFs that are
+ * held in the IF cache, so that they remain up to date.
+ */
+  if(ob->ifc) {
+    int bif = selif ? cif : 0;
+    int eif = selif ? cif : ob->nif - 1;
+    int i;
+    for(i=bif; i<=eif; i++) {
+      Ifvis *cvis = ifc_integ(ob, i, integ->irec);
+      if(cvis) {
+	Baseline *bptr = sub->base;
+	int base;
+	for(base=0; base<sub->nbase; base++,bptr++,cvis++) {
+	  if((selbase && base==index) ||
+	     (selstat && (bptr->tel_a==index || bptr->tel_b==index)) ||
+	     (!selbase && !selstat)) {
+	    if(doflag)
+	      cvis->bad |= FLAG_BAD;
+	    else
+	      cvis->bad &= ~FLAG_BAD;
+	  };
+	};
+      };
+    };
+  };
 /*
  * Is deferred editing required?
  */
@@ -476,6 +505,10 @@ int ed_flush(Observation *ob)
  * Inform user of reason for delay.
  */
     lprintf(stdout, "Applying %d buffered edits.\n", ob->obed->nused);
+/*
+ * Stashed polarization streams don't receive the edits, so discard them.
+ */
+    ps_forget(ob);
 /*
  * Apply edits to the uvdata scratch file.
  */
@@ -956,6 +989,10 @@ int app_Obedit(Observation *ob, int cif)
  */
   if(ob->obed && ob->obed->nused>0) {
     Intrec *rec;       /* Pointer into ob->rec[] */
+/*
+ * The flags of the visibilities in memory are about to change.
+ */
+    ob_cart_stale(ob, CART_VIEW);
 /*
  * Each integration has its own list of edits.
  */
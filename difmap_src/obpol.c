@@ -13,6 +13,7 @@ static GETPOL_FN(get_vpol);
 static GETPOL_FN(get_pi_pol);
 
 static int find_stokes(Observation *ob, Stokes pol);
+static float pair_wt(float wa, float wb);
 
 /*.......................................................................
  * Search for a way to create a given polarization from the stokes
@@ -52,6 +53,7 @@ int get_Obpol(Observation *ob, Stokes stokes, int report, Obpol *obpol)
  */
   ptmp.type = stokes;
   ptmp.pa = ptmp.pb = -1;
+  ptmp.op = POL_COPY;
   ptmp.getpol = 0;
 /*
  * Is the requested polarization directly recorded in the data?
@@ -74,6 +76,7 @@ int get_Obpol(Observation *ob, Stokes stokes, int report, Obpol *obpol)
       ptmp.pa = ptmp.pb;
       ptmp.pb = -1;
     };
+    ptmp.op = ptmp.pb < 0 ? POL_COPY : POL_PSEUDO;
     ptmp.getpol = get_pi_pol;
 /*
  * Was at least one or RR or LL found?
@@ -84,21 +87,25 @@ int get_Obpol(Observation *ob, Stokes stokes, int report, Obpol *obpol)
     case SI:
       ptmp.pa = find_stokes(ob, RR);
       ptmp.pb = find_stokes(ob, LL);
+      ptmp.op = POL_SUM;
       ptmp.getpol = get_ipol;
       break;
     case SV:
       ptmp.pa = find_stokes(ob, RR);
       ptmp.pb = find_stokes(ob, LL);
+      ptmp.op = POL_DIF;
       ptmp.getpol = get_vpol;
       break;
     case SQ:
       ptmp.pa = find_stokes(ob, RL);
       ptmp.pb = find_stokes(ob, LR);
+      ptmp.op = POL_SUM;
       ptmp.getpol = get_qpol;
       break;
     case SU:
       ptmp.pa = find_stokes(ob, LR);
       ptmp.pb = find_stokes(ob, RL);
+      ptmp.op = POL_IDIF;
       ptmp.getpol = get_upol;
       break;
     case NO_POL:   /* Substitute default polarization */
@@ -376,6 +383,197 @@ static GETPOL_FN(get_pi_pol)
   return;
 }
 
+/*.......................................................................
+ * Accumulate the unweighted sum of the visibilities of a given
+ * polarization, over n ob->dp->ifs[].chan[].base[].pol arrays that are
+ * separated by a constant stride in the I/O buffer (eg. the channels of
+ * one baseline). The result is the same as summing the output of
+ * obpol->getpol() for each array, but the polarization combination is
+ * dispatched once per run rather than once per visibility, and the
+ * loops are free of branches, so that the compiler can vectorize them.
+ *
+ * Input:
+ *  obpol   Obpol *  The descriptor of the polarization to be summed.
+ *  pvis     Cvis *  The first of the n polarization arrays.
+ *  stride   long    The number of elements of ob->dp->cvis[] between
+ *                   the starts of neighboring polarization arrays
+ *                   (eg. ob->dp->coff for channels).
+ *  n         int    The number of polarization arrays to sum over.
+ * Input/Output:
+ *  sum    Polsum *  The sums to be added to. Note that deleted
+ *                   visibilities are counted in sum->ndel, but the
+ *                   other members of sum are then meaningless.
+ */
+void pol_sum_run(Obpol *obpol, Cvis *pvis, long stride, int n, Polsum *sum)
+{
+  float re=0.0f, im=0.0f, var=0.0f; /* The sums to be accumulated */
+  int nflag=0, ndel=0;              /* The numbers of flagged and deleted */
+  Cvis *a = pvis + obpol->pa;       /* The first polarization */
+  Cvis *b = pvis + (obpol->pb >= 0 ? obpol->pb : obpol->pa); /* The second */
+  int i;
+  switch(obpol->op) {
+/*
+ * A directly recorded polarization. Note that adding 1 to the weights of
+ * deleted visibilities, whose sums are meaningless anyway, avoids
+ * dividing by zero.
+ */
+  case POL_COPY:
+    for(i=0; i<n; i++, a+=stride) {
+      float wt = a->wt;
+      re += a->re;
+      im += a->im;
+      var += 1.0f / ((wt < 0.0f ? -wt : wt) + (wt == 0.0f));
+      nflag += wt < 0.0f;
+      ndel += wt == 0.0f;
+    };
+    break;
+/*
+ * Polarizations combined from two recorded polarizations, each of which
+ * has a variance of (1/|wta| + 1/|wtb|)/4.
+ */
+  case POL_SUM:
+    for(i=0; i<n; i++, a+=stride, b+=stride) {
+      float wa = a->wt, wb = b->wt;
+      re += 0.5f * (a->re + b->re);
+      im += 0.5f * (a->im + b->im);
+      var += 0.25f * (1.0f / ((wa < 0.0f ? -wa : wa) + (wa == 0.0f)) +
+		      1.0f / ((wb < 0.0f ? -wb : wb) + (wb == 0.0f)));
+      nflag += (wa < 0.0f) | (wb < 0.0f);
+      ndel += (wa == 0.0f) | (wb == 0.0f);
+    };
+    break;
+  case POL_DIF:
+    for(i=0; i<n; i++, a+=stride, b+=stride) {
+      float wa = a->wt, wb = b->wt;
+      re += 0.5f * (a->re - b->re);
+      im += 0.5f * (a->im - b->im);
+      var += 0.25f * (1.0f / ((wa < 0.0f ? -wa : wa) + (wa == 0.0f)) +
+		      1.0f / ((wb < 0.0f ? -wb : wb) + (wb == 0.0f)));
+      nflag += (wa < 0.0f) | (wb < 0.0f);
+      ndel += (wa == 0.0f) | (wb == 0.0f);
+    };
+    break;
+  case POL_IDIF:
+    for(i=0; i<n; i++, a+=stride, b+=stride) {
+      float wa = a->wt, wb = b->wt;
+      re -= 0.5f * (a->im - b->im);
+      im += 0.5f * (a->re - b->re);
+      var += 0.25f * (1.0f / ((wa < 0.0f ? -wa : wa) + (wa == 0.0f)) +
+		      1.0f / ((wb < 0.0f ? -wb : wb) + (wb == 0.0f)));
+      nflag += (wa < 0.0f) | (wb < 0.0f);
+      ndel += (wa == 0.0f) | (wb == 0.0f);
+    };
+    break;
+/*
+ * Pseudo-I is inherently conditional, so simply call its extraction
+ * function directly for each visibility.
+ */
+  case POL_PSEUDO:
+    for(i=0; i<n; i++, pvis+=stride) {
+      Cvis cvis;
+      get_pi_pol(obpol, pvis, &cvis);
+      re += cvis.re;
+      im += cvis.im;
+      var += 1.0f / ((cvis.wt < 0.0f ? -cvis.wt : cvis.wt) +
+		     (cvis.wt == 0.0f));
+      nflag += cvis.wt < 0.0f;
+      ndel += cvis.wt == 0.0f;
+    };
+    break;
+  };
+/*
+ * Add the sums of this run to those of previous runs.
+ */
+  sum->re += re;
+  sum->im += im;
+  sum->var += var;
+  sum->npts += n;
+  sum->nflag += nflag;
+  sum->ndel += ndel;
+  return;
+}
+
+/*.......................................................................
+ * Extract the visibilities of a given polarization from n
+ * ob->dp->ifs[].chan[].base[].pol arrays that are separated by a
+ * constant stride in the I/O buffer, into a contiguous array. The
+ * result is the same as calling obpol->getpol() for each array, except
+ * that the real and imaginary parts of deleted visibilities are left
+ * undefined, but the polarization combination is dispatched once per
+ * run rather than once per visibility.
+ *
+ * Input:
+ *  obpol   Obpol *  The descriptor of the polarization to be extracted.
+ *  pvis     Cvis *  The first of the n polarization arrays.
+ *  stride   long    The number of elements of ob->dp->cvis[] between
+ *                   the starts of neighboring polarization arrays.
+ *  n         int    The number of polarization arrays to extract from.
+ * Input/Output:
+ *  out      Cvis *  The array of n visibilities to fill.
+ */
+void pol_get_run(Obpol *obpol, Cvis *pvis, long stride, int n, Cvis *out)
+{
+  Cvis *a = pvis + obpol->pa;       /* The first polarization */
+  Cvis *b = pvis + (obpol->pb >= 0 ? obpol->pb : obpol->pa); /* The second */
+  int i;
+  switch(obpol->op) {
+  case POL_COPY:
+    for(i=0; i<n; i++, a+=stride)
+      out[i] = *a;
+    break;
+/*
+ * Polarizations combined from two recorded polarizations. The combined
+ * visibility is deleted if either of its constituents is deleted.
+ */
+  case POL_SUM:
+    for(i=0; i<n; i++, a+=stride, b+=stride) {
+      out[i].re = 0.5f * (a->re + b->re);
+      out[i].im = 0.5f * (a->im + b->im);
+      out[i].wt = pair_wt(a->wt, b->wt);
+    };
+    break;
+  case POL_DIF:
+    for(i=0; i<n; i++, a+=stride, b+=stride) {
+      out[i].re = 0.5f * (a->re - b->re);
+      out[i].im = 0.5f * (a->im - b->im);
+      out[i].wt = pair_wt(a->wt, b->wt);
+    };
+    break;
+  case POL_IDIF:
+    for(i=0; i<n; i++, a+=stride, b+=stride) {
+      out[i].re = -0.5f * (a->im - b->im);
+      out[i].im =  0.5f * (a->re - b->re);
+      out[i].wt = pair_wt(a->wt, b->wt);
+    };
+    break;
+  case POL_PSEUDO:
+    for(i=0; i<n; i++, pvis+=stride)
+      get_pi_pol(obpol, pvis, out + i);
+    break;
+  };
+  return;
+}
+
+/*.......................................................................
+ * Return the weight of a visibility formed from half the sum or
+ * difference of two visibilities, as computed by get_ipol() etc. The
+ * result is zero if either visibility is deleted, and negative if
+ * either is flagged.
+ *
+ * Input:
+ *  wa, wb    float    The weights of the two visibilities.
+ * Output:
+ *  return    float    The weight of the combined visibility.
+ */
+static float pair_wt(float wa, float wb)
+{
+  float wt;
+  if(wa == 0.0f || wb == 0.0f)
+    return 0.0f;
+  wt = 4.0f/(1.0f/fabs(wa) + 1.0f/fabs(wb));
+  return (wa < 0.0f || wb < 0.0f) ? -wt : wt;
+}
+
 /*.......................................................................
  * Locate a given STOKES parameter in the observed data. Return its
  * index.
@@ -5,6 +5,9 @@
 #include "logio.h"
 #include "obs.h"
 #include "obedit.h"
+#include "ifcache.h"
+#include "visview.h"
+#include "polstash.h"
 #include "modeltab.h"
 
 static Observation *obalerr(Observation *ob);
@@ -157,6 +160,7 @@ Observation *Obs_alloc(Observation *ob, int nrec, int nbmax, int nsub,
     ob->stream.cl = NULL;
     ob->stream.pol.type = NO_POL;
     ob->stream.pol.pa = ob->stream.pol.pb = -1;
+    ob->stream.pol.op = POL_COPY;
     ob->stream.pol.getpol = 0;
     ob->stream.uvscale = 1.0f;
 /*
@@ -203,6 +207,9 @@ Observation *Obs_alloc(Observation *ob, int nrec, int nbmax, int nsub,
     ob->dp   = 0;
     ob->ip   = 0;
     ob->uvp  = 0;
+    ob->ifc  = 0;
+    ob->view = 0;
+    ob->pstash = 0;
     ob->model= 0;
     ob->newmod = 0;
     ob->cmodel= 0;
@@ -229,6 +236,17 @@ Observation *Obs_alloc(Observation *ob, int nrec, int nbmax, int nsub,
  * Mark the descriptor as allocated.
  */
   ob->state = OB_ALLOC;
+/*
+ * The visibility arrays are about to be (re-)allocated, so their
+ * Cartesian copies and structure-of-arrays view are invalid.
+ */
+  ob->cart = 0;
+  ob->view = del_Visview(ob->view);
+/*
+ * Any stashed polarization streams were composed from the previous
+ * visibilities.
+ */
+  ob->pstash = del_Polstash(ob->pstash);
 /*
  * (Re-)allocate an array of nsub sub-array descriptors.
  * Each new element must be externally filled via ini_Subarray() before
@@ -306,6 +324,23 @@ Observation *Obs_alloc(Observation *ob, int nrec, int nbmax, int nsub,
     if(ob->uvp==NULL)
       return del_Observation(ob);
   };
+/*
+ * Delete an obsolete cache of corrected IFs if not of the required size.
+ */
+  if(ob->ifc) {
+    IFcache *ifc = ob->ifc;
+    if(ifc->nif != nif || ifc->nbase != nbmax || ifc->ntime != nrec)
+      ob->ifc = del_IFcache(ob->ifc);
+  };
+/*
+ * Create an initially empty cache of corrected IFs, for use when IFs
+ * are paged.
+ */
+  if(ob->ifc==NULL && nif>1) {
+    ob->ifc = new_IFcache(nif, nbmax, nrec);
+    if(ob->ifc==NULL)
+      return del_Observation(ob);
+  };
 /*
  * Allocate empty established and tentative models if necessary.
  */
@@ -419,6 +454,18 @@ Observation *del_Observation(Observation *ob)
  * Delete the UV model scratch file.
  */
     ob->uvp = del_UVpage(ob->uvp);
+/*
+ * Delete the cache of corrected IFs.
+ */
+    ob->ifc = del_IFcache(ob->ifc);
+/*
+ * Delete the structure-of-arrays view of the visibilities.
+ */
+    ob->view = del_Visview(ob->view);
+/*
+ * Delete the stashed polarization streams.
+ */
+    ob->pstash = del_Polstash(ob->pstash);
 /*
  * Delete the lists of map-plane model components.
  */
@@ -20,6 +20,14 @@ struct Obedit;
 struct Edint;
 #endif
 
+#ifndef ifcache_h
+struct IFcache;
+#endif
+
+#ifndef visview_h
+struct Visview;
+#endif
+
 /*
  * Define a source descriptor.
  */
@@ -188,8 +196,25 @@ typedef struct {
   float w;         /* W coordinate (light-seconds) */
   float dt;        /* The integration time, or 0.0 if not known */
   int bad;         /* Status recorded as a union of Flagtype enumerators */
+  float re;        /* The real part of amp,phs (see ob_cartesian()) */
+  float im;        /* The imaginary part of amp,phs */
+  float modre;     /* The real part of modamp,modphs */
+  float modim;     /* The imaginary part of modamp,modphs */
 } Visibility;
 
+/*
+ * Enumerate the copies of the visibilities of the current IF that are
+ * derived on demand, namely the Cartesian copies, Visibility::re,im and
+ * Visibility::modre,modim, and the structure-of-arrays view,
+ * Observation::view. Observation::cart records a union of those that
+ * are up to date.
+ */
+typedef enum {
+  CART_DATA=1,   /* re,im are up to date wrt amp,phs */
+  CART_MODEL=2,  /* modre,modim are up to date wrt modamp,modphs */
+  CART_VIEW=4    /* The view is up to date wrt all visibility members */
+} Cartflag;
+
 /*
  * Define a container of IF-specific integration telescope corrections.
  */
@@ -281,6 +306,18 @@ typedef enum {
   PI_POL = -9
 } Stokes;
 
+/*
+ * Enumerate the ways in which a stream polarization is formed from the
+ * recorded polarizations, pvis[pa] and pvis[pb].
+ */
+typedef enum {
+  POL_COPY,      /* pvis[pa] */
+  POL_SUM,       /* (pvis[pa] + pvis[pb])/2, ie. I or Q */
+  POL_DIF,       /* (pvis[pa] - pvis[pb])/2, ie. V */
+  POL_IDIF,      /* i(pvis[pa] - pvis[pb])/2, ie. U */
+  POL_PSEUDO     /* The weighted mean of pvis[pa] and pvis[pb], ie. PI_POL */
+} Polop;
+
 /* Stream polarization descriptor */
 #define GETPOL_FN(fn) void (fn)(Obpol *pol, Cvis *pvis, Cvis *out)
 typedef struct Obpol Obpol;
@@ -288,11 +325,34 @@ struct Obpol{
   Stokes type;   /* Current polarization/Stokes-parameter type. */
   int pa;        /* First of up to 2 indexes of stokes parameters to combine */
   int pb;        /* The second stokes parameter index, or -1 if not required */
+  Polop op;      /* The way in which pa and pb are combined */
   GETPOL_FN(*getpol); /* Use to extract a visibility of polarization 'type'*/
 };
 
 int get_Obpol(Observation *ob, Stokes stokes, int report, Obpol *obpol);
 
+/*
+ * The following container accumulates the unweighted sum of a run of
+ * visibilities of a given polarization, as used to average
+ * spectral-line channels.
+ */
+typedef struct {
+  float re, im;  /* The sums of the real and imaginary parts */
+  float var;     /* The sum of the variances (1/|weight|) */
+  int npts;      /* The number of visibilities summed */
+  int nflag;     /* The number of flagged visibilities that were summed */
+  int ndel;      /* The number of deleted visibilities that were summed */
+} Polsum;
+
+/*
+ * Sum or extract the visibilities of a given polarization from
+ * n ob->dp->ifs[].chan[].base[].pol arrays, separated by 'stride'
+ * elements of ob->dp->cvis[]. These are equivalent to calling
+ * obpol->getpol() for each array in turn.
+ */
+void pol_sum_run(Obpol *obpol, Cvis *pvis, long stride, int n, Polsum *sum);
+void pol_get_run(Obpol *obpol, Cvis *pvis, long stride, int n, Cvis *out);
+
 /*
  * Enumerate recognized spherical coordinate projections.
  */
@@ -427,6 +487,12 @@ struct Observation {
   IFpage *ip;      /* IF paging descriptor */
   Recio *his;      /* History paging descriptor */
   UVpage *uvp;     /* UV model paging descriptor */
+  struct IFcache *ifc; /* Memory-resident copies of corrected IFs */
+  int cart;        /* The union of Cartflag parts of the visibilities of */
+                   /*  the current IF whose derived copies are valid */
+  struct Visview *view; /* A structure-of-arrays view of the current IF */
+  struct Polstash *pstash; /* The composed streams of unselected */
+                           /*  polarizations */
   Model *model;    /* The component form of the established UV model */
   Model *newmod;   /* The tentative, un-established part of the model */
   Model *cmodel;   /* Established continuum model */
@@ -459,6 +525,10 @@ int ob_ready(Observation *ob, Obstate state, const char *name);
 
 int ob_select(Observation *ob, int keep, Chlist *cl, Stokes stokes);
 
+/* Compose the streams of other polarizations for later ob_select()s */
+
+int ob_stash_pols(Observation *ob, Stokes *pols, int npol);
+
 /* Swap in a given IF into the associated Observation */
 
 int getIF(Observation *ob, int cif);
@@ -470,6 +540,22 @@ int getIF(Observation *ob, int cif);
 int get_cif_state(Observation *ob);
 int set_cif_state(Observation *ob, int cif);
 
+/*
+ * Mark given parts (a union of Cartflag enumerators) of the Cartesian
+ * copies of the visibilities of the current IF as out of date. This
+ * must be called whenever amp, phs, modamp or modphs are changed.
+ * It also marks the structure-of-arrays view as out of date, so
+ * changes to the weights, flags or UV coordinates of the visibilities
+ * must be followed by ob_cart_stale(ob, CART_VIEW).
+ */
+void ob_cart_stale(Observation *ob, int parts);
+
+/*
+ * Bring given parts of the Cartesian copies of the visibilities of the
+ * current IF up to date.
+ */
+void ob_cartesian(Observation *ob, int parts);
+
 /* Swap in the UV model of a given IF */
 
 int getmodel(Observation *ob, int cif);
@@ -610,6 +696,8 @@ Stokes Stokes_id(char *name);
 
 Observation *uvf_read(const char *name, double binwid, int scatter,
 		      int keepant);
+int get_uvf_spool(void);
+void set_uvf_spool(int spool);
 int uvf_write(Observation *ob, const char *name, int doshift);
 
 /* If descriptor memory management functions */
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include "vlbconst.h"
 #include "obs.h"
+#include "ifcache.h"
 #include "slalib.h"
 
 static int uvmodshift(Observation *ob, float east, float north);
@@ -37,6 +38,11 @@ int obshift(Observation *ob, float east, float north)
  */
   ob->geom.east += east;
   ob->geom.north += north;
+/*
+ * Cached copies of IFs other than the current one are no longer
+ * correctly shifted.
+ */
+  ifc_forget(ob, -1);
 /*
  * If an IF is currently in memory, shift its visibilities.
  */
@@ -136,6 +142,7 @@ int uvshift(Observation *ob, float east, float north)
  * Rotate by adding the pertinent amount to each visibility phase in
  * the observation.
  */
+  ob_cart_stale(ob, CART_DATA);
   sub = ob->sub;
   for(isub=0; isub<ob->nsub; isub++,sub++) {
     Integration *integ = sub->integ;
@@ -214,6 +221,7 @@ static int uvmodshift(Observation *ob, float east, float north)
  * Rotate by adding the pertinent amount to each visibility phase in
  * the observation.
  */
+      ob_cart_stale(ob, CART_MODEL);
       sub = ob->sub;
       for(isub=0; isub<ob->nsub; isub++,sub++) {
 	Integration *integ = sub->integ;
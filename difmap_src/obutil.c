@@ -11,11 +11,20 @@
 #include "logio.h"
 #include "obs.h"
 #include "obedit.h"
+#include "ifcache.h"
 #include "modeltab.h"
+#include "partask.h"
+#include "polstash.h"
 
 static int ob_get_select(Observation *ob, Chlist *cl, Stokes pol);
 static int bad_ob_chlist(Observation *ob, Chlist *def_cl, Chlist **if_cl);
 static int iniIF(Observation *ob, int cif);
+static void ob_prefetch(Observation *ob, int cif);
+static void ob_mean_vis(Obpol *obpol, Dpage *dp, Dif *dif, Chlist *cl,
+			int base, Dvis *dvis);
+static int ob_compose(Observation *ob, Obpol *obpol, IFpage **ip, int nstream);
+static int ob_unstash(Observation *ob, IFpage *ip, Stokes oldpol);
+static void ob_set_vis(Dvis *dvis, Visibility *vis);
 
 /*.......................................................................
  * Add a new line of history to observation 'ob'.
@@ -177,6 +186,11 @@ int getIF(Observation *ob, int cif)
  */
   if(ip_error(ip, "getIF"))
     return 1;
+/*
+ * Keep a copy of the corrected visibilities of the IF that is about to
+ * be replaced, if the IF cache has room for it.
+ */
+  (void) ifc_save(ob);
 /*
  * Select the visibility range and IF to be read.
  */
@@ -187,9 +201,25 @@ int getIF(Observation *ob, int cif)
  * has been succesfully been acquired.
  */
   ob->state = OB_SELECT;
+/*
+ * If the requested IF is in the IF cache, copy its corrected visibilities
+ * back into the Observation structure, then read its UV model. Since
+ * the cached visibilities already have all corrections applied, only
+ * the details of the new IF selection need to be recorded.
+ */
+  if(ifc_load(ob, cif) == 0) {
+    if(getmodel(ob, cif))
+      return 1;
+    ob->stream.cif = cif;
+    ob->stream.uvscale = getuvscale(ob, cif);
+    ob->state = OB_GETIF;
+    ob_prefetch(ob, cif);
+    return 0;
+  };
 /*
  * Read each integration from the IF paging file.
  */
+  ob_cart_stale(ob, CART_DATA);
   rec = ob->rec;
   for(ut=0; ut<ob->nrec; ut++,rec++) {
     Integration *integ = rec->integ;
@@ -234,9 +264,31 @@ int getIF(Observation *ob, int cif)
     ob->state = OB_SELECT;
     return 1;
   };
+/*
+ * Start reading the IF that IF loops will ask for next.
+ */
+  ob_prefetch(ob, cif);
   return 0;
 }
 
+/*.......................................................................
+ * Private function of getIF(), used to start a background read of the
+ * next sampled IF after a given IF, so that the next getIF() of an IF
+ * loop doesn't have to wait for the IF paging file. This is only done
+ * when multi-threading has been enabled, and not for IFs that can be
+ * restored from the IF cache.
+ *
+ * Input:
+ *  ob   Observation *  The descriptor of the observation.
+ *  cif          int    The IF that has just been acquired.
+ */
+static void ob_prefetch(Observation *ob, int cif)
+{
+  int nif = nextIF(ob, cif+1, 1, 1);
+  if(nif >= 0 && get_nthread() > 1 && !ifc_integ(ob, nif, 0L))
+    (void) ip_prefetch(ob->ip, nif);
+}
+
 /*.......................................................................
  * Private function of nextIF() and ob_select(), used to apply corrections
  * to visibilities that have just been read from the uvdata.scr scratch
@@ -303,6 +355,7 @@ static int iniIF(Observation *ob, int cif)
 /*
  * Loop over the integration arrays in each sub-array.
  */
+      ob_cart_stale(ob, CART_VIEW);
       sub = ob->sub;
       for(isub=0; isub<ob->nsub; isub++,sub++) {
 	Integration *integ = sub->integ;
@@ -392,6 +445,7 @@ int getmodel(Observation *ob, int cif)
 /*
  * Read each integration from the UV model paging file.
  */
+  ob_cart_stale(ob, CART_MODEL);
   rec = ob->rec;
   for(ut=0; ut<ob->nrec; ut++,rec++) {
     Integration *integ = rec->integ;
@@ -495,6 +549,73 @@ int putmodel(Observation *ob, int cif)
   return 0;
 }
 
+/*.......................................................................
+ * Mark given parts of the Cartesian copies of the visibilities of the
+ * current IF as out of date. This must be called by any function that
+ * changes the amp, phs, modamp or modphs members of the visibilities in
+ * ob->rec[]. Since the structure-of-arrays view of the visibilities
+ * (see visview.h) copies all of the members that it needs, it is
+ * marked as out of date by every call. Functions that only change the
+ * wt, bad, u or v members should thus specify parts=CART_VIEW.
+ *
+ * Input:
+ *  ob    Observation *   The observation whose visibilities are changing.
+ *  parts         int     A union of Cartflag enumerators, specifying
+ *                        which parts are changing.
+ */
+void ob_cart_stale(Observation *ob, int parts)
+{
+  if(ob)
+    ob->cart &= ~(parts | CART_VIEW);
+}
+
+/*.......................................................................
+ * Bring given parts of the Cartesian copies of the visibilities of the
+ * current IF up to date. Functions that need the real and imaginary
+ * parts of the data or model visibilities should call this, then use
+ * Visibility::re,im and Visibility::modre,modim instead of converting
+ * amp,phs and modamp,modphs themselves. The conversion is then only
+ * performed once per change in the visibilities, rather than once per
+ * use.
+ *
+ * Input:
+ *  ob    Observation *   The observation whose visibilities are needed.
+ *  parts         int     A union of Cartflag enumerators, specifying
+ *                        which parts are needed.
+ */
+void ob_cartesian(Observation *ob, int parts)
+{
+  Intrec *rec; /* Pointer into integration record array ob->rec */
+  int ut;      /* The index of the current integration */
+  int base;    /* The index of the current baseline */
+/*
+ * Which of the requested parts are out of date?
+ */
+  parts &= ~ob->cart;
+  if(!parts)
+    return;
+/*
+ * Convert the stale parts of each visibility of each integration.
+ */
+  rec = ob->rec;
+  for(ut=0; ut<ob->nrec; ut++,rec++) {
+    Integration *integ = rec->integ;
+    Visibility *vis = integ->vis;
+    int nbase = integ->sub->nbase;
+    for(base=0; base<nbase; base++,vis++) {
+      if(parts & CART_DATA) {
+	vis->re = vis->amp * cos(vis->phs);
+	vis->im = vis->amp * sin(vis->phs);
+      };
+      if(parts & CART_MODEL) {
+	vis->modre = vis->modamp * cos(vis->modphs);
+	vis->modim = vis->modamp * sin(vis->modphs);
+      };
+    };
+  };
+  ob->cart |= parts;
+}
+
 /*.......................................................................
  * Select a new UV data stream, compose it from the uvdata scratch file
  * and write the IF scratch file. Note that the UV representation of the
@@ -533,13 +654,12 @@ int putmodel(Observation *ob, int cif)
  */
 int ob_select(Observation *ob, int keep, Chlist *cl, Stokes stokes)
 {
-  Intrec *rec;   /* Pointer into integration record array ob->rec */
   Obpol *obpol;  /* Stream polarization descriptor */
-  int ut;        /* The index of the integration being processed */
+  IFpage *sip;   /* The stashed stream of the new polarization, or NULL */
+  Stokes oldpol; /* The polarization of the current stream, or NO_POL */
+  int samechan;  /* True if the channel selection isn't being changed */
   int cif;       /* The index of the IF bieng processed */
-  int base;      /* The index of the baseline being processed */
   int cr;        /* The channel range being processed */
-  int chan;      /* The index of the spectral-line channel being processed */
 /*
  * Check validity of arguments.
  */
@@ -563,6 +683,13 @@ int ob_select(Observation *ob, int keep, Chlist *cl, Stokes stokes)
     cl = del_Chlist(cl);
     return 1;
   };
+/*
+ * Record the polarization of the current stream, if there is one, and
+ * whether the channel selection is being changed, as described by
+ * ob_get_select().
+ */
+  oldpol = ob_ready(ob, OB_SELECT, NULL) ? ob->stream.pol.type : NO_POL;
+  samechan = ob->stream.cl && (!cl || cl == ob->stream.cl);
 /*
  * Install the new channel list and polarization selections if valid.
  */
@@ -575,10 +702,20 @@ int ob_select(Observation *ob, int keep, Chlist *cl, Stokes stokes)
  */
   cl = ob->stream.cl;
   obpol = &ob->stream.pol;
+/*
+ * Streams that were stashed for the previous channel selection are
+ * no longer usable.
+ */
+  if(!samechan)
+    ps_forget(ob);
 /*
  * Mark all per-baseline sums of weights as out of date.
  */
   flag_baseline_weights(ob, -1);
+/*
+ * The IF streams are about to be recomposed, so discard all cached IFs.
+ */
+  ifc_forget(ob, -1);
 /*
  * If we are keeping different models for different channel/polarization
  * selections, restore any model that was previously made for this
@@ -596,190 +733,410 @@ int ob_select(Observation *ob, int keep, Chlist *cl, Stokes stokes)
     lprintf(stdout, " %d..%d", cl->range[cr].ca+1, cl->range[cr].cb+1);
   lprintf(stdout, "\n");
 /*
- * For each IF separately read the uvdata.scr file, compose the new stream
- * in ob and then write it to the IF scratch file.
+ * Report the channels that will be read from each IF.
  */
   for(cif=0; cif<ob->nif; cif++) {
-    Dif *dif = &ob->dp->ifs[cif];
     If *ifp = ob->ifs + cif;
     Chlist *if_cl = ifp->cl;
-/*
- * Select the next IF in the output ifdata.scr file.
- */
-    if(ip_range(ob->ip, cif, 0, ob->nbmax-1))
-      return 1;
-/*
- * Start the report of the number of channels being read from each IF.
- */
     lprintf(stdout, "Reading IF %d channels:", cif+1);
-/*
- * Are any channels of this IF sampled?
- */
     if(if_cl) {
-/*
- * List the channel ranges that will be read.
- */
       for(cr=0; cr < if_cl->nrange; cr++) {
 	lprintf(stdout, " %d..%d",
 		ifp->coff + if_cl->range[cr].ca+1,
 		ifp->coff + if_cl->range[cr].cb+1);
       };
       lprintf(stdout, "\n");
+    } else {
+      lprintf(stdout, " (none)\n");
+    };
+  };
 /*
- * Set required uvdata-file paging ranges.
+ * If the stream of the new polarization was stashed by ob_stash_pols(),
+ * or by a previous call to this function, install it instead of
+ * composing it afresh from the uvdata.scr file.
  */
-      if(dp_crange(ob->dp, if_cl->ca, if_cl->cb) ||
-	 dp_srange(ob->dp, 0, ob->npol-1)  ||
-	 dp_brange(ob->dp, 0, ob->nbmax-1) ||
-	 dp_irange(ob->dp, cif, cif))
-	return 1;
+  sip = samechan ? ps_take(ob->pstash, obpol->type) : NULL;
+  if(sip) {
+    if(ob_unstash(ob, sip, oldpol))
+      return 1;
 /*
- * Read an integration at a time from the uvdata file and combine the
- * required spectral line channels and stokes parameters separately
- * for each IF. Place the results in ob.
+ * Compose the new stream of each IF. When there is only one IF, there
+ * is no IF scratch file, so its stream is composed directly in ob.
  */
-      rec = ob->rec;
-      for(ut=0; ut<ob->nrec; ut++,rec++) {
-	Integration *integ = rec->integ;
-	Visibility *vis = integ->vis;
-	int nbase = integ->sub->nbase;
+  } else {
+    ob_cart_stale(ob, CART_DATA);
+    if(ob_compose(ob, obpol, &ob->ip, 1))
+      return 1;
+  };
 /*
- * Read the next integration of the current IF from the uvdata scratch file
- * and construct the required polarization in the I/O buffer.
+ * Record the new observation state.
  */
-	if(dp_read(ob->dp, ut))
-	  return 1;
+  ob->state = OB_SELECT;
 /*
- * Accumulate one visibility for each baseline.
+ * If only one IF exists its visibilities are currently in memory, so
+ * apply corrections to them and place the observation in OB_GETIF state.
  */
-	for(base=0; base<nbase; base++,vis++) {
-	  int deleted=0;  /* True if the target visibility should be deleted */
-	  int flagged=0;  /* True if the target visibility should be flagged */
-	  int npts=0;     /* The number of visibilities in the mean */
-/*
- * Accumulate the weighted complex sum of visibilities over the
- * required spectral-line channels.
+  if(ob->nif==1 && iniIF(ob, 0)) {
+    ob->state = OB_SELECT;
+    return 1;
+  };
+  return 0;
+}
+
+/*.......................................................................
+ * Compose the streams of one or more polarizations of the current
+ * channel selection, reading each integration of the uvdata.scr file
+ * just once.
+ *
+ * Input:
+ *  ob     Observation *  The descriptor of the observation.
+ *  obpol        Obpol *  The descriptors of the nstream polarizations.
+ *  ip          IFpage ** The IF paging files to write the nstream
+ *                        streams to. If ob->nif==1, a NULL element
+ *                        requests that its stream be recorded directly
+ *                        in the visibilities of ob.
+ *  nstream        int    The number of streams to compose.
+ * Output:
+ *  return         int    0 - OK.
+ *                        1 - Error.
  */
-	  Cvis sumvis={0.0f,0.0f,0.0f};
-	  for(cr=0; cr < if_cl->nrange && !deleted; cr++) {
-	    for(chan=if_cl->range[cr].ca; chan<=if_cl->range[cr].cb; chan++) {
-	      Cvis curvis;
-	      obpol->getpol(obpol, dif->chan[chan].base[base].pol, &curvis);
+static int ob_compose(Observation *ob, Obpol *obpol, IFpage **ip, int nstream)
+{
+  Intrec *rec;   /* Pointer into integration record array ob->rec */
+  int ut;        /* The index of the integration being processed */
+  int cif;       /* The index of the IF bieng processed */
+  int base;      /* The index of the baseline being processed */
+  int bif, eif;  /* The indexes of the first and last sampled IFs */
+  int ca, cb;    /* The range of channels that spans all sampled IFs */
+  int is;        /* The index of a stream */
 /*
- * Ascertain the usability of the new visibility.
+ * Find the range of IFs that have selected channels, and the range of
+ * channels that spans all of them.
  */
-	      if(curvis.wt == 0.0f) {
-		deleted = 1;
-		break;
-	      } else {
-		if(curvis.wt < 0.0f) {
-		  flagged = 1;
-		  curvis.wt = -curvis.wt;
-		};
+  bif = eif = -1;
+  ca = cb = 0;
+  for(cif=0; cif<ob->nif; cif++) {
+    Chlist *if_cl = ob->ifs[cif].cl;
+    if(if_cl) {
+      if(bif < 0) {
+	bif = cif;
+	ca = if_cl->ca;
+	cb = if_cl->cb;
+      } else {
+	if(if_cl->ca < ca)
+	  ca = if_cl->ca;
+	if(if_cl->cb > cb)
+	  cb = if_cl->cb;
+      };
+      eif = cif;
+    };
+  };
 /*
- * Accumulate the unweighted sum of spectral line channel visibilities.
+ * Read each integration from the uvdata.scr file just once, compose the
+ * streams of all sampled IFs from it, and write them to the IF
+ * scratch files.
  */
-		npts++;
-		sumvis.re += curvis.re;
-		sumvis.im += curvis.im;
-		sumvis.wt += 1.0f/curvis.wt; /* Accumulate variance sum */
-	      };
-	    };
-	  };
+  if(bif >= 0) {
 /*
- * Convert the visibility sum into a mean.
+ * Set the uvdata-file paging ranges to span the sampled channels of all
+ * sampled IFs.
  */
-	  if(deleted || sumvis.wt==0.0f || npts==0) {
-	    sumvis.re = sumvis.im = sumvis.wt = 0.0f; /* Deleted */
-	  } else {
-	    sumvis.re /= npts;
-	    sumvis.im /= npts;
-	    sumvis.wt = npts * npts / sumvis.wt;
-	  };
+    if(dp_crange(ob->dp, ca, cb) ||
+       dp_srange(ob->dp, 0, ob->npol-1)  ||
+       dp_brange(ob->dp, 0, ob->nbmax-1) ||
+       dp_irange(ob->dp, bif, eif))
+      return 1;
+    rec = ob->rec;
+    for(ut=0; ut<ob->nrec; ut++,rec++) {
+      Integration *integ = rec->integ;
+      int nbase = integ->sub->nbase;
 /*
- * Record the visibility on the latest baseline in the respective
- * visibility in the current integration of ob. Note that if there
- * is only one IF in the observation, there will be no IF scratch
- * file.
+ * Read the next integration from the uvdata scratch file.
  */
-	  if(deleted || (sumvis.re==0.0f && sumvis.im==0.0f)) {
-	    vis->amp = vis->phs = vis->wt = 0.0f;
-	    vis->bad = FLAG_DEL;
-	  } else {
-	    vis->amp = sqrt(sumvis.re * sumvis.re + sumvis.im * sumvis.im);
-	    vis->phs = atan2(sumvis.im, sumvis.re);
-	    vis->wt = sumvis.wt;
-	    vis->bad = flagged ? FLAG_BAD : 0;
-	  };
-	};
-      };
+      if(dp_read(ob->dp, ut))
+	return 1;
 /*
- * Having cached a whole IF in the observation structure, copy it to
- * the IF scratch file if there is one.
- */
-      if(ob->ip) {
-	rec = ob->rec;
-	for(ut=0; ut<ob->nrec; ut++,rec++) {
-	  Integration *integ = rec->integ;
-	  Visibility *vis = integ->vis;
-	  int nbase = integ->sub->nbase;
-	  Dvis *dvis = ob->ip->dvis;
+ * Compose the stream visibilities of each sampled IF.
+ */
+      for(cif=bif; cif<=eif; cif++) {
+	Dif *dif = &ob->dp->ifs[cif];
+	Chlist *if_cl = ob->ifs[cif].cl;
+	if(!if_cl)
+	  continue;
+	for(is=0; is<nstream; is++) {
+	  if(ip[is]) {
+/*
+ * Write the visibilities of the IF straight into the output buffer of
+ * the IF scratch file, then write the buffer to the integration's slot
+ * in the IF's record.
+ */
+	    Dvis *dvis = ip[is]->dvis;
+	    for(base=0; base<nbase; base++,dvis++)
+	      ob_mean_vis(obpol + is, ob->dp, dif, if_cl, base, dvis);
+	    if(ip_range(ip[is], cif, 0, ob->nbmax-1) || ip_write(ip[is], ut))
+	      return 1;
+	  } else {
 /*
- * Copy visibilities from the current integration in the Observation
- * structure to the output buffer.
+ * Record the visibilities of the only IF in the current integration
+ * of ob.
  */
-	  for(base=0; base<nbase; base++,vis++,dvis++) {
-	    dvis->amp = vis->amp;
-	    dvis->phs = vis->phs;
-	    if(!(vis->bad & (FLAG_DEL | FLAG_BAD))) {
-	      dvis->wt = vis->wt;   /* +ve weight means a good visibility */
-	    } else if(vis->bad & FLAG_BAD) {
-	      dvis->wt = -vis->wt;  /* -ve weight means a flagged visibility */
-	    } else {
-	      dvis->wt = 0.0f;      /* Zero weight means a deleted visibility */
+	    Visibility *vis = integ->vis;
+	    for(base=0; base<nbase; base++,vis++) {
+	      Dvis dvis;
+	      ob_mean_vis(obpol + is, ob->dp, dif, if_cl, base, &dvis);
+	      ob_set_vis(&dvis, vis);
 	    };
 	  };
+	};
+      };
+    };
+  };
 /*
- * Write the latest integration to the output IF scratch file.
+ * Zero fill the IF scratch file records of IFs that have no selected
+ * channels.
  */
-	  if(ip_write(ob->ip, ut))
+  for(is=0; is<nstream; is++) {
+    if(ip[is]) {
+      for(cif=0; cif<ob->nif; cif++) {
+	if(!ob->ifs[cif].cl) {
+	  if(ip_range(ip[is], cif, 0, ob->nbmax-1) || ip_clear(ip[is]))
 	    return 1;
+	  for(ut=0; ut<ob->nrec; ut++) {
+	    if(ip_write(ip[is], ut))
+	      return 1;
+	  };
 	};
       };
-/*
- * If there are no channels selected in the current IF, simply clear
- * output buffer and write all integrations.
+    };
+  };
+  return 0;
+}
+
+/*.......................................................................
+ * Install a stashed stream as the stream of the new selection. This is
+ * a private function of ob_select().
+ *
+ * Input:
+ *  ob     Observation *  The descriptor of the observation, whose new
+ *                        selection has been installed by
+ *                        ob_get_select().
+ *  ip          IFpage *  The stashed stream of the new selection, as
+ *                        returned by ps_take(). This is deleted on
+ *                        error.
+ *  oldpol      Stokes    The polarization of the stream that is being
+ *                        replaced, or NO_POL if there was no valid
+ *                        stream.
+ * Output:
+ *  return         int    0 - OK.
+ *                        1 - Error.
  */
-    } else {
+static int ob_unstash(Observation *ob, IFpage *ip, Stokes oldpol)
+{
+  Stokes pol = ob->stream.pol.type;  /* The new polarization */
+  ob_cart_stale(ob, CART_DATA);
 /*
- * Report that no channels are being read from this IF.
+ * If there is more than one IF, swap the IF scratch file of the stream
+ * into ob, and stash the stream that it replaces, for use if its
+ * polarization is re-selected.
  */
-      lprintf(stdout, " (none)\n");
+  if(ob->ip) {
+    if(ip_flush(ob->ip)) {
+      del_IFpage(ip);
+      return 1;
+    };
+    if(oldpol != NO_POL && oldpol != pol)
+      ps_put(ob->pstash, oldpol, ob->ip);
+    else
+      del_IFpage(ob->ip);
+    ob->ip = ip;
 /*
- * Zero fill the IF scratch file records for the empty IF.
+ * When there is only one IF, the stream is recorded directly in the
+ * visibilities of ob. Since these get corrected by iniIF(), they can't
+ * be stashed, so return a copy of the stream to the stash.
  */
-      if(ob->ip) {
-	ip_clear(ob->ip);
-	for(ut=0; ut<ob->nrec; ut++,rec++) {
-	  if(ip_write(ob->ip, ut))
-	    return 1;
-	};
+  } else {
+    Intrec *rec = ob->rec;
+    int ut;
+    for(ut=0; ut<ob->nrec; ut++,rec++) {
+      Integration *integ = rec->integ;
+      Visibility *vis = integ->vis;
+      Dvis *dvis = ip->dvis;
+      int nbase = integ->sub->nbase;
+      int base;
+      if(ip_range(ip, 0, 0, ob->nbmax-1) || ip_read(ip, ut)) {
+	del_IFpage(ip);
+	return 1;
       };
+      for(base=0; base<nbase; base++,vis++,dvis++)
+	ob_set_vis(dvis, vis);
     };
+    ps_put(ob->pstash, pol, ip);
   };
+  return 0;
+}
+
+/*.......................................................................
+ * Copy a stream visibility from the form used in IF scratch files into
+ * a Visibility.
+ *
+ * Input:
+ *  dvis        Dvis *  The visibility to be copied, with a positive
+ *                      weight if good, a negative weight if flagged,
+ *                      or zero weight if deleted.
+ * Input/Output:
+ *  vis   Visibility *  The visibility to copy to.
+ */
+static void ob_set_vis(Dvis *dvis, Visibility *vis)
+{
+  vis->amp = dvis->amp;
+  vis->phs = dvis->phs;
+  if(dvis->wt > 0.0f) {
+    vis->wt = dvis->wt;
+    vis->bad = 0;
+  } else if(dvis->wt < 0.0f) {
+    vis->wt = -dvis->wt;
+    vis->bad = FLAG_BAD;
+  } else {
+    vis->wt = 0.0f;
+    vis->bad = FLAG_DEL;
+  };
+}
+
+/*.......................................................................
+ * Compose and stash the streams of one or more polarizations of the
+ * current channel selection, in a single pass through the uvdata.scr
+ * file, so that subsequent calls to ob_select() that select these
+ * polarizations, without changing the channel selection, don't have
+ * to read uvdata.scr. This is used when a number of polarizations are
+ * going to be selected in turn, such as when making polarization maps.
+ * Polarizations that are already stashed, or that can't be formed
+ * from the observed polarizations, are quietly skipped, as is the
+ * currently selected polarization if ob_select() will stash it itself.
+ *
+ * Input:
+ *  ob     Observation *  The descriptor of the observation.
+ *  pols        Stokes *  The array of npol polarizations to stash.
+ *  npol           int    The number of elements in pols[]. Only the
+ *                        first PS_MAXSTREAM polarizations that need
+ *                        to be composed are stashed.
+ * Output:
+ *  return         int    0 - OK.
+ *                        1 - Error.
+ */
+int ob_stash_pols(Observation *ob, Stokes *pols, int npol)
+{
+  Obpol obpol[PS_MAXSTREAM]; /* The polarizations to be composed */
+  IFpage *ip[PS_MAXSTREAM];  /* The IF scratch files of the new streams */
+  int nstream = 0;           /* The number of streams to be composed */
+  int ok = 1;                /* False after an error */
+  int i, is;
 /*
- * Record the new observation state.
+ * Check the state of the observation.
  */
-  ob->state = OB_SELECT;
+  if(!ob_ready(ob, OB_SELECT, "ob_stash_pols"))
+    return 1;
 /*
- * If only one IF exists its visibilities are currently in memory, so
- * apply corrections to them and place the observation in OB_GETIF state.
+ * Ensure that all deferred edits have been applied to uvdata.scr.
  */
-  if(ob->nif==1 && iniIF(ob, 0)) {
-    ob->state = OB_SELECT;
+  if(ed_flush(ob))
     return 1;
+/*
+ * Create the stash if needed.
+ */
+  if(!ob->pstash && !(ob->pstash = new_Polstash()))
+    return 1;
+/*
+ * Get the descriptors of the polarizations that need to be composed,
+ * and create a scratch file for each of them.
+ */
+  for(i=0; ok && i<npol && nstream<PS_MAXSTREAM; i++) {
+    Obpol op;
+    int dup = 0;
+    if(get_Obpol(ob, pols[i], 0, &op) ||
+       (ob->ip && op.type == ob->stream.pol.type) ||
+       ps_have(ob->pstash, op.type))
+      continue;
+    for(is=0; is<nstream; is++)
+      dup = dup || obpol[is].type == op.type;
+    if(dup)
+      continue;
+    ip[nstream] = new_IFpage(ob->nif, ob->nbmax, ob->nrec);
+    if(ip[nstream])
+      obpol[nstream++] = op;
+    else
+      ok = 0;
+  };
+/*
+ * Compose the streams.
+ */
+  if(ok && nstream > 0) {
+    lprintf(stdout, "Composing polarization%s:", nstream==1 ? "" : "s");
+    for(is=0; is<nstream; is++)
+      lprintf(stdout, " %s", Stokes_name(obpol[is].type));
+    lprintf(stdout, "\n");
+    ok = !ob_compose(ob, obpol, ip, nstream);
+    for(is=0; ok && is<nstream; is++)
+      ok = !ip_flush(ip[is]);
+  };
+/*
+ * Stash the new streams, or discard them on error.
+ */
+  for(is=0; is<nstream; is++) {
+    if(ok)
+      ps_put(ob->pstash, obpol[is].type, ip[is]);
+    else
+      del_IFpage(ip[is]);
+  };
+  return !ok;
+}
+
+/*.......................................................................
+ * Private function of ob_select(), used to form the stream visibility of
+ * one baseline of an IF, from the spectral-line channels and
+ * polarizations of the integration that is in the uvdata.scr I/O buffer.
+ *
+ * Input:
+ *  obpol      Obpol *  The descriptor of the selected polarization.
+ *  dp         Dpage *  The uvdata.scr paging descriptor.
+ *  dif          Dif *  The uvdata.scr buffer tree of the IF.
+ *  cl        Chlist *  The selected channel ranges of the IF.
+ *  base         int    The index of the baseline.
+ * Input/Output:
+ *  dvis        Dvis *  The mean visibility, with a positive weight if
+ *                      good, a negative weight if flagged, or zero
+ *                      weight if deleted.
+ */
+static void ob_mean_vis(Obpol *obpol, Dpage *dp, Dif *dif, Chlist *cl,
+			int base, Dvis *dvis)
+{
+  Polsum sum = {0.0f, 0.0f, 0.0f, 0, 0, 0}; /* The sums over channels */
+  int cr;         /* The channel range being processed */
+/*
+ * Accumulate the unweighted sum of visibilities over each range of
+ * spectral-line channels. The channels of a baseline are separated by
+ * dp->coff visibilities in the I/O buffer.
+ */
+  for(cr=0; cr < cl->nrange && sum.ndel==0; cr++) {
+    int ca = cl->range[cr].ca;
+    pol_sum_run(obpol, dif->chan[ca].base[base].pol, dp->coff,
+		cl->range[cr].cb - ca + 1, &sum);
+  };
+/*
+ * Convert the visibility sum into a mean, recording it in amplitude
+ * and phase form. The visibility is deleted if any of its channels
+ * are deleted.
+ */
+  if(sum.ndel || sum.var==0.0f || sum.npts==0 ||
+     (sum.re==0.0f && sum.im==0.0f)) {
+    dvis->amp = dvis->phs = dvis->wt = 0.0f;   /* Deleted */
+  } else {
+    float re = sum.re / sum.npts;
+    float im = sum.im / sum.npts;
+    float wt = sum.npts * sum.npts / sum.var;
+    dvis->amp = sqrt(re * re + im * im);
+    dvis->phs = atan2(im, re);
+    dvis->wt = sum.nflag ? -wt : wt;
   };
-  return 0;
 }
 
 /*.......................................................................
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "partask.h"
+#include "logio.h"
+
+/*
+ * The max number of threads that multi-threaded operations are allowed
+ * to use, as set by set_nthread().
+ */
+static int max_nthread = 1;
+
+/*
+ * The mutex of partask_lock() and partask_unlock().
+ */
+static pthread_mutex_t partask_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Define the argument of each worker thread.
+ */
+typedef struct {
+  PARTASK_FN(*task);  /* The task function to be called */
+  void *data;         /* The data argument of task() */
+  int ithread;        /* The index of the thread */
+  int nthread;        /* The total number of threads */
+} Partask;
+
+static void *partask_thread(void *arg);
+
+/*.......................................................................
+ * Run a given task function concurrently in a given number of threads,
+ * and wait for all of the threads to complete. The calling thread is
+ * used to run thread 0.
+ *
+ * Input:
+ *  nthread       int    The number of threads to run. Values < 1 are
+ *                       treated as 1.
+ *  task   PARTASK_FN(*) The function to call in each thread.
+ *  data         void *  The data argument to pass to task().
+ */
+void run_partask(int nthread, PARTASK_FN(*task), void *data)
+{
+  pthread_t tid[MAX_NTHREAD]; /* The identifiers of the worker threads */
+  Partask args[MAX_NTHREAD];  /* The arguments of the worker threads */
+  int nrun;                   /* The number of worker threads created */
+  int i;
+/*
+ * Enforce the permitted range of thread counts.
+ */
+  if(nthread < 1)
+    nthread = 1;
+  else if(nthread > MAX_NTHREAD)
+    nthread = MAX_NTHREAD;
+/*
+ * Without additional threads there is no need for the overheads of
+ * creating threads.
+ */
+  if(nthread == 1) {
+    task(data, 0, 1);
+    return;
+  };
+/*
+ * Initialize the arguments of each thread.
+ */
+  for(i=0; i<nthread; i++) {
+    Partask *pt = args + i;
+    pt->task = task;
+    pt->data = data;
+    pt->ithread = i;
+    pt->nthread = nthread;
+  };
+/*
+ * Start threads 1..nthread-1, stopping if the system refuses to create
+ * any more threads.
+ */
+  for(nrun=1; nrun<nthread; nrun++) {
+    if(pthread_create(tid + nrun, NULL, partask_thread, args + nrun))
+      break;
+  };
+/*
+ * Use the calling thread to run thread 0, plus the shares of any
+ * threads that couldn't be created.
+ */
+  task(data, 0, nthread);
+  for(i=nrun; i<nthread; i++)
+    task(data, i, nthread);
+/*
+ * Wait for the worker threads to finish.
+ */
+  for(i=1; i<nrun; i++)
+    pthread_join(tid[i], NULL);
+}
+
+/*.......................................................................
+ * The start function of the threads created by run_partask().
+ *
+ * Input:
+ *  arg     void *  The Partask argument of the thread.
+ * Output:
+ *  return  void *  Always NULL.
+ */
+static void *partask_thread(void *arg)
+{
+  Partask *pt = (Partask *) arg;
+  pt->task(pt->data, pt->ithread, pt->nthread);
+  return NULL;
+}
+
+/*.......................................................................
+ * Return the range of elements that a given thread should process, when
+ * n elements are divided as evenly as possible into nthread contiguous
+ * ranges.
+ *
+ * Input:
+ *  n          long    The total number of elements.
+ *  ithread     int    The index of the thread (0..nthread-1).
+ *  nthread     int    The total number of threads.
+ * Input/Output:
+ *  ia         long *  The index of the first element to process.
+ *  ib         long *  The index of the element that follows the last
+ *                     element to process.
+ */
+void partask_range(long n, int ithread, int nthread, long *ia, long *ib)
+{
+  *ia = (long) ((double) n * ithread / nthread);
+  *ib = (long) ((double) n * (ithread + 1) / nthread);
+}
+
+/*.......................................................................
+ * Wait until no other thread of a parallel task is between calls to
+ * partask_lock() and partask_unlock(), then claim exclusive use of
+ * any shared data until partask_unlock() is called.
+ */
+void partask_lock(void)
+{
+  pthread_mutex_lock(&partask_mutex);
+}
+
+/*.......................................................................
+ * Release the exclusive use of shared data that was claimed by
+ * partask_lock().
+ */
+void partask_unlock(void)
+{
+  pthread_mutex_unlock(&partask_mutex);
+}
+
+/*.......................................................................
+ * Return the maximum number of threads that multi-threaded operations
+ * should use.
+ *
+ * Output:
+ *  return   int   The number of threads (>= 1).
+ */
+int get_nthread(void)
+{
+  return max_nthread;
+}
+
+/*.......................................................................
+ * Set the maximum number of threads that multi-threaded operations
+ * should use.
+ *
+ * Input:
+ *  nthread   int   The new number of threads. This must be in the
+ *                  range 1..MAX_NTHREAD.
+ * Output:
+ *  return    int   0 - OK.
+ *                  1 - Error.
+ */
+int set_nthread(int nthread)
+{
+  if(nthread < 1 || nthread > MAX_NTHREAD) {
+    lprintf(stderr, "The number of threads must be in the range 1-%d.\n",
+	    MAX_NTHREAD);
+    return 1;
+  };
+  max_nthread = nthread;
+  return 0;
+}
+
+/*.......................................................................
+ * Return the number of processors that are currently online.
+ *
+ * Output:
+ *  return   int   The number of processors, or 1 if not known.
+ */
+int count_cpus(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if(ncpu > 0)
+    return ncpu > MAX_NTHREAD ? MAX_NTHREAD : (int) ncpu;
+#endif
+  return 1;
+}
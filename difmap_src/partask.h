@@ -0,0 +1,77 @@
+#ifndef partask_h
+#define partask_h
+
+/*
+ * This module provides a simple facility for dividing the work of a
+ * computationally intensive loop between a number of concurrently
+ * executing threads. The caller supplies a task function, which is
+ * called once per thread, with the index of that thread and the
+ * total number of threads. It is up to the task function to use
+ * these to select its share of the work, and to avoid modifying
+ * data that other threads might also be modifying at the same time.
+ */
+
+/*
+ * The declaration of a parallel task function.
+ *
+ * Input:
+ *  data      void *  The data argument that was passed to run_partask().
+ *  ithread    int    The 0-relative index of the calling thread.
+ *  nthread    int    The total number of threads that are running
+ *                    the task.
+ */
+#define PARTASK_FN(fn) void (fn)(void *data, int ithread, int nthread)
+
+/*
+ * Run task() concurrently in nthread threads, and wait for all of
+ * them to finish. The calling thread is used as thread 0. If
+ * threads can't be created, the remaining calls to task() are made
+ * sequentially by the calling thread, so the task is always
+ * completed.
+ */
+void run_partask(int nthread, PARTASK_FN(*task), void *data);
+
+/*
+ * Return the indexes of the first and last+1 elements of the
+ * contiguous share of n elements that thread ithread of nthread
+ * should process.
+ */
+void partask_range(long n, int ithread, int nthread, long *ia, long *ib);
+
+/*
+ * Serialize the rare sections of a task function that must modify
+ * data that are shared by all threads. Calls may not be nested.
+ */
+void partask_lock(void);
+void partask_unlock(void);
+
+/*
+ * Get and set the maximum number of threads that multi-threaded
+ * operations should use. The default is 1.
+ */
+int get_nthread(void);
+int set_nthread(int nthread);
+
+/*
+ * Return the number of processors that are currently online, or 1
+ * if this can't be determined.
+ */
+int count_cpus(void);
+
+/*
+ * The upper limit on the number of threads that set_nthread() allows.
+ */
+#define MAX_NTHREAD 64
+
+/*
+ * The size of a cache line on most current processors. When the
+ * per-thread states of a task are stored in adjacent elements of an
+ * array, ending each element with PARTASK_PAD ensures that the members
+ * that one thread updates never share a cache line with those of
+ * another thread. Otherwise each update by one thread would evict the
+ * line from the caches of the threads of neighbouring elements.
+ */
+#define PARTASK_LINE 64
+#define PARTASK_PAD char partask_pad[PARTASK_LINE]
+
+#endif
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "logio.h"
+#include "obs.h"
+#include "polstash.h"
+
+static int ps_index(Polstash *ps, Stokes pol);
+static void ps_remove(Polstash *ps, int i);
+
+/*.......................................................................
+ * Allocate an empty polarization stash.
+ *
+ * Output:
+ *  return  Polstash *  The new stash, or NULL on error.
+ */
+Polstash *new_Polstash(void)
+{
+  Polstash *ps = malloc(sizeof(*ps));
+  if(ps==NULL) {
+    lprintf(stderr, "new_Polstash: Insufficient memory.\n");
+    return NULL;
+  };
+  ps->nstream = 0;
+  return ps;
+}
+
+/*.......................................................................
+ * Delete a polarization stash and the paging files of its streams.
+ *
+ * Input:
+ *  ps     Polstash *  The stash to be deleted.
+ * Output:
+ *  return Polstash *  Always NULL. Use like ps=del_Polstash(ps);
+ */
+Polstash *del_Polstash(Polstash *ps)
+{
+  if(ps) {
+    while(ps->nstream > 0)
+      ps_remove(ps, ps->nstream - 1);
+    free(ps);
+  };
+  return NULL;
+}
+
+/*.......................................................................
+ * Return true if the stream of a given polarization is in a stash.
+ *
+ * Input:
+ *  ps     Polstash *  The stash to look in (can be NULL).
+ *  pol      Stokes    The polarization of the stream.
+ * Output:
+ *  return      int    0 - The stream isn't stashed.
+ *                     1 - The stream is stashed.
+ */
+int ps_have(Polstash *ps, Stokes pol)
+{
+  return ps_index(ps, pol) >= 0;
+}
+
+/*.......................................................................
+ * Remove the stream of a given polarization from a stash, and return
+ * its paging file to the caller.
+ *
+ * Input:
+ *  ps     Polstash *  The stash to take the stream from (can be NULL).
+ *  pol      Stokes    The polarization of the stream.
+ * Output:
+ *  return   IFpage *  The paging file of the stream, or NULL if the
+ *                     stream isn't stashed. The caller becomes
+ *                     responsible for deleting it.
+ */
+IFpage *ps_take(Polstash *ps, Stokes pol)
+{
+  IFpage *ip;
+  int i = ps_index(ps, pol);
+  if(i < 0)
+    return NULL;
+  ip = ps->stream[i].ip;
+  ps->stream[i].ip = NULL;
+  ps_remove(ps, i);
+  return ip;
+}
+
+/*.......................................................................
+ * Add the stream of a given polarization to a stash, replacing any
+ * existing stream of the same polarization. If the stash is full, the
+ * least recently stashed stream is discarded to make room.
+ *
+ * Input:
+ *  ps     Polstash *  The stash to add the stream to.
+ *  pol      Stokes    The polarization of the stream.
+ *  ip       IFpage *  The paging file of the stream. The stash becomes
+ *                     responsible for deleting it.
+ */
+void ps_put(Polstash *ps, Stokes pol, IFpage *ip)
+{
+  int i = ps_index(ps, pol);
+  if(i >= 0)
+    ps_remove(ps, i);
+  else if(ps->nstream >= PS_MAXSTREAM)
+    ps_remove(ps, 0);
+  ps->stream[ps->nstream].pol = pol;
+  ps->stream[ps->nstream].ip = ip;
+  ps->nstream++;
+}
+
+/*.......................................................................
+ * Discard all of the stashed streams of an observation. This must be
+ * called whenever the visibilities of uvdata.scr, or the channel
+ * selection that the streams were composed from, are changed.
+ *
+ * Input:
+ *  ob     Observation *  The observation whose stash is to be emptied.
+ */
+void ps_forget(Observation *ob)
+{
+  Polstash *ps = ob ? ob->pstash : NULL;
+  if(ps) {
+    while(ps->nstream > 0)
+      ps_remove(ps, ps->nstream - 1);
+  };
+}
+
+/*.......................................................................
+ * Return the index of the stashed stream of a given polarization.
+ *
+ * Input:
+ *  ps     Polstash *  The stash to look in (can be NULL).
+ *  pol      Stokes    The polarization of the stream.
+ * Output:
+ *  return      int    The index of the stream in ps->stream[], or -1
+ *                     if not found.
+ */
+static int ps_index(Polstash *ps, Stokes pol)
+{
+  int i;
+  if(ps) {
+    for(i=0; i<ps->nstream; i++) {
+      if(ps->stream[i].pol == pol)
+	return i;
+    };
+  };
+  return -1;
+}
+
+/*.......................................................................
+ * Remove an element of ps->stream[], deleting its paging file if it
+ * still has one.
+ *
+ * Input:
+ *  ps     Polstash *  The stash to remove the stream from.
+ *  i           int    The index of the stream in ps->stream[].
+ */
+static void ps_remove(Polstash *ps, int i)
+{
+  del_IFpage(ps->stream[i].ip);
+  for( ; i < ps->nstream-1; i++)
+    ps->stream[i] = ps->stream[i+1];
+  ps->nstream--;
+}
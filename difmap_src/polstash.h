@@ -0,0 +1,56 @@
+#ifndef polstash_h
+#define polstash_h
+
+/*
+ * The polarization stash keeps the composed, but uncorrected, stream
+ * visibilities of polarizations other than the one that is currently
+ * selected, each in an IF paging file of its own. This allows
+ * ob_select() to switch to one of these polarizations without
+ * re-reading the uvdata.scr paging file, provided that the channel
+ * selection is unchanged. The streams of several polarizations can be
+ * composed in a single pass through uvdata.scr by ob_stash_pols().
+ * All stashed streams are discarded whenever the channel selection is
+ * changed, or edits are applied to uvdata.scr.
+ */
+
+/* The maximum number of streams that can be stashed at once */
+
+#define PS_MAXSTREAM 4
+
+/* Declare the container of one stashed stream */
+
+typedef struct {
+  Stokes pol;     /* The polarization of the stream */
+  IFpage *ip;     /* The stream visibilities of each IF */
+} Pstream;
+
+/* Declare the container of the stashed streams of an observation */
+
+typedef struct Polstash {
+  int nstream;    /* The number of streams in stream[] */
+  Pstream stream[PS_MAXSTREAM]; /* The stashed streams, ordered from the */
+                                /*  least to the most recently stashed */
+} Polstash;
+
+/* Create and delete the stash of an observation */
+
+Polstash *new_Polstash(void);
+Polstash *del_Polstash(Polstash *ps);
+
+/* Return true if the stream of a given polarization is stashed */
+
+int ps_have(Polstash *ps, Stokes pol);
+
+/* Remove the stream of a given polarization from the stash */
+
+IFpage *ps_take(Polstash *ps, Stokes pol);
+
+/* Add the stream of a given polarization to the stash */
+
+void ps_put(Polstash *ps, Stokes pol, IFpage *ip);
+
+/* Discard all stashed streams of an observation */
+
+void ps_forget(Observation *ob);
+
+#endif
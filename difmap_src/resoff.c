@@ -4,6 +4,7 @@
 #include "logio.h"
 #include "vlbconst.h"
 #include "obs.h"
+#include "ifcache.h"
 
 /*.......................................................................
  * Determine and apply a single correction amp+phase residual offset
@@ -142,6 +143,7 @@ int resoff(Observation *ob, int doall, int base, int isub)
 /*
  * Apply the corrections to all but the deleted visibilities.
  */
+      ob_cart_stale(ob, CART_DATA);
       for(ut=0; ut<sub->ntime; ut++) {
 	Integration *integ = &sub->integ[ut];
 	Visibility *vis = &integ->vis[base];
@@ -214,6 +216,7 @@ int clroff(Observation *ob, int doall, int doamp, int dophs)
 /*
  * Undo the corrections of the current IF one sub-array at a time.
  */
+    ob_cart_stale(ob, CART_DATA);
     for(isub=0; isub<ob->nsub; isub++) {
       Subarray *sub = &ob->sub[isub];
       Integration *integ = sub->integ;
@@ -284,6 +287,7 @@ int app_bcor(Observation *ob, int cif)
 /*
  * Apply the corrections of the current IF one sub-array at a time.
  */
+  ob_cart_stale(ob, CART_DATA);
   for(isub=0; isub<ob->nsub; isub++) {
     Subarray *sub = &ob->sub[isub];
     Integration *integ = sub->integ;
@@ -347,6 +351,11 @@ int ini_bcor(Observation *ob, int doall, int doamp, int dophs)
   } else {
     bif = eif = ob->stream.cif;
   };  
+/*
+ * Cached copies of the affected IFs will no longer have the correct
+ * corrections.
+ */
+  ifc_forget(ob, doall ? -1 : ob->stream.cif);
 /*
  * Initialize the corrections one sub-array at a time.
  */
@@ -6,6 +6,7 @@
 #include "logio.h"
 #include "obs.h"
 #include "slfcal.h"
+#include "partask.h"
 
 /*
  * Types specific to the self-cal functions.
@@ -42,8 +43,32 @@ typedef struct {
   int nstat;      /* Number of baselines */
   int nbase;      /* Number of stations */
   int nbin;       /* The number of solution bins */
+  int nbadtel;    /* The number of bad telescope corrections */
+  int nbadsol;    /* The number of un-usable solution intervals */
+  int nsolved;    /* The number of bins that were solved for */
+  long nsiter;    /* The total number of iterations of the nsolved bins */
 } Scalmem;
 
+/*
+ * Define the parameters and results of the solutions of the bins of
+ * a sub-array, as shared by the threads of slfbin_task().
+ */
+typedef struct {
+  Observation *ob;  /* The parent observation */
+  Subarray *sub;    /* The sub-array being corrected */
+  Scalmem *scal;    /* The container of the solutions of all bins */
+  Scalmem **work;   /* work[ithread] is the work container of thread */
+                    /*  ithread, where work[0] is scal */
+  int *binut;       /* The nbin+1 indexes of the first integrations of */
+                    /*  each bin, followed by sub->ntime */
+  int nbin;         /* The number of solution bins */
+  double utint;     /* The solution interval (seconds), or 0 */
+  float gfac;       /* The -ve reciprocal variance of the gaussian */
+                    /*  taper, or 0 for no taper */
+  int doamp, dophs, mintel, doflag, doone, dostef; /* See slfsub() */
+  float maxamp, maxphs, uvmin, uvmax;      /* See slfsub() */
+} Slftask;
+
 static Scalmem *new_Scal(Subarray *sub, double utint, int doone);
 static Scalmem *del_Scal(Scalmem *scal);   /* Scalmem destructor */
 static float slfdif(Scvis **nvis, Scvis *gain, int nstat);
@@ -69,8 +94,10 @@ static int count_tel(Observation *ob, Subarray *sub, int ut, int doclose,
 static float norm_cors(Subarray *sub, int cif, Cor *cors);
 static int slfsub(Observation *ob, int isub, float gauval, float gaurad,
 		  float solint, int doamp, int dophs, int dofloat, int mintel,
-		  int doflag, int doone, float maxamp, float maxphs,
-		  float uvmin, float uvmax, int *flagged);
+		  int doflag, int doone, int dostef, float maxamp,
+		  float maxphs, float uvmin, float uvmax, int *flagged);
+static void slfbin(Slftask *t, Scalmem *scal, Solns *soln, int uta, int utb);
+static PARTASK_FN(slfbin_task);
 
 static Scvis czero={0.0f,0.0f,0.0f}; /* Used to initialize Scvis elements */
 
@@ -118,6 +145,9 @@ static Scvis czero={0.0f,0.0f,0.0f}; /* Used to initialize Scvis elements */
  *   doflag       int    If true, flag un-correctable visibilities.
  *   doone        int    If true, ignore solint and find a single
  *                       overall correction for the whole time range.
+ *   dostef       int    If true, iterate for the gains with the faster
+ *                       StEFCal schedule of loop gains. Otherwise use
+ *                       a fixed loop gain.
  *   maxamp     float    If maxamp>1.0f and any amplitude correction
  *                       is > maxamp or < 1.0/maxamp, then the affected
  *                       solution interval will be left un-corrected.
@@ -134,7 +164,7 @@ static Scvis czero={0.0f,0.0f,0.0f}; /* Used to initialize Scvis elements */
  */
 int slfcal(Observation *ob, int isub, int doall, float gauval, float gaurad,
 	   float solint, int doamp, int dophs, int dofloat, int mintel,
-	   int doflag, int doone, float maxamp, float maxphs,
+	   int doflag, int doone, int dostef, float maxamp, float maxphs,
 	   float uvmin, float uvmax, int *flagged)
 {
   Moddif before,after;/* The goodness of fit before and after selfcal */
@@ -217,9 +247,14 @@ int slfcal(Observation *ob, int isub, int doall, float gauval, float gaurad,
 /*
  * Correct the sub-array.
  */
-	if(slfsub(ob, is, gauval, gaurad, solint, doamp, dophs, dofloat,
-		  mintel, doflag, doone, maxamp, maxphs, uvmin, uvmax,
-		  flagged))
+	int waserr = slfsub(ob, is, gauval, gaurad, solint, doamp, dophs,
+			    dofloat, mintel, doflag, doone, dostef, maxamp,
+			    maxphs, uvmin, uvmax, flagged);
+/*
+ * The corrections have changed the visibilities of the IF.
+ */
+	ob_cart_stale(ob, CART_DATA);
+	if(waserr)
 	  return 1;
       };
     };
@@ -286,6 +321,9 @@ int slfcal(Observation *ob, int isub, int doall, float gauval, float gaurad,
  *   doflag       int    If true, flag un-correctable visibilities.
  *   doone        int    If true, ignore solint and find a single
  *                       overall correction for the whole time range.
+ *   dostef       int    If true, iterate for the gains with the faster
+ *                       StEFCal schedule of loop gains. Otherwise use
+ *                       a fixed loop gain.
  *   maxamp     float    If maxamp>1.0f and any amplitude correction
  *                       is > maxamp or < 1.0/maxamp, then the affected
  *                       solution interval will be left un-corrected.
@@ -302,30 +340,23 @@ int slfcal(Observation *ob, int isub, int doall, float gauval, float gaurad,
  */
 static int slfsub(Observation *ob, int isub, float gauval, float gaurad,
 		  float solint, int doamp, int dophs, int dofloat, int mintel,
-		  int doflag, int doone, float maxamp, float maxphs,
-		  float uvmin, float uvmax, int *flagged)
+		  int doflag, int doone, int dostef, float maxamp,
+		  float maxphs, float uvmin, float uvmax, int *flagged)
 {
-  const int niter=100;         /* Max number of gradient-search iterations */
-  const float slfgain=0.5f;    /* Loop gain of gradient search */
-  const float epsilon=1.0e-6f; /* Acceptable relative change in residuals */
+  Slftask t;          /* The parameters of the solutions of the bins */
   Subarray *sub;      /* The descriptor of the sub-array being corrected */
-  Solns *soln;        /* Pointer to solution bin container in scal->solns[] */
-  int ut;             /* The index of the integration being processed */
-  Scvis *gain;        /* A gain correction from scal->gain[] */
-  Scvis *ctmp;        /* Element of 'scal->nvis' */
-  int ita, itb;       /* The numbers of the telescopes on a given baseline */
   Scalmem *scal;      /* Container of dynamically allocated arrays */
-  float ini_res;      /* Solution residual before any fitting */
-  float old_res;      /* Residual from previous iteration */
-  float new_res=0.0f; /* Residual after latest iteration */
+  Scalmem *work[MAX_NTHREAD]; /* The work containers of the threads */
   float gfac=0.0f;    /* The reciprocal variance of the gaussian taper */
   double utint;       /* The solution interval */
-  double utmid;       /* Mid point of solution interval */
-  int uta, utb;       /* The start and end integration indexes in a bin */
-  int n_ut;           /* The number of usable integrations in a bin */
-  int iter;           /* Current iteration number */
+  int nthread;        /* The number of threads to solve bins with */
   int nbadtel=0;      /* The number of bad telescope corrections */
   int nbadsol=0;      /* The number of un-usable solution intervals */
+  int nsolved=0;      /* The number of bins that were solved for */
+  long nsiter=0;      /* The total number of iterations of the solutions */
+  int waserr=0;       /* True after an error */
+  int uta;            /* The index of the first integration of a bin */
+  int i;
 /*
  * Get the descriptor of the specified sub-array.
  */
@@ -334,6 +365,11 @@ static int slfsub(Observation *ob, int isub, float gauval, float gaurad,
     return 1;
   };
   sub = &ob->sub[isub];
+/*
+ * sum_ratios() uses the Cartesian forms of the data and model
+ * visibilities.
+ */
+  ob_cartesian(ob, CART_DATA | CART_MODEL);
 /*
  * Convert the requested solution interval to seconds.
  * 'utint' will double as a flag, in that if no UT interval was selected
@@ -358,176 +394,327 @@ static int slfsub(Observation *ob, int isub, float gauval, float gaurad,
     gaurad /= ob->stream.uvscale;
     gfac = log(1.0f-gauval)/gaurad/gaurad;
   };
+/*
+ * Record the parameters of the solutions.
+ */
+  t.ob = ob;
+  t.sub = sub;
+  t.scal = scal;
+  t.work = work;
+  t.binut = NULL;
+  t.nbin = 0;
+  t.utint = utint;
+  t.gfac = gfac;
+  t.doamp = doamp;
+  t.dophs = dophs;
+  t.mintel = mintel;
+  t.doflag = doflag;
+  t.doone = doone;
+  t.dostef = dostef;
+  t.maxamp = maxamp;
+  t.maxphs = maxphs;
+  t.uvmin = uvmin;
+  t.uvmax = uvmax;
+/*
+ * Divide the integrations into solution bins, recording the index of
+ * the first integration of each bin.
+ */
+  t.binut = (int *) malloc(sizeof(int) * (sub->ntime + 1));
+  if(t.binut == NULL) {
+    lprintf(stderr, "Insufficient memory to self-cal\n");
+    del_Scal(scal);
+    return -1;
+  };
+  for(uta=0; uta<sub->ntime;
+      uta = (doone ? sub->ntime-1 : endbin(sub, uta, utint)) + 1)
+    t.binut[t.nbin++] = uta;
+  t.binut[t.nbin] = sub->ntime;
+/*
+ * The bins are independent of each other, so they can be solved
+ * concurrently, each thread using its own work arrays. Apart from the
+ * container of the bins of finite solution intervals, which each bin
+ * accesses a different element of, the work arrays of thread 0 are
+ * those of scal.
+ */
+  nthread = get_nthread();
+  if(nthread > t.nbin)
+    nthread = t.nbin;
+  if(nthread < 1)
+    nthread = 1;
+  work[0] = scal;
+  for(i=1; i<nthread; i++) {
+    work[i] = waserr ? NULL : new_Scal(sub, 0.0, 1);
+    if(work[i] == NULL)
+      waserr = 1;
+  };
 /*
  *---------------------------------------------------------------------
  * Solve for telescope complex gain errors over each solution interval.
  *---------------------------------------------------------------------
  */
-  soln = scal->solns;
-  for(uta=0; uta<sub->ntime; uta=utb+1,soln += utint>0.0?1:0) {
+  if(!waserr)
+    run_partask(nthread, slfbin_task, &t);
+/*
+ * Combine the statistics of the threads and discard their work arrays.
+ */
+  for(i=0; i<nthread; i++) {
+    if(work[i]) {
+      nbadtel += work[i]->nbadtel;
+      nbadsol += work[i]->nbadsol;
+      nsolved += work[i]->nsolved;
+      nsiter += work[i]->nsiter;
+      if(i > 0)
+	work[i] = del_Scal(work[i]);
+    };
+  };
+  free(t.binut);
+  if(waserr) {
+    del_Scal(scal);
+    return -1;
+  };
+/*
+ * If smoothed interpolated solutions are required, smooth and
+ * interpolate them onto the olbservation time grid, and apply the
+ * resulting corrections to the observed data.
+ */
+  if(utint>0.0 && !doone)
+    apply_solns(sub, scal, ob->stream.cif, solint, doamp, dophs);
+/*
+ * In StEFCal mode, report the mean number of iterations that the
+ * solutions took.
+ */
+  if(dostef && nsolved > 0) {
+    lprintf(stdout,
+	    " Gain solutions in sub-array %d took a mean of %.1f iterations.\n",
+	    isub+1, (double) nsiter / nsolved);
+  };
+/*
+ * Report flagging operations.
+ */
+  if(nbadtel>0) {
+    lprintf(stdout,
+        " A total of %d telescope corrections were %s in sub-array %d.\n",
+	 nbadtel, doflag ? "flagged" : "ignored", isub+1);
+  };
+/*
+ * Normalize absolute gain corrections?
+ */
+  if(doamp && !dofloat) {
+    lprintf(stdout, " Amplitude normalization factor in sub-array %d: %g\n",
+	    isub+1, norm_cors(sub, ob->stream.cif, scal->cors));
+  };
+/*
+ * Report the corrections if single overall corrections were requested.
+ */
+  if(doone)
+    rep_cors(ob, isub, scal->solns[0].cors, doamp, dophs);
 /*
- * Determine the end UT of the next solution bin.
+ * Finished - free all dynamically allocated memory and return.
  */
-    utb = doone ? sub->ntime-1 : endbin(sub, uta, utint);
+  del_Scal(scal);
+/*
+ * Any data flagged?
+ */
+  if(flagged!=NULL && doflag && nbadtel > 0)
+    *flagged = 1;
+  return 0;
+}
+
+/*.......................................................................
+ * The parallel task function of slfsub(). Each thread solves for the
+ * corrections of a contiguous share of the solution bins of the
+ * sub-array. Since each bin only reads and corrects the visibilities
+ * of its own integrations, the results don't depend on the number of
+ * threads.
+ *
+ * Input:
+ *  data      void *  The Slftask parameters of the solutions.
+ *  ithread    int    The index of the calling thread.
+ *  nthread    int    The total number of threads.
+ */
+static PARTASK_FN(slfbin_task)
+{
+  Slftask *t = (Slftask *) data;
+  Scalmem *scal = t->work[ithread];
+  long ia, ib;   /* The range of bins to be solved */
+  long ibin;     /* The index of a bin */
+  partask_range(t->nbin, ithread, nthread, &ia, &ib);
+  for(ibin=ia; ibin<ib; ibin++) {
+/*
+ * Solutions of finite intervals are retained for subsequent smoothing,
+ * whereas other solutions are applied immediately, and can be
+ * compiled in the single solution container of the work arrays.
+ */
+    Solns *soln = (t->utint > 0.0 && !t->doone) ? &t->scal->solns[ibin] :
+      &scal->solns[0];
+    slfbin(t, scal, soln, t->binut[ibin], t->binut[ibin+1]-1);
+  };
+}
+
+/*.......................................................................
+ * Solve for the telescope gain corrections of one solution bin of a
+ * sub-array, and apply them immediately unless they are to be
+ * smoothed by apply_solns().
+ *
+ * Input:
+ *  t         Slftask *  The parameters of the solutions.
+ *  scal      Scalmem *  The work arrays of the calling thread. Counts of
+ *                       bad telescopes and solutions are added to
+ *                       scal->nbadtel and scal->nbadsol.
+ *  uta           int    The index of the first integration of the bin.
+ *  utb           int    The index of the last integration of the bin.
+ * Input/Output:
+ *  soln        Solns *  The container in which to record the
+ *                       corrections of the bin.
+ */
+static void slfbin(Slftask *t, Scalmem *scal, Solns *soln, int uta, int utb)
+{
+  const int niter=100;         /* Max number of gradient-search iterations */
+  const float slfgain=0.5f;    /* Loop gain of gradient search */
+  const float epsilon=1.0e-6f; /* Acceptable relative change in residuals */
+  Subarray *sub = t->sub; /* The descriptor of the sub-array */
+  int ut;             /* The index of the integration being processed */
+  Scvis *gain;        /* A gain correction from scal->gain[] */
+  Scvis *ctmp;        /* Element of 'scal->nvis' */
+  int ita, itb;       /* The numbers of the telescopes on a given baseline */
+  float ini_res;      /* Solution residual before any fitting */
+  float old_res;      /* Residual from previous iteration */
+  float new_res=0.0f; /* Residual after latest iteration */
+  double utmid;       /* Mid point of solution interval */
+  int n_ut;           /* The number of usable integrations in a bin */
+  int iter;           /* Current iteration number */
 /*
  * Record the start and end times of the solution bin.
  * Take care when finding midut to precision losses.
  */
-    utmid = sub->integ[uta].ut + (sub->integ[utb].ut - sub->integ[uta].ut)/2.0;
-    soln->begut = utmid-(utint/2.0);
-    soln->endut = utmid+(utint/2.0);
+  utmid = sub->integ[uta].ut + (sub->integ[utb].ut - sub->integ[uta].ut)/2.0;
+  soln->begut = utmid-(t->utint/2.0);
+  soln->endut = utmid+(t->utint/2.0);
 /*
  * Initialize the 'nvis' model-normalized visibility array to zero for the
  * new bin.
  * NB. The nvis 2-D array is formed from the 1D array scal->memblk, which
  * has sub->nstat * sub->nstat elements.
  */
-    ctmp = scal->memblk;
-    for(ita=0;ita<sub->nstat; ita++)
-      for(itb=0;itb<sub->nstat; itb++)
-	*ctmp++ = czero;
+  ctmp = scal->memblk;
+  for(ita=0;ita<sub->nstat; ita++)
+    for(itb=0;itb<sub->nstat; itb++)
+      *ctmp++ = czero;
 /*
  * Process UTs in the new bin.
  */
-    n_ut = 0;
-    for(ut=uta; ut <= utb; ut++) {
+  n_ut = 0;
+  for(ut=uta; ut <= utb; ut++) {
 /*
  * Determine which visibilities in the current integration are usable
  * for self-calibration, and whether there is sufficient data for
  * a solution. Also flag un-correctable data if doflag is true.
  */
-      if(get_usable(ob, sub, ut, uvmin, uvmax, mintel, doflag, scal->usable,
-		    scal->iwrk, &nbadtel)==0) {
+    if(get_usable(t->ob, sub, ut, t->uvmin, t->uvmax, t->mintel, t->doflag,
+		  scal->usable, scal->iwrk, &scal->nbadtel)==0) {
 /*
  * Count usable integrations.
  */
-	n_ut++;
+      n_ut++;
 /*
  * Accumulate the weighted sums of the ratio of observed and model
  * visibilities per baseline, over integrations in the current solution bin.
  */
-	sum_ratios(sub, ut, gfac, scal);
-      };
+      sum_ratios(sub, ut, t->gfac, scal);
     };
+  };
 /*
  * If non of the integrations within the latest bin were usable,
  * skip to the next bin.
  */
-    if(!n_ut)
-      continue;
+  if(!n_ut)
+    return;
 /*
  * Convert weighted observed/model visibility sums into weighted means
  * by dividing by the sums of weights.
  */
-    for(ita=0; ita<sub->nstat; ita++) {
-      ctmp = &scal->nvis[ita][0];
-      for(itb=0; itb<sub->nstat; itb++, ctmp++) {
-	float wt = ctmp->wt;
-	if(wt > 0.0f) {
-	  ctmp->re /= wt;
-	  ctmp->im /= wt;
-	};
+  for(ita=0; ita<sub->nstat; ita++) {
+    ctmp = &scal->nvis[ita][0];
+    for(itb=0; itb<sub->nstat; itb++, ctmp++) {
+      float wt = ctmp->wt;
+      if(wt > 0.0f) {
+	ctmp->re /= wt;
+	ctmp->im /= wt;
       };
     };
+  };
 /*
  * Temporarily set gain corrections to 1+0i with 0 weight and determine
  * the starting residual.
  */
-    gain = &scal->gain[0];
-    for(ita=0; ita<sub->nstat; ita++, gain++) {
-      gain->re = 1.0f;
-      gain->im = 0.0f;
-      gain->wt = 0.0f;
-    };
-    ini_res = slfdif(scal->nvis,scal->gain,sub->nstat);
+  gain = &scal->gain[0];
+  for(ita=0; ita<sub->nstat; ita++, gain++) {
+    gain->re = 1.0f;
+    gain->im = 0.0f;
+    gain->wt = 0.0f;
+  };
+  ini_res = slfdif(scal->nvis,scal->gain,sub->nstat);
 /*
  * Initial estimate of telescope gain corrections comes from the weighted
  * mean normalized visibility over the respective telescope.
  */
-    getgain(sub, scal->nvis, scal->gain, scal->gnew, doamp, dophs, 1.0f);
+  getgain(sub, scal->nvis, scal->gain, scal->gnew, t->doamp, t->dophs, 1.0f);
 /*
  * Compute residual for this estimate.
  */
-    old_res = slfdif(scal->nvis,scal->gain,sub->nstat);
+  old_res = slfdif(scal->nvis,scal->gain,sub->nstat);
 /*
  * Iterate for better gain solutions.
  */
-    for(iter=0; iter<niter; iter++) {
+  for(iter=0; iter<niter; iter++) {
 /*
- * Get better gain estimate gain[ita] for each telescope ita.
+ * Get better gain estimate gain[ita] for each telescope ita. StEFCal
+ * alternates between replacing the previous estimates with the new
+ * ones, and replacing them with the mean of the previous and new
+ * estimates. The initial estimate above counts as a replacement.
  */
-      getgain(sub, scal->nvis, scal->gain, scal->gnew, doamp, dophs, slfgain);
+    getgain(sub, scal->nvis, scal->gain, scal->gnew, t->doamp, t->dophs,
+	    t->dostef ? (iter % 2 ? 1.0f : 0.5f) : slfgain);
 /*
  * Determine the resulting residuals to the new fit.
  */
-      new_res = slfdif(scal->nvis,scal->gain,sub->nstat);
+    new_res = slfdif(scal->nvis,scal->gain,sub->nstat);
 /*
  * Compare change in residuals from this iteration with the
  * initial residual.
  */
-      if(fabs(new_res-old_res) <= epsilon*ini_res)
-	break;
-      old_res = new_res;
-    };
+    if(fabs(new_res-old_res) <= epsilon*ini_res)
+      break;
+    old_res = new_res;
+  };
+/*
+ * Keep a record of the number of iterations used.
+ */
+  scal->nsolved++;
+  scal->nsiter += iter < niter ? iter+1 : niter;
 /*
  * Convert the complex reciprocal gains of scal->gain[] to amplitude and
  * phase corrections. Store these in soln->cors and check them against
  * any user-specified limits. Substitute zero-weight unit corrections,
  * if the solution turns out to be un-usable.
  */
-    if(get_cors(sub, ini_res<new_res, dophs,maxphs, doamp,maxamp,
-		scal->gain, soln->cors)) {
-      nbadsol++;  /* Count the number of un-usable solution intervals */
-    }
+  if(get_cors(sub, ini_res<new_res, t->dophs, t->maxphs, t->doamp, t->maxamp,
+	      scal->gain, soln->cors)) {
+    scal->nbadsol++;  /* Count the number of un-usable solution intervals */
+  }
 /*
  * The solutions were OK. Apply them now if no interpolation or
  * smoothing is required.
  */
-    else {
+  else {
 /*
  * Apply corrections now if no finite solution interval was requested.
  */
-      if(doone || utint<=0.0)
-	apply_cors(sub, ob->stream.cif, uta, utb, doamp, dophs, soln->cors);
-    };
-  };          /* end of loop over UT bins. */
-/*
- * If smoothed interpolated solutions are required, smooth and
- * interpolate them onto the olbservation time grid, and apply the
- * resulting corrections to the observed data.
- */
-  if(utint>0.0 && !doone)
-    apply_solns(sub, scal, ob->stream.cif, solint, doamp, dophs);
-/*
- * Report flagging operations.
- */
-  if(nbadtel>0) {
-    lprintf(stdout,
-        " A total of %d telescope corrections were %s in sub-array %d.\n",
-	 nbadtel, doflag ? "flagged" : "ignored", isub+1);
+    if(t->doone || t->utint<=0.0)
+      apply_cors(sub, t->ob->stream.cif, uta, utb, t->doamp, t->dophs,
+		 soln->cors);
   };
-/*
- * Normalize absolute gain corrections?
- */
-  if(doamp && !dofloat) {
-    lprintf(stdout, " Amplitude normalization factor in sub-array %d: %g\n",
-	    isub+1, norm_cors(sub, ob->stream.cif, scal->cors));
-  };
-/*
- * Report the corrections if single overall corrections were requested.
- */
-  if(doone)
-    rep_cors(ob, isub, soln->cors, doamp, dophs);
-/*
- * Finished - free all dynamically allocated memory and return.
- */
-  del_Scal(scal);
-/*
- * Any data flagged?
- */
-  if(flagged!=NULL && doflag && nbadtel > 0)
-    *flagged = 1;
-  return 0;
+  return;
 }
 
 /*.......................................................................
@@ -607,16 +794,16 @@ static float slfdif(Scvis **nvis, Scvis *gain, int nstat)
 static void getgain(Subarray *sub, Scvis **nvis, Scvis *gain, Scvis *gnew,
 		    int doamp, int dophs, float slfgain)
 {
-  static Station *tel;  /* The descriptor of a telescope */
-  static Scvis *ga, *gb;/* Telescope gains for telescope pair a,b */
-  static Scvis *gn;     /* Pointer into gnew[] */
-  static Scvis *ctmp;
-  static Scvis top;     /* Complex temporary (numerator of quotient) */
-  static float bot;     /* Temporary real (denominator of quotient) */
-  static float amp;     /* An amplitude */
-  static float wt;      /* A weight */
-  static float wt_sum;  /* Sum of weights */
-  static int ita,itb;   /* Indexes of baseline telescope pair a,b */
+  Station *tel;  /* The descriptor of a telescope */
+  Scvis *ga, *gb;/* Telescope gains for telescope pair a,b */
+  Scvis *gn;     /* Pointer into gnew[] */
+  Scvis *ctmp;
+  Scvis top;     /* Complex temporary (numerator of quotient) */
+  float bot;     /* Temporary real (denominator of quotient) */
+  float amp;     /* An amplitude */
+  float wt;      /* A weight */
+  float wt_sum;  /* Sum of weights */
+  int ita,itb;   /* Indexes of baseline telescope pair a,b */
 /*
  * Get better gain estimate gnew[ita] for each telescope ita.
  */
@@ -751,6 +938,10 @@ static Scalmem *new_Scal(Subarray *sub, double utint, int doone)
  */
   scal->nbase = sub->nbase;
   scal->nstat = sub->nstat;
+  scal->nbadtel = 0;
+  scal->nbadsol = 0;
+  scal->nsolved = 0;
+  scal->nsiter = 0;
 /*
  * Now allocate the various arrays.
  * First those that depend on the number of baselines.
@@ -1315,8 +1506,8 @@ static void sum_ratios(Subarray *sub, int ut, float gaufac, Scalmem *scal)
   Station *tel;     /* The array of station descriptors in the sub-array */
   int *usable;      /* Pointer into scal->usable[] */
   Scvis *ctmp;      /* Pointer to nvis[ita][itb] */
-  float amp;        /* The weighted obs/model amp ratio of a visibility */
-  float phs;        /* The obs-model phase difference of a visibility */
+  float fac;        /* The weight of a visibility ratio divided by */
+                    /*  the squared model amplitude */
   float wt;         /* The weight of a visibility ratio */
   float re;         /* Real part of complex temporary */
   float im;         /* Imaginary part of complex temporary */
@@ -1358,30 +1549,29 @@ static void sum_ratios(Subarray *sub, int ut, float gaufac, Scalmem *scal)
  * The definition of vis->wt is 1/Variance(Vobs), and |Vmod| is the
  * amplitude of the model, leading to the following equation for the weight.
  */
-      wt = vis->wt * vis->modamp * vis->modamp;
+      fac = vis->wt;
 /*
  * Gaussian taper to apply to the weights?
  */
       if(gaufac < 0.0f) {
 	float uu = vis->u;
 	float vv = vis->v;
-	wt *= 1.0-exp(gaufac*(uu*uu+vv*vv));
+	fac *= 1.0-exp(gaufac*(uu*uu+vv*vv));
       };
 /*
  * Apply extra telescope weights.
  */
-      wt *= fabs(tel[ita].antwt * tel[itb].antwt);
+      fac *= fabs(tel[ita].antwt * tel[itb].antwt);
+      wt = fac * vis->modamp * vis->modamp;
 /*
- * Divide polar representation of visibility by model and multiply by
- * weight.
+ * Divide the visibility by the model and multiply by the weight. Since
+ * the weight includes a factor of |Vmod|^2, this is the same as
+ * multiplying the visibility by the conjugate of the model and by fac.
+ * The Cartesian copies of the visibilities were brought up to date by
+ * slfsub().
  */
-      amp = wt * vis->amp / vis->modamp;
-      phs = vis->phs - vis->modphs;
-/*
- * Get the complex representation of amp and phase.
- */
-      re = amp * cos(phs);
-      im = amp * sin(phs);
+      re = fac * (vis->re * vis->modre + vis->im * vis->modim);
+      im = fac * (vis->im * vis->modre - vis->re * vis->modim);
 /*
  * Sum into baseline visibility matrix.
  */
@@ -1583,7 +1773,14 @@ static int get_usable(Observation *ob, Subarray *sub, int ut,
     if(telnum[itel]==0 && !sub->tel[itel].antfix) {
       if(doflag && !tcor[itel].bad) {
 	(*nbadtel)++;
+/*
+ * ed_Telcor() also marks details of the whole IF as out of date, so
+ * it mustn't be called by more than one thread of slfbin_task() at a
+ * time.
+ */
+	partask_lock();
 	ed_Telcor(ob, sub, ob->stream.cif, ut, itel, 1);
+	partask_unlock();
       };
     };
   };
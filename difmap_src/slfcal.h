@@ -2,5 +2,5 @@
 
 int slfcal(Observation *ob, int isub, int doall, float gauval, float gaurad,
 	   float solint, int doamp, int dophs, int dofloat, int mintel,
-	   int doflag, int doone, float maxamp, float maxphs,
+	   int doflag, int doone, int dostef, float maxamp, float maxphs,
 	   float uvmin, float uvmax, int *flagged);
@@ -10,7 +10,7 @@
 #include "spectra.h"
 #include "obedit.h"
 
-static int dp_sumspec(Observation *ob, Spectrum *spec);
+static int dp_sumspec(Observation *ob, Spectrum *spec, Cvis *work);
 static int bad_Spectrum(Spectrum *spec, char *fname);
 static int bad_Spectra(Spectra *spectra, char *fname);
 
@@ -603,7 +603,9 @@ int get_Spectra(Spectra *spectra)
 {
   Observation *ob;  /* The observation descriptor of the spectra */
   Spectrum *spec;   /* The spectrum being processed */
+  Cvis *work;       /* The polarized channels of one baseline */
   int irec;         /* The index of the integration record being processed */
+  int waserr = 0;   /* True after an error */
 /*
  * NULL container?
  */
@@ -636,6 +638,15 @@ int get_Spectra(Spectra *spectra)
      dp_brange(ob->dp, 0, ob->nbmax-1) ||
      dp_srange(ob->dp, 0, ob->npol-1))
     return 1;
+/*
+ * Allocate a work array in which to extract the visibilities of the
+ * channels of one baseline.
+ */
+  work = (Cvis *) malloc(sizeof(Cvis) * ob->nchan);
+  if(!work) {
+    lprintf(stderr, "get_Spectra: Insufficient memory.\n");
+    return 1;
+  };
 /*
  * Read sampled integration records and construct their spectra.
  */
@@ -667,32 +678,23 @@ int get_Spectra(Spectra *spectra)
  * Process the located spectrum over the new index range, along with
  * any other spectra that happen to be sampled over the same interval.
  */
-    for( ; irec<=utb; irec++) {
+    for( ; !waserr && irec<=utb; irec++) {
 /*
  * Read the next integration of raw visibilities from the uvdata.scr
- * paging file.
- */
-      if(dp_read(ob->dp, irec))
-	return 1;
-/*
- * Calibrate the raw data.
- */
-      if(dp_cal(ob))
-	return 1;
-/*
- * Apply the current stream position shift, if any.
+ * paging file, calibrate it, and apply the current stream position
+ * shift, if any.
  */
-      if(dp_shift(ob))
-	return 1;
+      waserr = dp_read(ob->dp, irec) || dp_cal(ob) || dp_shift(ob);
 /*
  * Add to the weighted sum spectra from this integration.
  */
-      for(spec=spectra->head; spec; spec=spec->next) {
-	if(dp_sumspec(ob, spec))
-	  return 1;
-      };
+      for(spec=spectra->head; !waserr && spec; spec=spec->next)
+	waserr = dp_sumspec(ob, spec, work);
     };
-  } while(irec < ob->nrec);
+  } while(!waserr && irec < ob->nrec);
+  free(work);
+  if(waserr)
+    return 1;
 /*
  * Process all listed spectra together, one integration at a time.
  */
@@ -732,11 +734,12 @@ int get_Spectra(Spectra *spectra)
  * Input:
  *  ob   Observation *   The observation descriptor.
  *  spec    Spectrum *   The spectrum container to add to.
+ *  work        Cvis *   A work array of ob->nchan visibilities.
  * Output:
  *  return       int     0 - OK.
  *                       1 - Error.
  */
-static int dp_sumspec(Observation *ob, Spectrum *spec)
+static int dp_sumspec(Observation *ob, Spectrum *spec, Cvis *work)
 {
   Integration *integ;/* The descriptor of the integration in the I/O buffer */
   Specsub *ssub;     /* Baseline set for the current sub-array */
@@ -807,8 +810,8 @@ static int dp_sumspec(Observation *ob, Spectrum *spec)
       cif++, dif++, ifs++, ifp++) {
     float f;           /* Frequency of channel 0 */
     float df;          /* Frequency increment per channel */
-    Cvis *svis;        /* Spectrum visibility */
-    Dchan *dchan;      /* Channel pointer in the I/O buffer */
+    int nchan;         /* The number of channels in the I/O buffer */
+    int *bptr;         /* Pointer into ssub->baselines[] */
 /*
  * Check that the IF holds the expected number of channels.
  */
@@ -822,55 +825,49 @@ static int dp_sumspec(Observation *ob, Spectrum *spec)
  */
     f = ifp->freq;
     df = ifp->df;
-/*
- * Form sums for each spectral line channel in the IF.
- */
-    for(fc=dp->ca, dchan=dif->chan+fc, svis=ifs->chan+fc;
-	fc<=dp->cb; fc++, dchan++, svis++) {
-      Dbase *dbase = dchan->base;
+    nchan = dp->cb - dp->ca + 1;
 /*
  * Iterate over all requested baselines.
  */
-      int *bptr = ssub->baselines;
-      for( ; bptr < ssub->baselines+ssub->nbase; bptr++) {
-	int base = *bptr;
+    for(bptr=ssub->baselines; bptr < ssub->baselines+ssub->nbase; bptr++) {
+      int base = *bptr;
 /*
  * Only process baselines that are within the range last read into the
  * I/O buffer.
  */
-	if(base >= dp->ba && base <= bmax) {
+      if(base >= dp->ba && base <= bmax) {
+	Visibility *vis = integ->vis + base;
+	float uvlen = sqrt(vis->u * vis->u + vis->v * vis->v);
+	Cvis *svis = ifs->chan + dp->ca;  /* Spectrum visibility */
+	Cvis *cvis = work;                 /* Baseline visibility */
 /*
- * Check whether the UV radius of the baseline is in the required range.
+ * Extract the visibilities of the requested polarization from all of
+ * the channels of the baseline at once.
  */
-	  Visibility *vis = integ->vis + base;
-	  float freq = f + fc * df;
-	  float u = vis->u * freq;
-	  float v = vis->v * freq;
-	  float uvrad = sqrt(u*u+v*v);
+	pol_get_run(&spec->obpol, dif->chan[dp->ca].base[base].pol, dp->coff,
+		    nchan, work);
 /*
- * Is the visibility within the specified range of UV radii?
+ * Add them to the spectrum.
  */
-	  if(spec->uvmax <= 0.0f ||
-	     (uvrad >= spec->uvmin && uvrad <= spec->uvmax)) {
+	for(fc=dp->ca; fc<=dp->cb; fc++, svis++, cvis++) {
 /*
- * Get the appropriate polarization.
+ * Is the visibility within the specified range of UV radii?
  */
-	    Cvis cvis;
-	    spec->obpol.getpol(&spec->obpol, dbase[*bptr].pol, &cvis);
+	  float uvrad = uvlen * fabs(f + fc * df);
+	  if(cvis->wt > 0.0f && (spec->uvmax <= 0.0f ||
+	     (uvrad >= spec->uvmin && uvrad <= spec->uvmax))) {
 /*
  * Accumulate the visibility spectrum as a weighted sum of good visibilities.
  */
-	    if(cvis.wt > 0.0f) {
-	      if(spec->dovector) {               /* Vector average */
-		svis->re += cvis.wt * cvis.re;
-		svis->im += cvis.wt * cvis.im;
-	      } else {                           /* Scalar average */
-		svis->re += cvis.wt * sqrt(cvis.re*cvis.re + cvis.im*cvis.im);
-		svis->im += cvis.wt * ((cvis.re!=0.0f || cvis.im!=0.0f) ?
-		  atan2(cvis.im, cvis.re) : 0.0f);
-	      };
-	      svis->wt += cvis.wt;
+	    if(spec->dovector) {               /* Vector average */
+	      svis->re += cvis->wt * cvis->re;
+	      svis->im += cvis->wt * cvis->im;
+	    } else {                           /* Scalar average */
+	      svis->re += cvis->wt * sqrt(cvis->re*cvis->re + cvis->im*cvis->im);
+	      svis->im += cvis->wt * ((cvis->re!=0.0f || cvis->im!=0.0f) ?
+		atan2(cvis->im, cvis->re) : 0.0f);
 	    };
+	    svis->wt += cvis->wt;
 	  };
 	};
       };
@@ -1001,6 +1001,8 @@ static Visibility *new_Visibilities(Intmem *im, int nbase, int ntime)
       vis->u = vis->v = vis->w = 0.0f;
       vis->dt = 0.0f;
       vis->bad = FLAG_DEL;
+      vis->re = vis->im = 0.0f;
+      vis->modre = vis->modim = 0.0f;
     };
   };
 /*
@@ -3,6 +3,7 @@
 #include <math.h>
 
 #include "obs.h"
+#include "ifcache.h"
 #include "logio.h"
 
 /*.......................................................................
@@ -43,6 +44,11 @@ void uncalib(Observation *ob, int doamp, int dophs, int doflag, int doreset)
  */
     if(doamp || doflag)
       flag_baseline_weights(ob, -1);
+/*
+ * The corrections of all IFs are being changed, so cached copies of
+ * IFs are no longer valid.
+ */
+    ifc_forget(ob, -1);
 /*
  * If an IF is in memory, remove the corrections.
  */
@@ -54,6 +60,7 @@ void uncalib(Observation *ob, int doamp, int dophs, int doflag, int doreset)
 /*
  * Uncalibrate each sub-array of the current IF.
  */
+      ob_cart_stale(ob, CART_DATA);
       sub = ob->sub;
       for(isub=0; isub<ob->nsub; isub++,sub++) {
 	Integration *integ = sub->integ;
@@ -173,6 +180,7 @@ int app_Telcor(Observation *ob, int cif)
 /*
  * Re-calibrate each sub-array of the given IF.
  */
+  ob_cart_stale(ob, CART_DATA);
   sub = ob->sub;
   for(isub=0; isub<ob->nsub; isub++,sub++) {
     Integration *integ = sub->integ;
@@ -252,10 +260,15 @@ int ed_Telcor(Observation *ob, Subarray *sub, int cif, int ut, int itel, int dof
  * Mark the per-baseline sums of weights as stale.
  */
   flag_baseline_weights(ob, cif);
+/*
+ * Any cached copy of the IF no longer has the correct flags.
+ */
+  ifc_forget(ob, cif);
 /*
  * Flag or unflag all visibilities that lie on baselines of telescope 'itel'.
  */
   if(ob_ready(ob, OB_GETIF, NULL) && cif==ob->stream.cif) {
+    ob_cart_stale(ob, CART_VIEW);
     vis = integ->vis;
     bptr = sub->base;
     if(doflag) {
@@ -325,11 +338,16 @@ int adj_Telcor(Observation *ob, Subarray *sub, int cif, int ut, int itel,
  * Mark the corresponding per-baseline sums of weights as stale.
  */
   flag_baseline_weights(ob, cif);
+/*
+ * Any cached copy of the IF no longer has the correct corrections.
+ */
+  ifc_forget(ob, cif);
 /*
  * Adjust the corrections applied to all visibilities that lie on
  * baselines of telescope 'itel'.
  */
   if(ob_ready(ob, OB_GETIF, NULL) && cif==ob->stream.cif) {
+    ob_cart_stale(ob, CART_DATA);
     vis = integ->vis;
     bptr = sub->base;
     for(base=0; base<sub->nbase; base++,vis++,bptr++) {
@@ -398,11 +416,16 @@ int clr_Telcor(Observation *ob, Subarray *sub, int cif, int ut, int itel)
  * Mark the corresponding per-baseline sums of weights as stale.
  */
   flag_baseline_weights(ob, cif);
+/*
+ * Any cached copy of the IF no longer has the correct corrections.
+ */
+  ifc_forget(ob, cif);
 /*
  * Remove the corrections from all visibilities that lie on baselines of
  * telescope 'itel'.
  */
   if(ob_ready(ob, OB_GETIF, NULL) && cif==ob->stream.cif) {
+    ob_cart_stale(ob, CART_DATA);
     vis = integ->vis;
     bptr = sub->base;
     for(base=0; base<sub->nbase; base++,vis++,bptr++) {
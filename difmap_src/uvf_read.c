@@ -53,6 +53,72 @@ static struct {
   int dpos,dinc; /* Index and increment of DEC axis */
 } ax = {0};
 
+/*
+ * The layout of the rows of the UV_DATA table of a FITS-IDI file is
+ * described by a synthetic random-groups header descriptor (see
+ * idi_header()), in which each row is a group. The following are the
+ * max number of axes of the visibility matrix of each row, and the
+ * max number of table columns that are presented as random parameters.
+ */
+enum {IDI_MAXAXIS=7, IDI_MAXPAR=8};
+
+/*
+ * Declare and define a container for FITS-IDI UV_DATA column indexes.
+ * All are 1-relative, and optional columns that are missing are
+ * marked by 0.
+ */
+static struct {
+  int npar;              /* The number of pseudo random parameters */
+  int pcol[IDI_MAXPAR];  /* The columns of each of the npar parameters */
+  int base;              /* The index of the BASELINE parameter in pcol[] */
+  int array;             /* The optional ARRAY (sub-array number) column */
+  int flux;              /* The FLUX column of visibility matrices */
+  int weight;            /* The optional WEIGHT column */
+  int ncomplex;          /* The number of elements per visibility in */
+                         /*  the FLUX column (2=re,im 3=re,im,wt) */
+  int nflux;             /* The number of elements in a FLUX entry */
+  int nweight;           /* The number of elements in a WEIGHT entry */
+} idi = {0};
+
+/*
+ * Declare a type that lists the names of the tables, and table
+ * columns, that differ between random-groups UV FITS files and
+ * FITS-IDI files.
+ */
+typedef struct {
+  char *an;        /* The antenna table */
+  char *su;        /* The source table */
+  char *fq;        /* The frequency table */
+  char *fqcol[4];  /* The frequency-table columns of the IF frequency */
+                   /*  offsets, channel widths, IF bandwidths and */
+                   /*  sidebands */
+} Uvfnames;
+
+static Uvfnames uvf_names = {"AIPS AN", "AIPS SU", "AIPS FQ",
+  {"IF FREQ", "CH WIDTH", "TOTAL BANDWIDTH", "SIDEBAND"}};
+static Uvfnames idi_names = {"ARRAY_GEOMETRY", "SOURCE", "FREQUENCY",
+  {"BANDFREQ", "CH_WIDTH", "TOTAL_BANDWIDTH", "SIDEBAND"}};
+
+/*
+ * When ingest spooling is enabled, bin_uvdata() records each useable
+ * group in a scratch file, as SP_NHEAD decoded random-parameter values
+ * followed by the fob->ndata elements of its data array, all as floats.
+ * The following enumerators index the random-parameter values.
+ */
+enum {SP_UU, SP_VV, SP_WW, SP_INTTIM, SP_ISUB, SP_TA, SP_TB, SP_NHEAD};
+
+/*
+ * bin_uvdata() reads the groups of the file in chunks of consecutive
+ * groups, using buffers of up to UVF_CHUNK elements.
+ */
+enum {UVF_CHUNK=131072};
+
+/*
+ * If true, uvf_read() reads the FITS file once, spooling the groups
+ * for get_uvdata(), instead of reading it twice.
+ */
+static int uvf_spool = 0;
+
 /*
  * Declare a type used to mark used stations or baselines
  * and for map from their indexes in the original AN table to their
@@ -85,14 +151,25 @@ typedef struct {
 } Antab;
 
 /* Define the structure used to store details about a random-groups
- * UV fits file.
+ * UV fits file, or a FITS-IDI file.
  */
 typedef struct Fitob {
   Fits *fits;         /* The descriptor of the UV FITS file */
+  Phdu *phdu;         /* The descriptor of the random groups. This is */
+                      /*  the primary HDU of a random-groups file, or */
+                      /*  a synthetic descriptor of the UV_DATA table */
+                      /*  rows of a FITS-IDI file */
+  Thdu *uvtab;        /* The UV_DATA table of a FITS-IDI file, or NULL */
+  Uvfnames *names;    /* The names of the tables of the file */
+  long ngroup;        /* The number of groups, or UV_DATA table rows */
   int npar;           /* Number of random-parameters per group */
   double *pars;       /* Buffer array of 'npar' elements */
   int ndata;          /* Number of elements per group array */
-  double *data;       /* Buffer array of 'ndata' elements */
+  float *data;        /* Buffer array of 'ndata' elements */
+  long nchunk;        /* The number of groups per chunk read by bin_uvdata() */
+  double *gpars;      /* Buffer of the 'npar' parameters of nchunk groups */
+  float *gdata;       /* Buffer of the 'ndata' elements of nchunk groups, */
+                      /*  or NULL if not spooling */
   int maxan;          /* Max AN table version number */
   Antab *antab;       /* [0..maxan] Map AN version to internal descriptors. */
   int nbmax;          /* Max number of baselines per sub-array */
@@ -104,7 +181,14 @@ typedef struct Fitob {
   int scatter;        /* If true substitute scatter estimates of weights */
   double binwid;      /* Integration bin width (seconds). */
   double wtsign;      /* The sign of the AIPS WTSCAL factor */
+  float *flux;        /* Buffer of the idi.nflux elements of a FITS-IDI */
+                      /*  FLUX entry, or NULL if read directly */
+  float *wbuf;        /* Buffer of the idi.nweight elements of a */
+                      /*  FITS-IDI WEIGHT entry, or NULL */
   Intlist *ilist;     /* Integration bin list/iterator */
+  Recio *spool;       /* The optional spool of useable groups, or NULL */
+  float *spbuf;       /* Buffer of one spool record */
+  long nspool;        /* The number of records in the spool */
   Obdate date;        /* Observation reference date info recorded by get_date */
   Proj proj;          /* The UU,VV,WW projection code */
   long start_group;   /* The index of the first group with a useable date */
@@ -121,8 +205,8 @@ static int loc_axis(char *name, Phdu *phdu, int need, int *ax, int *inc);
 static int grp_parms(Fitob *fob);
 static int uvw_parms(Fitob *fob);
 static int get_axes(Fitob *fob);
-static double *get_data(Fitob *fob, long group);
-static int get_source(Observation *ob, Fits *fits, Obdate *date);
+static float *get_data(Fitob *fob, long group);
+static int get_source(Observation *ob, Fitob *fob);
 static int find_subarrays(Fitob *fob, int keepant);
 static int count_IFs(Fitob *fob);
 static int count_stokes(Fitob *fob);
@@ -131,22 +215,29 @@ static int count_FQ_entries(Fitob *fob);
 static int get_date(Fitob *fob);
 static int get_subarray_time_systems(Fitob *fob, double iatutc);
 static int get_antrow(Fits *fits, Thdu *thdu, Antab *an);
-static int get_stations(Observation *ob, Fits *fits, Antab *an);
+static int get_stations(Observation *ob, Fitob *fob, Antab *an);
 static int getanbin(Observation *ob, Fits *fits, Antab *an);
 static int getanasc(Observation *ob, Fits *fits, Antab *an);
 static int rd_p_refant(Fits *fits, Hdu *hdu, Subarray *sub);
 static Intlist *bin_uvdata(Fitob *fob, double binwid);
 
-static int get_misc(Observation *ob, Fits *fits);
+static int get_misc(Observation *ob, Fitob *fob);
 static int get_vel(Observation *ob, Fits *fits);
-static int get_IF_freq(Observation *ob, Fits *fits);
-static int get_stokes(Observation *ob, Fits *fits);
+static int get_IF_freq(Observation *ob, Fitob *fob);
+static int get_stokes(Observation *ob, Fitob *fob);
 static int get_history(Observation *ob, Fits *fits, Fitob *fob);
 static int check_history(Observation *ob, char *hline, Fitob *fob);
 static int get_baselines(Observation *ob, Fitob *fob, Antab *an);
 static int get_subarrays(Observation *ob, Fitob *fob);
 static int get_uvdata(Observation *ob, Fitob *fob);
 static Parval *read_pars(Fitob *fob, long group);
+static Parval *decode_pars(double *pars);
+static int idi_header(Fitob *fob);
+static int idi_pars(Fitob *fob, long row, double *pars);
+static int idi_data(Fitob *fob, long row, float *data);
+static int idi_groups(Fitob *fob, long first, long ngroup);
+static int put_spool(Fitob *fob, Parval *pval, float *data);
+static Parval *get_spool(Fitob *fob, long irec);
 static Anmap *loc_base(Fitob *fob, Parval *pval);
 
 static Observation *foberr(Fitob *fob, Observation *ob);
@@ -157,7 +248,8 @@ static int string_is_empty(char *string);
  * Read a new observation from a FITS file.
  *
  * Input:
- *  name          char *  The name of a random-group UV FITS file.
+ *  name          char *  The name of a random-group UV FITS file, or
+ *                        of a FITS-IDI file.
  *  binwid      double    The integration bin width to collect visibilities
  *                        into (seconds). If binwid < 1.0 no binning will
  *                        be performed.
@@ -201,7 +293,7 @@ Observation *uvf_read(const char *name, double binwid, int scatter, int keepant)
 /*
  * Record the miscellaneous descriptive header keyword values.
  */
-  if(get_misc(ob, fob->fits))
+  if(get_misc(ob, fob))
     return foberr(fob, ob);
 /*
  * Record AIPS altdef velocity info if given.
@@ -223,7 +315,7 @@ Observation *uvf_read(const char *name, double binwid, int scatter, int keepant)
 /*
  * Determine and record source characteristics in ob->source.
  */
-  if(get_source(ob, fob->fits, &fob->date))
+  if(get_source(ob, fob))
     return foberr(fob, ob);
 /*
  * Intialize sub-array descriptors from AN tables.
@@ -233,12 +325,12 @@ Observation *uvf_read(const char *name, double binwid, int scatter, int keepant)
 /*
  * Get IF frequency info.
  */
-  if(get_IF_freq(ob, fob->fits))
+  if(get_IF_freq(ob, fob))
     return foberr(fob, ob);
 /*
  * Get polarization info.
  */
-  if(get_stokes(ob, fob->fits))
+  if(get_stokes(ob, fob))
     return foberr(fob, ob);
 /*
  * Store FITS history.
@@ -273,10 +365,13 @@ static Observation *foberr(Fitob *fob, Observation *ob)
 /*.......................................................................
  * Open and interpret the header and tables of a random-group UV FITS file.
  * Record the results in a Fitob descriptor to be subsequently used by
- * read_fits().
+ * read_fits(). FITS-IDI files, whose visibilities are recorded in the
+ * rows of a UV_DATA table, are read through a synthetic random-groups
+ * description of the table (see idi_header()).
  *
  * Input:
- *  name          char *  The name of a random-group UV FITS file.
+ *  name          char *  The name of a random-group UV FITS file, or
+ *                        of a FITS-IDI file.
  *  binwid      double    The integration bin width to collect visibilities
  *                        into (seconds). If binwid < 1.0 no binning will
  *                        be performed.
@@ -322,15 +417,27 @@ static Fitob *new_Fitob(const char *name, double binwid, int scatter,
   fob->nchan = 0;
   fob->maxan = 0;
   fob->data = NULL;
+  fob->nchunk = 0;
+  fob->gpars = NULL;
+  fob->gdata = NULL;
   fob->antab = NULL;
   fob->pars = NULL;
   fob->fits = NULL;
+  fob->phdu = NULL;
+  fob->uvtab = NULL;
+  fob->names = &uvf_names;
+  fob->ngroup = 0L;
+  fob->flux = NULL;
+  fob->wbuf = NULL;
   fob->scatter = scatter;
   fob->binwid = binwid < 1.0 ? 0.0 : binwid;
   fob->wtsign = 1.0;
   fob->ilist = NULL;
   fob->proj = PRJ_SIN;
   fob->start_group = 0L;
+  fob->spool = NULL;
+  fob->spbuf = NULL;
+  fob->nspool = 0L;
 /*
  * Attempt to open the new FITS file.
  */
@@ -342,17 +449,28 @@ static Fitob *new_Fitob(const char *name, double binwid, int scatter,
  */
   lprintf(stdout, "Reading UV FITS file: %s\n", name);
 /*
- * Get the descriptor of the PRIMARY HDU and its dimensions.
+ * Get the descriptor of the PRIMARY HDU.
  */
   phdu = (Phdu *) fits->hdu;
-  dims = phdu->dims;
 /*
- * The primary HDU must be a random-group HDU.
+ * The visibilities must either be recorded in random-groups in the
+ * primary HDU, or in the UV_DATA table of a FITS-IDI file.
  */
-  if(!phdu->groups || phdu->pcount==0) {
+  if(phdu->groups && phdu->pcount!=0) {
+    fob->phdu = phdu;
+    fob->ngroup = phdu->gcount;
+  } else if(find_table(fits, "UV_DATA", -1, NULL)) {
+    if(idi_header(fob))
+      return del_Fitob(fob);
+    phdu = fob->phdu;
+  } else {
     lprintf(stderr, "get_fits: Error: Primary header does not contain random-groups.\n");
     return del_Fitob(fob);
   };
+/*
+ * Get the dimensions of the group data-arrays.
+ */
+  dims = phdu->dims;
 /*
  * Get the 0-relative indexes of each of the recognized random parameters
  * and axes - also return the size of the data array in fob->ndata.
@@ -366,16 +484,31 @@ static Fitob *new_Fitob(const char *name, double binwid, int scatter,
   fob->ndata = 1;
   for(i=1; i<phdu->naxis; i++)
     fob->ndata *= dims[i];
-  fob->data = (double *) malloc(sizeof(double) * fob->ndata);
+  fob->data = (float *) malloc(sizeof(float) * fob->ndata);
 /*
  * Also allocate an array to read random-group parameters into.
  */
   fob->npar = phdu->pcount;
   fob->pars = (double *) malloc(sizeof(double) * fob->npar);
+/*
+ * Allocate buffers for reading chunks of groups, including their data
+ * arrays if these are to be spooled.
+ */
+  fob->nchunk = UVF_CHUNK / (fob->npar + (uvf_spool ? fob->ndata : 0));
+  if(fob->nchunk < 1)
+    fob->nchunk = 1;
+  fob->gpars = (double *) malloc(sizeof(double) * fob->nchunk * fob->npar);
+  if(uvf_spool) {
+    fob->gdata = (float *) malloc(sizeof(float) * fob->nchunk * fob->ndata);
+    if(fob->gdata==NULL) {
+      lprintf(stderr, "new_Fitob: Insufficient memory to read FITS file.\n");
+      return del_Fitob(fob);
+    };
+  };
 /*
  * Insufficient memory?
  */
-  if(fob->pars==NULL || fob->data==NULL) {
+  if(fob->pars==NULL || fob->data==NULL || fob->gpars==NULL) {
     lprintf(stderr, "new_Fitob: Insufficient memory to read FITS file.\n");
     return del_Fitob(fob);
   };
@@ -431,6 +564,23 @@ static Fitob *new_Fitob(const char *name, double binwid, int scatter,
  */
   if(get_date(fob))
     return del_Fitob(fob);
+/*
+ * If requested, open a scratch file in which to spool the groups as
+ * they are binned, so that the FITS file only has to be read once.
+ * Groups are usually recorded in time order, so the spool is
+ * subsequently read mostly sequentially.
+ */
+  if(uvf_spool) {
+    fob->spbuf = (float *) malloc(sizeof(float) * (SP_NHEAD + fob->ndata));
+    if(fob->spbuf==NULL) {
+      lprintf(stderr, "new_Fitob: Insufficient memory to spool groups.\n");
+      return del_Fitob(fob);
+    };
+    fob->spool = new_Recio("uvspool.scr", IS_SCR, 0,
+			   sizeof(float) * (SP_NHEAD + fob->ndata));
+    if(fob->spool==NULL || rec_mmap(fob->spool, REC_SEQUENTIAL))
+      return del_Fitob(fob);
+  };
 /*
  * Read through the UV data to associate groups into integrations,
  * to count the number of such in each sub-array, to record the date
@@ -479,6 +629,23 @@ static Fitob *del_Fitob(Fitob *fob)
   };
   if(fob->data)
     free(fob->data);
+  if(fob->gpars)
+    free(fob->gpars);
+  if(fob->gdata)
+    free(fob->gdata);
+  if(fob->spool)
+    fob->spool = del_Recio(fob->spool);
+  if(fob->spbuf)
+    free(fob->spbuf);
+  if(fob->flux)
+    free(fob->flux);
+  if(fob->wbuf)
+    free(fob->wbuf);
+/*
+ * Delete the synthetic random-groups descriptor of a FITS-IDI file.
+ */
+  if(fob->uvtab && fob->phdu)
+    fob->phdu = (Phdu *) del_Hdu((Hdu *) fob->phdu);
   if(fob->fits)
     fob->fits = del_Fits(fob->fits);
   free(fob);
@@ -490,14 +657,14 @@ static Fitob *del_Fitob(Fitob *fob)
  *
  * Input:
  *  ob Observation *  The descriptor of the Observation being read.
- *  fits      Fits *  The descriptor of the FITS file.
+ *  fob      Fitob *  The FITS/Observation intermediary descriptor.
  * Output:
  *  return    int     0 - OK.
  *                    1 - Error.
  */
-static int get_misc(Observation *ob, Fits *fits)
+static int get_misc(Observation *ob, Fitob *fob)
 {
-  Phdu *phdu = (Phdu *)fits->hdu;  /* Descriptor of primary HDU */
+  Phdu *phdu = fob->phdu;  /* Descriptor of the random groups */
 /*
  * Record the keyword values.
  */
@@ -704,9 +871,9 @@ static int get_axes(Fitob *fob)
  */
   ax.ready = 0;
 /*
- * Get the primary HDU descriptor.
+ * Get the descriptor of the random groups.
  */
-  phdu = (Phdu *) fob->fits->hdu;
+  phdu = fob->phdu;
 /*
  * Locate the required axes.
  */
@@ -752,14 +919,16 @@ static int get_axes(Fitob *fob)
  *
  * Input:
  *  ob   Observation *  The descriptor being initialized.
- *  fits        Fits *  The descriptor of the FITS file.
- *  date      Obdate *  The reference date descriptor.
+ *  fob        Fitob *  The FITS/Observation intermediary descriptor,
+ *                      including the reference date in fob->date.
  * Output:
  *  return     int    0 - OK.
  *                    1 - Error.
  */
-static int get_source(Observation *ob, Fits *fits, Obdate *date)
+static int get_source(Observation *ob, Fitob *fob)
 {
+  Fits *fits = fob->fits; /* The descriptor of the FITS file */
+  Obdate *date = &fob->date; /* The reference date descriptor */
   Source *sou;         /* Pointer into ob->source. */
   Phdu *phdu;          /* The primary HDU */
   Thdu *thdu;          /* The SU table descriptor. */
@@ -808,9 +977,9 @@ static int get_source(Observation *ob, Fits *fits, Obdate *date)
     return 1;
   };
 /*
- * Get a pointer to the PRIMARY HDU descriptor.
+ * Get a pointer to the descriptor of the random groups.
  */
-  phdu = (Phdu *) fits->hdu;
+  phdu = fob->phdu;
 /*
  * Get a pointer to the source descriptor.
  */
@@ -818,7 +987,7 @@ static int get_source(Observation *ob, Fits *fits, Obdate *date)
 /*
  * Look for an SU table.
  */
-  thdu = find_table(fits, "AIPS SU", 0, NULL);
+  thdu = find_table(fits, fob->names->su, 0, NULL);
 /*
  * If there is a table, make sure that it only contains a single source
  * then read the source parameters.
@@ -838,8 +1007,8 @@ static int get_source(Observation *ob, Fits *fits, Obdate *date)
       col->icol = find_column(thdu, col->name, 0);
       if(col->icol==0) {
 	lprintf(stderr,
-		"get_source: Failed to find %s column in AIPS SU table.\n",
-		col->name);
+		"get_source: Failed to find %s column in %s table.\n",
+		col->name, fob->names->su);
 	return 1;
       };
     };
@@ -1013,13 +1182,15 @@ static int count_sources(Fitob *fob)
 /*
  * Look for an SU table.
  */
-  thdu = find_table(fob->fits, "AIPS SU", 0, NULL);
+  thdu = find_table(fob->fits, fob->names->su, 0, NULL);
 /*
  * If there is no source table then ensure that the primary HDU header
- * cites a source.
+ * cites a source. The RA,DEC axes of the synthetic random-groups
+ * descriptor of a FITS-IDI file don't record the source position, so
+ * FITS-IDI files must have a SOURCE table.
  */
   if(thdu==NULL) {
-    if(((Phdu *)fob->fits->hdu)->object==NULL) {
+    if(fob->phdu->object==NULL || fob->uvtab) {
       lprintf(stderr, "count_sources: No source description in FITS file.\n");
       nsource = 0;
     } else {
@@ -1049,7 +1220,7 @@ static int count_FQ_entries(Fitob *fob)
 /*
  * Look for an FQ table.
  */
-  thdu = find_table(fob->fits, "AIPS FQ", 0, NULL);
+  thdu = find_table(fob->fits, fob->names->fq, 0, NULL);
   return thdu==NULL ? 1 : numrow(thdu);
 }
 
@@ -1066,7 +1237,7 @@ static int count_IFs(Fitob *fob)
 /*
  * If there is an IF axis, then its dimension is the number of IFs.
  */
-  fob->nif = (ax.ipos < 0) ? 1 : ((Phdu *) fob->fits->hdu)->dims[ax.ipos];
+  fob->nif = (ax.ipos < 0) ? 1 : fob->phdu->dims[ax.ipos];
 /*
  * Sanity check the number of IFs.
  */
@@ -1090,7 +1261,7 @@ static int count_IFs(Fitob *fob)
 static int get_date(Fitob *fob)
 {
   Parval *pval=NULL; /* Random group parameters */
-  long gcount;       /* The number of groups in the file */
+  long ngroup;       /* The number of groups in the file */
   int yy,mm,dd;      /* Gregorian Year, month and day of observation */
   int ierr=0;        /* Error return status from slalib routines */
   double day1;       /* UTC MJD of the first day of the observation */
@@ -1105,8 +1276,8 @@ static int get_date(Fitob *fob)
  * in the file. When it comes to binning and reading the UV data,
  * these visibilities will be ommitted.
  */
-  gcount = fob->fits->hdu->gcount;
-  for(fob->start_group=0; fob->start_group<gcount; fob->start_group++) {
+  ngroup = fob->ngroup;
+  for(fob->start_group=0; fob->start_group<ngroup; fob->start_group++) {
 /*
  * Read the next group.
  */
@@ -1122,7 +1293,7 @@ static int get_date(Fitob *fob)
 /*
  * Have we reached the end of the data without finding a usable date?
  */
-  if(!pval || fob->start_group >=gcount) {
+  if(!pval || fob->start_group >=ngroup) {
     lprintf(stderr,
 	    "get_date: There are no visibilities with valid dates.\n");
     return 1;
@@ -1205,18 +1376,19 @@ static int get_date(Fitob *fob)
  *
  * Input:
  *  ob  Observation * The descriptor of the observation being read.
- *  fits       Fits * The descriptor of the FITS file.
+ *  fob       Fitob * The FITS/Observation intermediary descriptor.
  *  an        Antab * AN table descriptor.
  * Output:
  *  return   int    0 - OK.
  *                  1 - Error.
  */
-static int get_stations(Observation *ob, Fits *fits, Antab *an)
+static int get_stations(Observation *ob, Fitob *fob, Antab *an)
 {
+  Fits *fits = fob->fits; /* The descriptor of the FITS file */
   static const double vlalon = 1.878283678; /* VLA longitude (radians) */
   Subarray *sub;     /* Subarray descriptor */
   Thdu *thdu;        /* FITS descriptor of AN table */
-  Phdu *phdu;        /* The primary header descriptor */
+  Phdu *phdu;        /* The descriptor of the random groups */
   Station *tel;      /* Pointer to station descriptor array */
   int i;
 /*
@@ -1274,7 +1446,7 @@ static int get_stations(Observation *ob, Fits *fits, Antab *an)
  * to the VLBI standard after deducing the array type from the PRIMARY
  * header TELESCOP keyword.
  */
-  phdu = (Phdu *) fits->hdu;
+  phdu = fob->phdu;
   if(phdu->telescop) {
     if(strcmp(phdu->telescop, "VLA")==0) {
       for(i=0,tel = sub->tel; i<sub->nstat; i++,tel++) {
@@ -1344,6 +1516,7 @@ static int getanbin(Observation *ob, Fits *fits, Antab *an)
   Subarray *sub;     /* The subarray to be processed. */
   Fitkey key;        /* Descriptor of FITS keyword/value pair */
   double iatutc=0.0; /* Archaic alternate for DATUTC */
+  double reffreq=0.0;/* The FITS-IDI REF_FREQ keyword */
   Binan *binan;      /* Container for FITS style sub-array info */
   int nchar;         /* Number of characters read from char column */
   int icol;          /* Column number - 1-relative */
@@ -1356,7 +1529,7 @@ static int getanbin(Observation *ob, Fits *fits, Antab *an)
  * Create a table of optional keywords.
  */
   enum {ARRAYX, ARRAYY, ARRAYZ, GSTIA0, DEGPDY, AN_FREQ, RDATE,	POLARX, POLARY,
-	UT1UTC, DATUTC, IATUTC, TIMSYS, ARRNAM, NUMORB, POLTYPE};
+	UT1UTC, DATUTC, IATUTC, TIMSYS, ARRNAM, NUMORB, POLTYPE, REF_FREQ};
   static Fitkey ankeys[]={
     {"ARRAYX", 0, ARRAYX,   DAT_DBL, NULL, NULL},
     {"ARRAYY", 0, ARRAYY,   DAT_DBL, NULL, NULL},
@@ -1373,6 +1546,7 @@ static int getanbin(Observation *ob, Fits *fits, Antab *an)
     {"TIMSYS", 0, TIMSYS,   DAT_STR, NULL, NULL},
     {"ARRNAM", 0, ARRNAM,   DAT_STR, NULL, NULL},
     {"POLTYPE",0, POLTYPE,  DAT_STR, NULL, NULL},
+    {"REF_FREQ",0,REF_FREQ, DAT_DBL, NULL, NULL},
   };
 /*
  * Define a structure used to record field assignments.
@@ -1488,8 +1662,20 @@ static int getanbin(Observation *ob, Fits *fits, Antab *an)
       stripcpy(binan->poltype, sizeof(binan->poltype), KEYSTR(key),
 	       strlen(KEYSTR(key)));
       break;
+    case REF_FREQ:
+      reffreq = KEYDBL(key);
+      break;
     };
   };
+/*
+ * FITS-IDI ARRAY_GEOMETRY tables don't always give the array frequency
+ * in a FREQ keyword (header keywords are limited to 8 characters, so
+ * it can't be spelt FREQUENCY). When it is missing, substitute the
+ * reference frequency that all FITS-IDI tables are required to record
+ * in their REF_FREQ keyword.
+ */
+  if(binan->freq == 0.0)
+    binan->freq = reffreq;
 /*
  * Read the reference antenna number and associated R-L phase differences
  * if present.
@@ -1879,22 +2065,23 @@ static int get_baselines(Observation *ob, Fitob *fob, Antab *an)
  *
  * Input:
  *  ob Observation *  The descriptor of the Observation being read.
- *  fits      Fits *  The descriptor of the FITS file.
+ *  fob      Fitob *  The FITS/Observation intermediary descriptor.
  * Output:
  *  return     int     0 - OK.
  *                     1 - Error.
  */
-static int get_IF_freq(Observation *ob, Fits *fits)
+static int get_IF_freq(Observation *ob, Fitob *fob)
 {
-  Phdu *phdu;        /* Pointer to primary HDU descriptor */
+  Fits *fits = fob->fits; /* The descriptor of the FITS file */
+  Phdu *phdu;        /* The descriptor of the random groups */
   Thdu *thdu;        /* The FQ-table descriptor */
   Imaxis *axis;      /* The FITS descriptor of the FREQ axis */
   If *ifptr;         /* POinter to IF descriptor being initialized */
   int i;
 /*
- * Get a pointer to the primary HDU descriptor.
+ * Get a pointer to the descriptor of the random groups.
  */
-  phdu = (Phdu *) fits->hdu;
+  phdu = fob->phdu;
 /*
  * Get the descriptor for the FREQ primary HDU axis.
  */
@@ -1904,7 +2091,7 @@ static int get_IF_freq(Observation *ob, Fits *fits)
 /*
  * Look for an FQ table.
  */
-  thdu = find_table(fits, "AIPS FQ", 0, NULL);
+  thdu = find_table(fits, fob->names->fq, 0, NULL);
 /*
  * No FQ table?
  */
@@ -1913,7 +2100,8 @@ static int get_IF_freq(Observation *ob, Fits *fits)
  * This is an error if there is an IF axis.
  */
     if(ax.ipos >= 0 || ob->nif > 1) {
-      lprintf(stderr, "get_IF_freq: Unable to locate AIPS FQ table.\n");
+      lprintf(stderr, "get_IF_freq: Unable to locate %s table.\n",
+	      fob->names->fq);
       return 1;
     };
 /*
@@ -1938,30 +2126,30 @@ static int get_IF_freq(Observation *ob, Fits *fits)
  * Define a structure used to record field assignments.
  */
     typedef struct {
-      char *name;    /* Name of field */
       int icol;      /* Number of field column in row (0-relative) */
       int need;      /* True if this axis is mandatory */
     } FQfield;
 /*
- * Define 'AIPS FQ' field assignments.
+ * Define FQ table field assignments. The names of the fields are
+ * listed in the same order in fob->names->fqcol[].
  */
     enum {IF_FREQ, CH_WIDTH, TOTAL_BW, SIDEBAND}; /* Used to index 'fields[]'*/
     static FQfield fields[]={
-      {"IF FREQ",         0, 1},
-      {"CH WIDTH",        0, 1},
-      {"TOTAL BANDWIDTH", 0, 1},
-      {"SIDEBAND",        0, 1},
+      {0, 1},
+      {0, 1},
+      {0, 1},
+      {0, 1},
     };
     static const int nfield=sizeof(fields)/sizeof(FQfield);
     FQfield *field;   /* Pointer into fields[] */
 /*
- * Search for each of the fields named in fields[].
+ * Search for each of the fields named in fob->names->fqcol[].
  */
     for(field=fields,i=0; i<nfield; i++,field++) {
-      field->icol = find_column(thdu, field->name, 0);
+      field->icol = find_column(thdu, fob->names->fqcol[i], 0);
       if(field->icol==0 && field->need) {
 	lprintf(stderr, "get_IF_freq: Missing %s field in FQ table.\n",
-		field->name);
+		fob->names->fqcol[i]);
 	return 1;
       };
     };
@@ -2056,7 +2244,7 @@ static int count_stokes(Fitob *fob)
  * If there is a STOKES axis, then its dimension is the number
  * of polarizations or stokes parameters recorded.
  */
-  fob->npol = (ax.spos < 0) ? 1 : ((Phdu *) fob->fits->hdu)->dims[ax.spos];
+  fob->npol = (ax.spos < 0) ? 1 : fob->phdu->dims[ax.spos];
 /*
  * Sanity check the number of polarizations.
  */
@@ -2077,12 +2265,12 @@ static int count_stokes(Fitob *fob)
  *
  * Input:
  *  ob Observation *  The descriptor of the Observation being read.
- *  fits      Fits *  The descriptor of the FITS file.
+ *  fob      Fitob *  The FITS/Observation intermediary descriptor.
  * Output:
  *  return    int     0 - OK.
  *                    1 - Error.
  */
-static int get_stokes(Observation *ob, Fits *fits)
+static int get_stokes(Observation *ob, Fitob *fob)
 {
   int i;
 /*
@@ -2102,7 +2290,7 @@ static int get_stokes(Observation *ob, Fits *fits)
 /*
  * Get a pointer to the stokes axis descriptor.
  */
-    axis = get_axis((Phdu *)fits->hdu, ax.spos+1);
+    axis = get_axis(fob->phdu, ax.spos+1);
 /*
  * Check and assign polarization types into ob->pols[].
  */
@@ -2300,18 +2488,22 @@ static int check_history(Observation *ob, char *hline, Fitob *fob)
 }
 
 /*.......................................................................
- * Read the data section of a given group from the FITS file.
+ * Read the data section of a given group from the FITS file. The data
+ * are read directly into single precision, which is the precision in
+ * which get_uvdata() uses them, so that rimage() doesn't have to widen
+ * them to double precision first.
  *
  * Input:
  *  fob    Fitob *  The FITS Observation intermediary descriptor.
  *  group   long    The 0-relative number of the group to read.
  * Output:
- *  pars  double *  Pointer to fob->data which contains fob->ndata
+ *  pars   float *  Pointer to fob->data which contains fob->ndata
  *                  group parameters, or NULL on error.
  */
-static double *get_data(Fitob *fob, long group)
+static float *get_data(Fitob *fob, long group)
 {
-  if(rimage(fob->fits, (Phdu *)fob->fits->hdu, group, 0L, fob->ndata, DAT_DBL,1,
+  if(fob->uvtab ? idi_data(fob, group, fob->data) :
+     rimage(fob->fits, fob->phdu, group, 0L, fob->ndata, DAT_FLT, 1,
 	    NULL, fob->data) != fob->ndata)
     return NULL;
   else
@@ -2449,7 +2641,7 @@ static int get_subarrays(Observation *ob, Fitob *fob)
 /*
  * Initialize the station descriptors in ob->sub[isub].
  */
-      if(get_stations(ob, fob->fits, an))
+      if(get_stations(ob, fob, an))
 	return 1;
 /*
  * Initialize the corresponding used baseline descriptors.
@@ -2498,7 +2690,7 @@ static int find_subarrays(Fitob *fob, int keepant)
  */
   fob->maxan = 0;
   prev = NULL;
-  while((thdu=find_table(fob->fits, "AIPS AN", -1, (Hdu *) prev)) != NULL) {
+  while((thdu=find_table(fob->fits, fob->names->an, -1, (Hdu *) prev)) != NULL) {
     prev = thdu;
 /*
  * Ascertain the extension version number.
@@ -2554,7 +2746,7 @@ static int find_subarrays(Fitob *fob, int keepant)
  * the last table of a given version number is mapped.
  */
   prev = NULL;
-  while((thdu=find_table(fob->fits, "AIPS AN", -1, (Hdu *) prev)) != NULL) {
+  while((thdu=find_table(fob->fits, fob->names->an, -1, (Hdu *) prev)) != NULL) {
     prev = thdu;
     extver = thdu->extver - 1;
     fob->antab[extver].thdu = thdu;
@@ -2717,7 +2909,7 @@ static int get_antrow(Fits *fits, Thdu *thdu, Antab *an)
  */
 static int grp_parms(Fitob *fob)
 {
-  Phdu *phdu = (Phdu *) fob->fits->hdu;
+  Phdu *phdu = fob->phdu;
   Gpar *gpar;  /* Descriptor of random parameter */
 /*
  * Indexes not ready yet.
@@ -2771,7 +2963,6 @@ static int grp_parms(Fitob *fob)
  */
 static Parval *read_pars(Fitob *fob, long group)
 {
-  static Parval pval;   /* Repository for decoded random-parameters */
   double *pars;         /* Pointer to buffer containing random parameters */
 /*
  * Initialize random parameter indexes?
@@ -2785,9 +2976,27 @@ static Parval *read_pars(Fitob *fob, long group)
 /*
  * Read the requested group.
  */
-  if(rgroup(fob->fits, (Phdu *)fob->fits->hdu, group, 0L, fob->npar, DAT_DBL,1,
+  if(fob->uvtab ? idi_pars(fob, group, pars) :
+     rgroup(fob->fits, fob->phdu, group, 0L, fob->npar, DAT_DBL, 1,
 	    NULL, pars) != fob->npar)
     return NULL;
+  return decode_pars(pars);
+}
+
+/*.......................................................................
+ * Decode the random parameters of a group, as read by rgroup() or
+ * rgroups(). The indexes of the parameters must already have been
+ * initialized by grp_parms().
+ *
+ * Input:
+ *  pars   double *  The scaled random parameters of the group.
+ * Output:
+ *  return Parval *  Pointer to internal static struct containing the
+ *                   decoded values.
+ */
+static Parval *decode_pars(double *pars)
+{
+  static Parval pval;   /* Repository for decoded random-parameters */
 /*
  * Get the U, V and W coords in there FITS file units (seconds of light
  * travel time over the projected baseline).
@@ -2843,6 +3052,588 @@ static Parval *read_pars(Fitob *fob, long group)
   return &pval;
 }
 
+/*.......................................................................
+ * Describe the rows of the UV_DATA table of a FITS-IDI file with a
+ * synthetic random-groups descriptor, recorded in fob->phdu, so that
+ * the rest of this file can treat each row as a random group. The
+ * random parameters of each group are the UU, VV, WW, BASELINE, DATE
+ * and TIME columns of the row, plus the FREQID and INTTIM columns if
+ * present, and are read by idi_pars(). The data array of each group is
+ * the visibility matrix in the FLUX column of the row, described by the
+ * MAXISn, CTYPEn, CRVALn, CDELTn and CRPIXn keywords of the table, and
+ * is read by idi_data(). Note that only files that contain a single
+ * UV_DATA table are supported.
+ *
+ * Input/Output:
+ *  fob    Fitob *  The FITS/Observation intermediary descriptor.
+ *                  On success fob->phdu, fob->uvtab, fob->names and
+ *                  fob->ngroup are assigned, along with the FLUX and
+ *                  WEIGHT buffers if needed.
+ * Output:
+ *  return   int    0 - OK.
+ *                  1 - Error.
+ */
+static int idi_header(Fitob *fob)
+{
+  Fits *fits = fob->fits;            /* The descriptor of the FITS file */
+  Phdu *prim = (Phdu *) fits->hdu;   /* The primary HDU descriptor */
+  Thdu *thdu;        /* The descriptor of the UV_DATA table */
+  Hdu *hdu;          /* The synthetic random-groups descriptor */
+  Fitkey key;        /* Descriptor of FITS keyword/value pair */
+  char *ptype[IDI_MAXPAR]; /* The names of the random parameters */
+  int dims[IDI_MAXAXIS+3]; /* The dimensions of the random-groups axes */
+  int maxis=0;       /* The number of axes of the visibility matrix */
+  int naxis;         /* The number of random-groups axes */
+  int have_ra=0;     /* True if the matrix has an RA axis */
+  int have_dec=0;    /* True if the matrix has a DEC axis */
+  long nelem;        /* The number of elements in the visibility matrix */
+  char telescop[81]; /* The UV_DATA TELESCOP keyword */
+  char observer[81]; /* The UV_DATA OBSERVER keyword */
+  char date_obs[81]; /* The UV_DATA DATE-OBS keyword */
+  int i;
+/*
+ * Record the description of each axis of the visibility matrix.
+ */
+  struct {
+    int dim;         /* The number of elements on the axis */
+    char ctype[81];  /* The name of the axis */
+    double crpix;    /* The reference pixel */
+    double crval;    /* The coordinate at the reference pixel */
+    double cdelt;    /* The coordinate increment per pixel */
+    double crota;    /* The rotation of the axis */
+  } axes[IDI_MAXAXIS];
+/*
+ * List the UV_DATA keywords that describe the visibility matrix, along
+ * with those that override the equivalent primary HDU keywords.
+ */
+  enum {MAXIS, CTYPE, CRPIX, CRVAL, CDELT, CROTA, TELESCOP, OBSERVER,
+	DATE_OBS};
+  static Fitkey idikeys[]={
+    {"MAXIS",    0, MAXIS,    DAT_INT, NULL, NULL},
+    {"CTYPE",    0, CTYPE,    DAT_STR, NULL, NULL},
+    {"CRPIX",    0, CRPIX,    DAT_DBL, NULL, NULL},
+    {"CRVAL",    0, CRVAL,    DAT_DBL, NULL, NULL},
+    {"CDELT",    0, CDELT,    DAT_DBL, NULL, NULL},
+    {"CROTA",    0, CROTA,    DAT_DBL, NULL, NULL},
+    {"TELESCOP", 0, TELESCOP, DAT_STR, NULL, NULL},
+    {"OBSERVER", 0, OBSERVER, DAT_STR, NULL, NULL},
+    {"DATE-OBS", 0, DATE_OBS, DAT_STR, NULL, NULL},
+  };
+/*
+ * List the columns that are presented as random parameters, other
+ * than UU, VV and WW, and the names of the equivalent random
+ * parameters. The date of each row is the sum of its DATE and TIME
+ * columns, so both are presented as DATE parameters.
+ */
+  typedef struct {
+    char *name;    /* The name of the column */
+    char *ptype;   /* The name of the equivalent random parameter */
+    int need;      /* True if the column is mandatory */
+  } Idipar;
+  static Idipar idipars[]={
+    {"BASELINE", "BASELINE", 1},
+    {"DATE",     "DATE",     1},
+    {"TIME",     "DATE",     1},
+    {"FREQID",   "FREQSEL",  0},
+    {"INTTIM",   "INTTIM",   0},
+  };
+  static char *uvwpre[3] = {"UU", "VV", "WW"};
+/*
+ * Locate the UV_DATA table. Files in which the visibilities are
+ * split between more than one UV_DATA table aren't supported.
+ */
+  thdu = find_table(fits, "UV_DATA", -1, NULL);
+  if(thdu==NULL || thdu->type != F_BINTAB) {
+    lprintf(stderr, "idi_header: Missing UV_DATA binary table.\n");
+    return 1;
+  };
+  if(find_table(fits, "UV_DATA", -1, (Hdu *) thdu) != NULL) {
+    lprintf(stderr,
+	    "idi_header: Unable to handle more than one UV_DATA table.\n");
+    return 1;
+  };
+  fob->uvtab = thdu;
+  fob->names = &idi_names;
+  fob->ngroup = numrow(thdu);
+  lprintf(stdout, "Reading the FITS-IDI UV_DATA table (%ld rows).\n",
+	  fob->ngroup);
+/*
+ * Set the default description of each axis.
+ */
+  for(i=0; i<IDI_MAXAXIS; i++) {
+    axes[i].dim = 0;
+    axes[i].ctype[0] = '\0';
+    axes[i].crpix = 1.0;
+    axes[i].crval = 0.0;
+    axes[i].cdelt = 1.0;
+    axes[i].crota = 0.0;
+  };
+  telescop[0] = observer[0] = date_obs[0] = '\0';
+/*
+ * Read the keywords that are listed in idikeys[]. The axis number of
+ * indexed keywords, like MAXIS2, is returned in key.extn.
+ */
+  new_hline((Hdu *) thdu, 0);   /* Rewind header */
+  while(next_key(fits, (Hdu *) thdu, idikeys,
+		 sizeof(idikeys)/sizeof(Fitkey), EOH_SEEK, &key) == 0) {
+    int iax = key.extn - 1;   /* The 0-relative axis index, if any */
+    int isaxis = iax >= 0 && iax < IDI_MAXAXIS;
+    switch(key.keyid) {
+    case MAXIS:
+      if(key.extn == 0)
+	maxis = KEYINT(key);
+      else if(isaxis)
+	axes[iax].dim = KEYINT(key);
+      break;
+    case CTYPE:
+      if(isaxis) {
+	stripcpy(axes[iax].ctype, sizeof(axes[iax].ctype), KEYSTR(key),
+		 strlen(KEYSTR(key)));
+      };
+      break;
+    case CRPIX:
+      if(isaxis)
+	axes[iax].crpix = KEYDBL(key);
+      break;
+    case CRVAL:
+      if(isaxis)
+	axes[iax].crval = KEYDBL(key);
+      break;
+    case CDELT:
+      if(isaxis)
+	axes[iax].cdelt = KEYDBL(key);
+      break;
+    case CROTA:
+      if(isaxis)
+	axes[iax].crota = KEYDBL(key);
+      break;
+    case TELESCOP:
+      stripcpy(telescop, sizeof(telescop), KEYSTR(key), strlen(KEYSTR(key)));
+      break;
+    case OBSERVER:
+      stripcpy(observer, sizeof(observer), KEYSTR(key), strlen(KEYSTR(key)));
+      break;
+    case DATE_OBS:
+      stripcpy(date_obs, sizeof(date_obs), KEYSTR(key), strlen(KEYSTR(key)));
+      break;
+    };
+  };
+/*
+ * Check the description of the visibility matrix.
+ */
+  if(maxis < 1 || maxis > IDI_MAXAXIS) {
+    lprintf(stderr, "idi_header: Unsupported UV_DATA MAXIS value: %d\n",
+	    maxis);
+    return 1;
+  };
+  nelem = 1;
+  for(i=0; i<maxis; i++) {
+    if(axes[i].dim < 1) {
+      lprintf(stderr, "idi_header: Illegal or missing UV_DATA MAXIS%d.\n",
+	      i+1);
+      return 1;
+    };
+    nelem *= axes[i].dim;
+/*
+ * The IF axis of a FITS-IDI file is called BAND.
+ */
+    if(strcmp(axes[i].ctype, "BAND")==0)
+      strcpy(axes[i].ctype, "IF");
+    else if(strcmp(axes[i].ctype, "RA")==0)
+      have_ra = 1;
+    else if(strcmp(axes[i].ctype, "DEC")==0)
+      have_dec = 1;
+  };
+/*
+ * The first axis must be the COMPLEX axis, with either 2 elements
+ * (real,imaginary), in which case the weights are taken from the
+ * optional WEIGHT column, or 3 elements (real,imaginary,weight).
+ */
+  if(strcmp(axes[0].ctype, "COMPLEX") != 0 ||
+     (axes[0].dim != 2 && axes[0].dim != 3)) {
+    lprintf(stderr,
+	    "idi_header: The first UV_DATA axis should be a COMPLEX axis of 2 or 3 elements.\n");
+    return 1;
+  };
+  idi.ncomplex = axes[0].dim;
+/*
+ * Locate the UU, VV and WW columns, whose names also specify the
+ * projection of the coordinates, as for random parameters.
+ */
+  idi.npar = 0;
+  for(i=0; i<3; i++) {
+    int icol = find_column(thdu, uvwpre[i], 2);
+    if(icol==0) {
+      lprintf(stderr, "idi_header: Missing %s column in UV_DATA table.\n",
+	      uvwpre[i]);
+      return 1;
+    };
+    ptype[idi.npar] = col_name(thdu, icol);
+    idi.pcol[idi.npar++] = icol;
+  };
+/*
+ * Locate the other columns that are presented as random parameters.
+ */
+  idi.base = -1;
+  for(i=0; i<sizeof(idipars)/sizeof(Idipar); i++) {
+    Idipar *par = idipars + i;
+    int icol = find_column(thdu, par->name, 0);
+    if(icol==0) {
+      if(par->need) {
+	lprintf(stderr, "idi_header: Missing %s column in UV_DATA table.\n",
+		par->name);
+	return 1;
+      };
+    } else {
+      if(strcmp(par->name, "BASELINE")==0)
+	idi.base = idi.npar;
+      ptype[idi.npar] = par->ptype;
+      idi.pcol[idi.npar++] = icol;
+    };
+  };
+/*
+ * Locate the optional sub-array column, and the visibility columns.
+ */
+  idi.array = find_column(thdu, "ARRAY", 0);
+  idi.flux = find_column(thdu, "FLUX", 0);
+  idi.weight = find_column(thdu, "WEIGHT", 0);
+  if(idi.flux==0) {
+    lprintf(stderr, "idi_header: Missing FLUX column in UV_DATA table.\n");
+    return 1;
+  };
+/*
+ * The FLUX column must contain the whole visibility matrix.
+ */
+  idi.nflux = col_dim(fits, thdu, idi.flux, 1);
+  if(idi.nflux != nelem) {
+    lprintf(stderr,
+	    "idi_header: The FLUX column has %d elements, instead of %ld.\n",
+	    idi.nflux, nelem);
+    return 1;
+  };
+  idi.nweight = idi.weight ? col_dim(fits, thdu, idi.weight, 1) : 0;
+/*
+ * If the weights aren't recorded in the FLUX column, allocate buffers
+ * for reading the FLUX and WEIGHT columns, before interleaving them
+ * into the random-groups layout.
+ */
+  if(idi.ncomplex == 2) {
+    fob->flux = (float *) malloc(sizeof(float) * idi.nflux);
+    if(idi.nweight > 0)
+      fob->wbuf = (float *) malloc(sizeof(float) * idi.nweight);
+    if(fob->flux==NULL || (idi.nweight > 0 && fob->wbuf==NULL)) {
+      lprintf(stderr, "idi_header: Insufficient memory.\n");
+      return 1;
+    };
+  };
+/*
+ * Compile the dimensions of the random-groups axes. The first is the
+ * degenerate group axis, the second is the COMPLEX axis, which always
+ * has 3 elements in the random-groups layout, and the rest are those
+ * of the visibility matrix, followed by RA and DEC axes if the matrix
+ * doesn't have them.
+ */
+  dims[0] = 0;
+  dims[1] = 3;
+  for(i=1; i<maxis; i++)
+    dims[i+1] = axes[i].dim;
+  naxis = maxis + 1;
+  if(!have_ra)
+    dims[naxis++] = 1;
+  if(!have_dec)
+    dims[naxis++] = 1;
+/*
+ * Create the synthetic random-groups descriptor.
+ */
+  hdu = new_primary(B_FLOAT, naxis, dims, 1, idi.npar, (int) fob->ngroup);
+  if(hdu==NULL)
+    return 1;
+  fob->phdu = (Phdu *) hdu;
+/*
+ * Describe its axes.
+ */
+  for(i=0; i<maxis; i++) {
+    if(setaxis(hdu, i+2, axes[i].ctype, axes[i].crpix, axes[i].crval,
+	       axes[i].cdelt, axes[i].crota))
+      return 1;
+  };
+  naxis = maxis + 1;
+  if(!have_ra && setaxis(hdu, ++naxis, "RA", 1.0, 0.0, 1.0, 0.0))
+    return 1;
+  if(!have_dec && setaxis(hdu, ++naxis, "DEC", 1.0, 0.0, 1.0, 0.0))
+    return 1;
+/*
+ * Name its random parameters. The scale factors and offsets of the
+ * columns are applied by rcolumn(), so these start out as 1 and 0,
+ * but may subsequently be modified by grp_parms() and uvw_parms().
+ */
+  for(i=0; i<idi.npar; i++) {
+    if(setgroup(hdu, i+1, ptype[i], 1.0, 0.0))
+      return 1;
+  };
+/*
+ * Record the descriptive keywords of the primary HDU, overriden by
+ * those of the UV_DATA table.
+ */
+  if(setprim(hdu, prim->origin, *date_obs ? date_obs : prim->date_obs,
+	     *telescop ? telescop : prim->telescop, prim->instrume,
+	     *observer ? observer : prim->observer, prim->object,
+	     prim->author, prim->referenc, prim->equinox))
+    return 1;
+  return 0;
+}
+
+/*.......................................................................
+ * Read the pseudo random parameters of a given row of the UV_DATA
+ * table of a FITS-IDI file. This is the FITS-IDI equivalent of
+ * rgroup(), as described by idi_header().
+ *
+ * Input:
+ *  fob     Fitob *  The FITS/Observation intermediary descriptor.
+ *  row      long    The 0-relative index of the row.
+ * Output:
+ *  pars   double *  The fob->npar scaled random parameters of the row.
+ *  return    int    0 - OK.
+ *                   1 - Error.
+ */
+static int idi_pars(Fitob *fob, long row, double *pars)
+{
+  Gpar *gpar = fob->phdu->pars;  /* The random-parameter descriptors */
+  int irow = (int) row + 1;      /* The 1-relative row number */
+  int i;
+/*
+ * Read each of the columns that are presented as random parameters,
+ * and apply the offsets and scale factors of the random parameters.
+ */
+  for(i=0; i<idi.npar; i++,gpar++) {
+    double value;
+    if(rcolumn(fob->fits, fob->uvtab, idi.pcol[i], irow, DAT_DBL, 1, NULL,
+	       0, 1, &value) != 1)
+      return 1;
+    pars[i] = gpar->pzero + gpar->pscal * value;
+  };
+/*
+ * FITS-IDI records the sub-array number in a separate ARRAY column.
+ * Encode it in the BASELINE parameter, in the same way as in
+ * random-groups files, ie. 256*ant1 + ant2 + 0.01*(subarray-1).
+ */
+  if(idi.array) {
+    int array;
+    if(rcolumn(fob->fits, fob->uvtab, idi.array, irow, DAT_INT, 1, NULL,
+	       0, 1, &array) != 1)
+      return 1;
+    pars[idi.base] += 0.01 * (array - 1);
+  };
+  return 0;
+}
+
+/*.......................................................................
+ * Read the visibility matrix of a given row of the UV_DATA table of a
+ * FITS-IDI file, in the layout of the data array of the equivalent
+ * random group. This is the FITS-IDI equivalent of rimage(), as
+ * described by idi_header().
+ *
+ * Input:
+ *  fob     Fitob *  The FITS/Observation intermediary descriptor.
+ *  row      long    The 0-relative index of the row.
+ * Output:
+ *  data    float *  The fob->ndata elements of the data array.
+ *  return    int    0 - OK.
+ *                   1 - Error.
+ */
+static int idi_data(Fitob *fob, long row, float *data)
+{
+  int irow = (int) row + 1;   /* The 1-relative row number */
+  long npol_if;               /* The number of weights per (pol,IF) */
+  long npol_ch_if;            /* The number of weights per (pol,chan,IF) */
+  int cif;                    /* The index of an IF */
+  int ch;                     /* The index of a spectral-line channel */
+  int pol;                    /* The index of a polarization */
+/*
+ * If the weights are recorded in the FLUX column, its layout is that
+ * of the data array of a random group, so read it directly.
+ */
+  if(idi.ncomplex == 3) {
+    return rcolumn(fob->fits, fob->uvtab, idi.flux, irow, DAT_FLT, 1, NULL,
+		   0, fob->ndata, data) != fob->ndata;
+  };
+/*
+ * Read the real and imaginary parts of the visibilities, along with
+ * their weights, if any.
+ */
+  if(rcolumn(fob->fits, fob->uvtab, idi.flux, irow, DAT_FLT, 1, NULL,
+	     0, idi.nflux, fob->flux) != idi.nflux)
+    return 1;
+  if(idi.nweight > 0 &&
+     rcolumn(fob->fits, fob->uvtab, idi.weight, irow, DAT_FLT, 1, NULL,
+	     0, idi.nweight, fob->wbuf) != idi.nweight)
+    return 1;
+/*
+ * FITS-IDI records either one weight per polarization per IF, or one
+ * per polarization per channel per IF, ordered like the visibilities.
+ * Visibilities without weights are given unit weights.
+ */
+  npol_if = (long) fob->npol * fob->nif;
+  npol_ch_if = npol_if * fob->nchan;
+/*
+ * Interleave the weights with the visibilities. The increments in ax
+ * are those of the random-groups layout, in which each visibility
+ * occupies 3 elements, whereas it occupies 2 in the FLUX column.
+ */
+  for(cif=0; cif<fob->nif; cif++) {
+    for(ch=0; ch<fob->nchan; ch++) {
+      for(pol=0; pol<fob->npol; pol++) {
+	long datpos = cif * ax.iinc + ch * ax.finc + pol * ax.sinc;
+	float *flux = fob->flux + datpos / 3 * 2;
+	float wt;
+	if(idi.nweight == npol_if)
+	  wt = fob->wbuf[pol + fob->npol * cif];
+	else if(idi.nweight == npol_ch_if)
+	  wt = fob->wbuf[pol + fob->npol * (ch + fob->nchan * cif)];
+	else
+	  wt = 1.0f;
+	data[datpos] = flux[0];
+	data[datpos+1] = flux[1];
+	data[datpos+2] = wt;
+      };
+    };
+  };
+  return 0;
+}
+
+/*.......................................................................
+ * Read the pseudo random parameters of a chunk of consecutive rows of
+ * the UV_DATA table of a FITS-IDI file into fob->gpars, along with their
+ * visibilities if fob->gdata!=NULL. This is the FITS-IDI equivalent
+ * of rgroups().
+ *
+ * Input:
+ *  fob     Fitob *  The FITS/Observation intermediary descriptor.
+ *  first    long    The 0-relative index of the first row to read.
+ *  ngroup   long    The number of rows to read (<= fob->nchunk).
+ * Output:
+ *  return    int    0 - OK.
+ *                   1 - Error.
+ */
+static int idi_groups(Fitob *fob, long first, long ngroup)
+{
+  long i;
+  for(i=0; i<ngroup; i++) {
+    if(idi_pars(fob, first + i, fob->gpars + i * fob->npar) ||
+       (fob->gdata && idi_data(fob, first + i, fob->gdata + i * fob->ndata)))
+      return 1;
+  };
+  return 0;
+}
+
+/*.......................................................................
+ * Append the decoded random parameters and the data array of a group
+ * to the spool.
+ *
+ * Input:
+ *  fob     Fitob *  The FITS/Observation intermediary descriptor.
+ *  pval   Parval *  The random parameters of the group, as returned
+ *                   by decode_pars().
+ *  data    float *  The fob->ndata elements of the data array of the
+ *                   group.
+ * Output:
+ *  return    int    0 - OK.
+ *                   1 - Error.
+ */
+static int put_spool(Fitob *fob, Parval *pval, float *data)
+{
+  float *spbuf = fob->spbuf;
+  long nrec = SP_NHEAD + fob->ndata;
+  int i;
+/*
+ * Record the random parameters that get_uvdata() needs. These are
+ * used in single precision, so there is no loss of precision in
+ * storing them as floats.
+ */
+  spbuf[SP_UU] = pval->uu;
+  spbuf[SP_VV] = pval->vv;
+  spbuf[SP_WW] = pval->ww;
+  spbuf[SP_INTTIM] = pval->inttim;
+  spbuf[SP_ISUB] = pval->isub;
+  spbuf[SP_TA] = pval->ta;
+  spbuf[SP_TB] = pval->tb;
+/*
+ * Append the data array.
+ */
+  for(i=0; i<fob->ndata; i++)
+    spbuf[SP_NHEAD + i] = data[i];
+  if(rec_seek(fob->spool, fob->nspool, 0L) ||
+     rec_write(fob->spool, nrec, sizeof(float), spbuf) < nrec)
+    return 1;
+  fob->nspool++;
+  return 0;
+}
+
+/*.......................................................................
+ * Read a group back from the spool. Its data array is returned in
+ * fob->data, as though read by get_data().
+ *
+ * Input:
+ *  fob     Fitob *  The FITS/Observation intermediary descriptor.
+ *  irec     long    The spool record number of the group.
+ * Output:
+ *  return Parval *  Pointer to internal static struct containing the
+ *                   random parameters of the group - or NULL on error.
+ *                   The date and fqid members are not recorded in
+ *                   the spool, so they are returned as 0.
+ */
+static Parval *get_spool(Fitob *fob, long irec)
+{
+  static Parval pval;   /* Repository for spooled random-parameters */
+  float *spbuf = fob->spbuf;
+  long nrec = SP_NHEAD + fob->ndata;
+  int i;
+  if(rec_seek(fob->spool, irec, 0L) ||
+     rec_read(fob->spool, nrec, sizeof(float), spbuf) < nrec)
+    return NULL;
+  pval.uu = spbuf[SP_UU];
+  pval.vv = spbuf[SP_VV];
+  pval.ww = spbuf[SP_WW];
+  pval.inttim = spbuf[SP_INTTIM];
+  pval.isub = spbuf[SP_ISUB];
+  pval.ta = spbuf[SP_TA];
+  pval.tb = spbuf[SP_TB];
+  pval.date = 0.0;
+  pval.fqid = 0;
+  for(i=0; i<fob->ndata; i++)
+    fob->data[i] = spbuf[SP_NHEAD + i];
+  return &pval;
+}
+
+/*.......................................................................
+ * Return true if uvf_read() spools the groups of UV FITS files, so
+ * that each file is only read once.
+ *
+ * Output:
+ *  return    int    0 - Each file is read twice.
+ *                   1 - Each file is read once, and its groups are
+ *                       spooled to a scratch file.
+ */
+int get_uvf_spool(void)
+{
+  return uvf_spool;
+}
+
+/*.......................................................................
+ * Select whether uvf_read() spools the groups of UV FITS files, so
+ * that each file only has to be read once. Spooling needs scratch
+ * space comparable to the size of the file, but avoids a second pass
+ * through a file that may be large, or on slow storage.
+ *
+ * Input:
+ *  spool     int    If true, spool the groups of subsequently read
+ *                   files. If false, read each file twice.
+ */
+void set_uvf_spool(int spool)
+{
+  uvf_spool = spool;
+}
+
 /*.......................................................................
  * Construct and initialize an integration grid iterator by binning
  * time-ordered groups in a UV FITS file into integration bins.
@@ -2850,7 +3641,10 @@ static Parval *read_pars(Fitob *fob, long group)
  * The returned iterator is initialized such that repeated calls to
  * nxt_Intbin() will return the descriptor of each integration bin in time
  * order, and for each integration bin nxt_group() will return the index
- * of each contained group.
+ * of each contained group. If fob->spool!=NULL, the data of each useable
+ * group are also appended to fob->spool, and nxt_group()
+ * returns the spool record numbers of the groups instead of their
+ * indexes in the FITS file.
  *
  * Input:
  *  fob      Fitob *   The FITS/Observation intermediary descriptor.
@@ -2865,6 +3659,8 @@ static Intlist *bin_uvdata(Fitob *fob, double binwid)
   Anmap *bmap;   /* Pointer to fob->bmap[] baseline-mapping entry */
   long group;    /* Group number */
   long gcount;   /* Group count */
+  long cbeg=0L;  /* The index of the first group in fob->gpars[] */
+  long cnum=0L;  /* The number of groups in fob->gpars[] */
   long ngroup=0L;/* The minimum number of groups for complete sampling. */
   int i;
 /*
@@ -2883,17 +3679,29 @@ static Intlist *bin_uvdata(Fitob *fob, double binwid)
 /*
  * Determine the number of groups in the file.
  */
-  gcount = fob->fits->hdu->gcount;
+  gcount = fob->ngroup;
 /*
  * Read the UV FITS file in group order.
  */
   for(group=fob->start_group; group<gcount; group++) {
+    Parval *pval;  /* The decoded random parameters of the new group */
+/*
+ * Read the next chunk of groups when the current one is exhausted.
+ */
+    if(group >= cbeg + cnum) {
+      cbeg = group;
+      cnum = gcount - group;
+      if(cnum > fob->nchunk)
+	cnum = fob->nchunk;
+      if(fob->uvtab ? idi_groups(fob, cbeg, cnum) :
+	 rgroups(fob->fits, fob->phdu, cbeg, cnum, 1, DAT_DBL, fob->gpars,
+		 DAT_FLT, fob->gdata) != cnum)
+	return del_Intlist(ilist);
+    };
 /*
- * Read the random group parameters of the new group.
+ * Decode the random group parameters of the new group.
  */
-    Parval *pval = read_pars(fob, group);
-    if(pval==NULL)
-      return del_Intlist(ilist);
+    pval = decode_pars(fob->gpars + (group - cbeg) * fob->npar);
 /*
  * Get the baseline mapping entry for the baseline and sub-array of
  * the new group.
@@ -2915,10 +3723,16 @@ static Intlist *bin_uvdata(Fitob *fob, double binwid)
  */
       bmap->used = 1;
 /*
- * Append a record of the group index to the appropriate integration bin.
+ * Append a record of the group index, or of its index in the spool,
+ * to the appropriate integration bin.
  */
-      if(add_group(ilist, newut, group, pval->isub))
+      if(fob->spool) {
+	if(put_spool(fob, pval, fob->gdata + (group - cbeg) * fob->ndata) ||
+	   add_group(ilist, newut, fob->nspool-1, pval->isub))
+	  return del_Intlist(ilist);
+      } else if(add_group(ilist, newut, group, pval->isub)) {
 	return del_Intlist(ilist);
+      };
     };
   };
 /*
@@ -3035,6 +3849,8 @@ static Intlist *bin_uvdata(Fitob *fob, double binwid)
  * Copy visibilities from a UV FITS file to the output uvdata.scr file
  * and into memory. bin_uvdata() must be called before this function,
  * to determine how to bin the input visibilities into integrations etc..
+ * If bin_uvdata() spooled the groups, they are read from the spool
+ * instead of from the FITS file.
  *
  * Input:
  *  ob  Observation *  The descriptor of the Observation being initialized.
@@ -3052,7 +3868,7 @@ static int get_uvdata(Observation *ob, Fitob *fob)
   Integration *integ;  /* Pointer to the latest integration */
   Intbin *ibin;        /* The integration bin being processed */
   Dpage *dp;           /* The descriptor of the output uvdata scratch file */
-  double *datbuf;      /* Pointer to group data buffer */
+  float *datbuf;       /* Pointer to group data buffer */
   long irec=0;         /* Record number in scratch file */
   long igroup;         /* The index of the group being read. */
   int i;
@@ -3071,7 +3887,7 @@ static int get_uvdata(Observation *ob, Fitob *fob)
  * Keep the user informed.
  */
   lprintf(stdout, "\nReading %ld visibilities.\n",
-	  (long) fob->fits->hdu->gcount * ob->nchan * ob->nif * ob->npol);
+	  fob->ngroup * ob->nchan * ob->nif * ob->npol);
 /*
  * Get pointers into the sub-array integration arrays.
  */
@@ -3124,9 +3940,11 @@ static int get_uvdata(Observation *ob, Fitob *fob)
     while( (igroup=nxt_group(ibin)) != -1) {
       Anmap *bmap;        /* Baseline index mapping container */
 /*
- * Read the random-group parameters of the new group.
+ * Read the random-group parameters of the new group, along with its
+ * data if it was spooled.
  */
-      Parval *pval = read_pars(fob, igroup);
+      Parval *pval = fob->spool ? get_spool(fob, igroup) :
+	                          read_pars(fob, igroup);
       if(pval==NULL)
 	return uvretfn(av, 1);
 /*
@@ -3145,9 +3963,10 @@ static int get_uvdata(Observation *ob, Fitob *fob)
  */
 	base = bmap->slot;
 /*
- * Read the visibility data of the new group.
+ * Read the visibility data of the new group, if not already read from
+ * the spool.
  */
-	if(get_data(fob, igroup)==NULL)
+	if(!fob->spool && get_data(fob, igroup)==NULL)
 	  return uvretfn(av, 1);
 /*
  * Add to the weighted running mean of the visibilities in the output
@@ -3267,7 +4086,7 @@ static int uvretfn(Visaver *av, int iret)
 static int uvw_parms(Fitob *fob)
 {
   char uvwname[9];     /* Full space padded 8 character parameter name */
-  Phdu *phdu;          /* The Primary HDU descriptor */
+  Phdu *phdu;          /* The descriptor of the random groups */
   double xfreq;        /* The frequency needed to re-cale UU-L */
   char *cptr;          /* Pointer into a random parameter name */
   int i;
@@ -3290,9 +4109,9 @@ static int uvw_parms(Fitob *fob)
  */
   Proj uvwproj = PRJ_NON;
 /*
- * Get the primary HDU descriptor.
+ * Get the descriptor of the random groups.
  */
-  phdu = (Phdu *) fob->fits->hdu;
+  phdu = fob->phdu;
 /*
  * Get the reference value of the frequency axis in case we have to
  * scale UU-L etc.. to UU etc..
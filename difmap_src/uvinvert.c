@@ -3,11 +3,13 @@
 #include <math.h>
 
 #include "obs.h"
+#include "visview.h"
 #include "units.h"
 #include "vlbconst.h"
 #include "vlbinv.h"
 #include "vlbmath.h"
 #include "mapmem.h"
+#include "partask.h"
 #include "logio.h"
 
 /*
@@ -22,9 +24,65 @@ typedef struct {
 static const int nmask=2;   /* The number of pixels on either side of a */
                             /*  given U,V into which to interpolate */
 
+/*
+ * Define a container for the sums used to estimate the clean beam and
+ * the map noise while gridding.
+ */
+typedef struct {
+  double wsum; /* Sum of un-interpolated gridding weights */
+  double muu;  /* Mean of U.U */
+  double mvv;  /* Mean of V.V */
+  double muv;  /* Mean of U.V */
+  double nsum; /* Sum of grid weight / visibility weight */
+} Beamsum;
+
+/*
+ * Define the gridding state of one thread of uvgrid().
+ */
+typedef struct {
+  float *map;     /* The map UV grid that the thread grids into, or NULL */
+  float *beam;    /* The beam UV grid that the thread grids into, or NULL */
+  double wsum;    /* The sum of weights applied during gridding */
+  Beamsum bm;     /* Beam and noise estimation sums */
+  PARTASK_PAD;    /* Separates the sums of neighbouring threads */
+} Gridpart;
+
+/*
+ * Define the gridding context that uvgrid() shares with its threads.
+ */
+typedef struct {
+  Observation *ob;  /* The observation being gridded */
+  Visview *view;    /* The structure-of-arrays view of the current IF */
+  MapBeam *mb;      /* The map and beam container */
+  UVgcf *gcf;       /* The gridding convolution function */
+  float uvmin;      /* The minimum UV radius to grid (wavelengths) */
+  float uvmax;      /* The maximum UV radius to grid (wavelengths) */
+  int docut;        /* Flag whether uvmin and uvmax should be applied */
+  int dotaper;      /* If true then apply a gaussian weighting taper */
+  float gfac;       /* The reciprocal of the variance of the gaussian taper */
+  int dorad;        /* If true apply radial weighting */
+  float errpow;     /* The amplitude error weighting exponent */
+  int dounif;       /* If true then apply uniform weighting */
+  int domap;        /* True to grid the map */
+  int dobeam;       /* True to grid the beam */
+  float ulimit;     /* The largest |U| distance that can be accomodated */
+  float vlimit;     /* The largest |V| distance that can be accomodated */
+  float uvscale;    /* The UVW scale factor of the IF being gridded */
+  int nugrid;       /* Number of complex elements along U direction */
+  int nvgrid;       /* The number of complex elements along V direction */
+  float wsum;       /* The normalization applied by uvgrid_sum_task() */
+  int nthread;      /* The number of gridding threads */
+  Gridpart part[MAX_NTHREAD]; /* The gridding states of the threads */
+} Gridder;
+
 static int uvgrid(Observation *ob, MapBeam *mb, UVgcf *gcf, float uvmin,
 	      float uvmax, float gauval, float gaurad, int dorad, float errpow,
-	      int dounif, int domap);
+	      int dounif, int domap, int dobeam);
+static PARTASK_FN(uvgrid_task);
+static PARTASK_FN(uvgrid_sum_task);
+static void uvgrid_vis(Gridder *grd, Gridpart *gp, float u, float v,
+		       float re, float im, float wt, int bad);
+static void del_Gridparts(Gridder *grd);
 
 static int uvbin(Observation *ob, MapBeam *mb, float binwid,
 		 float uvmin, float uvmax);
@@ -34,7 +92,6 @@ static Bincell *getuvbin(UVbin *uvb, float uu, float vv);
 static UVgcf *uvgcf(MapBeam *mb);
 
 static void uv_limits(MapBeam *mb, float *ulimit, float *vlimit);
-static int ispow2(int n);
 
 /*.......................................................................
  * Fourier invert the residuals between the established model (after
@@ -123,20 +180,24 @@ int uvinvert(Observation *ob, MapBeam *mb, float uvmin, float uvmax,
   if(gcf==NULL)
     return 1;
 /*
- * Grid the UV data into half of a conjugate symmetric array then
- * transform to the dirty map/beam.
+ * Grid the UV data of the map and/or beam into halves of conjugate
+ * symmetric arrays, in a single pass through the data.
+ */
+  if(uvgrid(ob, mb, gcf, uvmin, uvmax, gauval, gaurad, dorad, errpow,
+	    binwid>0, mb->domap, mb->dobeam))
+    return 1;
+/*
+ * Transform the gridded data to the dirty map/beam.
  */
   if(mb->domap) {
-    uvgrid(ob, mb, gcf, uvmin, uvmax, gauval, gaurad, dorad, errpow,
-	   binwid>0, 1);
-    uvtrans(mb, 1);
+    if(uvtrans(mb, 1))
+      return 1;
     mapstats(ob, mb);   /* Record the min/max valued pixels */
     mb->domap = 0;
   };
   if(mb->dobeam) {
-    uvgrid(ob, mb, gcf, uvmin, uvmax, gauval, gaurad, dorad, errpow,
-	   binwid>0, 0);
-    uvtrans(mb, 0);
+    if(uvtrans(mb, 0))
+      return 1;
     mb->dobeam = 0;
   };
 /*
@@ -155,6 +216,20 @@ int uvinvert(Observation *ob, MapBeam *mb, float uvmin, float uvmax,
  * ngrid*ngrid floats. If you want the map to be centered then call
  * uvtrans() which phase shifts the array, then calls realfft().
  *
+ * The map and the beam can be gridded together in a single pass
+ * through the data. Since the weight and the convolution function
+ * values of each visibility are the same for the map and the beam,
+ * these are then only computed once per visibility.
+ *
+ * If more than one thread has been requested via set_nthread(), the
+ * integrations of each IF are divided between that number of threads.
+ * Each thread grids its share into a private copy of the UV grid, and
+ * the copies are summed once all IFs have been gridded. The result is
+ * the same as when a single thread is used, to within float rounding
+ * errors. The weight sums are accumulated in double precision, so that
+ * the normalization of the grid doesn't depend on the order in which
+ * the weights are summed.
+ *
  * Input:
  *  ob Observation *  The observation to be gridded.
  *  mb     MapBeam *  The map and beam grid container.
@@ -175,70 +250,64 @@ int uvinvert(Observation *ob, MapBeam *mb, float uvmin, float uvmax,
  *  errpow   float    If < 0.0 then the amplitude errors, raised to the
  *                    power 'errpow', will be used to scale the weights.
  *  dounif     int    If true then uniform weighting will be performed.
- *  domap      int      0 - grid the dirty beam.
- *                      1 - grid the dirty map.
+ *  domap      int    If true, grid the residual visibilities into
+ *                    mb->map.
+ *  dobeam     int    If true, grid the UV sampling function into
+ *                    mb->beam.
  * Output:
- *  mb->map or beam   An array of (ngrid+2)*ngrid floats to be treated as
+ *  mb->map, beam     Arrays of (ngrid+2)*ngrid floats to be treated as
  *                    the 2-D array of (ngrid/2+1)*ngrid real,imaginary
  *                    pairs, of the gridded UV points in one half of a
  *                    conjugate symettric array. NB. The 0,0 U,V point will
  *                    be located in array element 0,0.
  *  mb->e_bpa,        An estimate of the equivalent elliptical clean beam
  *  mb->e_bmin,       is recorded. All values are recorded in radians.
- *  mb->e_bmaj
+ *  mb->e_bmaj        (These are only computed when dobeam is true).
  *  return     int    0 - OK.
  *                    1 - Error.
  */
 static int uvgrid(Observation *ob, MapBeam *mb, UVgcf *gcf, float uvmin,
 	      float uvmax, float gauval, float gaurad, int dorad, float errpow,
-	      int dounif, int domap)
+	      int dounif, int domap, int dobeam)
 {
-  float *uvmap;   /* Pointer to the map or beam array to be gridded */
+  Gridder grd;    /* The gridding context shared by all threads */
+  Gridpart *gp;   /* The gridding state of thread 0 */
+  Beamsum bm;     /* The combined beam and noise estimation sums */
   float *convfn;  /* The gridding convolution function array */
-  int docut;      /* Flag whether uvmin and uvmax should be applied */
-  int dotaper;    /* If true then apply a gaussian weighting taper */
-  float gfac=0.0f;/* The reciprocal of the variance of the gaussian taper */
   float tgtocg;   /* Conversion factor between target grid pixels and */
                   /*  interpolation grid pixels. */
-  float *cntr_ptr;/* Pointer to centre of 2D representation of uvmap */
-  float *rptr;    /* Pointer to a complex element in the UV grid */
-  float rval;     /* Interpolated real value of visibility */
-  float ival;     /* Interpolated imaginary value of visibility */
-  float wsum;     /* The sum of weights applied during gridding */
+  long cntr;      /* The offset of the centre of the 2D representation */
+                  /*  of the UV grids */
+  double wsum;    /* The sum of weights applied during gridding */
   float fv,fuv;   /* Value of interpolation function at centre of a pixel */
-  float ulimit;   /* The largest |U| distance that can be accomodated */
-  float vlimit;   /* The largest |V| distance that can be accomodated */
   int iu, iv;     /* U,V pixel coordinate in convolution grid */
   int nugrid;     /* Number of complex elements along U direction */
   int nvgrid;     /* The number of complex elements along V direction */
-  int vinc;       /* Increment in floats to move up/down V axis */
-  float *normptr; /* Pointer to U=0 at a given value of V=v */
-  float *conjptr; /* Pointer to U=0 at V=-v (wrt normptr) */
+  long vinc;      /* Increment in floats to move up/down V axis */
+  long normoff;   /* Offset of U=0 at a given value of V=v */
+  long conjoff;   /* Offset of U=0 at V=-v (wrt normoff) */
+  long ngrid;     /* The number of floats in each UV grid */
   int cif;        /* The index of the IF being processed */
+  int ithread;    /* The index of a gridding thread */
   int i;
 /*
- * Create and initialize a container for the beam and noise estimation
- * sums and running means.
+ * Get the size of the grid and the number of complex elements along
+ * the U axis.
  */
-  struct {
-    float wsum;  /* Sum of un-interpolated gridding weights */
-    float muu;   /* Mean of U.U */
-    float mvv;   /* Mean of V.V */
-    float muv;   /* Mean of U.V */
-    float nsum;  /* Sum of grid weight / visibility weight */
-  } bm = {0.0f,0.0f,0.0f,0.0f,0.0f};
-/*
- * Get a pointer to the map or beam, the size of the grid and the number
- * of complex elements along the U axis.
- */
-  uvmap = domap ? mb->map : mb->beam;
   nvgrid = mb->ny;
   nugrid = mb->nx/2+1;
+  ngrid = 2L*nugrid*nvgrid;
 /*
- * Set up for gridding - zero uvmap.
+ * Set up for gridding - zero the map and/or beam arrays.
  */
-  for(i=0; i<2*nugrid*nvgrid; i++)
-    uvmap[i] = 0.0f;
+  if(domap) {
+    for(i=0; i<ngrid; i++)
+      mb->map[i] = 0.0f;
+  };
+  if(dobeam) {
+    for(i=0; i<ngrid; i++)
+      mb->beam[i] = 0.0f;
+  };
 /*
  * Enforce positivity on uvmin and uvmax.
  */
@@ -250,147 +319,389 @@ static int uvgrid(Observation *ob, MapBeam *mb, UVgcf *gcf, float uvmin,
  * Arrange that uvmin <= uvmax.
  */
   if(uvmin > uvmax) {float ftmp = uvmin; uvmin = uvmax; uvmax = ftmp;};
+/*
+ * Record the gridding parameters in the context that is shared by the
+ * gridding threads.
+ */
+  grd.ob = ob;
+  grd.view = NULL;
+  grd.mb = mb;
+  grd.gcf = gcf;
+  grd.uvmin = uvmin;
+  grd.uvmax = uvmax;
+  grd.dorad = dorad;
+  grd.errpow = errpow;
+  grd.dounif = dounif;
+  grd.domap = domap;
+  grd.dobeam = dobeam;
+  grd.nugrid = nugrid;
+  grd.nvgrid = nvgrid;
+  grd.uvscale = 0.0f;
 /*
  * Should we apply a cut-off in U and V?
  */
-  docut = uvmax > 0.0f;
+  grd.docut = uvmax > 0.0f;
 /*
  * Get the maximum U and V coordinates that can be nyquist sampled
  * using the current map pixel size.
  */
-  uv_limits(mb, &ulimit, &vlimit);
+  uv_limits(mb, &grd.ulimit, &grd.vlimit);
 /*
  * Record whether a gaussian taper was specified.
  */
-  dotaper = gaurad > 0.0 && gauval > 0.0 && gauval < 1.0;
+  grd.dotaper = gaurad > 0.0 && gauval > 0.0 && gauval < 1.0;
 /*
  * Work out the -ve reciprocal of the variance of the gaussian taper.
  */
-  if(dotaper)
-    gfac = log(gauval)/gaurad/gaurad;
+  grd.gfac = grd.dotaper ? log(gauval)/gaurad/gaurad : 0.0f;
+/*
+ * Allocate the gridding state of each thread. Thread 0 grids directly
+ * into mb->map and mb->beam, whereas the other threads are given
+ * private zeroed grids. If there is insufficient memory for the
+ * requested number of threads, make do with fewer.
+ */
+  grd.nthread = get_nthread();
+  for(ithread=0; ithread<grd.nthread; ithread++) {
+    gp = grd.part + ithread;
+    gp->map = gp->beam = NULL;
+    if(ithread==0) {
+      gp->map = domap ? mb->map : NULL;
+      gp->beam = dobeam ? mb->beam : NULL;
+    } else if((domap && !(gp->map=(float *) calloc(ngrid, sizeof(float)))) ||
+	      (dobeam && !(gp->beam=(float *) calloc(ngrid, sizeof(float))))) {
+      if(gp->map)
+	free(gp->map);
+      gp->map = NULL;
+      grd.nthread = ithread;
+      break;
+    };
+    gp->wsum = 0.0;
+    gp->bm.wsum = gp->bm.muu = gp->bm.mvv = gp->bm.muv = gp->bm.nsum = 0.0;
+  };
+/*
+ * Loop through all sampled IFs.
+ */
+  for(cif=0; (cif=nextIF(ob, cif, 1, 1)) >= 0; cif++) {
+/*
+ * Get the next IF.
+ */
+    if(getIF(ob, cif)) {
+      del_Gridparts(&grd);
+      return 1;
+    };
+/*
+ * Get the multiplicative factor required to scale UVW light-second
+ * distances to wavelength numbers at the frequency of the new IF.
+ */
+    grd.uvscale = ob->stream.uvscale;
+/*
+ * Get the structure-of-arrays view of the visibilities of the new IF,
+ * which holds the Cartesian residuals to be gridded.
+ */
+    grd.view = ob_visview(ob);
+    if(!grd.view) {
+      del_Gridparts(&grd);
+      return 1;
+    };
+/*
+ * Divide the integrations of the new IF between the gridding threads.
+ */
+    run_partask(grd.nthread, uvgrid_task, &grd);
+  };
 /*
- * Get the convolution function array, and the conversion factor between
- * pixels in the target grid and pixels in the convolution grid.
+ * Get the state of thread 0, which will be used to accumulate the
+ * combined results of all threads.
+ */
+  gp = grd.part;
+/*
+ * If a zero spacing flux has been specified convolve it in separately here
+ * using the same algorithm as above (without the imaginary parts).
+ * Note that the zero baseline flux has zero weight if radial weighting
+ * has been selected, and should then be ignored.
  */
   tgtocg = gcf->tgtocg;
   convfn = gcf->convfn;
+  cntr = (long) nvgrid * nugrid;
+  if(ob->uvzero.wt > 0.0f && !dorad) {
+    float weight = 1.0f;
+    float uvrval = ob->uvzero.amp - ob->uvzero.modamp;
 /*
- * Get a pointer to the real part of the pixel U=0,V=N/2
+ * Apply amplitude uncertainty weighting?
  */
-  cntr_ptr = uvmap + nvgrid * nugrid;
+    if(errpow < -0.001)
+      weight *= pow(ob->uvzero.wt, -errpow/2.0f); /* General case */
 /*
- * Loop through all UV points in observation.
+ * Uniform weighting?
  */
-  wsum = 0.0f;
+    if(dounif) {
+      Bincell *bc = getuvbin(mb->bin, 0.0f, 0.0f);
+      if(bc && *bc>0)
+	weight /= *bc;
+    };
 /*
- * Loop through all sampled IFs.
+ * Convolve over the nmask pixels either side of the centre of the grids.
  */
-  for(cif=0; (cif=nextIF(ob, cif, 1, 1)) >= 0; cif++) {
-    float uvscale;  /* UV coordinate scale factor */
-    Subarray *sub;  /* The descriptor of the sub-array being processed */
-    int isub;       /* The index of sub in ob->sub[] */
+    for(iv = -nmask; iv<=nmask; iv++) {
+      fv = weight * convfn[(int) (tgtocg*fabs(iv)+0.5f)];
 /*
- * Get the next IF.
+ * Address increment to U=0,V=iv.
  */
-    if(getIF(ob, cif))
-      return 1;
+      vinc = nugrid*(iv+iv+((iv<0)?nvgrid:-nvgrid));
 /*
- * Get the multiplicative factor required to scale UVW light-second
- * distances to wavelength numbers at the frequency of the new IF.
+ * Determine the offsets of U=0,V=iv and U=0,V=-iv.
  */
-    uvscale = ob->stream.uvscale;
+      normoff = cntr + vinc;
+      conjoff = cntr + ((iv) ? -vinc:vinc);
+      for(iu = -nmask; iu<=nmask; iu++) {
+	gp->wsum += (fuv = fv * convfn[(int) (tgtocg*fabs(iu)+0.5f)]);
+	if(iu <= 0) {                 /* Conjugate element */
+	  if(gp->map)
+	    gp->map[conjoff-iu-iu] += uvrval * fuv;
+	  if(gp->beam)
+	    gp->beam[conjoff-iu-iu] += fuv;
+	};
+	if(iu >= 0) {                 /* Sampled element */
+	  if(gp->map)
+	    gp->map[normoff+iu+iu] += uvrval * fuv;
+	  if(gp->beam)
+	    gp->beam[normoff+iu+iu] += fuv;
+	};
+      };
+    };
+  };
+/*
+ * Combine the weight sums and the beam-estimation running means of
+ * the threads.
+ */
+  wsum = gp->wsum;
+  bm = gp->bm;
+  for(ithread=1; ithread<grd.nthread; ithread++) {
+    Beamsum *tbm = &grd.part[ithread].bm;
+    wsum += grd.part[ithread].wsum;
+    if(tbm->wsum > 0.0) {
+      double runwt = tbm->wsum / (bm.wsum += tbm->wsum);
+      bm.muu += runwt * (tbm->muu - bm.muu);
+      bm.mvv += runwt * (tbm->mvv - bm.mvv);
+      bm.muv += runwt * (tbm->muv - bm.muv);
+      bm.nsum += tbm->nsum;
+    };
+  };
 /*
- * Loop through sub-arrays of the new IF.
+ * No data gridded?
  */
-    sub = ob->sub;
-    for(isub=0; isub<ob->nsub; isub++,sub++) {
+  if(wsum<=0.0 || (dobeam && bm.wsum<=0.0)) {
+    lprintf(stderr, "uvgrid: No data in UV range.\n");
+    del_Gridparts(&grd);
+    return 1;
+  };
 /*
- * Loop over integrations of the new sub-array.
+ * Finally - sum the grids of the threads and divide the result by the
+ * sum of weights. Prescale wsum by 2 to take into account the fact that
+ * every point appears twice in the UV plane.
  */
-      Integration *integ = sub->integ;
-      int ut;
-      for(ut=0; ut<sub->ntime; ut++,integ++) {
+  grd.wsum = wsum * 2.0;
+  run_partask(grd.nthread, uvgrid_sum_task, &grd);
 /*
- * Loop over visibilities in the new integration.
+ * Discard the private grids of the threads.
  */
-	Visibility *vis = integ->vis;
-	int base;
-	for(base=0; base<sub->nbase; base++,vis++) {
-          float uu = vis->u * uvscale;       /* U distance (wavelengths) */
-          float vv = vis->v * uvscale;       /* V distance (wavelenghts) */
-          float uvrad = sqrt(uu*uu + vv*vv); /* Radial distance in UV plane */
+  del_Gridparts(&grd);
+/*
+ * Work out the estimate of the size of the clean beam.
+ * The technique used was developed by Tim Pearson, and I don't fully
+ * understand it. It depends on the property of fourier transforms
+ * that relates the 2nd moment in the UV plane to the curvature at the center
+ * of the beam in the image plane. An empirical fudge factor is used to
+ * extrapolate the extents of the beam at HWHM.
+ */
+  if(dobeam) {
+    const float fudge=0.7f; /* Empirical fudge factor of TJP's algorithm */
+    float ftmp = sqrt((bm.muu-bm.mvv)*(bm.muu-bm.mvv) + 4.0*bm.muv*bm.muv);
+/*
+ * First the position angle of the equivalent elliptical gaussian distribution.
+ */
+    mb->e_bpa = -0.5*atan2(2.0*bm.muv, bm.muu - bm.mvv);
+/*
+ * Then the equivalent elliptical beam widths in radians.
+ */
+    mb->e_bmin = fudge/(sqrt(2.0*(bm.muu+bm.mvv) + 2.0*ftmp));
+    mb->e_bmaj = fudge/(sqrt(2.0*(bm.muu+bm.mvv) - 2.0*ftmp));
+    lprintf(stdout,
+         "Estimated beam: bmin=%.4g %s, bmaj=%.4g %s, bpa=%.4g degrees\n",
+	    radtoxy(mb->e_bmin), mapunits(U_NAME),
+	    radtoxy(mb->e_bmaj), mapunits(U_NAME),
+	    mb->e_bpa * rtod);
+/*
+ * Determine the estimated map noise.
+ */
+    mb->noise = sqrt(bm.nsum / bm.wsum / bm.wsum);
+/*
+ * Display the estimated noise.
+ */
+    lprintf(stdout, "Estimated noise=%g mJy/beam.\n", mb->noise * 1.0e+3);
+  };
+  return 0;
+}
+
+/*.......................................................................
+ * This is the parallel task function that uvgrid() uses to grid the
+ * visibilities of the current IF. The integrations of all sub-arrays
+ * are divided into nthread contiguous ranges, and each thread grids
+ * its range into its own UV grid.
+ *
+ * Input:
+ *  data      void *  The Gridder context of uvgrid(), cast to (void *).
+ *  ithread    int    The index of the calling thread.
+ *  nthread    int    The number of threads.
+ */
+static PARTASK_FN(uvgrid_task)
+{
+  Gridder *grd = (Gridder *) data;
+  Gridpart *gp = grd->part + ithread;  /* The state of this thread */
+  Observation *ob = grd->ob;
+  Subarray *sub;   /* The descriptor of the sub-array being processed */
+  long ntotal;     /* The total number of integrations in all sub-arrays */
+  long ia, ib;     /* The range of integrations to be gridded */
+  long first;      /* The index of the first integration of sub */
+  int isub;        /* The index of sub in ob->sub[] */
+/*
+ * Count the integrations of all sub-arrays.
+ */
+  ntotal = 0;
+  for(isub=0; isub<ob->nsub; isub++)
+    ntotal += ob->sub[isub].ntime;
+/*
+ * Get the range of integrations of this thread.
+ */
+  partask_range(ntotal, ithread, nthread, &ia, &ib);
+/*
+ * Loop through sub-arrays, gridding the visibilities of those
+ * integrations that lie within the range of this thread.
+ */
+  first = 0;
+  for(sub=ob->sub,isub=0; isub<ob->nsub && first<ib; isub++,sub++) {
+    Subview *sv = grd->view->sub + isub;
+    long uta = ia > first ? ia - first : 0;
+    long utb = ib - first < sub->ntime ? ib - first : sub->ntime;
+/*
+ * The visibilities of integrations uta..utb-1 are contiguous in the
+ * arrays of the view.
+ */
+    long i, iend = utb * sv->nbase;
+    for(i=uta * sv->nbase; i<iend; i++) {
+      uvgrid_vis(grd, gp, sv->u[i], sv->v[i], sv->re[i], sv->im[i],
+		 sv->wt[i], sv->bad[i]);
+    };
+    first += sub->ntime;
+  };
+}
+
+/*.......................................................................
+ * Convolve a single visibility onto the UV grid of a given gridding
+ * thread.
+ *
+ * Input:
+ *  grd       Gridder *  The shared gridding context.
+ *  gp       Gridpart *  The gridding state of the calling thread.
+ *  u, v        float    The UV coordinates of the visibility
+ *                       (light-seconds).
+ *  re, im      float    The real and imaginary parts of the residual
+ *                       (data - model) visibility.
+ *  wt          float    The weight of the visibility.
+ *  bad           int    The Flagtype flags of the visibility.
+ */
+static void uvgrid_vis(Gridder *grd, Gridpart *gp, float u, float v,
+		       float re, float im, float wt, int bad)
+{
+  float *convfn = grd->gcf->convfn;  /* The gridding convolution function */
+  float tgtocg = grd->gcf->tgtocg;   /* Converts from target grid pixels */
+                                     /*  to convolution function pixels */
+  int nugrid = grd->nugrid;          /* Number of complex elements along U */
+  int nvgrid = grd->nvgrid;          /* Number of complex elements along V */
+  float *map = gp->map;              /* The map grid of the thread */
+  float *beam = gp->beam;            /* The beam grid of the thread */
+  long cntr = (long) nvgrid * nugrid;/* Offset of the centre of the 2D */
+                                     /*  representation of the UV grids */
+  long off;       /* The offset of a complex element in the UV grids */
+  float rval;     /* Interpolated real value of visibility */
+  float ival;     /* Interpolated imaginary value of visibility */
+  float fv,fuv;   /* Value of interpolation function at centre of a pixel */
+  int iu, iv;     /* U,V pixel coordinate in convolution grid */
+  long vinc;      /* Increment in floats to move up/down V axis */
+  long normoff;   /* Offset of U=0 at a given value of V=v */
+  long conjoff;   /* Offset of U=0 at V=-v (wrt normoff) */
+  float uu = u * grd->uvscale;       /* U distance (wavelengths) */
+  float vv = v * grd->uvscale;       /* V distance (wavelenghts) */
+  float uvrad = sqrt(uu*uu + vv*vv); /* Radial distance in UV plane */
 /*
  * Only grid usable visibilities.
  */
-	  if(!vis->bad && !(docut && (uvrad < uvmin || uvrad > uvmax)) &&
-	     fabs(uu) <= ulimit && fabs(vv) <= vlimit) {
-	    float ufrc = uu / mb->uinc;   /* Decimal pixel position */
-	    float vfrc = vv / mb->vinc;
-	    int upix = fnint(ufrc);       /* Integer pixel position */
-	    int vpix = fnint(vfrc);
-	    float uvrval;                 /* Real part of visibility */
-	    float uvival;                 /* Imaginary part of visibility */
-	    float weight=1.0f;            /* Weight to apply to visibility */
+  if(!bad &&
+     !(grd->docut && (uvrad < grd->uvmin || uvrad > grd->uvmax)) &&
+     fabs(uu) <= grd->ulimit && fabs(vv) <= grd->vlimit) {
+    float ufrc = uu / grd->mb->uinc;   /* Decimal pixel position */
+    float vfrc = vv / grd->mb->vinc;
+    int upix = fnint(ufrc);            /* Integer pixel position */
+    int vpix = fnint(vfrc);
+    float uvrval=0.0f;                 /* Real part of visibility */
+    float uvival=0.0f;                 /* Imaginary part of visibility */
+    float weight=1.0f;                 /* Weight to apply to visibility */
 /*
  * Work out the weight to assign to the new visibility.
  */
-	    if(dotaper)
-	      weight *= exp(gfac * uvrad*uvrad);  /* Gaussian taper. */
+    if(grd->dotaper)
+      weight *= exp(grd->gfac * uvrad*uvrad);  /* Gaussian taper. */
 /*
  * Radial weighting.
  */
-	    if(dorad)
-	      weight *= uvrad;
+    if(grd->dorad)
+      weight *= uvrad;
 /*
  * Amplitude uncertainty weighting - include special cases for common
  * values.
  */
-	    if(errpow < -0.001) {
-	      float power = -errpow/2.0f;
-	      float wt = fabs(vis->wt);
-	      if(power==1.0f)
-		weight *= wt;             /* vis->wt is the correct value */
-	      else if(power==0.5f)
-		weight *= sqrt(wt);       /* sqrt() is faster than pow() */
-	      else
-		weight *= pow(wt, power); /* General case */
-	    };
+    if(grd->errpow < -0.001) {
+      float power = -grd->errpow/2.0f;
+      float awt = fabs(wt);
+      if(power==1.0f)
+	weight *= awt;            /* wt is the correct value */
+      else if(power==0.5f)
+	weight *= sqrt(awt);      /* sqrt() is faster than pow() */
+      else
+	weight *= pow(awt, power);/* General case */
+    };
 /*
  * Uniform weighting?
  */
-	    if(dounif) {
-	      Bincell *bc = getuvbin(mb->bin, uu, vv);
-	      if(bc && *bc>0)
-		weight /= *bc;
-	    };
+    if(grd->dounif) {
+      Bincell *bc = getuvbin(grd->mb->bin, uu, vv);
+      if(bc && *bc>0)
+	weight /= *bc;
+    };
 /*
  * Accumulate the weighted running means used to estimate the clean-beam.
  * Use of running means is essential since the numbers being added are
  * very large.
  */
-	    if(!domap) {
-	      float runwt = weight / (bm.wsum += weight);
-	      bm.muu += runwt * (uu*uu - bm.muu);
-	      bm.mvv += runwt * (vv*vv - bm.mvv);
-	      bm.muv += runwt * (uu*vv - bm.muv);
+    if(grd->dobeam) {
+      double runwt = weight / (gp->bm.wsum += weight);
+      gp->bm.muu += runwt * (uu*uu - gp->bm.muu);
+      gp->bm.mvv += runwt * (vv*vv - gp->bm.mvv);
+      gp->bm.muv += runwt * (uu*vv - gp->bm.muv);
 /*
  * Accumulate weight sum used together with bm.wsum to calculate the
  * estimated noise.
  */
-	      bm.nsum += weight * weight / vis->wt;
-	    };
+      gp->bm.nsum += weight * weight / wt;
+    };
 /*
- * Turn the data value into a complex form.
+ * Turn the residual data value into a complex form. The beam is
+ * the transform of a unit-amplitude zero-phase visibility, so the
+ * weighted convolution function itself is gridded into the beam.
  */
-	    if(domap) {
-	      uvrval = vis->amp * cos(vis->phs) -
-		vis->modamp * cos(vis->modphs);
-	      uvival = vis->amp * sin(vis->phs) -
-		vis->modamp * sin(vis->modphs);
-	    } else {
-	      uvrval = 1.0f;    /* Beam */
-	      uvival = 0.0f;
-	    };
+    if(grd->domap) {
+      uvrval = re;
+      uvival = im;
+    };
 /*
  * Convolve the 2*nmask+1 square array of points around upix and vpix
  * with the interpolation function. In the full conjugate symmetric array
@@ -402,33 +713,33 @@ static int uvgrid(Observation *ob, MapBeam *mb, UVgcf *gcf, float uvmin,
  *
  * Loop through the interpolation area.
  */
-	    for(iv = vpix-nmask; iv<=vpix+nmask; iv++) {
+    for(iv = vpix-nmask; iv<=vpix+nmask; iv++) {
 /*
  * Determine the value of the interpolation function along V at this pixel.
  */
-	      fv = weight * convfn[(int) (tgtocg*fabs(iv-vfrc)+0.5f)];
+      fv = weight * convfn[(int) (tgtocg*fabs(iv-vfrc)+0.5f)];
 /*
  * Determine the increment in floats to move from v=N/2 to v=vpix+iv.
  * The same increment with the opposite sign will take us to v=-N/2, (except
  * when v=0 [see below]) hence the choice of U=0,V=N/2 as the reference point.
  */
-	      vinc = nugrid*(iv+iv+((iv<0)?nvgrid:-nvgrid));
+      vinc = nugrid*(iv+iv+((iv<0)?nvgrid:-nvgrid));
 /*
- * Determine pointers to U=0,V=iv and U=0,V=-iv.
+ * Determine the offsets of U=0,V=iv and U=0,V=-iv.
  */
-	      normptr = cntr_ptr + vinc;
-	      conjptr = cntr_ptr + ((iv) ? -vinc:vinc);	      
-	      for(iu = upix-nmask; iu<=upix+nmask; iu++) {
+      normoff = cntr + vinc;
+      conjoff = cntr + ((iv) ? -vinc:vinc);
+      for(iu = upix-nmask; iu<=upix+nmask; iu++) {
 /*
  * Combine the interpolation functions along U and V.
  */
-		wsum += (fuv = fv * convfn[(int) (tgtocg*fabs(iu-ufrc)+0.5f)]);
+	gp->wsum += (fuv = fv * convfn[(int) (tgtocg*fabs(iu-ufrc)+0.5f)]);
 /*
  * Calculate the real and imaginary parts of the interpolated
  * and weighted UV data value.
  */
-		rval = uvrval*fuv;
-		ival = uvival*fuv;
+	rval = uvrval*fuv;
+	ival = uvival*fuv;
 /*
  * Pixel iu,iv may be inside the array or in the non-existent
  * conjugate other half of the array. If it is in the latter
@@ -436,122 +747,97 @@ static int uvgrid(Observation *ob, MapBeam *mb, UVgcf *gcf, float uvmin,
  * the array - this also means that the gridded data value should be
  * conjugated.
  */
-		if(iu <= 0) {
-		  rptr = conjptr-iu-iu; /* Pointer to conjugate element */
-		  *rptr += rval;
-		  *(rptr+1) -= ival;
-		};
-		if(iu >= 0) {
-		  rptr = normptr+iu+iu; /* Pointer to complex element */
-		  *rptr += rval;
-		  *(rptr+1) += ival;
-		};
-	      };
-	    };
+	if(iu <= 0) {
+	  off = conjoff-iu-iu;  /* Offset of conjugate element */
+	  if(map) {
+	    map[off] += rval;
+	    map[off+1] -= ival;
 	  };
+	  if(beam)
+	    beam[off] += fuv;
+	};
+	if(iu >= 0) {
+	  off = normoff+iu+iu;  /* Offset of complex element */
+	  if(map) {
+	    map[off] += rval;
+	    map[off+1] += ival;
+	  };
+	  if(beam)
+	    beam[off] += fuv;
 	};
       };
     };
   };
-/*
- * If a zero spacing flux has been specified convolve it in separately here
- * using the same algorithm as above (without the imaginary parts).
- * Note that the zero baseline flux has zero weight if radial weighting
- * has been selected, and should then be ignored.
+}
+
+/*.......................................................................
+ * This is the parallel task function that uvgrid() uses to add the
+ * private UV grids of threads 1..nthread-1 to the UV grid of thread 0,
+ * and to normalize the result by the sum of weights. Each thread
+ * processes a contiguous range of grid elements.
+ *
+ * Input:
+ *  data      void *  The Gridder context of uvgrid(), cast to (void *).
+ *  ithread    int    The index of the calling thread.
+ *  nthread    int    The number of threads.
  */
-  if(ob->uvzero.wt > 0.0f && !dorad) {
-    float weight = 1.0f;
-    float uvrval = domap ? (ob->uvzero.amp - ob->uvzero.modamp) : 1.0f;
+static PARTASK_FN(uvgrid_sum_task)
+{
+  Gridder *grd = (Gridder *) data;
+  float *map = grd->part[0].map;   /* The map grid that receives the sum */
+  float *beam = grd->part[0].beam; /* The beam grid that receives the sum */
+  long ia, ib;   /* The range of grid elements to be processed */
+  long i;
+  int it;
 /*
- * Apply amplitude uncertainty weighting?
+ * Get the range of floats to be processed by this thread.
  */
-    if(errpow < -0.001)
-      weight *= pow(ob->uvzero.wt, -errpow/2.0f); /* General case */
+  partask_range(2L * grd->nugrid * grd->nvgrid, ithread, nthread, &ia, &ib);
 /*
- * Uniform weighting?
+ * Add the grids of the other threads.
  */
-    if(dounif) {
-      Bincell *bc = getuvbin(mb->bin, 0.0f, 0.0f);
-      if(bc && *bc>0)
-	weight /= *bc;
+  for(it=1; it<grd->nthread; it++) {
+    Gridpart *gp = grd->part + it;
+    if(map) {
+      for(i=ia; i<ib; i++)
+	map[i] += gp->map[i];
     };
-/*
- * Convolve over the nmask pixels either side of cntr_ptr.
- */
-    for(iv = -nmask; iv<=nmask; iv++) {
-      fv = weight * convfn[(int) (tgtocg*fabs(iv)+0.5f)];
-/*
- * Address increment to U=0,V=iv.
- */
-      vinc = nugrid*(iv+iv+((iv<0)?nvgrid:-nvgrid));
-/*
- * Determine pointers to U=0,V=iv and U=0,V=-iv.
- */
-      normptr = cntr_ptr + vinc;
-      conjptr = cntr_ptr + ((iv) ? -vinc:vinc);
-      for(iu = -nmask; iu<=nmask; iu++) {
-	wsum += (fuv = fv * convfn[(int) (tgtocg*fabs(iu)+0.5f)]);
-	rval = uvrval * fuv;
-	if(iu <= 0)
-	  *(conjptr-iu-iu) += rval;   /* Conjugate element */
-	if(iu >= 0)
-	  *(normptr+iu+iu) += rval;   /* Sampled element */
-      };
+    if(beam) {
+      for(i=ia; i<ib; i++)
+	beam[i] += gp->beam[i];
     };
   };
 /*
- * No data gridded?
+ * Normalize by the sum of weights.
  */
-  if(wsum<=0.0f || (!domap && bm.wsum<=0.0f)) {
-    lprintf(stderr, "uvgrid: No data in UV range.\n");
-    return 1;
+  if(map) {
+    for(i=ia; i<ib; i++)
+      map[i] /= grd->wsum;
   };
-/*
- * Finally - divide the UV grid by the sum of weights. Prescale
- * wsum by 2 to take into account the fact that every point appears twice
- * in the UV plane.
- */
-  wsum *= 2.0f;
-  rptr=uvmap;
-  for(iv=0; iv<nvgrid; iv++) {
-    for(iu=0;iu<2*nugrid;iu++)
-      *(rptr++) /= wsum;
+  if(beam) {
+    for(i=ia; i<ib; i++)
+      beam[i] /= grd->wsum;
   };
-/*
- * Work out the estimate of the size of the clean beam.
- * The technique used was developed by Tim Pearson, and I don't fully
- * understand it. It depends on the property of fourier transforms
- * that relates the 2nd moment in the UV plane to the curvature at the center 
- * of the beam in the image plane. An empirical fudge factor is used to
- * extrapolate the extents of the beam at HWHM.
- */
-  if(!domap) {
-    const float fudge=0.7f; /* Empirical fudge factor of TJP's algorithm */
-    float ftmp = sqrt((bm.muu-bm.mvv)*(bm.muu-bm.mvv) + 4.0*bm.muv*bm.muv);
-/*
- * First the position angle of the equivalent elliptical gaussian distribution.
- */
-    mb->e_bpa = -0.5*atan2(2.0*bm.muv, bm.muu - bm.mvv);
-/*
- * Then the equivalent elliptical beam widths in radians.
- */
-    mb->e_bmin = fudge/(sqrt(2.0*(bm.muu+bm.mvv) + 2.0*ftmp));
-    mb->e_bmaj = fudge/(sqrt(2.0*(bm.muu+bm.mvv) - 2.0*ftmp));
-    lprintf(stdout,
-         "Estimated beam: bmin=%.4g %s, bmaj=%.4g %s, bpa=%.4g degrees\n",
-	    radtoxy(mb->e_bmin), mapunits(U_NAME),
-	    radtoxy(mb->e_bmaj), mapunits(U_NAME),
-	    mb->e_bpa * rtod);
-/*
- * Determine the estimated map noise.
- */
-    mb->noise = sqrt(bm.nsum / bm.wsum / bm.wsum);
-/*
- * Display the estimated noise.
+}
+
+/*.......................................................................
+ * Delete the private map and beam UV grids that uvgrid() allocated for threads
+ * 1..grd->nthread-1.
+ *
+ * Input:
+ *  grd      Gridder *  The gridding context of uvgrid().
  */
-    lprintf(stdout, "Estimated noise=%g mJy/beam.\n", mb->noise * 1.0e+3);
+static void del_Gridparts(Gridder *grd)
+{
+  int ithread;
+  for(ithread=1; ithread<grd->nthread; ithread++) {
+    Gridpart *gp = grd->part + ithread;
+    if(gp->map)
+      free(gp->map);
+    if(gp->beam)
+      free(gp->beam);
+    gp->map = gp->beam = NULL;
   };
-  return 0;
 }
 
 /*.......................................................................
@@ -983,8 +1269,8 @@ int optimal_pixel_size(Observation *ob, float uvmin, float uvmax,
 /*
  * Check the arguments.
  */
-  if(nx < 1 || !ispow2(nx) || ny < 1 || !ispow2(ny)) {
-    lprintf(stderr, "Invalid non-power of 2 number of pixels.\n");
+  if(!mapsize_ok(nx) || !mapsize_ok(ny)) {
+    lprintf(stderr, "Unsupported number of pixels: %dx%d.\n", nx, ny);
     return 1;
   };
 /*
@@ -1010,29 +1296,3 @@ int optimal_pixel_size(Observation *ob, float uvmin, float uvmax,
   return 0;
 }
 
-/*.......................................................................
- * Determine whether a given integer is a power of 2. This method is a
- * lot faster and more robust than using logs etc..
- *
- * Input:
- *  n        int   The grid size.
- * Output:
- *  return   int   0 - n is not a power of 2.
- *                 1 - n is a power of 2.
- */
-static int ispow2(int n)
-{
-/*
- * Negative numbers are not powers of 2.
- */
-  if(n<=0)
-    return 0;
-/*
- * Divide by 2 until the remainder of dividing by two is non-zero, or
- * 1 is reached. 1 is only reached if the number is a power of two.
- */
-  while(n>1 && n%2==0)
-    n >>= 1;
-  return n==1;
-}
-
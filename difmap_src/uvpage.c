@@ -57,6 +57,12 @@ UVpage *new_UVpage(int ntime, int nbase, int nif)
   uvp->rio = new_Recio("uvmodel.scr", IS_SCR, 0, ntime * nbase * sizeof(Mvis));
   if(uvp->rio == NULL)
     return del_UVpage(uvp);
+/*
+ * Where possible, access the file via a memory map. The integrations
+ * of each IF are mostly read and written in time order.
+ */
+  if(rec_mmap(uvp->rio, REC_SEQUENTIAL))
+    return del_UVpage(uvp);
 /*
  * Allocate a buffer to be used when reading and writing to the
  * uvmodel.scr.
@@ -40,6 +40,7 @@ void uvrotate(Observation *ob, float angle)
 /*
  * Perform the rotation.
  */
+    ob_cart_stale(ob, CART_VIEW);
     sub = ob->sub;
     for(isub=0; isub<ob->nsub; isub++,sub++) {
       Integration *integ = sub->integ;
@@ -19,8 +19,11 @@
  * Input:
  *  domap     int    If true, invert the map grid. If false, invert the
  *                   beam grid.
+ * Output:
+ *  return    int    0 - OK.
+ *                   1 - Error.
  */
-void uvtrans(MapBeam *mb, int domap)
+int uvtrans(MapBeam *mb, int domap)
 {
   float *image;  /* Pointer to the grid to be inverted */
   float *rxptr;  /* Pointer into rtrans for current X pixel coordinate */
@@ -39,7 +42,8 @@ void uvtrans(MapBeam *mb, int domap)
 /*
  * Inverse transform the UV grid.
  */
-  newfft(image, mb->nx/2, mb->ny, -1, 1, 0);
+  if(newfft(image, mb->nx/2, mb->ny, -1, 1, 0))
+    return 1;
 /*
  * Multiply the image throughout by the sensitivity function to remove the
  * gridding convolution function.
@@ -52,7 +56,7 @@ void uvtrans(MapBeam *mb, int domap)
       *(imptr++) *= *(rxptr++) * *ryptr;
     ryptr++;
   };
-  return;
+  return 0;
 }
 
 
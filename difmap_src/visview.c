@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "logio.h"
+#include "obs.h"
+#include "visview.h"
+
+static Visview *vvmemerr(Visview *view);
+
+/*.......................................................................
+ * Allocate the structure-of-arrays view of the visibilities of an
+ * observation. The contents of the view are not filled until
+ * ob_visview() is called.
+ *
+ * Input:
+ *  ob     Observation *  The observation whose sub-arrays are to be
+ *                        viewed.
+ * Output:
+ *  return     Visview *  The new view, or NULL on error.
+ */
+Visview *new_Visview(Observation *ob)
+{
+  Visview *view;  /* The new view */
+  int isub;       /* The index of a sub-array */
+/*
+ * Attempt to allocate the container.
+ */
+  view = malloc(sizeof(*view));
+  if(view==NULL)
+    return vvmemerr(view);
+/*
+ * Intialize the container at least up to the point at which it can
+ * safely be passed to del_Visview().
+ */
+  view->nsub = 0;
+  view->sub = malloc(sizeof(Subview) * (ob->nsub > 0 ? ob->nsub : 1));
+  if(view->sub==NULL)
+    return vvmemerr(view);
+  for(isub=0; isub<ob->nsub; isub++) {
+    Subview *sv = view->sub + isub;
+    sv->nbase = sv->ntime = 0;
+    sv->nvis = 0;
+    sv->u = sv->v = sv->re = sv->im = sv->wt = NULL;
+    sv->bad = NULL;
+  };
+  view->nsub = ob->nsub;
+/*
+ * Allocate the arrays of each sub-array.
+ */
+  for(isub=0; isub<ob->nsub; isub++) {
+    Subarray *sub = ob->sub + isub;
+    Subview *sv = view->sub + isub;
+    size_t n;
+    sv->nbase = sub->nbase;
+    sv->ntime = sub->ntime;
+    sv->nvis = (long) sub->nbase * sub->ntime;
+    n = sv->nvis > 0 ? sv->nvis : 1;
+    sv->u = malloc(sizeof(float) * n);
+    sv->v = malloc(sizeof(float) * n);
+    sv->re = malloc(sizeof(float) * n);
+    sv->im = malloc(sizeof(float) * n);
+    sv->wt = malloc(sizeof(float) * n);
+    sv->bad = malloc(sizeof(unsigned char) * n);
+    if(!sv->u || !sv->v || !sv->re || !sv->im || !sv->wt || !sv->bad)
+      return vvmemerr(view);
+  };
+  return view;
+}
+
+/*.......................................................................
+ * Private cleanup function of new_Visview() for memory allocation
+ * failures.
+ *
+ * Input:
+ *  view    Visview *   The partially initialized view.
+ * Output:
+ *  return  Visview *   Allways NULL.
+ */
+static Visview *vvmemerr(Visview *view)
+{
+  lprintf(stderr, "new_Visview: Insufficient memory.\n");
+  return del_Visview(view);
+}
+
+/*.......................................................................
+ * Delete a view of the visibilities of an observation.
+ *
+ * Input:
+ *  view    Visview *  A view returned by new_Visview().
+ * Output:
+ *  return  Visview *  Always NULL. Use like view=del_Visview(view);
+ */
+Visview *del_Visview(Visview *view)
+{
+  if(view) {
+    if(view->sub) {
+      int isub;
+      for(isub=0; isub<view->nsub; isub++) {
+	Subview *sv = view->sub + isub;
+	if(sv->u)
+	  free(sv->u);
+	if(sv->v)
+	  free(sv->v);
+	if(sv->re)
+	  free(sv->re);
+	if(sv->im)
+	  free(sv->im);
+	if(sv->wt)
+	  free(sv->wt);
+	if(sv->bad)
+	  free(sv->bad);
+      };
+      free(view->sub);
+    };
+    free(view);
+  };
+  return NULL;
+}
+
+/*.......................................................................
+ * Return the structure-of-arrays view of the visibilities of the IF
+ * that is currently in an Observation structure, creating it if it
+ * doesn't exist yet, and refreshing it if the visibilities have been
+ * changed since it was last filled. Note that the view must be
+ * re-acquired after any change to the visibilities.
+ *
+ * Input:
+ *  ob     Observation *  The observation whose visibilities are needed.
+ * Output:
+ *  return     Visview *  The view, or NULL on error.
+ */
+Visview *ob_visview(Observation *ob)
+{
+  Visview *view;  /* The view of the observation */
+  int isub;       /* The index of a sub-array */
+/*
+ * Check the state of the observation.
+ */
+  if(!ob_ready(ob, OB_RAWIF, "ob_visview"))
+    return NULL;
+/*
+ * Discard the view if the shape of the observation has changed since it
+ * was created.
+ */
+  view = ob->view;
+  if(view) {
+    int changed = view->nsub != ob->nsub;
+    for(isub=0; !changed && isub<view->nsub; isub++) {
+      changed = view->sub[isub].nbase != ob->sub[isub].nbase ||
+	view->sub[isub].ntime != ob->sub[isub].ntime;
+    };
+    if(changed)
+      ob->view = del_Visview(ob->view);
+  };
+/*
+ * Create the view if necessary.
+ */
+  if(!ob->view) {
+    ob->view = new_Visview(ob);
+    if(!ob->view)
+      return NULL;
+    ob->cart &= ~CART_VIEW;
+  };
+  view = ob->view;
+/*
+ * Is the view already up to date?
+ */
+  if(ob->cart & CART_VIEW)
+    return view;
+/*
+ * The residuals are formed from the Cartesian copies of the data and
+ * model visibilities.
+ */
+  ob_cartesian(ob, CART_DATA | CART_MODEL);
+/*
+ * Copy the visibilities of each integration of each sub-array.
+ */
+  for(isub=0; isub<view->nsub; isub++) {
+    Subarray *sub = ob->sub + isub;
+    Subview *sv = view->sub + isub;
+    long i = 0;
+    int ut;
+    for(ut=0; ut<sv->ntime; ut++) {
+      Visibility *vis = sub->integ[ut].vis;
+      int base;
+      for(base=0; base<sv->nbase; base++,vis++,i++) {
+	sv->u[i] = vis->u;
+	sv->v[i] = vis->v;
+	sv->re[i] = vis->re - vis->modre;
+	sv->im[i] = vis->im - vis->modim;
+	sv->wt[i] = vis->wt;
+	sv->bad[i] = vis->bad;
+      };
+    };
+  };
+  ob->cart |= CART_VIEW;
+  return view;
+}
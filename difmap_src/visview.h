@@ -0,0 +1,48 @@
+#ifndef visview_h
+#define visview_h
+
+/*
+ * A visibility view is a structure-of-arrays copy of the visibilities
+ * of the IF that is currently in an Observation structure. Each
+ * sub-array has contiguous arrays of the few members of its
+ * visibilities that are needed by loops that visit every visibility,
+ * such as those of gridding and model comparison, so that these loops
+ * can stream through memory instead of striding through the
+ * Visibility array of each integration. The view is built on demand
+ * by ob_visview(), and is marked as out of date by ob_cart_stale()
+ * whenever the visibilities of the IF are changed.
+ */
+
+/* The view of the visibilities of one sub-array */
+
+typedef struct {
+  int nbase;      /* The number of baselines per integration */
+  int ntime;      /* The number of integrations */
+  long nvis;      /* The number of visibilities, ntime x nbase, ordered */
+                  /*  like sub->integ[ut].vis[base] */
+  float *u;       /* The U coordinates of the visibilities (light-seconds) */
+  float *v;       /* The V coordinates of the visibilities (light-seconds) */
+  float *re;      /* The real parts of the residual (data - model) */
+                  /*  visibilities */
+  float *im;      /* The imaginary parts of the residual visibilities */
+  float *wt;      /* The visibility weights */
+  unsigned char *bad; /* The Flagtype flags of the visibilities */
+} Subview;
+
+/* The view of all sub-arrays */
+
+typedef struct Visview {
+  int nsub;       /* The number of sub-arrays */
+  Subview *sub;   /* The views of the nsub sub-arrays */
+} Visview;
+
+/* Create and delete the view of an observation */
+
+Visview *new_Visview(Observation *ob);
+Visview *del_Visview(Visview *view);
+
+/* Return an up to date view of the visibilities of the current IF */
+
+Visview *ob_visview(Observation *ob);
+
+#endif
@@ -13,5 +13,12 @@ void cnj_shift(float *image, int adim, int bdim);
 /*
  * Perform a 2D real or complex fft.
  */
-void newfft(float *image, int adim, int bdim, int isign, int isreal,
-	    int rescale);
+int newfft(float *image, int adim, int bdim, int isign, int isreal,
+	   int rescale);
+
+/*
+ * Return true if newfft() can transform an axis of n complex
+ * elements. This requires that n have no prime factors other than
+ * 2, 3 and 5.
+ */
+int fft_size_ok(int n);
@@ -8,7 +8,7 @@ int uvinvert(Observation *ob, MapBeam *mb, float uvmin, float uvmax,
 	     float gauval, float gaurad, int dorad, float errpow,
 	     float uvbin);
 
-void uvtrans(MapBeam *mb, int domap);
+int uvtrans(MapBeam *mb, int domap);
 
 int optimal_pixel_size(Observation *ob, float uvmin, float uvmax,
 		       int nx, int ny, float *xmax, float *ymax);
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 
 #include "obs.h"
+#include "ifcache.h"
 #include "logio.h"
 
 /*.......................................................................
@@ -42,10 +43,16 @@ int wtscale(Observation *ob, float scale)
  * Scale the recorded wtscale parameter.
  */
   ob->geom.wtscale *= mult;
+/*
+ * Cached copies of IFs other than the current one no longer have
+ * correctly scaled weights.
+ */
+  ifc_forget(ob, -1);
 /*
  * Re-scale the weights in the visibilities that are currently in the
  * observation structure.
  */
+  ob_cart_stale(ob, CART_VIEW);
   sub = ob->sub;
   for(isub=0; isub<ob->nsub; isub++,sub++) {
     Integration *integ = sub->integ;
@@ -20,6 +20,10 @@ static void flagnan(Fittype type, int nobj, unsigned char *data,
 		    Fitsflag *flags);
 static void makenan(Fittype type, int nobj, unsigned char *data,
 		    Fitsflag *flags);
+static int fits_save(Fits *fits);
+static int fits_getrec(Fits *fits, long recnum, unsigned char *buff);
+static int fits_putrec(Fits *fits, long recnum, unsigned char *buff);
+static int fits_drain(Fits *fits);
 
 
 /* Buffer used to send data to writedata and receive data from readdata */
@@ -33,9 +37,11 @@ static int writedata(Fits *fits, Hdu *hdu, long offset, size_t size,
 /*
  * Temorary scratch buffer aligned for arrays of up to CNVBUF_LEN elements of
  * any supported type. This is separately used by get_data and put_data
- * as a type conversion buffer.
+ * as a type conversion buffer. It is large enough to hold the contents
+ * of fits_buff[] converted to any type, so that each call to readdata()
+ * or writedata() transfers as many elements as possible.
  */
-enum {CNVBUF_LEN=200};
+enum {CNVBUF_LEN=FITSLEN};
 static union {
   char c; short s; int i; long l; float f; double d;
 } cnvbuf[CNVBUF_LEN];
@@ -84,6 +90,8 @@ Fits *new_Fits(const char *name, int isold, int readonly, int pedantic,
  */
   fits->hdu = 0;
   fits->name = 0;
+  fits->rec = 0;
+  fits->blk = 0;
 /*
  * Initialize other members.
  */
@@ -95,6 +103,18 @@ Fits *new_Fits(const char *name, int isold, int readonly, int pedantic,
   fits->pad = 0;
   fits->recnum = -1;
   fits->nullrec = 0;
+  fits->blkrec = 0;
+  fits->nblk = 0;
+  fits->blka = fits->blkb = 0;
+/*
+ * Allocate the block cache, through which records are read and
+ * written in batches of FITS_BLKREC records, instead of one at a time.
+ */
+  fits->blk = (unsigned char *) malloc(FITS_BLKREC * FITSLEN);
+  if(fits->blk==NULL) {
+    fprintf(stderr, "new_Fits: Insufficient memory for new FITS file\n");
+    return del_Fits(fits);
+  };
 /*
  * Record the file name.
  */
@@ -134,7 +154,8 @@ Fits *del_Fits(Fits *fits)
 /*
  * Flush any pending data to the FITS file.
  */
-  fits_flush(fits);
+  if(fits->rec)
+    fits_flush(fits);
 /*
  * Emit a warning if the last HDU written is incomplete?
  */
@@ -148,10 +169,12 @@ Fits *del_Fits(Fits *fits)
  */
   fits->rec = del_Recio(fits->rec);
 /*
- * Free the memory used to store the file name.
+ * Free the memory used to store the file name, and the block cache.
  */
   if(fits->name)
     free(fits->name);
+  if(fits->blk)
+    free(fits->blk);
 /*
  * Delete the linked list of Hdu descriptors.
  */
@@ -584,6 +607,8 @@ int get_data(Fits *fits, Hdu *hdu, long offset, Fittype atype, long start,
     nreq = nobj - ndone;   /* The number of elements remaining to be read */
     if(nreq > CNVBUF_LEN)
       nreq = CNVBUF_LEN;
+    if(nreq > FITSLEN / fsize)
+      nreq = FITSLEN / fsize;
     nread = readdata(fits, hdu, offset, fsize, start+ndone, nreq, 1);
     if(nread==0)
       return 1;
@@ -709,6 +734,8 @@ int put_data(Fits *fits, Hdu *hdu, long offset, Fittype atype, long start,
     nnew = nobj - ndone;   /* The number of elements remaining to be written */
     if(nnew > CNVBUF_LEN)
       nnew = CNVBUF_LEN;
+    if(nnew > FITSLEN / fsize)
+      nnew = FITSLEN / fsize;
 /*
  * Copy the data into the output array. While doing this, apply
  * 'zero' and 'scale' or os[*].off and os[*].mul and convert to the
@@ -792,8 +819,24 @@ int put_data(Fits *fits, Hdu *hdu, long offset, Fittype atype, long start,
 int typeconv(long ndata, Fittype atype, void *adata, double zero, double scal,
 	     Fittype btype, void *bdata)
 {
-  static int i;   /* Index into adata[] and bdata[] */
+  long i;         /* Index into adata[] and bdata[] */
   int ierr = 0;   /* Error status */
+/*
+ * When arithmetic data are neither scaled nor offset, and the input and
+ * output types are the same, copy them verbatim rather than passing
+ * each element through double precision arithmetic.
+ */
+  if(atype==btype && zero==0.0 && scal==1.0) {
+    switch(atype) {
+    case DAT_BYT: case DAT_SHT: case DAT_INT: case DAT_LNG:
+    case DAT_FLT: case DAT_DBL: case DAT_SCMP: case DAT_DCMP:
+      if(bdata != adata)
+	memcpy(bdata, adata, ndata * machsize(atype));
+      return 0;
+    default:
+      break;
+    };
+  };
   switch(atype) {
   case DAT_BYT:      /* Treat byte type as a small int */
     switch(btype) {
@@ -1101,7 +1144,7 @@ int typeconv(long ndata, Fittype atype, void *adata, double zero, double scal,
 int arrconv(long ndata, Fittype atype, void *adata, Offscal *os,
 	    Fittype btype, void *bdata)
 {
-  static int i;   /* Index into adata[] and bdata[] */
+  long i;         /* Index into adata[] and bdata[] */
   int ierr = 0;   /* Error status */
   switch(atype) {
   case DAT_BYT:      /* Treat byte type as a small int */
@@ -1807,7 +1850,8 @@ static int writedata(Fits *fits, Hdu *hdu, long offset, size_t size,
 }
 
 /*.......................................................................
- * Flush a FITS I/O buffer to a FITS file.
+ * Flush a FITS I/O buffer to a FITS file, along with any records that
+ * are waiting to be written from the block cache.
  *
  * Input:
  *  fits    Fits *  The FITS file descriptor.
@@ -1816,6 +1860,21 @@ static int writedata(Fits *fits, Hdu *hdu, long offset, size_t size,
  *                  1 - Error.
  */
 int fits_flush(Fits *fits)
+{
+  return fits_save(fits) || fits_drain(fits);
+}
+
+/*.......................................................................
+ * Copy the FITS I/O buffer to the block cache, if it has been modified.
+ * This is a private function of fits_flush() and fits_read().
+ *
+ * Input:
+ *  fits    Fits *  The FITS file descriptor.
+ * Output:
+ *  return   int    0 - OK.
+ *                  1 - Error.
+ */
+static int fits_save(Fits *fits)
 {
 /*
  * Don't write to the file if no modifications have been made to the
@@ -1836,14 +1895,9 @@ int fits_flush(Fits *fits)
     if(fits->recnum > fits->nullrec && fits_pad(fits, fits->recnum))
       return 1;
 /*
- * Move the file pointer to the start of the fits record.
+ * Queue the record to be written to the FITS file.
  */
-    if(rec_seek(fits->rec, fits->recnum, 0L))
-      return 1;
-/*
- * Write the record to the FITS file.
- */
-    if(rec_write(fits->rec, FITSLEN, sizeof(char), fits->buff)<FITSLEN)
+    if(fits_putrec(fits, fits->recnum, fits->buff))
       return 1;
 /*
  * Record changed FITS status.
@@ -1876,7 +1930,7 @@ int fits_read(Fits *fits, long recnum, int doreport)
 /*
  * First flush the previous record if it has been modified.
  */
-  if(fits->modified && fits_flush(fits))
+  if(fits->modified && fits_save(fits))
     return 1;
 /*
  * If the last HDU is marked as complete, or recnum precedes the
@@ -1888,14 +1942,9 @@ int fits_read(Fits *fits, long recnum, int doreport)
  */
   if(fits->complete || recnum < fits->nullrec) {
 /*
- * Position the file at the start of the record.
- */
-    if(rec_seek(fits->rec, recnum, 0L))
-      return 1;
-/*
- * Read the record.
+ * Read the record, via the block cache.
  */
-    if(rec_read(fits->rec, FITSLEN, sizeof(char), fits->buff)<FITSLEN) {
+    if(fits_getrec(fits, recnum, fits->buff)) {
       fits->recnum = -1;
       if(doreport)
 	fprintf(stderr, "fits_read: Error reading from file: %s\n", fits->name);
@@ -1920,7 +1969,9 @@ int fits_read(Fits *fits, long recnum, int doreport)
 /*.......................................................................
  * Fill the gap between fits->nullrec-1 and recnum with padded records.
  * Records fits->nullrec up to recnum-1 are padded with the current
- * padding character fits->pad.
+ * padding character fits->pad. The padding records are written to the
+ * file before returning, so that write errors are reported here, rather
+ * than being deferred to del_Fits(), which can't report them.
  *
  * Input:
  *  fits    Fits *   The fits descriptor.
@@ -1936,11 +1987,6 @@ int fits_pad(Fits *fits, long recnum)
  */
   if(recnum <= fits->nullrec)
     return 0;
-/*
- * Move to the start of the first record to be padded.
- */
-  if(rec_seek(fits->rec, fits->nullrec, 0L))
-    return 1;
 /*
  * Pad a temporary I/O buffer with the current padding character.
  */
@@ -1950,8 +1996,133 @@ int fits_pad(Fits *fits, long recnum)
  * fits->nullrec to recnum, inclusive.
  */
   for( ; fits->nullrec < recnum; fits->nullrec++) {
-    if(rec_write(fits->rec, FITSLEN, sizeof(char), fits_buff) < FITSLEN)
+    if(fits_putrec(fits, fits->nullrec, fits_buff))
       return 1;
   };
+  return fits_drain(fits);
+}
+
+/*.......................................................................
+ * Copy a record of a FITS file into a given buffer, reading it, and up
+ * to FITS_BLKREC-1 following records, into the block cache of the file
+ * if it isn't already there.
+ *
+ * Input:
+ *  fits    Fits *  The descriptor of the FITS file.
+ *  recnum  long    The record number to be read. If the last HDU of
+ *                  the file is incomplete, this must be less than
+ *                  fits->nullrec.
+ * Input/Output:
+ *  buff    unsigned char *  The buffer to copy the record into.
+ * Output:
+ *  return   int    0 - OK.
+ *                  1 - Error.
+ */
+static int fits_getrec(Fits *fits, long recnum, unsigned char *buff)
+{
+  long nrec;   /* The number of records to read into the cache */
+/*
+ * Is the record already in the cache?
+ */
+  if(recnum < fits->blkrec || recnum >= fits->blkrec + fits->nblk) {
+/*
+ * Write any modified records in the cache before replacing them.
+ */
+    if(fits_drain(fits))
+      return 1;
+/*
+ * Don't read beyond the end of an incompletely written HDU, since the
+ * records that follow it are returned as padding by fits_read().
+ */
+    nrec = FITS_BLKREC;
+    if(!fits->complete && recnum + nrec > fits->nullrec)
+      nrec = fits->nullrec - recnum;
+/*
+ * Read as many of the records as the file contains.
+ */
+    fits->blkrec = recnum;
+    fits->nblk = 0;
+    if(nrec < 1 || rec_seek(fits->rec, recnum, 0L))
+      return 1;
+    fits->nblk = rec_read(fits->rec, nrec, FITSLEN, fits->blk);
+    if(fits->nblk < 1) {
+      fits->nblk = 0;
+      return 1;
+    };
+  };
+  memcpy(buff, fits->blk + (recnum - fits->blkrec) * FITSLEN, FITSLEN);
+  return 0;
+}
+
+/*.......................................................................
+ * Copy a given record into the block cache of a FITS file, to be written
+ * to the file when the cache is next drained. If the record can't be
+ * added to the records that are currently in the cache, the cache is
+ * drained first.
+ *
+ * Input:
+ *  fits    Fits *  The descriptor of the FITS file.
+ *  recnum  long    The record number of the record.
+ *  buff    unsigned char *  The contents of the record.
+ * Output:
+ *  return   int    0 - OK.
+ *                  1 - Error.
+ */
+static int fits_putrec(Fits *fits, long recnum, unsigned char *buff)
+{
+  long irec = recnum - fits->blkrec;  /* The index of the record in blk[] */
+/*
+ * Unless the record is already in the cache, or immediately follows the
+ * last record in the cache, start a new block.
+ */
+  if(irec < 0 || irec > fits->nblk || irec >= FITS_BLKREC) {
+    if(fits_drain(fits))
+      return 1;
+    fits->blkrec = recnum;
+    fits->nblk = 0;
+    irec = 0;
+  };
+/*
+ * Copy the record into the cache.
+ */
+  memcpy(fits->blk + irec * FITSLEN, buff, FITSLEN);
+  if(irec == fits->nblk)
+    fits->nblk++;
+/*
+ * Extend the range of modified records to include the new record.
+ */
+  if(fits->blka >= fits->blkb) {
+    fits->blka = irec;
+    fits->blkb = irec + 1;
+  } else if(irec < fits->blka) {
+    fits->blka = irec;
+  } else if(irec >= fits->blkb) {
+    fits->blkb = irec + 1;
+  };
+  return 0;
+}
+
+/*.......................................................................
+ * Write any modified records in the block cache of a FITS file to the
+ * file.
+ *
+ * Input:
+ *  fits    Fits *  The descriptor of the FITS file.
+ * Output:
+ *  return   int    0 - OK.
+ *                  1 - Error.
+ */
+static int fits_drain(Fits *fits)
+{
+  if(fits->blka < fits->blkb) {
+    int nrec = fits->blkb - fits->blka;
+    if(rec_seek(fits->rec, fits->blkrec + fits->blka, 0L) ||
+       rec_write(fits->rec, nrec, FITSLEN, fits->blk + fits->blka * FITSLEN)
+       < nrec) {
+      fprintf(stderr, "fits_flush: Error writing to file: %s\n", fits->name);
+      return 1;
+    };
+    fits->blka = fits->blkb = 0;
+  };
   return 0;
 }
@@ -5,6 +5,12 @@
 
 #define FITSLEN (23040/CHAR_BIT)  /* The number of chars per FITS record */
 
+/*
+ * The number of FITS records that are read from, or written to, a FITS
+ * file at a time, via the block cache of its Fits descriptor.
+ */
+#define FITS_BLKREC 1024
+
 /* Enumerate header types. Each enumerator must be a unique power of two */
 
 typedef enum {
@@ -84,6 +90,13 @@ typedef struct Fits {
   long nullrec;     /* Index of first un-written record in fits file */
   struct Hdu *hdu;  /* Linked list of Header-Data-Unit descriptors */
   unsigned char buff[FITSLEN]; /* FITS I/O buffer */
+  unsigned char *blk; /* Read-ahead, write-behind cache of FITS_BLKREC */
+                    /*  records */
+  long blkrec;      /* The record number of the first record in blk[] */
+  int nblk;         /* The number of consecutive records in blk[] */
+  int blka, blkb;   /* Records blka..blkb-1 of blk[] have been modified */
+                    /*  since they were read or last written (blka>=blkb */
+                    /*  if none have been modified) */
 } Fits;
 
 /* Enumerate the types retrievable from FITS tables */
@@ -34,7 +34,7 @@ static Imaxis *new_axes(Phdu *phdu);
 /*
  * Declare a scratch buffer used to collect and send the different scale and
  * offset factors of different random group parameters to arrconv().
- * It is independantly used by wgroup() and rgroup().
+ * It is independantly used by wgroup(), rgroup() and rgroups().
  */
 enum {PHDU_NPAR=30};
 static Offscal offscal[PHDU_NPAR];
@@ -476,6 +476,117 @@ long rgroup(Fits *fits, Phdu *phdu, long igroup, long start, long nobj,
   return nobj;
 }
 
+/*.......................................................................
+ * Read the random parameters and/or image arrays of a range of
+ * consecutive random groups from an IMAGE HDU. This is equivalent to
+ * calling rgroup() and rimage() for each group, but the arguments are
+ * checked, and the parameter scale factors assembled, just once.
+ *
+ * Input:
+ *  fits      Fits *  The FITS file descriptor.
+ *  phdu      Phdu *  The descriptor of the IMAGE HDU to be read from.
+ *  igroup    long    The 0-relative index of the first group to be read.
+ *  ngroup    long    The number of groups to be read.
+ *  doscale    int    If true apply offset and scale factors.
+ *  ptype  Fittype    The declared type of array pars[] - conversion
+ *                    to this type will be performed if meaningful.
+ *  dtype  Fittype    The declared type of array data[] - conversion
+ *                    to this type will be performed if meaningful.
+ * Output:
+ *  pars      void *  If not NULL, send an array of type 'ptype' and with
+ *                    a dimension of at least ngroup * phdu->pcount. On
+ *                    output, it will contain the random parameters of
+ *                    each group in turn.
+ *  data      void *  If not NULL, send an array of type 'dtype' and with
+ *                    a dimension of at least ngroup * phdu->imsize. On
+ *                    output, it will contain the image array of each
+ *                    group in turn.
+ *  return    long    The number of groups read. This is less than
+ *                    ngroup on error.
+ */
+long rgroups(Fits *fits, Phdu *phdu, long igroup, long ngroup, int doscale,
+	     Fittype ptype, void *pars, Fittype dtype, void *data)
+{
+  Hdu *hdu = (Hdu *) phdu;
+  size_t psize; /* The number of bytes in an element of pars[] */
+  size_t dsize; /* The number of bytes in an element of data[] */
+  long ndone;   /* The number of groups read */
+  int i;
+/*
+ * Sanity check the arguments.
+ */
+  if(hdu==NULL || fits==NULL || (pars==NULL && data==NULL)) {
+    fprintf(stderr, "rgroups: NULL parameter intercepted\n");
+    return 0L;
+  };
+/*
+ * Is this a random-groups HDU?
+ */
+  if(!hdu->groups) {
+    fprintf(stderr, "rgroups: The given HDU does not contain random-groups.\n");
+    return 0L;
+  };
+/*
+ * The group indexes may exceed the currently recorded number of groups
+ * in the file only if the data segment is incomplete.
+ */
+  if(igroup < 0 || ngroup < 0 ||
+     (hdu->state!=HDU_DATA && igroup + ngroup > hdu->gcount)) {
+    fprintf(stderr, "rgroups: Group indexes (%ld-%ld) out of range.\n",
+	    igroup+1L, igroup+ngroup);
+    return 0L;
+  };
+/*
+ * Get the number of bytes per element of pars[] and data[].
+ */
+  psize = machsize(ptype);
+  dsize = machsize(dtype);
+  if((pars && psize==0) || (data && dsize==0))
+    return 0L;
+/*
+ * Assemble the offset and scale factors of the random parameters, if
+ * they fit in offscal[]. Otherwise rgroup() is used to read them.
+ */
+  if(doscale && hdu->pcount <= PHDU_NPAR) {
+    for(i=0; i<hdu->pcount; i++) {
+      offscal[i].off = phdu->pars[i].pzero;
+      offscal[i].mul = phdu->pars[i].pscal;
+    };
+  };
+/*
+ * Read each group.
+ */
+  for(ndone=0; ndone<ngroup; ndone++) {
+    long offset = hdu->grpsize * (igroup + ndone);
+/*
+ * Read the random parameters of the group.
+ */
+    if(pars && hdu->pcount > 0) {
+      char *pptr = (char *) pars + ndone * hdu->pcount * psize;
+      if(doscale && hdu->pcount > PHDU_NPAR) {
+	if(rgroup(fits, phdu, igroup + ndone, 0L, hdu->pcount, ptype, 1, NULL,
+		  pptr) < hdu->pcount)
+	  break;
+      } else if(get_data(fits, hdu, offset, dat_type(hdu), 0L, hdu->pcount,
+			 ptype, 0.0, 1.0, doscale ? offscal : NULL, NULL,
+			 phdu->blank, pptr)) {
+	break;
+      };
+    };
+/*
+ * Read the image array of the group.
+ */
+    if(data && phdu->imsize > 0) {
+      char *dptr = (char *) data + ndone * phdu->imsize * dsize;
+      if(get_data(fits, hdu, offset, dat_type(hdu), (long) hdu->pcount,
+		  phdu->imsize, dtype, doscale ? phdu->bzero : 0.0,
+		  doscale ? phdu->bscale : 1.0, NULL, NULL, phdu->blank, dptr))
+	break;
+    };
+  };
+  return ndone;
+}
+
 /*.......................................................................
  * Write a given random groups entry to an IMAGE HDU.
  *
@@ -59,6 +59,8 @@ Gpar *get_gpar(Phdu *phdu, int ipar);
 
 long rgroup(Fits *fits, Phdu *phdu, long igroup, long start, long nobj,
 	       Fittype type, int doscale, Fitsflag *flags, void *data);
+long rgroups(Fits *fits, Phdu *phdu, long igroup, long ngroup, int doscale,
+	     Fittype ptype, void *pars, Fittype dtype, void *data);
 long wgroup(Fits *fits, Phdu *phdu, long igroup, long start, long nobj,
 	    Fittype type, int doscale, Fitsflag *flags, void *data);
 long rimage(Fits *fits, Phdu *phdu, long igroup, long start, long nobj,
@@ -83,13 +83,20 @@ void cp_b4b8(unsigned char *dest, unsigned char *orig, size_t nitem)
 /*.......................................................................
  * Orig: 2-byte datatype.
  * Dest: 2-byte datatype with byte order reversed.
+ *
+ * Each item is loaded into an unsigned short and byte-reversed with
+ * shifts, which compilers turn into single byte-swap or vector shuffle
+ * instructions. This requires 16-bit shorts, as on all architectures
+ * that define NEED_2R2.
  */
 void cp_2r2(unsigned char *dest, unsigned char *orig, size_t nitem)
 {
   size_t i;
   for(i=0; i<nitem; i++, orig+=2, dest+=2) {
-    dest[0] = orig[1];
-    dest[1] = orig[0];
+    unsigned short w;
+    memcpy(&w, orig, 2);
+    w = (unsigned short) ((w >> 8) | (w << 8));
+    memcpy(dest, &w, 2);
   };
 }
 #endif
@@ -98,15 +105,18 @@ void cp_2r2(unsigned char *dest, unsigned char *orig, size_t nitem)
 /*.......................................................................
  * Orig: 4-byte datatype.
  * Dest: 4-byte datatype with byte order reversed.
+ *
+ * As in cp_2r2(), each item is byte-reversed as a word. This requires
+ * 32-bit ints, as on all architectures that define NEED_4R4.
  */
 void cp_4r4(unsigned char *dest, unsigned char *orig, size_t nitem)
 {
   size_t i;
   for(i=0; i<nitem; i++, orig+=4, dest+=4) {
-    dest[0] = orig[3];
-    dest[1] = orig[2];
-    dest[2] = orig[1];
-    dest[3] = orig[0];
+    unsigned int w;
+    memcpy(&w, orig, 4);
+    w = (w >> 24) | ((w >> 8) & 0xff00U) | ((w << 8) & 0xff0000U) | (w << 24);
+    memcpy(dest, &w, 4);
   };
 }
 #endif
@@ -115,19 +125,24 @@ void cp_4r4(unsigned char *dest, unsigned char *orig, size_t nitem)
 /*.......................................................................
  * Orig: 8-byte datatype.
  * Dest: 8-byte datatype with byte order reversed.
+ *
+ * Each item is byte-reversed as two 32-bit words, which are then
+ * exchanged. As in cp_4r4(), this requires 32-bit ints.
  */
 void cp_8r8(unsigned char *dest, unsigned char *orig, size_t nitem)
 {
   size_t i;
   for(i=0; i<nitem; i++, orig+=8, dest+=8) {
-    dest[0] = orig[7];
-    dest[1] = orig[6];
-    dest[2] = orig[5];
-    dest[3] = orig[4];
-    dest[4] = orig[3];
-    dest[5] = orig[2];
-    dest[6] = orig[1];
-    dest[7] = orig[0];
+    unsigned int w[2];
+    unsigned int hi, lo;
+    memcpy(w, orig, 8);
+    hi = w[0];
+    lo = w[1];
+    w[0] = (lo >> 24) | ((lo >> 8) & 0xff00U) | ((lo << 8) & 0xff0000U) |
+           (lo << 24);
+    w[1] = (hi >> 24) | ((hi >> 8) & 0xff00U) | ((hi << 8) & 0xff0000U) |
+           (hi << 24);
+    memcpy(dest, w, 8);
   };
 }
 #endif
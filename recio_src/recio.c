@@ -7,6 +7,36 @@
 #include "recio.h"
 #include "scrfil.h"
 
+/*
+ * Files can be accessed via memory maps on systems that support POSIX
+ * mapped files.
+ */
+#if defined(unix) || defined(__unix__) || defined(__unix) || \
+    (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#if defined(_POSIX_MAPPED_FILES) && _POSIX_MAPPED_FILES > 0
+#define HAVE_MMAP 1
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#else
+#define HAVE_MMAP 0
+#endif
+
+/*
+ * When a mapped file has to be extended, it is extended by at least
+ * the size of the existing map, up to REC_MAPSTEP bytes, with a
+ * minimum size of REC_MAPMIN bytes. Space for the extension is
+ * reserved on disk, where supported, so that running out of disk
+ * space is reported as an error, rather than raising SIGBUS when the
+ * memory of the map is written.
+ */
+#define REC_MAPMIN (1L<<20)
+#define REC_MAPSTEP (1L<<28)
+
 /* Cater for pre-ANSI-C C libraries such as SUNs bundled libraries */
 
 #ifndef SEEK_SET
@@ -19,6 +49,13 @@
 
 static int rec_open(Recio *rio, const char *name);
 static int rec_bad(Recio *rio, const char *name);
+static void rec_advance(Recio *rio, long nbytes);
+static size_t rec_map_pos(Recio *rio);
+static int rec_map_read(Recio *rio, size_t nobj, size_t size, void *buff);
+static int rec_map_write(Recio *rio, size_t nobj, size_t size, void *buff);
+static int rec_map_grow(Recio *rio, size_t need);
+static int rec_map_fill(int fd, size_t start, size_t end);
+static int rec_unmap(Recio *rio);
 
 /*.......................................................................
  * Open a binary file, and return a descriptor to be used in future record
@@ -71,6 +108,13 @@ Recio *new_Recio(const char *name, Fileuse status, int readonly, long reclen)
   rio->status = status;
   rio->lastio = REC_SK;
   rio->reclen = reclen;
+  rio->mapped = 0;
+  rio->map = NULL;
+  rio->mapsize = 0;
+  rio->filesize = 0;
+  rio->advice = REC_NORMAL;
+  rio->maperr = 0;
+  rio->mapeof = 0;
 /*
  * Record the max seekable record offset, measured in record lengths.
  */
@@ -103,6 +147,16 @@ Recio *new_Recio(const char *name, Fileuse status, int readonly, long reclen)
 Recio *del_Recio(Recio *rio)
 {
   if(rio) {
+/*
+ * Remove the memory map of the file, if any, and truncate the file to
+ * its logical size.
+ */
+    if(rio->mapped && rio->status!=IS_SCR)
+      rec_unmap(rio);
+#if HAVE_MMAP
+    else if(rio->map)
+      munmap(rio->map, rio->mapsize);
+#endif
 /*
  * Close the file if it has been opened. Ignore close errors if the
  * file is a scratch file.
@@ -158,6 +212,11 @@ int rec_read(Recio *rio, size_t nobj, size_t size, void *buff)
     fprintf(stderr, "rec_read: NULL buffer received.\n");
     return -1;
   };
+/*
+ * Copy from the memory map of the file?
+ */
+  if(rio->mapped)
+    return rec_map_read(rio, nobj, size, buff);
 /*
  * Continue no further if an I/O error previously occured.
  */
@@ -212,12 +271,7 @@ int rec_read(Recio *rio, size_t nobj, size_t size, void *buff)
 /*
  * Update the record of the file position.
  */
-  {
-    long recoff = (nobj-nreq) * size;
-    long numoff = recoff / rio->reclen;
-    rio->recnum += numoff;
-    rio->recoff += recoff - numoff * rio->reclen;
-  };
+  rec_advance(rio, (nobj-nreq) * size);
 /*
  * Return a count of the number of complete objects read.
  */
@@ -250,6 +304,16 @@ int rec_write(Recio *rio, size_t nobj, size_t size, void *buff)
     fprintf(stderr, "rec_write: NULL buffer received.\n");
     return 0;
   };
+/*
+ * Copy to the memory map of the file? If the map can't be extended to
+ * accomodate the new data, rec_map_write() reverts to stdio I/O, and
+ * returns -2.
+ */
+  if(rio->mapped) {
+    int nnew = rec_map_write(rio, nobj, size, buff);
+    if(nnew != -2)
+      return nnew;
+  };
 /*
  * If the last I/O operation on the file was a read, then
  * use a file positioning command before continuing (The ANSI C standard
@@ -293,12 +357,7 @@ int rec_write(Recio *rio, size_t nobj, size_t size, void *buff)
 /*
  * Update the record of the file position.
  */
-  {
-    long recoff = (nobj - nreq) * size;
-    long numoff = recoff / rio->reclen;
-    rio->recnum += numoff;
-    rio->recoff += recoff - numoff * rio->reclen;
-  };
+  rec_advance(rio, (nobj - nreq) * size);
 /*
  * Return a count of the number of complete objects written.
  */
@@ -333,6 +392,15 @@ int rec_seek(Recio *rio, long recnum, long recoff)
 	    recnum<0 ? "number" : "offset");
     return 1;
   };
+/*
+ * Positioning a memory-mapped file doesn't involve the file, so just
+ * record the new position.
+ */
+  if(rio->mapped) {
+    rio->recnum = recnum;
+    rio->recoff = recoff;
+    return 0;
+  };
 /*
  * How far off are we in whole records and residual bytes?
  */
@@ -535,7 +603,8 @@ int rec_pad(Recio *rio, void *buff, long nbuff, long npad)
  * Write it to the file npad times.
  */
   for(ipad=0; ipad<npad; ipad++) {
-    if(fwrite(buff, 1, nbuff, rio->fp) < nbuff) {
+    if(rio->mapped ? rec_write(rio, nbuff, 1, buff) < nbuff :
+       fwrite(buff, 1, nbuff, rio->fp) < nbuff) {
       fprintf(stderr, "rec_pad: Error writing to file: %s\n", rio->name);
       return 1;
     };
@@ -566,7 +635,11 @@ void rec_rewind(Recio *rio)
  * reset any error conditions.
  */
   if(rio && rio->fp) {
-    rewind(rio->fp);
+    if(rio->mapped) {
+      rio->maperr = rio->mapeof = 0;
+    } else {
+      rewind(rio->fp);
+    };
     rio->recnum = rio->recoff = 0L;
   };
   return;
@@ -590,7 +663,7 @@ static int rec_bad(Recio *rio, const char *name)
     fprintf(stderr, "%s: NULL Recio descriptor intercepted.\n", name);
     return 1;
   };
-  return ferror(rio->fp);
+  return rio->mapped ? rio->maperr : ferror(rio->fp);
 }
 
 /*.......................................................................
@@ -609,6 +682,12 @@ int rec_flush(Recio *rio)
  */
   if(rec_bad(rio, "rec_flush"))
     return 0;
+/*
+ * The memory map of a mapped file is shared with the file, so there is
+ * nothing to flush.
+ */
+  if(rio->mapped)
+    return 0;
 /*
  * Have the file flushed.
  */
@@ -632,9 +711,9 @@ int rec_eof(Recio *rio)
   if(rec_bad(rio, "rec_eof"))
     return 0;
 /*
- * Have the file flushed.
+ * Return the end-of-file status.
  */
-  return feof(rio->fp);
+  return rio->mapped ? rio->mapeof : feof(rio->fp);
 }
 
 /*.......................................................................
@@ -675,3 +754,340 @@ int rec_tell(Recio *rio, long *recnum, long *recoff)
     *recoff = rio->recoff;
   return 0;
 }
+
+/*.......................................................................
+ * Arrange for subsequent reads and writes of a file to be performed by
+ * copying to and from a memory map of the file, instead of via stdio.
+ * This avoids a system call per record. Where memory mapping isn't
+ * supported, or the file can't be mapped, the file continues to be
+ * accessed via stdio, so callers don't need to check whether the file
+ * ended up being mapped.
+ *
+ * Input:
+ *  rio     Recio *  The descriptor of a record I/O file.
+ *  advice Recadv    The expected pattern of accesses to the file,
+ *                   which is passed on to the virtual memory system
+ *                   to guide its read-ahead and page-out policies.
+ * Output:
+ *  return    int    0 - OK.
+ *                   1 - Error.
+ */
+int rec_mmap(Recio *rio, Recadv advice)
+{
+#if HAVE_MMAP
+  struct stat st;   /* The status of the file */
+#endif
+/*
+ * Check args.
+ */
+  if(rec_bad(rio, "rec_mmap"))
+    return 1;
+  rio->advice = advice;
+#if HAVE_MMAP
+/*
+ * If the file is already mapped, just apply the new advice.
+ */
+  if(rio->mapped) {
+#ifdef MADV_NORMAL
+    if(rio->map) {
+      madvise(rio->map, rio->mapsize, advice==REC_SEQUENTIAL ?
+	      MADV_SEQUENTIAL : (advice==REC_RANDOM ? MADV_RANDOM:MADV_NORMAL));
+    };
+#endif
+    return 0;
+  };
+/*
+ * Flush any pending stdio output, and get the current size of the file.
+ */
+  if(fflush(rio->fp)==EOF || fstat(fileno(rio->fp), &st) || st.st_size < 0 ||
+     (unsigned long) st.st_size != (size_t) st.st_size)
+    return 0;
+/*
+ * Map the current contents of the file.
+ */
+  rio->filesize = rio->mapsize = 0;
+  rio->mapped = 1;
+  rio->maperr = rio->mapeof = 0;
+  if(st.st_size > 0 && rec_map_grow(rio, (size_t) st.st_size)) {
+    rio->mapped = 0;
+    return 0;
+  };
+  rio->filesize = st.st_size;
+#endif
+  return 0;
+}
+
+/*.......................................................................
+ * Advance the recorded file position by a given number of bytes.
+ *
+ * Input:
+ *  rio    Recio *  The descriptor of a record I/O file.
+ *  nbytes  long    The number of bytes that were read or written.
+ */
+static void rec_advance(Recio *rio, long nbytes)
+{
+  long numoff = nbytes / rio->reclen;
+  rio->recnum += numoff;
+  rio->recoff += nbytes - numoff * rio->reclen;
+}
+
+/*.......................................................................
+ * Return the byte offset of the file position of a mapped file.
+ *
+ * Input:
+ *  rio    Recio *  The descriptor of a mapped record I/O file.
+ * Output:
+ *  return size_t   The byte offset of the file position.
+ */
+static size_t rec_map_pos(Recio *rio)
+{
+  return (size_t) rio->recnum * rio->reclen + rio->recoff;
+}
+
+/*.......................................................................
+ * The rec_read() function for mapped files.
+ *
+ * Input:
+ *  rio    Recio *  The descriptor of a mapped record I/O file.
+ *  nobj  size_t    The number of objects of size 'size' to be read.
+ *  size  size_t    The size of the objects to be read, in chars.
+ * Input/Output:
+ *  buff    void *  A buffer of sufficient size to contain the
+ *                  requested number of objects.
+ * Output:
+ *  return   int    The number of objects read, which may only differ
+ *                  from nobj at the end of the file.
+ */
+static int rec_map_read(Recio *rio, size_t nobj, size_t size, void *buff)
+{
+  size_t pos = rec_map_pos(rio);   /* The byte offset to read from */
+  size_t nread;                    /* The number of objects to read */
+/*
+ * Work out how many complete objects lie before the end of the file.
+ */
+  nread = pos >= rio->filesize ? 0 : (rio->filesize - pos) / size;
+  if(nread >= nobj) {
+    nread = nobj;
+  } else {
+    rio->mapeof = 1;
+  };
+/*
+ * Copy them into the buffer.
+ */
+  if(nread > 0)
+    memcpy(buff, rio->map + pos, nread * size);
+  rio->lastio = REC_RD;
+  rec_advance(rio, nread * size);
+  return nread;
+}
+
+/*.......................................................................
+ * The rec_write() function for mapped files.
+ *
+ * Input:
+ *  rio    Recio *  The descriptor of a mapped record I/O file.
+ *  nobj  size_t    The number of objects of size 'size' to be written.
+ *  size  size_t    The size of the objects to be written, in chars.
+ * Input/Output:
+ *  buff    void *  The buffer containing the data to be written.
+ * Output:
+ *  return   int    The number of objects written, or -2 if the map
+ *                  couldn't be extended to accomodate them. In the
+ *                  latter case the file reverts to stdio I/O, and
+ *                  nothing is written.
+ */
+static int rec_map_write(Recio *rio, size_t nobj, size_t size, void *buff)
+{
+  size_t pos = rec_map_pos(rio);   /* The byte offset to write at */
+  size_t end = pos + nobj * size;  /* The byte offset that follows the data */
+/*
+ * File not opened for write?
+ */
+  if(rio->readonly) {
+    fprintf(stderr, "rec_write: File %s not opened for writing.\n",
+	    rio->name);
+    rio->maperr = 1;
+    return -1;
+  };
+/*
+ * Extend the map if needed.
+ */
+  if(end > rio->mapsize && rec_map_grow(rio, end))
+    return rec_unmap(rio) ? -1 : -2;
+/*
+ * Copy the data into the map.
+ */
+  if(end > pos)
+    memcpy(rio->map + pos, buff, end - pos);
+  if(end > rio->filesize)
+    rio->filesize = end;
+  rio->lastio = REC_WR;
+  rec_advance(rio, end - pos);
+  return nobj;
+}
+
+/*.......................................................................
+ * Extend the memory map of a file to contain at least a given number
+ * of bytes, extending the file if necessary.
+ *
+ * Input:
+ *  rio    Recio *  The descriptor of a mapped record I/O file.
+ *  need  size_t    The minimum required size of the map (bytes).
+ * Output:
+ *  return   int    0 - OK.
+ *                  1 - The map couldn't be extended. The previous
+ *                      map, if any, remains in effect.
+ */
+static int rec_map_grow(Recio *rio, size_t need)
+{
+#if HAVE_MMAP
+  int fd = fileno(rio->fp);   /* The file descriptor of the file */
+  size_t newsize;             /* The new size of the map */
+  struct stat st;             /* The status of the file */
+  long pagesize;              /* The size of a page of memory */
+  char *map;                  /* The new map */
+/*
+ * Work out the new size of the map, rounded up to a whole number of
+ * pages. Read-only files can't be extended, so map them as they are.
+ */
+  if(rio->readonly) {
+    newsize = need;
+  } else {
+    size_t step = rio->mapsize < REC_MAPSTEP ? rio->mapsize : REC_MAPSTEP;
+    newsize = rio->mapsize + step;
+    if(newsize < REC_MAPMIN)
+      newsize = REC_MAPMIN;
+    if(newsize < need)
+      newsize = need;
+#ifdef _SC_PAGESIZE
+    pagesize = sysconf(_SC_PAGESIZE);
+#else
+    pagesize = 4096;
+#endif
+    if(pagesize > 0)
+      newsize = ((newsize + pagesize - 1) / pagesize) * pagesize;
+  };
+/*
+ * Extend the file if needed, reserving the disk space of the
+ * extension. If the space were left unallocated, running out of disk
+ * space while storing into the map would raise SIGBUS instead of
+ * returning an error, so where posix_fallocate() isn't available, or
+ * fails, the extension is explicitly filled with zeros.
+ */
+  if(fstat(fd, &st))
+    return 1;
+  if(!rio->readonly && (size_t) st.st_size < newsize) {
+    int status = 1;
+#if defined(_POSIX_ADVISORY_INFO) && _POSIX_ADVISORY_INFO > 0
+    status = posix_fallocate(fd, st.st_size, newsize - st.st_size);
+#endif
+    if(status && status != ENOSPC) {
+      errno = 0;
+      if(rec_map_fill(fd, (size_t) st.st_size, newsize))
+	status = errno ? errno : EIO;
+      else
+	status = 0;
+    };
+    if(status) {
+      if(status == ENOSPC) {
+	fprintf(stderr, "rec_write: Insufficient disk space to extend: %s\n",
+		rio->name);
+      };
+      (void) ftruncate(fd, st.st_size);
+      return 1;
+    };
+  };
+/*
+ * Create the new map.
+ */
+  map = mmap(NULL, newsize, rio->readonly ? PROT_READ : (PROT_READ|PROT_WRITE),
+	     MAP_SHARED, fd, 0);
+  if(map == MAP_FAILED)
+    return 1;
+/*
+ * Tell the virtual memory system how the file will be accessed.
+ */
+#ifdef MADV_NORMAL
+  madvise(map, newsize, rio->advice==REC_SEQUENTIAL ? MADV_SEQUENTIAL :
+	  (rio->advice==REC_RANDOM ? MADV_RANDOM : MADV_NORMAL));
+#endif
+/*
+ * Replace the old map.
+ */
+  if(rio->map)
+    munmap(rio->map, rio->mapsize);
+  rio->map = map;
+  rio->mapsize = newsize;
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+/*.......................................................................
+ * Extend a file by writing zeros over a given range of byte offsets,
+ * so that the file system allocates disk space for them.
+ *
+ * Input:
+ *  fd        int    The file descriptor of the file.
+ *  start  size_t    The byte offset at which to start writing.
+ *  end    size_t    The byte offset that follows the last byte to
+ *                   be written.
+ * Output:
+ *  return    int    0 - OK.
+ *                   1 - Error (see errno).
+ */
+static int rec_map_fill(int fd, size_t start, size_t end)
+{
+#if HAVE_MMAP
+  static const char zeros[8192];  /* A block of zeros to be written */
+  while(start < end) {
+    size_t nbyte = end - start < sizeof(zeros) ? end - start : sizeof(zeros);
+    ssize_t nnew = pwrite(fd, zeros, nbyte, (off_t) start);
+    if(nnew > 0)
+      start += nnew;
+    else if(nnew == 0 || errno != EINTR)
+      return 1;
+  };
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+/*.......................................................................
+ * Stop accessing a file via a memory map, truncate the file to its
+ * logical size, and position the stdio stream at the current file
+ * position.
+ *
+ * Input:
+ *  rio    Recio *  The descriptor of a mapped record I/O file.
+ * Output:
+ *  return   int    0 - OK.
+ *                  1 - Error.
+ */
+static int rec_unmap(Recio *rio)
+{
+  long recnum = rio->recnum;   /* The file position to be restored */
+  long recoff = rio->recoff;
+  int waserr = rio->maperr;    /* The error status of the mapped file */
+#if HAVE_MMAP
+  if(rio->map)
+    munmap(rio->map, rio->mapsize);
+  if(!rio->readonly && ftruncate(fileno(rio->fp), rio->filesize)) {
+    fprintf(stderr, "rec_unmap: Error truncating file: %s (%s)\n",
+	    rio->name, strerror(errno));
+    waserr = 1;
+  };
+#endif
+  rio->map = NULL;
+  rio->mapsize = rio->filesize = 0;
+  rio->mapped = 0;
+/*
+ * Restore the file position for stdio I/O.
+ */
+  rewind(rio->fp);
+  rio->recnum = rio->recoff = 0L;
+  rio->lastio = REC_SK;
+  return rec_seek(rio, recnum, recoff) || waserr;
+}
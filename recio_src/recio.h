@@ -9,6 +9,14 @@ typedef enum {IS_OLD, IS_NEW, IS_SCR} Fileuse;
 
 typedef enum {REC_RD, REC_WR, REC_SK} Lastio;
 
+/* Define an enumeration of the expected access patterns of rec_mmap() files */
+
+typedef enum {
+  REC_NORMAL,          /* No particular access pattern */
+  REC_SEQUENTIAL,      /* Records are mostly accessed in ascending order */
+  REC_RANDOM           /* Records are accessed in no particular order */
+} Recadv;
+
 typedef struct Recio {
   FILE *fp;            /* File descriptor of opened file */
   char *name;          /* Name of file or NULL if scratch file */
@@ -19,12 +27,23 @@ typedef struct Recio {
   long reclim;         /* The max atomically seekable record offset */
   long recnum;         /* The record within which the file pointer lies */
   long recoff;         /* The offset of the file pointer into record recnum */
+  int mapped;          /* True if I/O is performed via a memory map */
+  char *map;           /* The memory-mapped contents of the file, or NULL */
+  size_t mapsize;      /* The number of bytes in map[] */
+  size_t filesize;     /* The logical size of a mapped file (bytes) */
+  Recadv advice;       /* The expected access pattern of a mapped file */
+  int maperr;          /* The error status of a mapped file */
+  int mapeof;          /* The end-of-file status of a mapped file */
 } Recio;
 
 /* Open a new record addressable binary file */
 
 Recio *new_Recio(const char *name, Fileuse status, int readonly, long reclen);
 
+/* Perform subsequent I/O via a memory map of the file, where supported */
+
+int rec_mmap(Recio *rio, Recadv advice);
+
 /* Close a file previously opened by new_Recio() */
 
 Recio *del_Recio(Recio *rio);